@@ -0,0 +1,160 @@
+#pragma once
+
+#ifdef THERMORESISTIVEEVAPORATOR_EXPORTS
+#define ASYNCCOMMANDS_API __declspec(dllexport)
+#else
+#define ASYNCCOMMANDS_API __declspec(dllimport)
+#endif
+
+#include <cstdint>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Completion callback of an asynchronous command.
+ * @param status Result of the command, the same codes as its blocking export, or AS_ERROR_CANCELLED.
+ * @param ctx Context pointer passed with the command.
+ * @note Called on an I/O thread of the DLL. A slow callback delays the next command of every device waiting for that thread.
+ */
+typedef void (*AsyncCallback)(int status, void* ctx);
+
+/**
+ * @struct AsyncStats
+ * @brief Counters of the asynchronous commands.
+ */
+struct AsyncStats
+{
+	int pending;         ///< Commands queued, not started yet.
+	int running;         ///< Commands running on an I/O thread.
+	long long submitted; ///< Commands accepted so far.
+	long long completed; ///< Commands that ran and called back so far.
+	long long cancelled; ///< Commands called back with AS_ERROR_CANCELLED so far.
+};
+
+/**
+ * @class AsyncExecutor
+ * @brief Runs the commands of the ...Async exports on a fixed pool of I/O threads.
+ *
+ * Commands are queued per device and a device runs one command at a time, so the commands
+ * of one device complete in submission order: TurnOnAsync then SetCurrentVoltageAsync reach
+ * the supply in that order. Up to kasync_workers devices run in parallel. The caller never
+ * blocks and no thread is held per queued command, the callback reports the completion.
+ * The threads start with the first command.
+ */
+class ASYNCCOMMANDS_API AsyncExecutor
+{
+private:
+	/// @brief One queued command.
+	struct Request
+	{
+		std::function<int()> command; ///< Blocking call performing the command.
+		AsyncCallback callback;       ///< Completion callback, may be null.
+		void* ctx;                    ///< Passed back to the callback.
+	};
+
+	/// @brief Commands of one device.
+	struct Lane
+	{
+		std::deque<Request> requests; ///< Commands not started yet, oldest first.
+		bool running{ false };        ///< Whether a command of the device is on an I/O thread.
+	};
+
+	std::mutex m_mutex;                  ///< Guards the state below.
+	std::condition_variable m_cv;        ///< Wakes the I/O threads on a new ready lane or shutdown.
+	std::map<const void*, Lane> m_lanes; ///< Lanes by device, a lane without commands is removed.
+	std::deque<const void*> m_ready;     ///< Lanes with commands and none running, in the order they became ready.
+	std::vector<std::thread> m_workers;  ///< I/O threads.
+	bool m_shutdown{ false };            ///< Asks the I/O threads to exit.
+	AsyncStats m_stats{};                ///< Counters.
+
+	/// @brief Body of an I/O thread: runs the oldest command of the oldest ready lane.
+	void worker_loop();
+
+public:
+	AsyncExecutor() = default;
+
+	/// @brief Dtor. Drops the queued commands without calling back and waits for the running ones.
+	~AsyncExecutor();
+
+	AsyncExecutor(const AsyncExecutor&) = delete;
+	AsyncExecutor& operator=(const AsyncExecutor&) = delete;
+
+	/**
+	 * @brief Queues a command behind the other commands of the same device.
+	 * @param device Identity of the device, commands with the same one run in order.
+	 * @param command Blocking call performing the command, returns its status code.
+	 * @param callback Called with the result, may be null.
+	 * @param ctx Passed back to the callback.
+	 * @return int Status code indicating the command was queued (STATUS_OK) or AS_ERROR_QUEUE_FULL. A rejected command never calls back.
+	 */
+	int submit(const void* device, std::function<int()> command, AsyncCallback callback, void* ctx);
+
+	/**
+	 * @brief Calls back every queued command with AS_ERROR_CANCELLED. The running ones complete as usual.
+	 * @return int Number of cancelled commands.
+	 */
+	int cancel_pending();
+
+	/**
+	 * @brief Gets the counters.
+	 * @param stats Pointer to store the counters.
+	 */
+	void stats(AsyncStats* stats);
+};
+
+///< Global instance of the executor of the asynchronous commands.
+extern ASYNCCOMMANDS_API AsyncExecutor g_Async;
+
+extern "C" {
+	/**
+	 * @brief Queues PowerSupply_Connect() and returns at once.
+	 *
+	 * Every ...Async export below queues the command of its blocking counterpart the same way,
+	 * the ...AsyncH ones on an instance created by handle. That instance stays alive until its
+	 * queued commands are done, even if destroyed meanwhile.
+	 *
+	 * @param port The serial port, copied, null to use the recorded one.
+	 * @param callback Called with the result of the command, may be null.
+	 * @param ctx Passed back to the callback.
+	 * @return int Status code indicating the command was queued (STATUS_OK), AS_ERROR_QUEUE_FULL or DEV_ERROR_INVALID_HANDLE. Only a queued command calls back.
+	 */
+	ASYNCCOMMANDS_API int PowerSupply_ConnectAsync(const char* port, AsyncCallback callback, void* ctx);
+
+	ASYNCCOMMANDS_API int PowerSupply_TurnOnAsync(AsyncCallback callback, void* ctx);
+
+	ASYNCCOMMANDS_API int PowerSupply_TurnOffAsync(AsyncCallback callback, void* ctx);
+
+	ASYNCCOMMANDS_API int PowerSupply_SetCurrentVoltageAsync(uint16_t current, uint16_t voltage, AsyncCallback callback, void* ctx);
+
+	ASYNCCOMMANDS_API int PowerSupply_ResetZPAsync(AsyncCallback callback, void* ctx);
+
+	ASYNCCOMMANDS_API int PowerSupply_TurnOnAsyncH(int handle, AsyncCallback callback, void* ctx);
+
+	ASYNCCOMMANDS_API int PowerSupply_TurnOffAsyncH(int handle, AsyncCallback callback, void* ctx);
+
+	ASYNCCOMMANDS_API int PowerSupply_SetCurrentVoltageAsyncH(int handle, uint16_t current, uint16_t voltage, AsyncCallback callback, void* ctx);
+
+	ASYNCCOMMANDS_API int StepMotor_ConnectAsync(const char* port, AsyncCallback callback, void* ctx);
+
+	ASYNCCOMMANDS_API int StepMotor_ForwardAsync(AsyncCallback callback, void* ctx);
+
+	ASYNCCOMMANDS_API int StepMotor_ReverseAsync(AsyncCallback callback, void* ctx);
+
+	/// @brief Queues StepMotor_Stop() behind the queued motor commands. The blocking StepMotor_Stop() stops the motor at once.
+	ASYNCCOMMANDS_API int StepMotor_StopAsync(AsyncCallback callback, void* ctx);
+
+	ASYNCCOMMANDS_API int StepMotor_ForwardAsyncH(int handle, AsyncCallback callback, void* ctx);
+
+	ASYNCCOMMANDS_API int StepMotor_ReverseAsyncH(int handle, AsyncCallback callback, void* ctx);
+
+	ASYNCCOMMANDS_API int StepMotor_StopAsyncH(int handle, AsyncCallback callback, void* ctx);
+
+	ASYNCCOMMANDS_API int Async_CancelPending();
+
+	ASYNCCOMMANDS_API void Async_GetStats(AsyncStats* stats);
+}
@@ -1,20 +1,116 @@
 #pragma once
 
+namespace Bus_constants
+{
+	static constexpr const int kdefault_response_timeout_ms{ 500 }; ///< Response timeout until configured, the libmodbus default.
+	static constexpr const int kdefault_byte_timeout_ms{ 500 };     ///< Byte timeout until configured, the libmodbus default.
+	static constexpr const int kmin_adaptive_timeout_ms{ 20 };      ///< Lower bound of the adaptive response timeout.
+	static constexpr const int kmax_retries{ 5 };                   ///< Upper bound of the retries of one transaction.
+	static constexpr const int kmax_retry_backoff_ms{ 1000 };       ///< Upper bound of the pause before one retry.
+	static constexpr const int kreconnect_backoff_min_ms{ 100 };    ///< Pause before the second reopening attempt of a lost port.
+	static constexpr const int kreconnect_backoff_max_ms{ 5000 };   ///< Upper bound of the pause between two reopening attempts.
+	static constexpr const int kdegraded_failure_limit{ 3 };        ///< Consecutive transport failures after which the port is reopened.
+	static constexpr const int kmax_batch_ops{ 256 };               ///< Upper bound of the operations in one batch.
+	static constexpr const int kmax_device_handles{ 32 };           ///< Upper bound of the live instances of one device type created by handle.
+	static constexpr const int kprobe_baud_rates[]{ 230400, 115200, 57600, 38400, 19200, 9600 }; ///< Baud rates tried by the probe, fastest first.
+	static constexpr const int kprobe_reads{ 20 };                  ///< Consecutive successful reads that make a probed baud rate reliable.
+	static constexpr const int kprobe_response_timeout_ms{ 100 };   ///< Response timeout while probing, a wrong rate mostly gets no answer.
+}
+
 namespace PowerSupply_constants
 {
 	static const char* kdefault_com_port{ "COM1" };          ///< Default value of the COM-port.
-	static constexpr const short kbuffer_size{ 20 };         ///< Buffer size to read inputs into.
-	static constexpr const short kvoltage_multiplier{ 100 }; ///< Needs because register gets values from 0 to 600. Supposed that value 100 equals to 1 V.
+	static constexpr const int kslave_id{ 1 };               ///< Modbus slave ID of the power supply.
+	static constexpr const int kbaud_rate{ 19200 };          ///< Baud rate of the power supply line (8N1).
+	static constexpr const unsigned ksample_ring_capacity{ 4096 };     ///< Number of telemetry samples buffered between drains (power of two).
+	static constexpr const int kdefault_acquisition_interval_ms{ 100 }; ///< Default telemetry polling period.
+	static constexpr const int kmin_acquisition_interval_ms{ 1 };       ///< Smallest supported telemetry polling period.
+	static constexpr const int kramp_step_ms{ 10 };                     ///< Shortest interval between two ramp writes, a slower line stretches it.
 }
 
 namespace StepMotor_constants
 {
-	static constexpr const short kreadbacks_size{ 100 };	  ///< Default size of the readbacks buffer.
 	static constexpr const char* kdefault_com_port{ "COM2" }; ///< Default COM-port.
+	static constexpr const int kslave_id{ 3 };                ///< Modbus slave ID of the step motor.
+	static constexpr const int kbaud_rate{ 115200 };          ///< Baud rate of the step motor line (8N1).
+	static constexpr const int kdefault_limit_watch_interval_ms{ 20 }; ///< Default polling period of the limit switches.
+	static constexpr const int kmin_limit_watch_interval_ms{ 1 };      ///< Smallest supported polling period of the limit switches.
+}
+
+namespace Scenario_constants
+{
+	static constexpr const int kscenario_max_stages{ 64 };       ///< Maximum number of stages in one scenario.
+	static constexpr const int kscenario_ramp_step_ms{ 100 };    ///< Period of the setpoint updates while a stage ramps.
+	static constexpr const unsigned kscenario_checkpoint_magic{ 0x504B4353 }; ///< "SCKP", first 4 bytes of a checkpoint file.
+	static constexpr const unsigned kscenario_checkpoint_version{ 2 };        ///< Version of the checkpoint file layout.
+	static constexpr const int kscenario_checkpoint_port_size{ 32 };          ///< Bytes of the port name in a checkpoint file, terminator included.
+	static constexpr const int kscenario_min_checkpoint_period_ms{ 100 };     ///< Shortest supported period of the checkpoints within a stage.
+	static constexpr const int kscenario_resume_ramp_ms{ 5000 };              ///< Time to ramp back to the setpoints of a checkpoint on resume.
+}
+
+namespace Diagnostics_constants
+{
+	static constexpr const int kdiag_histogram_buckets{ 32 };        ///< Latency buckets: [0, 1) us, then [2^(i-1), 2^i) us for bucket i.
+	static constexpr const unsigned kdiag_trace_magic{ 0x52544554 }; ///< "TETR", first 4 bytes of a trace file.
+	static constexpr const unsigned kdiag_trace_version{ 1 };        ///< Version of the trace record layout.
+}
+
+namespace Telemetry_constants
+{
+	static constexpr const unsigned ktelemetry_magic{ 0x4D4C4554 };    ///< "TELM", first 4 bytes of a recording.
+	static constexpr const unsigned ktelemetry_version{ 1 };           ///< Version of the recording layout.
+	static constexpr const unsigned ktelemetry_header_size{ 65536 };   ///< Header region, a multiple of the mapping granularity so chunks map at their own offset.
+	static constexpr const unsigned ktelemetry_chunk_records{ 32768 }; ///< Records per chunk, 1 MiB of file.
+	static constexpr const unsigned ktelemetry_max_chunks{ 2048 };     ///< Chunks indexed by the header, 2 GiB of records.
+	static constexpr const unsigned ktelemetry_pyramid_fanout{ 16 };   ///< Records per bucket of the finest envelope level, and buckets merged per coarser bucket.
+	static constexpr const unsigned kshared_telemetry_magic{ 0x4D485354 }; ///< "TSHM", first 4 bytes of the shared block.
+	static constexpr const unsigned kshared_telemetry_version{ 1 };        ///< Version of the shared block layout.
+	static constexpr const char* kshared_telemetry_default_name{ "Local\\ThermoresistiveEvaporatorTelemetry" }; ///< Section name used when none is given.
+	static constexpr const int kshared_telemetry_read_tries{ 1000 };       ///< Copies a reader attempts before giving up on a block under constant writes.
+}
+
+namespace Regulator_constants
+{
+	static constexpr const int kregulator_min_period_ms{ 5 }; ///< Smallest supported regulation period.
+	static constexpr const int kregulator_failure_limit{ 3 }; ///< Consecutive failed cycles after which the loop stops.
+}
+
+namespace Watchdog_constants
+{
+	static constexpr const int kwatchdog_min_kick_timeout_ms{ 10 }; ///< Shortest supported kick timeout.
+	static constexpr const int kwatchdog_min_poll_ms{ 5 };          ///< Shortest supported period of the limit checks.
+}
+
+namespace Async_constants
+{
+	static constexpr const int kasync_workers{ 4 };       ///< I/O threads running the asynchronous commands, devices beyond that wait their turn.
+	static constexpr const int kasync_max_pending{ 256 }; ///< Upper bound of the asynchronous commands queued or running.
+}
+
+namespace Simulator_constants
+{
+	static constexpr const int ksimulator_spin_us{ 2000 };     ///< Final part of a simulated transaction waited by spinning, the system timer is coarser.
+	static constexpr const int ksimulator_fast_gap_us{ 1750 }; ///< Silent interval ending a frame above 19200 baud, fixed by the Modbus RTU specification.
 }
 
+namespace bus_constants = Bus_constants;
 namespace ps_constants = PowerSupply_constants;
 namespace sm_constants = StepMotor_constants;
+namespace sc_constants = Scenario_constants;
+namespace dg_constants = Diagnostics_constants;
+namespace tm_constants = Telemetry_constants;
+namespace rg_constants = Regulator_constants;
+namespace wd_constants = Watchdog_constants;
+namespace as_constants = Async_constants;
+namespace sim_constants = Simulator_constants;
 
+using namespace Bus_constants;
 using namespace PowerSupply_constants;
 using namespace StepMotor_constants;
+using namespace Scenario_constants;
+using namespace Diagnostics_constants;
+using namespace Telemetry_constants;
+using namespace Regulator_constants;
+using namespace Watchdog_constants;
+using namespace Async_constants;
+using namespace Simulator_constants;
@@ -0,0 +1,61 @@
+#pragma once
+
+#ifdef THERMORESISTIVEEVAPORATOR_EXPORTS
+#define DEVICEBATCH_API __declspec(dllexport)
+#else
+#define DEVICEBATCH_API __declspec(dllimport)
+#endif
+
+/// @brief Device a batch operation is addressed to.
+enum BatchDevice
+{
+	BATCH_DEVICE_POWER_SUPPLY = 0, ///< The global power supply.
+	BATCH_DEVICE_STEP_MOTOR = 1    ///< The global step motor.
+};
+
+/// @brief Kind of a batch operation.
+enum BatchOpKind
+{
+	BATCH_READ_HOLDING = 0,   ///< Reads a holding register (function 0x03).
+	BATCH_READ_INPUT = 1,     ///< Reads an input register (function 0x04).
+	BATCH_WRITE_REGISTER = 2, ///< Writes a holding register (function 0x06, or 0x10 when merged).
+	BATCH_WRITE_COIL = 3      ///< Writes a coil (function 0x05, or 0x0F when merged).
+};
+
+/**
+ * @struct BatchOp
+ * @brief One register or coil operation of a batch.
+ */
+struct BatchOp
+{
+	int device; ///< One of BatchDevice.
+	int kind;   ///< One of BatchOpKind.
+	int addr;   ///< Register or coil address.
+	int value;  ///< Value to write, 0 or 1 for coils. Ignored by reads.
+};
+
+/**
+ * @struct BatchResult
+ * @brief Outcome of one batch operation.
+ */
+struct BatchResult
+{
+	int status; ///< STATUS_OK, DEV_ERROR_BATCH_OP_FAILED, or DEV_ERROR_BATCH_SKIPPED if not reached.
+	int value;  ///< Value read, or the value written.
+};
+
+extern "C" {
+	/**
+	 * @brief Executes a sequence of operations in order, with the fewest frames on the wire.
+	 *
+	 * Consecutive operations of the same device, kind and adjacent addresses are merged
+	 * into one frame. Consecutive operations of one device run as one bus request, so no
+	 * other command to that device gets in between. Execution stops at the first failure.
+	 *
+	 * @param ops Operations, from 1 to kmax_batch_ops of them.
+	 * @param n Number of operations.
+	 * @param out Array of `n` results.
+	 * @return int Status code indicating success (STATUS_OK) or the error that stopped the batch.
+	 */
+	DEVICEBATCH_API int Device_ExecuteBatch(const BatchOp* ops, int n, BatchResult* out);
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#ifdef THERMORESISTIVEEVAPORATOR_EXPORTS
+#define DEVICEGROUP_API __declspec(dllexport)
+#else
+#define DEVICEGROUP_API __declspec(dllimport)
+#endif
+
+#include <cstdint>
+
+/**
+ * @struct GroupResult
+ * @brief Outcome of a group command on one device.
+ */
+struct GroupResult
+{
+	int handle;             ///< Handle of the device, as passed in.
+	int status;             ///< STATUS_OK, DEV_ERROR_INVALID_HANDLE or the error of the command.
+	long long completed_us; ///< Moment the command returned, from the common start of the group.
+};
+
+/**
+ * @struct GroupReport
+ * @brief Summary of a group command.
+ */
+struct GroupReport
+{
+	int succeeded;        ///< Devices the command succeeded on.
+	int failed;           ///< Devices the command failed on.
+	long long elapsed_us; ///< Time from the common start until the last device returned.
+	long long spread_us;  ///< Time between the first and the last successful device, 0 with fewer than two.
+};
+
+extern "C" {
+	/**
+	 * @brief Turns on a group of power supplies created by handle, all at the same time.
+	 *
+	 * Every device gets its own worker, released together once all are ready, and the call
+	 * returns when every worker is done. Devices on different ports run in parallel, so the
+	 * group takes as long as its slowest device. Devices sharing a port are serialized by its bus.
+	 *
+	 * @param handles Handles of the devices, from 1 to kmax_device_handles of them.
+	 * @param n Number of devices.
+	 * @param out Array of `n` results, in the order of `handles`.
+	 * @param report Summary, may be null.
+	 * If a worker can not be started, no device gets the command and every result is DEV_ERROR_GROUP_START_FAILED.
+	 *
+	 * @return int Status code indicating success on every device (STATUS_OK), DEV_ERROR_INVALID_GROUP, DEV_ERROR_GROUP_OP_FAILED or DEV_ERROR_GROUP_START_FAILED.
+	 */
+	DEVICEGROUP_API int PowerSupply_GroupTurnOn(const int* handles, int n, GroupResult* out, GroupReport* report);
+
+	/// @brief Turns off a group of power supplies at the same time, see PowerSupply_GroupTurnOn().
+	DEVICEGROUP_API int PowerSupply_GroupTurnOff(const int* handles, int n, GroupResult* out, GroupReport* report);
+
+	/// @brief Sets the same current and voltage on a group of power supplies at the same time, see PowerSupply_GroupTurnOn().
+	DEVICEGROUP_API int PowerSupply_GroupSetCurrentVoltage(const int* handles, int n, uint16_t current, uint16_t voltage, GroupResult* out, GroupReport* report);
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "Constants.h"
+#include "ModbusBus.h"
+#include "StatusConstants.h"
+
+/**
+ * @struct DeviceConfig
+ * @brief Port, line settings and slave ID of a device instance created by handle.
+ */
+struct DeviceConfig
+{
+	const char* port; ///< Serial port of the device.
+	int baud;         ///< Baud rate, 0 to probe it.
+	char parity;      ///< 'N', 'E' or 'O'.
+	int data_bits;    ///< From 5 to 8.
+	int stop_bits;    ///< 1 or 2.
+	int slave;        ///< Modbus slave ID, from 1 to 247.
+};
+
+/**
+ * @class DeviceRegistry
+ * @brief Instances of one device manager created through the C exports, found by handle.
+ *
+ * Every instance owns its connection and background threads, so devices on different
+ * ports run in parallel, one bus thread per port. Handles are positive and never reused,
+ * so a stale handle can not reach a newer device. Lookups hand out shared ownership:
+ * an instance removed while a call on it is in flight is destroyed when that call returns.
+ *
+ * @tparam Device Manager type, constructible from a port name and providing connect_ex().
+ */
+template <typename Device>
+class DeviceRegistry
+{
+private:
+	std::mutex m_mutex;                               ///< Guards the instances and the handle counter.
+	std::map<int, std::shared_ptr<Device>> m_devices; ///< Live instances by handle.
+	int m_next_handle{ 1 };                           ///< Handle of the next instance.
+
+public:
+	/**
+	 * @brief Creates an instance and connects it with the given settings.
+	 *
+	 * The instance is registered only once it is connected, so every valid handle
+	 * refers to a device that has answered at least once.
+	 *
+	 * @param config Port, line settings and slave ID.
+	 * @param handle Receives the handle of the new instance, 0 on failure.
+	 * @return int Status code indicating success (STATUS_OK), DEV_ERROR_TOO_MANY_DEVICES or the connection error.
+	 */
+	int create(const DeviceConfig& config, int& handle)
+	{
+		handle = 0;
+		if (!config.port)
+			return BUS_ERROR_INVALID_LINE_SETTINGS;
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (m_devices.size() >= static_cast<std::size_t>(kmax_device_handles))
+				return DEV_ERROR_TOO_MANY_DEVICES;
+		}
+
+		// 1. Connecting outside the lock, a probing connection takes seconds.
+		auto device{ std::make_shared<Device>(config.port) };
+		int status{ device->connect_ex(config.port, SerialSettings{ config.baud, config.parity, config.data_bits, config.stop_bits }, config.slave) };
+		if (status != STATUS_OK)
+			return status;
+
+		// 2. Registering, another create may have taken the last slot in the meantime.
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_devices.size() >= static_cast<std::size_t>(kmax_device_handles))
+			return DEV_ERROR_TOO_MANY_DEVICES;
+
+		handle = m_next_handle++;
+		m_devices[handle] = device;
+		return STATUS_OK;
+	}
+
+	/**
+	 * @brief Unregisters an instance. It is destroyed once no call on it is in flight.
+	 * @param handle Handle of the instance.
+	 * @return int Status code indicating success (STATUS_OK) or DEV_ERROR_INVALID_HANDLE.
+	 */
+	int destroy(int handle)
+	{
+		std::shared_ptr<Device> device;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			auto it{ m_devices.find(handle) };
+			if (it == m_devices.end())
+				return DEV_ERROR_INVALID_HANDLE;
+
+			device = std::move(it->second);
+			m_devices.erase(it);
+		}
+
+		// Joining the threads of the instance outside the lock.
+		device.reset();
+		return STATUS_OK;
+	}
+
+	/**
+	 * @brief Finds an instance.
+	 * @param handle Handle of the instance.
+	 * @return std::shared_ptr<Device> The instance, null if the handle is unknown.
+	 */
+	std::shared_ptr<Device> get(int handle)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto it{ m_devices.find(handle) };
+		return it == m_devices.end() ? nullptr : it->second;
+	}
+
+	/**
+	 * @brief Gets every live instance.
+	 * @param devices Receives the instances.
+	 * @param wait Whether to wait for the registry lock, false gives up if it is held.
+	 * @return bool False if the lock was held and `wait` is false.
+	 */
+	bool snapshot(std::vector<std::shared_ptr<Device>>& devices, bool wait = true)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex, std::defer_lock);
+		if (wait)
+			lock.lock();
+		else if (!lock.try_lock())
+			return false;
+
+		devices.clear();
+		for (const auto& entry : m_devices)
+			devices.push_back(entry.second);
+		return true;
+	}
+
+	/**
+	 * @brief Calls `f` on an instance.
+	 * @param handle Handle of the instance.
+	 * @param f Callable taking `Device&` and returning a status code.
+	 * @return int Result of `f`, or DEV_ERROR_INVALID_HANDLE if the handle is unknown.
+	 */
+	template <typename F>
+	int invoke(int handle, F f)
+	{
+		auto device{ get(handle) };
+		return device ? f(*device) : DEV_ERROR_INVALID_HANDLE;
+	}
+};
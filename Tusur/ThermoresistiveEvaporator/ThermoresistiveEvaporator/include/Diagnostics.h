@@ -0,0 +1,116 @@
+#pragma once
+
+#ifdef THERMORESISTIVEEVAPORATOR_EXPORTS
+#define DIAGNOSTICS_API __declspec(dllexport)
+#else
+#define DIAGNOSTICS_API __declspec(dllimport)
+#endif
+
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <mutex>
+
+#include "Constants.h"
+
+/**
+ * @struct DiagnosticsStats
+ * @brief Latency statistics of one kind of Modbus transaction: slave, function and start register.
+ */
+struct DiagnosticsStats
+{
+	int slave;                                           ///< Modbus slave ID.
+	int function;                                        ///< Modbus function code, e.g. 0x03 or 0x10.
+	int addr;                                            ///< First register or coil of the transaction.
+	unsigned long long count;                            ///< Number of transactions.
+	unsigned long long errors;                           ///< Number of failed transactions, timeouts included.
+	unsigned long long timeouts;                         ///< Number of transactions the device did not answer in time.
+	long long min_us;                                    ///< Fastest transaction.
+	long long max_us;                                    ///< Slowest transaction.
+	long long total_us;                                  ///< Sum of all latencies, divide by `count` for the mean.
+	unsigned long long buckets[kdiag_histogram_buckets]; ///< Latency histogram, see kdiag_histogram_buckets.
+};
+
+/**
+ * @struct DiagnosticsTraceRecord
+ * @brief One transaction in a trace file. The file starts with kdiag_trace_magic and kdiag_trace_version.
+ */
+struct DiagnosticsTraceRecord
+{
+	long long timestamp_us; ///< Transaction start, steady clock, same base as the telemetry samples.
+	long long latency_us;   ///< Transaction duration.
+	int32_t slave;          ///< Modbus slave ID.
+	int32_t function;       ///< Modbus function code.
+	int32_t addr;           ///< First register or coil of the transaction.
+	int32_t result;         ///< libmodbus result, -1 on failure.
+	int32_t error;          ///< errno of a failed transaction, 0 otherwise.
+	int32_t reserved;       ///< Keeps the record 8-byte aligned.
+};
+
+/**
+ * @class Diagnostics
+ * @brief Collects latency histograms and error counters of every Modbus transaction.
+ *
+ * Fed by the bus threads, so all device managers are covered without timing code
+ * of their own. Optionally appends every transaction to a binary trace file.
+ */
+class DIAGNOSTICS_API Diagnostics
+{
+private:
+	/// @brief Builds the statistics key of a transaction.
+	static unsigned long long key(int slave, int function, int addr);
+
+	mutable std::mutex m_mutex;                             ///< Guards the statistics and the trace file.
+	std::map<unsigned long long, DiagnosticsStats> m_stats; ///< Statistics per slave, function and register.
+	std::FILE* m_trace{ nullptr };                          ///< Trace file, null when tracing is off.
+
+public:
+	/// @brief Dtor. Closes the trace file.
+	~Diagnostics();
+
+	/**
+	 * @brief Records one transaction.
+	 * @param slave Modbus slave ID.
+	 * @param function Modbus function code.
+	 * @param addr First register or coil of the transaction.
+	 * @param timestamp_us Transaction start on the steady clock.
+	 * @param latency_us Transaction duration.
+	 * @param result libmodbus result, -1 on failure.
+	 * @param error errno of a failed transaction.
+	 */
+	void record(int slave, int function, int addr, long long timestamp_us, long long latency_us, int result, int error);
+
+	/**
+	 * @brief Copies the statistics, ordered by slave, function and register.
+	 * @param out Array to store the statistics, may be null to query the count.
+	 * @param max Capacity of `out`.
+	 * @return int Number of entries available, may exceed `max`.
+	 */
+	int get_stats(DiagnosticsStats* out, int max) const;
+
+	/// @brief Drops all statistics.
+	void reset();
+
+	/**
+	 * @brief Starts writing every transaction to a binary trace file, replacing the current one.
+	 * @param path Path of the file, overwritten.
+	 * @return int Status code indicating success (STATUS_OK) or DG_ERROR_TRACE_OPEN_FAILED.
+	 */
+	int start_trace(const char* path);
+
+	/// @brief Stops tracing and closes the file.
+	void stop_trace();
+};
+
+///< Global instance fed by every Modbus bus.
+extern DIAGNOSTICS_API Diagnostics g_Diagnostics;
+
+extern "C" {
+	DIAGNOSTICS_API int Diagnostics_GetStats(DiagnosticsStats* out, int max);
+
+	DIAGNOSTICS_API void Diagnostics_Reset();
+
+	DIAGNOSTICS_API int Diagnostics_StartTrace(const char* path);
+
+	DIAGNOSTICS_API void Diagnostics_StopTrace();
+}
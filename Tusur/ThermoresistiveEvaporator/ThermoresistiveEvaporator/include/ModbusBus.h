@@ -0,0 +1,354 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "modbus.h"
+#include "Constants.h"
+#include "DeviceBatch.h"
+#include "ModbusTransport.h"
+#include "StatusConstants.h"
+
+/// @brief Priority of a bus request, lower values are served first.
+enum BusPriority
+{
+	BUS_PRIORITY_SAFETY = 0,   ///< Commands that make the hardware safe: turn off, stop.
+	BUS_PRIORITY_COMMAND = 1,  ///< Regular commands and setpoints.
+	BUS_PRIORITY_TELEMETRY = 2 ///< Periodic reads.
+};
+
+/// @brief State of the link to a port, driven by the bus supervisor.
+enum LinkState
+{
+	LINK_DISCONNECTED = 0, ///< Nobody has asked to open the port yet.
+	LINK_CONNECTING = 1,   ///< The port is closed and being reopened in the background, requests are rejected.
+	LINK_ONLINE = 2,       ///< The port is open and the last transfer succeeded.
+	LINK_DEGRADED = 3      ///< The port is open but the last transfers failed, reopened after kdegraded_failure_limit of them.
+};
+
+/**
+ * @struct LinkStatus
+ * @brief Snapshot of the link supervisor, cheap enough to be polled by the UI timer.
+ */
+struct LinkStatus
+{
+	int state;                      ///< One of LinkState.
+	int consecutive_failures;       ///< Transport failures since the last successful transfer.
+	int reconnect_attempts;         ///< Failed opening attempts since the port was last online.
+	int last_error;                 ///< Status code of the last failed opening attempt, STATUS_OK if none.
+	unsigned long long connections; ///< Number of successful port openings.
+};
+
+/**
+ * @struct TimeoutPolicy
+ * @brief Timeouts and retries of the transactions addressed to one slave.
+ */
+struct TimeoutPolicy
+{
+	int response_timeout_ms; ///< Response timeout, the upper bound of the timeout in adaptive mode.
+	int byte_timeout_ms;     ///< Timeout between two bytes of a response, 0 disables it.
+	bool adaptive;           ///< Derive the response timeout from the measured round trips.
+	int max_retries;         ///< Retries of a transaction that timed out or came back corrupted, at most kmax_retries.
+	int retry_backoff_ms;    ///< Pause before the first retry, doubled for every next one up to kmax_retry_backoff_ms.
+};
+
+/// @brief Policy of a slave nobody has configured: libmodbus timeouts, no retries.
+static constexpr const TimeoutPolicy kdefault_timeout_policy{ kdefault_response_timeout_ms, kdefault_byte_timeout_ms, false, 0, 0 };
+
+/**
+ * @class ModbusBus
+ * @brief Owns one RS-485 port and serializes the requests of all slaves on it.
+ *
+ * Every device manager talking to the same port shares one ModbusBus, obtained
+ * with acquire(). Requests are executed one at a time by the bus worker thread,
+ * which is the only thread touching the Modbus context, in priority order and
+ * FIFO within one priority. The caller blocks until its request is complete.
+ * A request pausing before a retry fails at once when a safety request is queued.
+ *
+ * Once asked to connect, the bus keeps the port open on its own: after
+ * kdegraded_failure_limit consecutive transport failures it closes the port
+ * and reopens it in the background with exponential backoff. Requests made
+ * meanwhile are rejected right away instead of waiting for the port.
+ */
+class ModbusBus
+{
+public:
+	/// @brief Operation executed on the bus thread with exclusive access to the transport.
+	using Operation = std::function<int(ModbusTransport&)>;
+
+	/**
+	 * @brief Gets the bus of the port, creating it on first use.
+	 * @param port The serial port.
+	 * @param settings Line settings, must match the ones of an existing bus on this port.
+	 * @param bus Receives the bus.
+	 * @return int Status code indicating success (STATUS_OK) or BUS_ERROR_SETTINGS_MISMATCH.
+	 */
+	static int acquire(const std::string& port, const SerialSettings& settings, std::shared_ptr<ModbusBus>& bus);
+
+	/// @brief Dtor. Finishes the queued requests and closes the port.
+	~ModbusBus();
+
+	ModbusBus(const ModbusBus&) = delete;
+	ModbusBus& operator=(const ModbusBus&) = delete;
+
+	/**
+	 * @brief Opens the port unless it is already open.
+	 * @return int Status code indicating success (STATUS_OK) or specific error,
+	 *             BUS_ERROR_OFFLINE right away while the supervisor is reopening the port.
+	 */
+	int connect();
+
+	/**
+	 * @brief Closes and reopens the port unconditionally.
+	 * @return int Status code indicating success (STATUS_OK) or specific error.
+	 */
+	int reconnect();
+
+	/**
+	 * @brief Runs an operation on the bus thread addressed to a slave.
+	 * @param slave Modbus slave ID.
+	 * @param priority One of BusPriority.
+	 * @param op The operation, returns the libmodbus result.
+	 * @param function Modbus function code of the operation, used for diagnostics only.
+	 * @param addr First register or coil of the operation, used for diagnostics only.
+	 * @return int Result of the operation, or -1 if the port could not be opened.
+	 */
+	int execute(int slave, int priority, const Operation& op, int function = 0, int addr = -1);
+
+	/**
+	 * @brief Runs an operation on the calling thread, bypassing the queue and the bus thread.
+	 *
+	 * Only for process termination, when the bus thread has already been killed by the
+	 * system. Never blocks: gives up if the queue lock was left held or the port is closed.
+	 *
+	 * @param slave Modbus slave ID.
+	 * @param op The operation, returns the libmodbus result.
+	 * @return int Result of the operation, or -1 if it could not be run.
+	 */
+	int execute_on_caller(int slave, const Operation& op);
+
+	/// @brief Reads holding registers (function 0x03).
+	int read_registers(int slave, int priority, int addr, int nb, uint16_t* dest);
+
+	/// @brief Reads input registers (function 0x04).
+	int read_input_registers(int slave, int priority, int addr, int nb, uint16_t* dest);
+
+	/// @brief Writes a single register (function 0x06).
+	int write_register(int slave, int priority, int addr, uint16_t value);
+
+	/**
+	 * @brief Writes consecutive registers in one frame (function 0x10).
+	 *
+	 * Slaves answering 0x10 with an illegal function exception are remembered and
+	 * served with consecutive 0x06 frames instead. Those frames belong to one bus
+	 * request, so no other request gets in between.
+	 *
+	 * @param slave Modbus slave ID.
+	 * @param priority One of BusPriority.
+	 * @param addr Address of the first register.
+	 * @param nb Number of registers.
+	 * @param src Values to write.
+	 * @param written Receives the number of registers known to be written, may be null.
+	 * @return int Number of written registers, or -1 on failure.
+	 */
+	int write_registers(int slave, int priority, int addr, int nb, const uint16_t* src, int* written = nullptr);
+
+	/**
+	 * @brief Runs a batch of operations addressed to one slave as one bus request.
+	 *
+	 * Runs of the same kind on adjacent addresses are merged into one frame. Register
+	 * and coil blocks fall back to single writes like write_registers(). Diagnostics
+	 * see the whole batch as one transaction with function code 0.
+	 *
+	 * @param slave Modbus slave ID.
+	 * @param priority One of BusPriority.
+	 * @param ops Operations, validated by the caller.
+	 * @param n Number of operations.
+	 * @param out Results, ops not reached are left untouched.
+	 * @return int `n`, or -1 on failure.
+	 */
+	int execute_batch(int slave, int priority, const BatchOp* ops, int n, BatchResult* out);
+
+	/// @brief Writes a single coil (function 0x05).
+	int write_bit(int slave, int priority, int addr, int status);
+
+	/// @brief Checks a policy against the bounds set_timeout_policy() accepts.
+	static bool is_valid_policy(const TimeoutPolicy& policy);
+
+	/// @brief Checks line settings: positive baud rate, parity 'N', 'E' or 'O', 5 to 8 data bits, 1 or 2 stop bits.
+	static bool is_valid_settings(const SerialSettings& settings);
+
+	/**
+	 * @brief Finds the fastest baud rate a slave answers reliably at.
+	 *
+	 * Tries kprobe_baud_rates from the fastest, on a bus of its own with a short timeout
+	 * and no retries. A rate is taken once kprobe_reads consecutive reads of a known
+	 * register succeed. The port must not be in use by another device meanwhile.
+	 *
+	 * @param port The serial port.
+	 * @param settings Line settings, the baud rate is ignored.
+	 * @param slave Modbus slave ID.
+	 * @param function 0x03 or 0x04, the function of the read.
+	 * @param addr First register of the read.
+	 * @param nb Number of registers of the read.
+	 * @param baud Receives the selected baud rate.
+	 * @return int STATUS_OK, BUS_ERROR_PROBE_FAILED if no rate works, or the error of opening the port.
+	 */
+	static int probe_baud(const std::string& port, const SerialSettings& settings, int slave, int function, int addr, int nb, int& baud);
+
+	/**
+	 * @brief Sets the timeouts and retries of the transactions addressed to a slave.
+	 * @param slave Modbus slave ID.
+	 * @param policy The policy.
+	 * @return int Status code indicating success (STATUS_OK) or BUS_ERROR_INVALID_TIMEOUT_POLICY.
+	 */
+	int set_timeout_policy(int slave, const TimeoutPolicy& policy);
+
+	/**
+	 * @brief Gets the response timeout the next transaction addressed to a slave will use.
+	 * @param slave Modbus slave ID.
+	 * @return long long Microseconds, the adaptive value in adaptive mode.
+	 */
+	long long response_timeout_us(int slave) const;
+
+	/// @brief Gets the port name.
+	const std::string& port() const { return m_port; }
+
+	/// @brief Gets the line settings.
+	const SerialSettings& settings() const { return m_settings; }
+
+	/// @brief Whether the port is open, whatever the last transfers did.
+	bool is_online() const { return m_state == LINK_ONLINE || m_state == LINK_DEGRADED; }
+
+	/// @brief Gets a snapshot of the link supervisor.
+	LinkStatus link_status() const;
+
+	/// @brief Gets the number of successful port openings, device state cached for an older epoch is stale.
+	unsigned long long connection_epoch() const { return m_epoch; }
+
+	/**
+	 * @brief Gets the duration of the last port opening.
+	 * @return long long Microseconds, or -1 if the port has never been opened.
+	 */
+	long long connect_latency_us() const { return m_connect_latency_us; }
+
+private:
+	/// @brief Kind of a queued request.
+	enum RequestKind
+	{
+		REQUEST_CONNECT,
+		REQUEST_RECONNECT,
+		REQUEST_OPERATION
+	};
+
+	/// @brief Queued request. Lives on the stack of the blocked caller.
+	struct Request
+	{
+		RequestKind kind;
+		int priority;
+		unsigned long long sequence;
+		int slave;
+		int function;
+		int addr;
+		const Operation* op;
+		int result;
+		bool done;
+	};
+
+	/// @brief Timing state of one slave.
+	struct SlaveLink
+	{
+		TimeoutPolicy policy;   ///< Configured policy.
+		bool has_rtt;           ///< Whether a round trip has been measured yet.
+		double srtt_us;         ///< Smoothed round-trip time.
+		double rttvar_us;       ///< Smoothed round-trip time deviation.
+	};
+
+	/// @brief Orders the queue by priority, then by arrival.
+	struct RequestOrder
+	{
+		bool operator()(const Request* a, const Request* b) const
+		{
+			return a->priority != b->priority ? a->priority > b->priority : a->sequence > b->sequence;
+		}
+	};
+
+	const std::string m_port;                             ///< Serial port.
+	const SerialSettings m_settings;                      ///< Line settings.
+	std::unique_ptr<ModbusTransport> m_transport;         ///< Link of the port, used by the bus thread only.
+	int m_current_slave{ -1 };                            ///< Slave the transport is addressed to.
+	std::set<int> m_single_write_slaves;                  ///< Slaves rejecting function 0x10, used by the bus thread only.
+	std::set<int> m_single_coil_slaves;                   ///< Slaves rejecting function 0x0F, used by the bus thread only.
+	long long m_applied_response_us{ -1 };                ///< Response timeout set on the transport, used by the bus thread only.
+	long long m_applied_byte_us{ -1 };                    ///< Byte timeout set on the transport, used by the bus thread only.
+	std::atomic<int> m_state{ LINK_DISCONNECTED };        ///< One of LinkState.
+	std::atomic<int> m_consecutive_failures{};            ///< Transport failures since the last successful transfer.
+	std::atomic<int> m_reconnect_attempts{};              ///< Failed opening attempts since the port was last online.
+	std::atomic<int> m_last_error{ STATUS_OK };           ///< Status code of the last failed opening attempt.
+	std::chrono::steady_clock::time_point m_next_attempt; ///< Next background opening attempt, used by the bus thread only.
+	int m_backoff_ms{ kreconnect_backoff_min_ms };        ///< Pause after the next failed attempt, used by the bus thread only.
+	std::atomic<long long> m_connect_latency_us{ -1 };    ///< Duration of the last port opening.
+	std::atomic<unsigned long long> m_epoch{};            ///< Number of successful port openings.
+
+	std::mutex m_mutex;                                                         ///< Guards the queue.
+	std::condition_variable m_cv;                                               ///< Wakes the bus thread.
+	std::condition_variable m_done_cv;                                          ///< Wakes the callers on completion.
+	std::priority_queue<Request*, std::vector<Request*>, RequestOrder> m_queue; ///< Pending requests.
+	unsigned long long m_sequence{};                                            ///< Arrival counter.
+	bool m_shutdown{ false };                                                   ///< Asks the bus thread to exit.
+	std::thread m_thread;                                                       ///< Bus thread.
+
+	mutable std::mutex m_links_mutex;    ///< Guards the slave timing state.
+	std::map<int, SlaveLink> m_links;    ///< Timing state per slave ID.
+
+	ModbusBus(const std::string& port, const SerialSettings& settings);
+
+	/// @brief Queues the request and waits for its completion.
+	int submit(Request& request);
+
+	/// @brief Body of the bus thread.
+	void run();
+
+	/// @brief Executes one request on the bus thread.
+	int process(const Request& request);
+
+	/// @brief Whether a safety request waits in the queue. Caller holds `m_mutex`.
+	bool safety_queued_locked() const;
+
+	/// @brief Gets the timing state of a slave, inserting the default one. Caller holds `m_links_mutex`.
+	SlaveLink& link_locked(int slave);
+
+	/// @brief Response timeout derived from the timing state. Caller holds `m_links_mutex`.
+	static long long timeout_of(const SlaveLink& link);
+
+	/// @brief Sets the timeouts on the transport unless they are already set. Runs on the bus thread.
+	void apply_timeouts(long long response_us, long long byte_us);
+
+	/// @brief Feeds a measured round trip into the adaptive timeout of a slave.
+	void update_rtt(int slave, long long rtt_us);
+
+	/// @brief Writes a register block to the addressed slave on the bus thread, see write_registers().
+	int write_block(ModbusTransport& transport, int addr, int nb, const uint16_t* src, int& written);
+
+	/// @brief Writes a coil block to the addressed slave on the bus thread, falling back to single 0x05 frames.
+	int write_bits_block(ModbusTransport& transport, int addr, int nb, const uint8_t* src);
+
+	/// @brief Runs a batch on the bus thread, see execute_batch().
+	int run_batch(ModbusTransport& transport, const BatchOp* ops, int n, BatchResult* out);
+
+	/// @brief Counts a transport failure, closes the port once the link is considered lost. Runs on the bus thread.
+	void link_failed();
+
+	/// @brief Opens the port on the bus thread, scheduling the next background attempt on failure.
+	int open();
+};
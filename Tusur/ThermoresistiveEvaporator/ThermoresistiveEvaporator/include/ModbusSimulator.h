@@ -0,0 +1,182 @@
+#pragma once
+
+#ifdef THERMORESISTIVEEVAPORATOR_EXPORTS
+#define MODBUSSIMULATOR_API __declspec(dllexport)
+#else
+#define MODBUSSIMULATOR_API __declspec(dllimport)
+#endif
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+
+#include "ModbusTransport.h"
+
+/**
+ * @struct SimulatorConfig
+ * @brief Timing, faults and device dynamics of the simulated bus.
+ */
+struct SimulatorConfig
+{
+	int processing_us;       ///< Time a slave takes between the request and its response.
+	int jitter_us;           ///< Upper bound of the uniform random delay added to each response.
+	double timeout_rate;     ///< Probability that a request gets no response, from 0 to 1.
+	double crc_error_rate;   ///< Probability that a response arrives corrupted, from 0 to 1.
+	int reject_block_writes; ///< 1 if the slaves answer functions 0x10 and 0x0F with an illegal function exception.
+	int offline;             ///< 1 if the ports can not be opened and the slaves are silent.
+	int response_tau_ms;     ///< Time constant of the measured current and voltage following the setpoints, 0 for a step.
+	int motor_travel_ms;     ///< Time the shutter takes from one limit switch to the other.
+	unsigned seed;           ///< Seed of the fault and jitter draws, runs with the same seed draw the same sequence.
+	int device_baud;         ///< Baud rate of the slaves, a master at another rate gets no answer. 0 to answer at any rate.
+};
+
+/**
+ * @struct SimulatorStats
+ * @brief Counters of the simulated bus since it was enabled or reset.
+ */
+struct SimulatorStats
+{
+	unsigned long long frames;     ///< Requests received by the slaves.
+	unsigned long long timeouts;   ///< Requests left without response, injected or because of an unknown slave.
+	unsigned long long crc_errors; ///< Corrupted responses injected.
+	unsigned long long exceptions; ///< Exception responses sent.
+	unsigned long long wire_us;    ///< Simulated time on the line, requests and responses.
+};
+
+/**
+ * @class MODBUSSIMULATOR_API ModbusSimulator
+ * @brief Register model of the power supply (slave 1) and the step motor (slave 3).
+ *
+ * Power supply: holding registers 18 (current setpoint), 19 (voltage setpoint) and 36 (zero point),
+ * coils 272 (power) and 273 (workmode), input registers 20 and 21 that follow the setpoints
+ * with a first order lag while both coils are on, and fall to 0 otherwise.
+ * Step motor: holding registers 512 (forward) and 513 (reverse) drive the shutter, 514 and 515 are
+ * its forward and reverse limit switches. The shutter starts closed, on the reverse limit.
+ */
+class MODBUSSIMULATOR_API ModbusSimulator
+{
+public:
+	/// @brief Ctor. Starts with the devices in their power-on state.
+	ModbusSimulator() { reset(); }
+
+	/**
+	 * @brief Checks and applies a configuration, also to the transports already open.
+	 * @return int STATUS_OK or SIM_ERROR_INVALID_CONFIG.
+	 */
+	int configure(const SimulatorConfig& config);
+
+	/// @brief Gets the current configuration.
+	SimulatorConfig config();
+
+	/// @brief Restores the power-on state of the devices, reseeds the draws and clears the counters.
+	void reset();
+
+	/// @brief Gets the counters.
+	SimulatorStats stats();
+
+	/**
+	 * @brief Delivers one request to the slaves and works out how long the master waits for the outcome.
+	 *
+	 * A request lost on the way is not applied, a response corrupted on the way back is.
+	 *
+	 * @param slave Addressed slave.
+	 * @param function Modbus function code.
+	 * @param addr First register or coil.
+	 * @param nb Number of registers or coils.
+	 * @param values Values to write, or the buffer the values read go to.
+	 * @param baud Baud rate of the master.
+	 * @param char_us Time of one character on the line.
+	 * @param gap_us Silent interval ending a frame.
+	 * @param response_timeout_us Response timeout of the master, a later response is a timeout.
+	 * @param wait_us Set to the time the master waits: the whole transaction, or the request and the timeout.
+	 * @return int `nb` on success, -1 with errno set otherwise.
+	 */
+	int transact(int slave, int function, int addr, int nb, uint16_t* values, int baud, double char_us, double gap_us,
+		long long response_timeout_us, long long& wait_us);
+
+	/// @brief Whether ports can be opened.
+	bool is_online();
+
+private:
+	std::mutex m_mutex;                              ///< Guards everything below.
+	SimulatorConfig m_config{};                      ///< Current configuration.
+	std::mt19937 m_rng{};                            ///< Fault and jitter draws.
+	SimulatorStats m_stats{};                        ///< Counters.
+	uint16_t m_setpoint[2]{};                        ///< Registers 18 and 19.
+	uint16_t m_zero_point{};                         ///< Register 36.
+	bool m_coils[2]{};                               ///< Coils 272 and 273.
+	double m_measured[2]{};                          ///< Values behind registers 20 and 21.
+	uint16_t m_direction[2]{};                       ///< Registers 512 and 513.
+	double m_position{};                             ///< Shutter position, 0 closed (reverse limit), 1 open (forward limit).
+	std::chrono::steady_clock::time_point m_updated; ///< Time the models were last advanced.
+
+	/// @brief Moves the measured values and the shutter to the present. Caller holds `m_mutex`.
+	void advance_locked();
+
+	/// @brief Applies a request to the registers. Caller holds `m_mutex`. @return 0 or the exception code.
+	int apply_locked(int slave, int function, int addr, int nb, uint16_t* values);
+
+	/// @brief Draws a number from [0, 1). Caller holds `m_mutex`.
+	double draw_locked();
+};
+
+/**
+ * @class SimulatedTransport
+ * @brief Transport of a port on the simulated bus, delays each transaction as long as the real line would.
+ */
+class SimulatedTransport : public ModbusTransport
+{
+private:
+	const SerialSettings m_settings;           ///< Line settings, give the time of a character.
+	int m_slave{ -1 };                         ///< Addressed slave.
+	long long m_response_timeout_us{ 500000 }; ///< Response timeout of the master.
+
+	/// @brief Runs a transaction and waits for its simulated duration.
+	int transfer(int function, int addr, int nb, uint16_t* values);
+
+public:
+	explicit SimulatedTransport(const SerialSettings& settings) : m_settings(settings) {}
+
+	/// @brief Creates the transport of a port on the simulated bus. Matches TransportFactory.
+	static std::unique_ptr<ModbusTransport> create(const std::string& port, const SerialSettings& settings);
+
+	int connect() override;
+	int flush() override;
+	int set_slave(int slave) override;
+	void set_response_timeout(long long timeout_us) override;
+	void set_byte_timeout(long long timeout_us) override;
+	int read_registers(int addr, int nb, uint16_t* dest) override;
+	int read_input_registers(int addr, int nb, uint16_t* dest) override;
+	int write_register(int addr, uint16_t value) override;
+	int write_registers(int addr, int nb, const uint16_t* src) override;
+	int write_bit(int addr, int status) override;
+	int write_bits(int addr, int nb, const uint8_t* src) override;
+};
+
+///< Global instance of the simulated bus.
+extern MODBUSSIMULATOR_API ModbusSimulator g_Simulator;
+
+extern "C" {
+	/**
+	 * @brief Routes the ports opened from now on to the simulated bus.
+	 *
+	 * Ports already open keep their link until they are reopened, e.g. by the reconnect call.
+	 * Called while enabled, replaces the configuration, the next transaction already follows it.
+	 *
+	 * @param config Timing, faults and device dynamics.
+	 * @return int STATUS_OK or SIM_ERROR_INVALID_CONFIG.
+	 */
+	MODBUSSIMULATOR_API int Simulator_Enable(const SimulatorConfig* config);
+
+	/// @brief Routes the ports opened from now on to the serial ports again.
+	MODBUSSIMULATOR_API void Simulator_Disable();
+
+	/// @brief Restores the power-on state of the simulated devices and clears the counters.
+	MODBUSSIMULATOR_API void Simulator_Reset();
+
+	/// @brief Gets the counters of the simulated bus.
+	MODBUSSIMULATOR_API void Simulator_GetStats(SimulatorStats* stats);
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "modbus.h"
+
+/**
+ * @struct SerialSettings
+ * @brief Line settings of a Modbus RTU port.
+ */
+struct SerialSettings
+{
+	int baud;      ///< Baud rate.
+	char parity;   ///< 'N', 'E' or 'O'.
+	int data_bits; ///< Number of data bits.
+	int stop_bits; ///< Number of stop bits.
+};
+
+/**
+ * @class ModbusTransport
+ * @brief Link a bus sends its frames over: a serial port, or the simulator.
+ *
+ * Results follow libmodbus: the number of registers or coils on success, -1 with
+ * errno set on failure (ETIMEDOUT, EMBBADCRC, EMBXILFUN, ...). Used by the bus
+ * thread only.
+ */
+class ModbusTransport
+{
+public:
+	/// @brief Dtor. Closes the link.
+	virtual ~ModbusTransport() = default;
+
+	/// @brief Opens the link, -1 on failure.
+	virtual int connect() = 0;
+
+	/// @brief Drops pending input, e.g. the remains of a late response.
+	virtual int flush() = 0;
+
+	/// @brief Sets the slave the next frames are addressed to.
+	virtual int set_slave(int slave) = 0;
+
+	/// @brief Sets the response timeout.
+	virtual void set_response_timeout(long long timeout_us) = 0;
+
+	/// @brief Sets the timeout between two bytes of a response.
+	virtual void set_byte_timeout(long long timeout_us) = 0;
+
+	/// @brief Reads holding registers (function 0x03).
+	virtual int read_registers(int addr, int nb, uint16_t* dest) = 0;
+
+	/// @brief Reads input registers (function 0x04).
+	virtual int read_input_registers(int addr, int nb, uint16_t* dest) = 0;
+
+	/// @brief Writes a single register (function 0x06).
+	virtual int write_register(int addr, uint16_t value) = 0;
+
+	/// @brief Writes a register block (function 0x10).
+	virtual int write_registers(int addr, int nb, const uint16_t* src) = 0;
+
+	/// @brief Writes a single coil (function 0x05).
+	virtual int write_bit(int addr, int status) = 0;
+
+	/// @brief Writes a coil block (function 0x0F).
+	virtual int write_bits(int addr, int nb, const uint8_t* src) = 0;
+};
+
+/**
+ * @brief Creates the transport of a port, null if it can not be created.
+ * @param port The serial port.
+ * @param settings Line settings.
+ */
+typedef std::unique_ptr<ModbusTransport> (*TransportFactory)(const std::string& port, const SerialSettings& settings);
+
+/**
+ * @class RtuTransport
+ * @brief Modbus RTU over a serial port, through libmodbus.
+ */
+class RtuTransport : public ModbusTransport
+{
+private:
+	/// @brief Custom deleter for Modbus context.
+	static void ModbusDeleter(modbus_t* m)
+	{
+		if (m)
+		{
+			modbus_close(m);
+			modbus_free(m);
+		}
+	}
+
+	std::unique_ptr<modbus_t, void(*)(modbus_t*)> m_ctx; ///< Modbus context.
+
+	explicit RtuTransport(modbus_t* ctx) : m_ctx(ctx, ModbusDeleter) {}
+
+public:
+	/// @brief Creates the context of a port, null if libmodbus rejects the settings. Matches TransportFactory.
+	static std::unique_ptr<ModbusTransport> create(const std::string& port, const SerialSettings& settings);
+
+	int connect() override;
+	int flush() override;
+	int set_slave(int slave) override;
+	void set_response_timeout(long long timeout_us) override;
+	void set_byte_timeout(long long timeout_us) override;
+	int read_registers(int addr, int nb, uint16_t* dest) override;
+	int read_input_registers(int addr, int nb, uint16_t* dest) override;
+	int write_register(int addr, uint16_t value) override;
+	int write_registers(int addr, int nb, const uint16_t* src) override;
+	int write_bit(int addr, int status) override;
+	int write_bits(int addr, int nb, const uint8_t* src) override;
+};
+
+/**
+ * @brief Selects the transport of the ports opened from now on.
+ * @param factory The factory, null for RtuTransport.
+ */
+void set_transport_factory(TransportFactory factory);
+
+/// @brief Creates the transport of a port with the selected factory.
+std::unique_ptr<ModbusTransport> make_transport(const std::string& port, const SerialSettings& settings);
@@ -0,0 +1,154 @@
+#pragma once
+
+#ifdef THERMORESISTIVEEVAPORATOR_EXPORTS
+#define POWERREGULATOR_API __declspec(dllexport)
+#else
+#define POWERREGULATOR_API __declspec(dllimport)
+#endif
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "PowerSupplyManager.h"
+
+/// @brief Process variable the regulator keeps at the target.
+enum RegulatorMode
+{
+	REGULATE_CURRENT = 0,   ///< Current reading (register 20).
+	REGULATE_POWER = 1,     ///< Current reading times the voltage reading in volts.
+	REGULATE_RESISTANCE = 2 ///< Voltage reading in volts over the current reading, the temperature proxy of the evaporator.
+};
+
+/**
+ * @struct RegulatorConfig
+ * @brief Tuning of the regulation loop. The output is the current setpoint (register 18).
+ */
+struct RegulatorConfig
+{
+	int mode;          ///< One of RegulatorMode.
+	int period_ms;     ///< Loop period, from kregulator_min_period_ms.
+	double kp;         ///< Proportional gain, output units per process variable unit.
+	double ki;         ///< Integral gain, per second.
+	double kd;         ///< Derivative gain on the measurement, seconds.
+	double kff;        ///< Feed-forward gain, the target times `kff` is added to the output.
+	int output_min;    ///< Lowest current setpoint written.
+	int output_max;    ///< Highest current setpoint written, at most 0xFFFF.
+	double slew_per_s; ///< Largest change of the current setpoint per second, 0 for no limit.
+	int voltage_limit; ///< Voltage setpoint held while regulating, same units as in PowerSupplyManager::set_current_voltage().
+};
+
+/**
+ * @struct RegulatorStatus
+ * @brief State of the regulation loop, polled by the UI.
+ */
+struct RegulatorStatus
+{
+	int running;             ///< 1 while the loop runs.
+	int last_error;          ///< STATUS_OK or the error code that stopped the loop.
+	double target;           ///< Target of the process variable.
+	double measured;         ///< Last process variable value.
+	double output;           ///< Last current setpoint written.
+	double integral;         ///< Integral term, output units.
+	long long cycles;        ///< Loop iterations since the start.
+	long long overruns;      ///< Iterations that took longer than the period.
+	long long max_jitter_us; ///< Largest wake-up delay after a deadline.
+};
+
+/**
+ * @class PowerRegulator
+ * @brief Closed-loop regulation of the evaporator current, power or resistance.
+ *
+ * A feed-forward plus PID controller on a dedicated high-priority thread, woken on a
+ * fixed grid of deadlines on the steady clock. Every cycle is one block read of the
+ * telemetry (20-21) and one setpoint write (18-19), which the shadow cache skips when
+ * the rounded output did not change. The derivative acts on the measurement, so target
+ * changes do not kick the output. The integral is frozen while the output is held by
+ * its range or by the slew limit in the direction of the error.
+ */
+class POWERREGULATOR_API PowerRegulator
+{
+private:
+	PowerSupplyManager& m_power_supply;  ///< Device the loop drives.
+	std::thread m_thread;                ///< Loop thread.
+	mutable std::mutex m_mutex;          ///< Guards the state below.
+	std::condition_variable m_cv;        ///< Wakes the loop thread on stop.
+	bool m_stop{ false };                ///< Asks the loop thread to exit.
+	bool m_configured{ false };          ///< Whether configure() succeeded once.
+	RegulatorConfig m_config{};          ///< Tuning, copied by the loop on every cycle.
+	RegulatorStatus m_status{};          ///< Last published state.
+
+	/// @brief Body of the loop thread.
+	void run();
+
+	/**
+	 * @brief Computes the process variable from a telemetry read.
+	 * @param mode One of RegulatorMode.
+	 * @param current Current reading.
+	 * @param voltage Voltage reading.
+	 * @param value Receives the process variable.
+	 * @return bool False if the value is undefined, e.g. the resistance at zero current.
+	 */
+	static bool process_variable(int mode, int current, int voltage, double& value);
+
+public:
+	/**
+	 * @brief Ctor.
+	 * @param power_supply Device the loop drives.
+	 */
+	explicit PowerRegulator(PowerSupplyManager& power_supply);
+
+	/// @brief Dtor. Stops the loop.
+	~PowerRegulator();
+
+	PowerRegulator(const PowerRegulator&) = delete;
+	PowerRegulator& operator=(const PowerRegulator&) = delete;
+
+	/**
+	 * @brief Sets the tuning. May be called while the loop runs, the next cycle uses it.
+	 * @param config The tuning.
+	 * @return int Status code indicating success (STATUS_OK) or RG_ERROR_INVALID_CONFIG.
+	 */
+	int configure(const RegulatorConfig& config);
+
+	/**
+	 * @brief Sets the target of the process variable.
+	 * @param target Target, in the units of the configured RegulatorMode.
+	 */
+	void set_target(double target);
+
+	/**
+	 * @brief Starts the loop. The output starts from the current setpoint, so the start is bumpless.
+	 *
+	 * The loop takes the setpoint from PowerSupplyManager::read_setpoints(). If it can not be read,
+	 * the loop stops before its first write with PS_ERROR_READ_SETPOINTS as the last error.
+	 *
+	 * @return int Status code indicating success (STATUS_OK) or specific error.
+	 */
+	int start();
+
+	/// @brief Stops the loop and waits for it. The last setpoint stays applied.
+	void stop();
+
+	/**
+	 * @brief Gets the state of the loop.
+	 * @param status Pointer to store the state.
+	 */
+	void get_status(RegulatorStatus* status) const;
+};
+
+///< Global instance of the regulator bound to the global power supply.
+extern POWERREGULATOR_API PowerRegulator g_Regulator;
+
+extern "C" {
+	POWERREGULATOR_API int Regulator_Configure(const RegulatorConfig* config);
+
+	POWERREGULATOR_API void Regulator_SetTarget(double target);
+
+	POWERREGULATOR_API int Regulator_Start();
+
+	POWERREGULATOR_API void Regulator_Stop();
+
+	POWERREGULATOR_API void Regulator_GetStatus(RegulatorStatus* status);
+}
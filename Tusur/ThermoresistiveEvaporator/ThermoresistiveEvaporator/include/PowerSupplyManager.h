@@ -1,3 +1,5 @@
+#pragma once
+
 #ifdef THERMORESISTIVEEVAPORATOR_EXPORTS
 #define POWERSUPPLYMANAGER_API __declspec(dllexport)
 #else
@@ -5,12 +7,89 @@
 #endif
 
 #include <memory>
+#include <string>
 #include <chrono>
 #include <thread>
 #include <functional>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
 
 #include "modbus.h"
 #include "Constants.h"
+#include "DeviceRegistry.h"
+#include "ModbusBus.h"
+#include "RegisterMap.h"
+#include "ShadowRegisters.h"
+#include "SampleRingBuffer.h"
+#include "TelemetryRecorder.h"
+
+/**
+ * @struct Sample
+ * @brief One timestamped telemetry sample produced by the acquisition thread.
+ */
+struct Sample
+{
+	long long timestamp_us; ///< Steady clock time of the read, in microseconds.
+	int current;            ///< Value of the current register (20).
+	int voltage;            ///< Value of the voltage register (21).
+	int status;             ///< STATUS_OK or the error code of the failed read.
+};
+
+/// @brief Shape of a setpoint ramp.
+enum RampProfile
+{
+	RAMP_LINEAR = 0, ///< Constant rate.
+	RAMP_S_CURVE = 1 ///< Smoothstep, zero rate at both ends, the configured rate at mid-ramp.
+};
+
+/**
+ * @struct RampConfig
+ * @brief Shape and rates of the setpoint ramps.
+ */
+struct RampConfig
+{
+	int profile;               ///< One of RampProfile.
+	double current_rate_per_s; ///< Current setpoint units per second, 0 to step the current.
+	double voltage_rate_per_s; ///< Volts per second, 0 to step the voltage.
+};
+
+/**
+ * @struct RampStatus
+ * @brief Progress of the setpoint ramp.
+ */
+struct RampStatus
+{
+	int active;             ///< 1 while a ramp runs.
+	int last_error;         ///< STATUS_OK or the error code that stopped the last ramp.
+	int current;            ///< Last current register value written by the ramp.
+	int voltage;            ///< Last voltage register value written by the ramp, volts times PowerSupplyRegisters::kvoltage_scale.
+	long long remaining_ms; ///< Time left until the target is reached.
+	long long writes;       ///< Setpoint writes sent by the ramps so far.
+};
+
+/**
+ * @struct SetpointMailboxStatus
+ * @brief State of the setpoint mailbox.
+ */
+struct SetpointMailboxStatus
+{
+	int pending;           ///< 1 while a posted setpoint waits for the worker.
+	int last_error;        ///< STATUS_OK or the error code of the last write of the worker.
+	int current;           ///< Last current register value written by the worker.
+	int voltage;           ///< Last voltage register value written by the worker, volts times PowerSupplyRegisters::kvoltage_scale.
+	long long posted;      ///< Setpoints posted so far.
+	long long applied;     ///< Setpoints written by the worker so far.
+	long long coalesced;   ///< Posted setpoints replaced by a newer one before they were written.
+	long long last_lag_us; ///< Time from the oldest post the last write covered until the device acknowledged it.
+	long long max_lag_us;  ///< Largest lag so far.
+};
+
+/**
+ * @brief Completion callback of a timed run.
+ * @param status Status of the turn-off performed at the deadline (STATUS_OK or specific error).
+ */
+typedef void (*TimedRunCallback)(int status);
 
 /**
  * @class PowerSupplyManager
@@ -19,16 +98,173 @@
  * This class provides methods to connect to a power supply, set current and
  * voltage, read current and voltage values, and control the power supply's
  * operations such as turning on, turning off, and resetting the zero point.
+ *
+ * All methods are thread-safe. Frames are serialized by the bus, and each
+ * multi-frame command holds the device command lock, so concurrent callers
+ * never interleave their sequences. Reads use per-call buffers.
  */
 class POWERSUPPLYMANAGER_API PowerSupplyManager
 {
 private:
-	uint16_t buffer[kbuffer_size];                       ///< Buffer for storing Modbus data.
-	std::unique_ptr<modbus_t, void(*)(modbus_t*)> m_ctx; ///< Unique pointer to Modbus context with custom deleter.
-	int timer_val{};
+	std::atomic<int> timer_val{};          ///< Timer value in minutes, set from the HMI.
+
+	std::mutex m_bus_mutex;                ///< Guards the bus handle, the port name and the line settings.
+	std::string m_port;                    ///< Serial port opened on first use.
+	SerialSettings m_line{ ps_constants::kbaud_rate, 'N', 8, 1 }; ///< Line settings of the port.
+	std::atomic<int> m_slave{ ps_constants::kslave_id }; ///< Modbus slave ID of the power supply.
+	std::shared_ptr<ModbusBus> m_bus;      ///< Bus the power supply is a slave on, shared with other devices on the port.
+	TimeoutPolicy m_timeouts{ kdefault_timeout_policy }; ///< Timeouts of this device, applied to every bus it is attached to.
+	std::mutex m_command_mutex;            ///< Keeps multi-frame command sequences of this device from interleaving.
+	ShadowRegisters m_shadow;              ///< Last acknowledged setpoint register values.
+
+	/**
+	 * @brief Gets the bus of `m_port` and opens it if it is not open yet.
+	 * @param bus Receives the bus.
+	 * @return int Status code indicating success (STATUS_OK) or specific error.
+	 */
+	int ensure_connected(std::shared_ptr<ModbusBus>& bus);
+
+	/**
+	 * @brief Stores the timeout policy and applies it to the current bus. Caller holds `m_bus_mutex`.
+	 * @param policy The policy.
+	 * @return int Status code indicating success (STATUS_OK) or BUS_ERROR_INVALID_TIMEOUT_POLICY.
+	 */
+	int store_timeout_policy_locked(const TimeoutPolicy& policy);
+
+	/**
+	 * @brief Writes a block of holding registers, skipping the ends the shadow cache says are up to date.
+	 * @param bus Bus to write through.
+	 * @param priority Bus priority of the write, one of BusPriority.
+	 * @param addr Address of the first register.
+	 * @param nb Number of registers.
+	 * @param values Values to write.
+	 * @param force Write the whole block even if the cached values match.
+	 * @param written Receives the number of leading registers known to hold their values.
+	 * @return int Result of the bus call, -1 on failure.
+	 */
+	int write_registers_cached(ModbusBus& bus, int priority, int addr, int nb, const uint16_t* values, bool force, int& written);
+
+	using Setpoints = PowerSupplyRegisters::Setpoints; ///< Current (18) and voltage (19) setpoint registers.
+	using Readings = PowerSupplyRegisters::Readings;   ///< Current (20) and voltage (21) reading registers.
+
+	/**
+	 * @brief Writes both setpoint registers through the shadow cache, in one frame when the map allows it.
+	 * @param bus Bus to write through.
+	 * @param priority Bus priority of the write, one of BusPriority.
+	 * @param values Current and voltage register values.
+	 * @param force Write both registers even if the cached values match.
+	 * @param written Receives the number of leading setpoints known to hold their values.
+	 * @return int 2 on success, -1 on failure.
+	 */
+	int write_setpoints_cached(ModbusBus& bus, int priority, const uint16_t* values, bool force, int& written);
+
+	/**
+	 * @brief Gets both setpoint registers from the shadow cache, or reads them back if this bus epoch acknowledged none yet.
+	 * @param bus Bus to read through.
+	 * @param priority Bus priority of the read, one of BusPriority.
+	 * @param values Receives the current and voltage register values.
+	 * @return int 2 on success, -1 on failure.
+	 */
+	int read_setpoints_cached(ModbusBus& bus, int priority, uint16_t* values);
+
+	SampleRingBuffer<Sample, ksample_ring_capacity> m_samples; ///< Samples produced by the acquisition thread.
+	std::thread m_acquisition_thread;                         ///< Background telemetry polling thread.
+	std::atomic<bool> m_acquisition_running{ false };         ///< Whether the acquisition thread should keep polling.
+	std::atomic<int> m_acquisition_interval_ms{ kdefault_acquisition_interval_ms }; ///< Polling period.
+	std::mutex m_acquisition_mutex;                           ///< Guards start/stop of the acquisition thread.
+	std::mutex m_acquisition_wait_mutex;                      ///< Mutex for the acquisition condition variable.
+	std::condition_variable m_acquisition_cv;                 ///< Wakes the acquisition thread on stop.
+
+	TelemetryRecorder m_recorder;                             ///< Recording fed by the acquisition thread.
+	std::atomic<int> m_current_setpoint{};                    ///< Last value acknowledged by register 18, for the recording.
+	std::atomic<int> m_voltage_setpoint{};                    ///< Last value acknowledged by register 19, for the recording.
+
+	/// @brief Remembers a setpoint register value acknowledged by the device.
+	void note_setpoint(int addr, int value);
+
+	/// @brief Publishes the state of a coil in the shared block, -1 if the outcome of its write is unknown.
+	void note_coil(int addr, int state);
+
+	/// @brief Publishes the result of a read of the readings in the shared block.
+	void publish_readings(int status, const uint16_t* registers);
+
+	/// @brief Whether this instance writes the shared block, only the global one does.
+	bool publishes_shared_telemetry() const;
+
+	/// @brief Body of the acquisition thread: polls registers 20-21 on a fixed schedule.
+	void acquisition_loop();
+
+	std::thread m_timed_run_thread;                            ///< Scheduler thread turning the supply off at the deadline.
+	std::mutex m_timed_run_mutex;                              ///< Guards the timed run state below.
+	std::condition_variable m_timed_run_cv;                    ///< Wakes the scheduler on start, cancel or shutdown.
+	std::chrono::steady_clock::time_point m_timed_run_deadline; ///< Moment the supply has to be turned off.
+	bool m_timed_run_active{ false };                          ///< Whether a timed run is pending.
+	bool m_timed_run_shutdown{ false };                        ///< Asks the scheduler thread to exit.
+	TimedRunCallback m_timed_run_callback{ nullptr };          ///< Called after the deadline turn-off.
+
+	/// @brief Body of the scheduler thread: waits for the deadline and turns the supply off.
+	void timed_run_loop();
+
+	std::thread m_ramp_thread;                                 ///< Ramp generator thread, started by the first ramp.
+	std::mutex m_ramp_mutex;                                   ///< Guards the ramp state below.
+	std::condition_variable m_ramp_cv;                         ///< Wakes the ramp thread on start, cancel or shutdown.
+	RampConfig m_ramp_config{ RAMP_LINEAR, 0.0, 0.0 };         ///< Shape and rates of the next ramps.
+	bool m_ramp_active{ false };                               ///< Whether a ramp is running.
+	bool m_ramp_shutdown{ false };                             ///< Asks the ramp thread to exit.
+	bool m_ramp_turn_off{ false };                             ///< Whether the supply is turned off at the end of the ramp.
+	int m_ramp_profile{ RAMP_LINEAR };                         ///< Profile of the running ramp.
+	int m_ramp_from[2]{};                                      ///< Register values (18, 19) at the ramp start.
+	int m_ramp_to[2]{};                                        ///< Register values (18, 19) at the ramp end.
+	bool m_ramp_stepped[2]{};                                  ///< Registers (18, 19) set at once because their rate is 0.
+	std::chrono::steady_clock::time_point m_ramp_start;        ///< Start of the running ramp.
+	std::chrono::microseconds m_ramp_duration{};               ///< Duration of the running ramp.
+	RampStatus m_ramp_status{};                                ///< Last published progress.
+
+	/**
+	 * @brief Starts a ramp of the setpoint registers from the values they hold now, see read_setpoints().
+	 * @param current Current register value to reach.
+	 * @param voltage Voltage register value to reach.
+	 * @param turn_off Turn the supply off once the target is reached.
+	 * @return int Status code indicating success (STATUS_OK) or specific error.
+	 */
+	int start_ramp(int current, int voltage, bool turn_off);
+
+	/**
+	 * @brief Resets the setpoints and the coils, the steps of turn_off() once the ramp and the mailbox are dropped.
+	 *        Caller holds `m_command_mutex`, except safety_turn_off().
+	 * @return int Status code indicating success (STATUS_OK) or specific error.
+	 */
+	int turn_off_sequence();
+
+	/// @brief Cancels the running ramp, the thread re-checks it under the command lock before every write.
+	void cancel_ramp_silently();
+
+	/// @brief Body of the ramp thread: writes the profile value of the current instant on a deadline grid.
+	void ramp_loop();
+
+	std::thread m_mailbox_thread;                              ///< Setpoint mailbox worker, started by the first post.
+	std::mutex m_mailbox_mutex;                                ///< Guards the mailbox state below.
+	std::condition_variable m_mailbox_cv;                      ///< Wakes the worker on post or shutdown.
+	bool m_mailbox_pending{ false };                           ///< Whether a posted setpoint waits for the worker.
+	bool m_mailbox_shutdown{ false };                          ///< Asks the worker thread to exit.
+	uint16_t m_mailbox_values[2]{};                            ///< Newest posted register values (18, 19).
+	std::chrono::steady_clock::time_point m_mailbox_posted_at; ///< Moment of the oldest post not written yet.
+	int m_mailbox_unreported_error{ STATUS_OK };               ///< First worker error since the last post, returned by the next one.
+	SetpointMailboxStatus m_mailbox_status{};                  ///< Last published state.
+
+	/// @brief Drops the pending posted setpoint, so it does not land after a later command.
+	void discard_posted_setpoint();
+
+	/// @brief Body of the mailbox worker: writes the newest posted setpoint whenever the previous write is done.
+	void mailbox_loop();
+
 public:
 	/**
 	 * @brief Constructor that initializes the power supply manager with a given port.
+	 *
+	 * Only records the port: it is opened on the first command or on an explicit connect(),
+	 * so constructing the global instance during DLL load does not touch the hardware.
+	 *
 	 * @param port The serial port to connect to.
 	 */
 	PowerSupplyManager(const char* port);
@@ -37,39 +273,115 @@ public:
 	~PowerSupplyManager();
 
 	/**
-	 * @brief Custom deleter for Modbus context.
-	 *		  Closes and frees the Modbus context if it is not null.
-	 * @param m Pointer to Modbus context.
+	 * @brief Connects to the power supply via the specified port.
+	 *
+	 * Attaches the power supply to the bus of the port and establishes the
+	 * connection. Returns immediately if the same port is already open and healthy.
+	 *
+	 * @param port The serial port to connect to, null to use the recorded one.
+	 * @return int Status code indicating success (STATUS_OK) or specific error.
 	 */
-	static void ModbusDeleter(modbus_t* m) {
-		if (m) {
-			modbus_close(m);
-			modbus_free(m);
-		}
-	}
+	int connect(const char* port);
 
 	/**
-	 * @brief Connects to the power supply via the specified port.
+	 * @brief Connects to the power supply with explicit line settings and slave ID.
 	 *
-	 * Initializes the Modbus RTU connection, sets the Modbus slave ID,
-	 * and establishes the connection.
+	 * Detaches from the current bus and attaches to the bus of `port` with the new settings.
+	 * Another device already on that port must use the same settings. With a baud rate of 0,
+	 * the fastest rate the power supply answers reliably at is probed first, see ModbusBus::probe_baud().
 	 *
 	 * @param port The serial port to connect to.
+	 * @param line Line settings, baud rate 0 to probe it.
+	 * @param slave Modbus slave ID, from 1 to 247.
+	 * @return int Status code indicating success (STATUS_OK), BUS_ERROR_INVALID_LINE_SETTINGS, BUS_ERROR_PROBE_FAILED or specific error.
+	 */
+	int connect_ex(const char* port, const SerialSettings& line, int slave);
+
+	/// @brief Gets the baud rate of the port, the probed one after a probing connect_ex().
+	int baud_rate();
+
+	/**
+	 * @brief Gets what the connection uses, e.g. to attach again after a restart of the host.
+	 * @param port Receives the serial port, empty until one is set.
+	 * @param line Receives the line settings, the probed baud rate after a probing connect_ex().
+	 * @param slave Receives the Modbus slave ID.
+	 */
+	void connection_settings(std::string& port, SerialSettings& line, int& slave);
+
+	/**
+	 * @brief Closes and reopens the port unconditionally. Used to recover a broken link.
 	 * @return int Status code indicating success (STATUS_OK) or specific error.
 	 */
-	int connect(const char* port);
+	int reconnect();
+
+	/**
+	 * @brief Gets the duration of the last port opening.
+	 * @return long long Microseconds, or -1 if the port has never been opened.
+	 */
+	long long connect_latency_us();
+
+	/**
+	 * @brief Gets the state of the link supervisor of the bus.
+	 * @param status Pointer to store the state, LINK_DISCONNECTED if no bus is attached yet.
+	 */
+	void link_status(LinkStatus* status);
+
+	/**
+	 * @brief Sets the timeouts of the transactions with this device.
+	 *
+	 * In adaptive mode the response timeout follows the measured round trips
+	 * (mean plus four deviations), bounded by `response_timeout_ms` from above,
+	 * so the common case fails fast while a slow but healthy device still works.
+	 *
+	 * @param response_timeout_ms Response timeout, the upper bound in adaptive mode.
+	 * @param byte_timeout_ms Timeout between two bytes of a response, 0 disables it.
+	 * @param adaptive Whether to derive the response timeout from the measured round trips.
+	 * @return int Status code indicating success (STATUS_OK) or BUS_ERROR_INVALID_TIMEOUT_POLICY.
+	 */
+	int set_timeouts(int response_timeout_ms, int byte_timeout_ms, bool adaptive);
+
+	/**
+	 * @brief Sets the retries of the transactions that timed out or came back corrupted.
+	 * @param max_retries Number of retries, at most kmax_retries.
+	 * @param retry_backoff_ms Pause before the first retry, doubled for every next one, at most kmax_retry_backoff_ms.
+	 * @return int Status code indicating success (STATUS_OK) or BUS_ERROR_INVALID_TIMEOUT_POLICY.
+	 */
+	int set_retry_policy(int max_retries, int retry_backoff_ms);
+
+	/**
+	 * @brief Gets the response timeout the next transaction will use.
+	 * @return long long Microseconds.
+	 */
+	long long response_timeout_us();
+
+	/**
+	 * @brief Runs a batch of operations on this device as one bus request.
+	 *
+	 * Holds the device command lock, so the batch does not interleave with other
+	 * commands of this device. Registers written by the batch are dropped from the shadow cache.
+	 *
+	 * @param ops Operations, validated by the caller.
+	 * @param n Number of operations.
+	 * @param out Results, ops not reached are left untouched.
+	 * @return int Status code indicating success (STATUS_OK) or specific error.
+	 */
+	int execute_batch(const BatchOp* ops, int n, BatchResult* out);
 
 	/**
 	 * @brief Sets the current and voltage for the power supply.
 	 *
 	 * Writes the specified current and voltage values to the respective
-	 * Modbus registers.
+	 * Modbus registers. A register already holding the value is not written again.
 	 *
 	 * @param current The desired current value.
 	 * @param voltage The desired voltage value.
+	 * @param force Write both registers even if the cached values match.
 	 * @return int Status code indicating success (STATUS_OK) or specific error.
 	 */
-	int set_current_voltage(uint16_t current, uint16_t voltage);
+	int set_current_voltage(uint16_t current, uint16_t voltage, bool force = false);
+
+	/// @brief Drops the cached setpoints, the next writes go to the device unconditionally.
+	void invalidate_shadow() { m_shadow.clear(); }
 
 	/**
 	 * @brief Reads the current value from the power supply.
@@ -84,6 +396,77 @@ public:
 	 */
 	int read_voltage();
 
+	/**
+	 * @brief Reads the current and voltage values from the power supply in one transaction.
+	 *
+	 * Reads input registers 20 (current) and 21 (voltage) as a single block, so both
+	 * values are sampled at the same instant and cost one Modbus round trip.
+	 *
+	 * @param current Pointer to store the current value, may be null.
+	 * @param voltage Pointer to store the voltage value, may be null.
+	 * @return int Status code indicating success (STATUS_OK) or specific error.
+	 */
+	int read_telemetry(int* current, int* voltage);
+
+	/**
+	 * @brief Gets the values the setpoint registers hold now.
+	 *
+	 * The last acknowledged values of the current connection are taken from the cache, otherwise
+	 * holding registers 18 (current) and 19 (voltage) are read back, e.g. in a fresh process
+	 * attached to a supply that is already running.
+	 *
+	 * @param current Pointer to store the current register value, may be null.
+	 * @param voltage Pointer to store the voltage register value, volts times PowerSupplyRegisters::kvoltage_scale, may be null.
+	 * @return int Status code indicating success (STATUS_OK) or PS_ERROR_READ_SETPOINTS.
+	 */
+	int read_setpoints(int* current, int* voltage);
+
+	/**
+	 * @brief Starts the background acquisition thread.
+	 *
+	 * The thread reads registers 20-21 every `interval_ms` milliseconds and pushes
+	 * timestamped samples into the internal ring buffer. If the thread is already
+	 * running, only the polling period is changed.
+	 *
+	 * @param interval_ms Polling period in milliseconds.
+	 * @return int Status code indicating success (STATUS_OK) or specific error.
+	 */
+	int start_acquisition(int interval_ms);
+
+	/// @brief Stops the background acquisition thread and waits for it to finish.
+	void stop_acquisition();
+
+	/**
+	 * @brief Moves acquired samples, oldest first, into the caller's array.
+	 * @param out Destination array.
+	 * @param max Capacity of the destination array.
+	 * @return int Number of samples written to `out`.
+	 */
+	int drain_samples(Sample* out, int max);
+
+	/**
+	 * @brief Starts recording every acquired sample to a memory-mapped file, replacing the current recording.
+	 *
+	 * Records are appended by the acquisition thread, so nothing is recorded while it is stopped.
+	 * See TelemetryFileHeader for the file layout.
+	 *
+	 * @param path Path of the file, overwritten.
+	 * @return int Status code indicating success (STATUS_OK) or TM_ERROR_RECORDING_OPEN_FAILED.
+	 */
+	int start_recording(const char* path) { return m_recorder.start(path); }
+
+	/// @brief Stops the recording and trims the file to the records written.
+	void stop_recording() { m_recorder.stop(); }
+
+	/// @brief Last value acknowledged by the current setpoint register (18).
+	int current_setpoint() const { return m_current_setpoint; }
+
+	/// @brief Number of records in the current recording.
+	long long recorded_count() const { return m_recorder.record_count(); }
+
+	/// @brief Gets the envelope of the last recording between two instants, see TelemetryRecorder::query().
+	int query_telemetry(long long t0_us, long long t1_us, int max_points, TelemetryEnvelopePoint* out) const { return m_recorder.query(t0_us, t1_us, max_points, out); }
+
 	/**
 	 * @brief Turns on the power supply.
 	 *		  Sends commands to turn on the power supply and set it to work mode.
@@ -99,6 +482,27 @@ public:
 	 */
 	int turn_off();
 
+	/**
+	 * @brief Turns off the power supply without waiting for the command in progress, for the safety watchdog.
+	 *
+	 * Same frames as turn_off(), on safety priority, but the command lock is not taken: the frames
+	 * go to the bus next to those of a command holding it, e.g. one pausing before a retry. That
+	 * command may still complete a write afterwards, so the caller follows up with turn_off().
+	 *
+	 * @return int Status code indicating success (STATUS_OK) or specific error.
+	 */
+	int safety_turn_off();
+
+	/**
+	 * @brief Turns off the power supply from a thread that can not rely on the bus thread.
+	 *
+	 * Same sequence as turn_off(), executed on the calling thread with ModbusBus::execute_on_caller().
+	 * Only for process termination, when every other thread has been killed. Never blocks on a lock.
+	 *
+	 * @return int Status code indicating success (STATUS_OK, also if the supply was never connected) or specific error.
+	 */
+	int emergency_turn_off();
+
 	/**
 	 * @brief Resets "ÇÏ" register of the power supply.
 	 *		  Sends a command to reset the "ÇÏ" register of the power supply.
@@ -115,30 +519,243 @@ public:
 	/**
 	* @brief A funcntion to turn the power supply block and then turn it off using a timer
 	*	Timer is defined by the user and is stored as as the timer value "timer_val"
+	*	Returns right after the supply is on, the turn-off is done by the timed run scheduler.
 	* @return int Status code indicating success (STATUS_OK) or specific error
 	*/
 	int turn_on_with_timer();
+
+	/**
+	 * @brief Turns the power supply on and schedules its turn-off.
+	 *
+	 * Does not block: the turn-off is performed by the scheduler thread when the
+	 * steady-clock deadline is reached. Starting a new run replaces a pending one.
+	 *
+	 * @param duration_ms Run duration in milliseconds, must be positive.
+	 * @return int Status code indicating success (STATUS_OK) or specific error.
+	 */
+	int start_timed_run(long long duration_ms);
+
+	/// @brief Cancels the pending timed run. The supply is left in its current state.
+	void cancel_timed_run();
+
+	/**
+	 * @brief Gets the time left until the scheduled turn-off.
+	 * @return long long Remaining milliseconds, or -1 if no timed run is pending.
+	 */
+	long long timed_run_remaining_ms();
+
+	/**
+	 * @brief Sets the callback invoked from the scheduler thread after the deadline turn-off.
+	 * @param callback The callback, or null to remove it.
+	 */
+	void set_timed_run_callback(TimedRunCallback callback);
+
+	/**
+	 * @brief Sets the shape and rates of the next ramps. A running ramp keeps its own.
+	 * @param config The shape and rates.
+	 * @return int Status code indicating success (STATUS_OK) or PS_ERROR_INVALID_RAMP.
+	 */
+	int set_ramp_config(const RampConfig& config);
+
+	/**
+	 * @brief Ramps the current and voltage setpoints to new values on the ramp thread.
+	 *
+	 * The ramp starts from the last acknowledged setpoints, so a new ramp smoothly takes
+	 * over a running one. With none acknowledged on the current connection, registers 18
+	 * and 19 are read back first. Both setpoints follow the same profile, the slower of the two
+	 * rates sets the duration. The thread writes the profile value of the moment it gets
+	 * the bus, at most every kramp_step_ms, so a slow line gets fewer and larger steps
+	 * instead of a backlog. Writes of unchanged values are skipped by the shadow cache.
+	 * set_current_voltage() and turn_off() cancel the ramp.
+	 *
+	 * @param current Current setpoint to reach.
+	 * @param voltage Voltage setpoint to reach, same units as in set_current_voltage().
+	 * @return int Status code indicating success (STATUS_OK) or specific error.
+	 */
+	int ramp_to(uint16_t current, uint16_t voltage);
+
+	/**
+	 * @brief Ramps both setpoints down to 0, then turns the supply off like turn_off().
+	 * @return int Status code indicating success (STATUS_OK) or specific error.
+	 */
+	int ramp_off();
+
+	/// @brief Stops the running ramp, the setpoints stay where the ramp left them.
+	void cancel_ramp();
+
+	/**
+	 * @brief Gets the progress of the ramp.
+	 * @param status Pointer to store the progress.
+	 */
+	void ramp_status(RampStatus* status);
+
+	/**
+	 * @brief Posts a current and voltage setpoint without waiting for the device.
+	 *
+	 * The setpoint goes to a single-slot mailbox, a newer post replaces a pending one.
+	 * The mailbox worker writes the newest value as soon as the previous write is
+	 * acknowledged, so a burst of posts costs at most one write in flight plus one,
+	 * and the device lags the newest post by about two round trips however fast the
+	 * posts come. Cancels a running ramp. set_current_voltage(), ramp_to() and
+	 * turn_off() drop the pending value.
+	 *
+	 * @param current The desired current value.
+	 * @param voltage The desired voltage value, same units as in set_current_voltage().
+	 * @return int The first error of the worker since the previous post (STATUS_OK if none), the write of this post is reported by the next one.
+	 */
+	int post_current_voltage(uint16_t current, uint16_t voltage);
+
+	/**
+	 * @brief Gets the state of the setpoint mailbox.
+	 * @param status Pointer to store the state.
+	 */
+	void setpoint_mailbox_status(SetpointMailboxStatus* status);
 };
 
 ///< Global instance of the extern variable with defaulted value of COM-port.
 extern POWERSUPPLYMANAGER_API PowerSupplyManager g_PowerSupply;
 
+///< Global registry of the power supplies created by handle, independent of `g_PowerSupply`.
+extern POWERSUPPLYMANAGER_API DeviceRegistry<PowerSupplyManager> g_PowerSupplies;
+
 extern "C" {
-	POWERSUPPLYMANAGER_API int PowerSupply_Connect(const char* port) { return g_PowerSupply.connect(port); }
+	POWERSUPPLYMANAGER_API int PowerSupply_Connect(const char* port);
+
+	POWERSUPPLYMANAGER_API int PowerSupply_ConnectEx(const char* port, int baud, char parity, int data_bits, int stop_bits, int slave);
+
+	POWERSUPPLYMANAGER_API int PowerSupply_GetBaudRate();
+
+	POWERSUPPLYMANAGER_API int PowerSupply_Reconnect();
+
+	POWERSUPPLYMANAGER_API long long PowerSupply_GetConnectLatency();
+
+	POWERSUPPLYMANAGER_API void PowerSupply_GetLinkStatus(LinkStatus* status);
+
+	POWERSUPPLYMANAGER_API int PowerSupply_SetTimeouts(int response_timeout_ms, int byte_timeout_ms, int adaptive);
+
+	POWERSUPPLYMANAGER_API int PowerSupply_SetRetryPolicy(int max_retries, int retry_backoff_ms);
+
+	POWERSUPPLYMANAGER_API long long PowerSupply_GetResponseTimeout();
+
+	POWERSUPPLYMANAGER_API int PowerSupply_SetCurrentVoltage(uint16_t current, uint16_t voltage);
+
+	POWERSUPPLYMANAGER_API int PowerSupply_SetCurrentVoltageEx(uint16_t current, uint16_t voltage, int force);
+
+	POWERSUPPLYMANAGER_API void PowerSupply_InvalidateShadow();
+
+	POWERSUPPLYMANAGER_API int PowerSupply_TurnOn();
+
+	POWERSUPPLYMANAGER_API int PowerSupply_TurnOff();
+
+	POWERSUPPLYMANAGER_API int PowerSupply_ReadCurrent();
+
+	POWERSUPPLYMANAGER_API int PowerSupply_ReadVoltage();
+
+	POWERSUPPLYMANAGER_API int PowerSupply_ReadCurrentVoltage(int* current, int* voltage);
+
+	POWERSUPPLYMANAGER_API int PowerSupply_StartAcquisition(int interval_ms);
+
+	POWERSUPPLYMANAGER_API void PowerSupply_StopAcquisition();
+
+	POWERSUPPLYMANAGER_API int PowerSupply_DrainSamples(Sample* out, int max);
+
+	POWERSUPPLYMANAGER_API int PowerSupply_StartRecording(const char* path);
+
+	POWERSUPPLYMANAGER_API void PowerSupply_StopRecording();
+
+	POWERSUPPLYMANAGER_API long long PowerSupply_GetRecordedCount();
+
+	POWERSUPPLYMANAGER_API int Telemetry_Query(long long t0_us, long long t1_us, int max_points, TelemetryEnvelopePoint* out);
+
+	POWERSUPPLYMANAGER_API int PowerSupply_ResetZP();
+
+	POWERSUPPLYMANAGER_API void PowerSupply_SetTimer(int t);
+
+	POWERSUPPLYMANAGER_API int PowerSupply_TurnOnWithTimer();
+
+	POWERSUPPLYMANAGER_API int PowerSupply_StartTimedRun(long long duration_ms);
+
+	POWERSUPPLYMANAGER_API void PowerSupply_CancelTimedRun();
+
+	POWERSUPPLYMANAGER_API long long PowerSupply_GetTimedRunRemaining();
+
+	POWERSUPPLYMANAGER_API void PowerSupply_SetTimedRunCallback(TimedRunCallback callback);
+
+	POWERSUPPLYMANAGER_API int PowerSupply_SetRampConfig(const RampConfig* config);
+
+	POWERSUPPLYMANAGER_API int PowerSupply_RampTo(uint16_t current, uint16_t voltage);
+
+	POWERSUPPLYMANAGER_API int PowerSupply_RampOff();
+
+	POWERSUPPLYMANAGER_API void PowerSupply_CancelRamp();
+
+	POWERSUPPLYMANAGER_API void PowerSupply_GetRampStatus(RampStatus* status);
+
+	POWERSUPPLYMANAGER_API int PowerSupply_PostCurrentVoltage(uint16_t current, uint16_t voltage);
+
+	POWERSUPPLYMANAGER_API void PowerSupply_GetSetpointMailboxStatus(SetpointMailboxStatus* status);
+
+	/**
+	 * @brief Creates a power supply instance with its own connection and threads, see DeviceRegistry::create().
+	 *
+	 * The ...H exports below act on the instance like the exports without the suffix act on `g_PowerSupply`,
+	 * and return DEV_ERROR_INVALID_HANDLE for an unknown handle.
+	 *
+	 * @param config Port, line settings and slave ID, baud rate 0 to probe it.
+	 * @param handle Receives the handle of the instance.
+	 * @return int Status code indicating success (STATUS_OK) or specific error.
+	 */
+	POWERSUPPLYMANAGER_API int PowerSupply_Create(const DeviceConfig* config, int* handle);
+
+	/**
+	 * @brief Destroys a power supply instance, stopping its threads. The supply is left in its current state.
+	 * @note Must not be called from a callback of the same instance.
+	 */
+	POWERSUPPLYMANAGER_API int PowerSupply_Destroy(int handle);
+
+	/// @brief Returns the baud rate of the instance, 0 for an unknown handle.
+	POWERSUPPLYMANAGER_API int PowerSupply_GetBaudRateH(int handle);
+
+	POWERSUPPLYMANAGER_API int PowerSupply_ReconnectH(int handle);
+
+	POWERSUPPLYMANAGER_API int PowerSupply_GetLinkStatusH(int handle, LinkStatus* status);
+
+	POWERSUPPLYMANAGER_API int PowerSupply_SetTimeoutsH(int handle, int response_timeout_ms, int byte_timeout_ms, int adaptive);
+
+	POWERSUPPLYMANAGER_API int PowerSupply_SetRetryPolicyH(int handle, int max_retries, int retry_backoff_ms);
+
+	POWERSUPPLYMANAGER_API int PowerSupply_SetCurrentVoltageH(int handle, uint16_t current, uint16_t voltage);
+
+	POWERSUPPLYMANAGER_API int PowerSupply_TurnOnH(int handle);
+
+	POWERSUPPLYMANAGER_API int PowerSupply_TurnOffH(int handle);
+
+	POWERSUPPLYMANAGER_API int PowerSupply_ResetZPH(int handle);
+
+	POWERSUPPLYMANAGER_API int PowerSupply_ReadCurrentVoltageH(int handle, int* current, int* voltage);
+
+	POWERSUPPLYMANAGER_API int PowerSupply_StartAcquisitionH(int handle, int interval_ms);
+
+	POWERSUPPLYMANAGER_API int PowerSupply_StopAcquisitionH(int handle);
+
+	/// @brief Returns the number of samples written to `out`, 0 for an unknown handle.
+	POWERSUPPLYMANAGER_API int PowerSupply_DrainSamplesH(int handle, Sample* out, int max);
+
+	POWERSUPPLYMANAGER_API int PowerSupply_StartTimedRunH(int handle, long long duration_ms);
 
-	POWERSUPPLYMANAGER_API int PowerSupply_SetCurrentVoltage(uint16_t current, uint16_t voltage) { return g_PowerSupply.set_current_voltage(current, voltage); }
+	POWERSUPPLYMANAGER_API int PowerSupply_CancelTimedRunH(int handle);
 
-	POWERSUPPLYMANAGER_API int PowerSupply_TurnOn() { return g_PowerSupply.turn_on(); }
+	POWERSUPPLYMANAGER_API int PowerSupply_SetRampConfigH(int handle, const RampConfig* config);
 
-	POWERSUPPLYMANAGER_API int PowerSupply_TurnOff() { return g_PowerSupply.turn_off(); }
+	POWERSUPPLYMANAGER_API int PowerSupply_RampToH(int handle, uint16_t current, uint16_t voltage);
 
-	POWERSUPPLYMANAGER_API int PowerSupply_ReadCurrent() { return g_PowerSupply.read_current(); }
+	POWERSUPPLYMANAGER_API int PowerSupply_RampOffH(int handle);
 
-	POWERSUPPLYMANAGER_API int PowerSupply_ReadVoltage() { return g_PowerSupply.read_voltage(); }
+	POWERSUPPLYMANAGER_API int PowerSupply_CancelRampH(int handle);
 
-	POWERSUPPLYMANAGER_API int PowerSupply_ResetZP() { return g_PowerSupply.reset_zp(); }
+	POWERSUPPLYMANAGER_API int PowerSupply_GetRampStatusH(int handle, RampStatus* status);
 
-	POWERSUPPLYMANAGER_API void PowerSupply_SetTimer(int t) { g_PowerSupply.set_timer(t); }
+	POWERSUPPLYMANAGER_API int PowerSupply_PostCurrentVoltageH(int handle, uint16_t current, uint16_t voltage);
 
-	POWERSUPPLYMANAGER_API int PowerSupply_TurnOnWithTimer() { return g_PowerSupply.turn_on_with_timer(); }
+	POWERSUPPLYMANAGER_API int PowerSupply_GetSetpointMailboxStatusH(int handle, SetpointMailboxStatus* status);
 }
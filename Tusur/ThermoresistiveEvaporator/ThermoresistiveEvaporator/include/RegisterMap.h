@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * @struct RegisterPair
+ * @brief Two registers that are always transferred together.
+ *
+ * Adjacent registers go in one block frame, any other pair in two single-register
+ * frames. The choice is made from the addresses at compile time, so a device model
+ * only lists its registers and gets the block transfers wherever its layout allows them.
+ * The values of a transfer are always ordered first, second.
+ *
+ * @tparam First Address of the first register.
+ * @tparam Second Address of the second register.
+ */
+template <int First, int Second>
+struct RegisterPair
+{
+	static_assert(First >= 0 && Second >= 0 && First <= 0xFFFF && Second <= 0xFFFF, "Modbus addresses are 16 bits.");
+	static_assert(First != Second, "The two registers of a pair must differ.");
+
+	static constexpr int kfirst{ First };                        ///< Address of the first register.
+	static constexpr int ksecond{ Second };                      ///< Address of the second register.
+	static constexpr int kframes{ Second == First + 1 ? 1 : 2 }; ///< Frames of one transfer of the pair.
+	static constexpr int kframe_registers{ 3 - kframes };        ///< Registers in each frame.
+
+	/**
+	 * @brief Gets the address of the first register of a frame.
+	 * @param frame Index of the frame, below kframes. Its values start at `frame * kframe_registers`.
+	 */
+	static constexpr int frame_addr(int frame) { return First + frame * (Second - First); }
+
+	/// @brief Gets the index (0 or 1) of `addr` in the pair, -1 if it is not one of the two.
+	static constexpr int index_of(int addr) { return addr == First ? 0 : addr == Second ? 1 : -1; }
+
+	/// @brief Whether `addr` is one of the two registers.
+	static constexpr bool contains(int addr) { return index_of(addr) >= 0; }
+};
+
+/**
+ * @struct DefaultPowerSupplyModel
+ * @brief Register layout of the power supply of the evaporator.
+ *
+ * Another model is described by a struct with the same members. Holding registers
+ * for the setpoints and the zero point, input registers for the readings, coils for the switches.
+ */
+struct DefaultPowerSupplyModel
+{
+	static constexpr int kcurrent_setpoint{ 18 }; ///< Holding register of the current setpoint.
+	static constexpr int kvoltage_setpoint{ 19 }; ///< Holding register of the voltage setpoint.
+	static constexpr int kcurrent_reading{ 20 };  ///< Input register of the measured current.
+	static constexpr int kvoltage_reading{ 21 };  ///< Input register of the measured voltage.
+	static constexpr int kzero_point{ 36 };       ///< Holding register of the zero point, reset by writing 0.
+	static constexpr int kpower_coil{ 272 };      ///< Coil turning the power supply on.
+	static constexpr int kworkmode_coil{ 273 };   ///< Coil turning the work mode on.
+	static constexpr int kvoltage_scale{ 100 };   ///< Register units per volt, the register takes values from 0 to 600.
+};
+
+/**
+ * @struct DefaultStepMotorModel
+ * @brief Register layout of the step motor driving the shutter.
+ */
+struct DefaultStepMotorModel
+{
+	static constexpr int kforward{ 512 };       ///< Holding register driving the motor forward while 1.
+	static constexpr int kreverse{ 513 };       ///< Holding register driving the motor in reverse while 1.
+	static constexpr int kforward_limit{ 514 }; ///< Holding register of the forward limit switch, 1 when hit.
+	static constexpr int kreverse_limit{ 515 }; ///< Holding register of the reverse limit switch, 1 when hit.
+};
+
+/**
+ * @struct PowerSupplyRegisterMap
+ * @brief Typed view of the registers of a power supply model, with its scaling.
+ * @tparam Model Register layout, see DefaultPowerSupplyModel.
+ */
+template <typename Model>
+struct PowerSupplyRegisterMap
+{
+	static_assert(Model::kvoltage_scale > 0, "The voltage scale must be positive.");
+
+	using Setpoints = RegisterPair<Model::kcurrent_setpoint, Model::kvoltage_setpoint>; ///< Current and voltage setpoints, always written together.
+	using Readings = RegisterPair<Model::kcurrent_reading, Model::kvoltage_reading>;    ///< Current and voltage readings, sampled together.
+
+	static constexpr int kzero_point{ Model::kzero_point };       ///< Holding register of the zero point.
+	static constexpr int kpower_coil{ Model::kpower_coil };       ///< Coil turning the power supply on.
+	static constexpr int kworkmode_coil{ Model::kworkmode_coil }; ///< Coil turning the work mode on.
+	static constexpr int kvoltage_scale{ Model::kvoltage_scale }; ///< Register units per volt.
+
+	/// @brief Converts a voltage setpoint in volts to its register value, truncated to 16 bits like the register.
+	static constexpr uint16_t voltage_to_register(uint16_t volts) { return static_cast<uint16_t>(volts * kvoltage_scale); }
+
+	/// @brief Converts a voltage register value to volts.
+	static constexpr double register_to_volts(int value) { return static_cast<double>(value) / kvoltage_scale; }
+
+	/// @brief Whether a voltage in volts fits the 16-bit register.
+	static constexpr bool voltage_fits(int volts) { return volts >= 0 && volts * kvoltage_scale <= 0xFFFF; }
+};
+
+/**
+ * @struct StepMotorRegisterMap
+ * @brief Typed view of the registers of a step motor model.
+ * @tparam Model Register layout, see DefaultStepMotorModel.
+ */
+template <typename Model>
+struct StepMotorRegisterMap
+{
+	using Direction = RegisterPair<Model::kforward, Model::kreverse>;         ///< Forward and reverse drive, written together so the motor never sees half a direction.
+	using Limits = RegisterPair<Model::kforward_limit, Model::kreverse_limit>; ///< Forward and reverse limit switches, read together.
+};
+
+///< Register map of the power supply the managers are built for. Another model is a new layout struct plugged in here.
+using PowerSupplyRegisters = PowerSupplyRegisterMap<DefaultPowerSupplyModel>;
+
+///< Register map of the step motor the managers are built for.
+using StepMotorRegisters = StepMotorRegisterMap<DefaultStepMotorModel>;
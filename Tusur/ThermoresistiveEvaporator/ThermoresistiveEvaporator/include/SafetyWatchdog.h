@@ -0,0 +1,176 @@
+#pragma once
+
+#ifdef THERMORESISTIVEEVAPORATOR_EXPORTS
+#define SAFETYWATCHDOG_API __declspec(dllexport)
+#else
+#define SAFETYWATCHDOG_API __declspec(dllimport)
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "PowerSupplyManager.h"
+
+/// @brief Cause of a watchdog shutdown.
+enum WatchdogTrip
+{
+	WATCHDOG_TRIP_NONE = 0,           ///< Not tripped since armed.
+	WATCHDOG_TRIP_KICK_TIMEOUT = 1,   ///< The host did not kick in time.
+	WATCHDOG_TRIP_CURRENT_LIMIT = 2,  ///< The current reading (register 20) exceeded its limit.
+	WATCHDOG_TRIP_VOLTAGE_LIMIT = 3,  ///< The voltage reading (register 21) exceeded its limit.
+	WATCHDOG_TRIP_PROCESS_DETACH = 4, ///< The process exited while armed.
+	WATCHDOG_TRIP_SHUTDOWN = 5        ///< shutdown() was called while armed, e.g. before the DLL is unloaded.
+};
+
+/**
+ * @struct WatchdogConfig
+ * @brief Deadline and limits the watchdog enforces.
+ */
+struct WatchdogConfig
+{
+	int kick_timeout_ms; ///< Longest time between two kicks, from kwatchdog_min_kick_timeout_ms.
+	int poll_period_ms;  ///< Period of the limit checks, from kwatchdog_min_poll_ms. Ignored when both limits are 0.
+	int current_limit;   ///< Highest allowed current reading, raw register 20 units, 0 for no limit.
+	int voltage_limit;   ///< Highest allowed voltage reading, raw register 21 units, 0 for no limit.
+};
+
+/**
+ * @struct WatchdogStatus
+ * @brief State of the watchdog, polled by the UI.
+ */
+struct WatchdogStatus
+{
+	int armed;                 ///< 1 while the watchdog runs.
+	int trip_reason;           ///< One of WatchdogTrip of the last trip.
+	int shutdown_status;       ///< STATUS_OK or the first error of the shutdown of the last trip.
+	int current;               ///< Last current reading of the limit checks.
+	int voltage;               ///< Last voltage reading of the limit checks.
+	long long checks;          ///< Limit checks since armed.
+	long long read_failures;   ///< Limit checks whose read failed since armed, they do not trip.
+	long long trips;           ///< Trips since the DLL was loaded.
+	long long last_latency_us; ///< Time from the trigger of the last trip until every supply acknowledged the turn-off.
+	long long max_latency_us;  ///< Largest trip latency since the DLL was loaded.
+};
+
+/**
+ * @class SafetyWatchdog
+ * @brief Turns every power supply off when the host stops kicking, a limit is exceeded or the DLL goes away.
+ *
+ * The watchdog thread runs at time-critical priority and sleeps until the kick deadline or the
+ * next limit check, whichever comes first. A trip runs safety_turn_off() on the global power supply
+ * and on every instance created by handle. It does not wait for the command lock of a device, and
+ * its frames go on safety priority, so they are served ahead of every queued command and telemetry
+ * request. A command pausing before a retry gives the retry up. Only the frame on the line is
+ * finished first, so a trip waits at most one response timeout for a bus. The regulator, the scenario
+ * and the timed run are stopped after. Then turn_off() runs once more on every supply, after the
+ * commands that were in progress, in case one of them got a write in meanwhile.
+ *
+ * The latency of a trip is counted from its trigger (the kick deadline, or the read that saw the
+ * limit exceeded) until the last supply acknowledged the first turn-off. A limit can be exceeded up to
+ * one poll period before it is seen. The watchdog disarms itself on a trip.
+ *
+ * The thread holds a reference on the DLL from arm() until disarm(), so a FreeLibrary of the host
+ * never unmaps the code it runs. An armed watchdog then trips on the missing kicks. A host
+ * unloading the DLL on purpose calls shutdown() first.
+ */
+class SAFETYWATCHDOG_API SafetyWatchdog
+{
+private:
+	std::thread m_thread;                                  ///< Watchdog thread.
+	mutable std::mutex m_mutex;                            ///< Guards the state below.
+	std::condition_variable m_cv;                          ///< Wakes the watchdog thread on disarm.
+	bool m_stop{ false };                                  ///< Asks the watchdog thread to exit.
+	WatchdogConfig m_config{};                             ///< Deadline and limits of the current arming.
+	std::chrono::steady_clock::time_point m_kick_deadline; ///< Moment the next kick is due.
+	WatchdogStatus m_status{};                             ///< Last published state.
+	std::atomic<HMODULE> m_module{ nullptr };              ///< Reference on the DLL held while the thread exists.
+
+	/// @brief Body of the watchdog thread.
+	void run();
+
+	/**
+	 * @brief Turns off every power supply through the bus threads.
+	 * @param off_at Receives the moment the first turn-off pass was acknowledged.
+	 * @return int STATUS_OK or the first error.
+	 */
+	static int shutdown_all(std::chrono::steady_clock::time_point& off_at);
+
+	/**
+	 * @brief Records a finished trip. Caller holds `m_mutex`.
+	 * @param reason One of WatchdogTrip.
+	 * @param trigger Moment the trip was triggered.
+	 * @param off_at Moment the supplies acknowledged the turn-off.
+	 * @param status Result of the shutdown.
+	 */
+	void record_trip_locked(int reason, std::chrono::steady_clock::time_point trigger, std::chrono::steady_clock::time_point off_at, int status);
+
+public:
+	SafetyWatchdog() = default;
+
+	/// @brief Dtor. Disarms the watchdog without a shutdown.
+	~SafetyWatchdog();
+
+	SafetyWatchdog(const SafetyWatchdog&) = delete;
+	SafetyWatchdog& operator=(const SafetyWatchdog&) = delete;
+
+	/**
+	 * @brief Arms the watchdog, or replaces the deadline and limits if it is armed. Counts as a kick.
+	 * @param config Deadline and limits.
+	 * @return int Status code indicating success (STATUS_OK) or WD_ERROR_INVALID_CONFIG.
+	 */
+	int arm(const WatchdogConfig& config);
+
+	/// @brief Disarms the watchdog, waits for its thread and releases its reference on the DLL. Nothing is turned off.
+	void disarm();
+
+	/**
+	 * @brief Disarms the watchdog and, if it was armed, turns every supply off like a trip.
+	 *
+	 * For a host about to unload the DLL: once it returns, no thread of the watchdog is left and
+	 * the DLL can be unloaded. The trip is recorded with WATCHDOG_TRIP_SHUTDOWN.
+	 *
+	 * @return int STATUS_OK, also when the watchdog was not armed, or the first error of the turn-off.
+	 */
+	int shutdown();
+
+	/**
+	 * @brief Moves the deadline to `kick_timeout_ms` from now.
+	 * @return int Status code indicating success (STATUS_OK) or WD_ERROR_NOT_ARMED, e.g. after a trip.
+	 */
+	int kick();
+
+	/**
+	 * @brief Gets the state of the watchdog.
+	 * @param status Pointer to store the state.
+	 */
+	void get_status(WatchdogStatus* status) const;
+
+	/**
+	 * @brief Shuts the supplies down from DllMain on DLL_PROCESS_DETACH if the process exits while armed.
+	 *
+	 * Runs on the calling thread under the loader lock, so no thread is joined. Every other thread is
+	 * already gone and the frames are sent with emergency_turn_off(). On FreeLibrary there is nothing
+	 * to do: while the watchdog thread exists, its reference keeps the DLL loaded.
+	 *
+	 * @param process_exit Whether the process is exiting, the `lpReserved` of DllMain is not null.
+	 */
+	void process_detach(bool process_exit);
+};
+
+///< Global instance of the watchdog guarding the global power supply and the instances created by handle.
+extern SAFETYWATCHDOG_API SafetyWatchdog g_Watchdog;
+
+extern "C" {
+	SAFETYWATCHDOG_API int Watchdog_Arm(const WatchdogConfig* config);
+
+	SAFETYWATCHDOG_API void Watchdog_Disarm();
+
+	SAFETYWATCHDOG_API int Watchdog_Shutdown();
+
+	SAFETYWATCHDOG_API int Watchdog_Kick();
+
+	SAFETYWATCHDOG_API void Watchdog_GetStatus(WatchdogStatus* status);
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+/**
+ * @class SampleRingBuffer
+ * @brief Fixed-size single-producer/single-consumer lock-free ring buffer.
+ *
+ * One thread may call push() and one (other) thread may call pop(). Head and
+ * tail are free-running counters, the slot index is taken modulo the capacity,
+ * which therefore must be a power of two. When the buffer is full, push()
+ * rejects the new item instead of overwriting data the consumer may be reading.
+ *
+ * @tparam T Trivially copyable item type.
+ * @tparam Capacity Number of slots, power of two.
+ */
+template <typename T, std::size_t Capacity>
+class SampleRingBuffer
+{
+	static_assert(Capacity != 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+private:
+	static constexpr std::size_t kmask{ Capacity - 1 };
+
+	alignas(64) std::atomic<std::size_t> m_head{ 0 }; ///< Next slot to write, owned by the producer.
+	alignas(64) std::atomic<std::size_t> m_tail{ 0 }; ///< Next slot to read, owned by the consumer.
+	alignas(64) T m_data[Capacity];                   ///< Storage for the items.
+
+public:
+	/**
+	 * @brief Appends an item. Producer side only.
+	 * @param item The item to append.
+	 * @return bool True if the item was stored, false if the buffer is full.
+	 */
+	bool push(const T& item)
+	{
+		const std::size_t head{ m_head.load(std::memory_order_relaxed) };
+		if (head - m_tail.load(std::memory_order_acquire) == Capacity)
+			return false;
+
+		m_data[head & kmask] = item;
+		m_head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	/**
+	 * @brief Moves up to `max` oldest items into `out`. Consumer side only.
+	 * @param out Destination array with room for at least `max` items.
+	 * @param max Maximum number of items to take.
+	 * @return std::size_t Number of items copied.
+	 */
+	std::size_t pop(T* out, std::size_t max)
+	{
+		const std::size_t tail{ m_tail.load(std::memory_order_relaxed) };
+		const std::size_t available{ m_head.load(std::memory_order_acquire) - tail };
+		const std::size_t count{ available < max ? available : max };
+
+		for (std::size_t i{}; i < count; ++i)
+			out[i] = m_data[(tail + i) & kmask];
+
+		m_tail.store(tail + count, std::memory_order_release);
+		return count;
+	}
+
+	/// @brief Number of items currently stored (approximate while the other side is running).
+	std::size_t size() const { return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire); }
+
+	/// @brief Total number of slots.
+	static constexpr std::size_t capacity() { return Capacity; }
+};
@@ -0,0 +1,274 @@
+#pragma once
+
+#ifdef THERMORESISTIVEEVAPORATOR_EXPORTS
+#define SCENARIOEXECUTOR_API __declspec(dllexport)
+#else
+#define SCENARIOEXECUTOR_API __declspec(dllimport)
+#endif
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "PowerSupplyManager.h"
+
+/**
+ * @struct ScenarioStage
+ * @brief One stage of a multi-stage recipe.
+ */
+struct ScenarioStage
+{
+	uint16_t current;      ///< Current setpoint (register 18).
+	uint16_t voltage;      ///< Voltage setpoint, same units as in PowerSupplyManager::set_current_voltage().
+	long long duration_ms; ///< Stage duration in milliseconds, ramp included.
+	long long ramp_ms;     ///< Time to ramp the current from the previous stage value, 0 for a step change.
+};
+
+/// @brief State of the scenario executor.
+enum ScenarioState
+{
+	SCENARIO_IDLE = 0,      ///< Nothing is running.
+	SCENARIO_RUNNING = 1,   ///< Stages are being executed.
+	SCENARIO_COMPLETED = 2, ///< All stages finished, the supply is off.
+	SCENARIO_ABORTED = 3,   ///< Stopped by the caller, the supply is off.
+	SCENARIO_FAILED = 4,    ///< A Modbus command failed, see `last_error`.
+	SCENARIO_STARTING = 5   ///< The supply is being turned on, the stages follow.
+};
+
+/**
+ * @struct ScenarioStatus
+ * @brief Progress of the scenario, polled by the UI.
+ */
+struct ScenarioStatus
+{
+	int state;                    ///< One of ScenarioState.
+	int stage_index;              ///< Zero-based index of the current stage.
+	int stage_count;              ///< Number of loaded stages.
+	int last_error;               ///< STATUS_OK or the error code that stopped the scenario.
+	long long stage_elapsed_ms;   ///< Time spent in the current stage.
+	long long stage_remaining_ms; ///< Time left in the current stage.
+	long long total_elapsed_ms;   ///< Time since the scenario start.
+};
+
+/**
+ * @struct ScenarioCheckpointHeader
+ * @brief Start of a checkpoint file: the connection and the stage table the checkpoints refer to.
+ *
+ * ScenarioCheckpoint records follow, appended one after the other. The last record
+ * whose checksum holds is the point a resume continues from.
+ */
+struct ScenarioCheckpointHeader
+{
+	uint32_t magic;                             ///< kscenario_checkpoint_magic.
+	uint32_t version;                           ///< kscenario_checkpoint_version.
+	uint32_t record_size;                       ///< sizeof(ScenarioCheckpoint).
+	int32_t stage_count;                        ///< Stages of the table.
+	char port[kscenario_checkpoint_port_size];  ///< Serial port of the power supply the run was started on, null-terminated.
+	int32_t baud;                               ///< Baud rate of the port.
+	int32_t parity;                             ///< 'N', 'E' or 'O'.
+	int32_t data_bits;                          ///< Data bits of the port.
+	int32_t stop_bits;                          ///< Stop bits of the port.
+	int32_t slave;                              ///< Modbus slave ID of the power supply.
+	uint32_t reserved;                          ///< Zero.
+	ScenarioStage stages[kscenario_max_stages]; ///< Stage table, `stage_count` used.
+};
+
+static_assert(sizeof(ScenarioStage) == 24, "ScenarioStage is part of the checkpoint file layout");
+static_assert(offsetof(ScenarioCheckpointHeader, stages) == 72, "ScenarioCheckpointHeader is part of the checkpoint file layout");
+
+/**
+ * @struct ScenarioCheckpoint
+ * @brief Progress of a run, appended at stage boundaries, periodically within a stage and at its end.
+ */
+struct ScenarioCheckpoint
+{
+	uint32_t sequence;          ///< Number of the record in the file, from 0.
+	int32_t state;              ///< SCENARIO_RUNNING, or the final ScenarioState of the run.
+	int32_t stage_index;        ///< Zero-based index of the stage.
+	int32_t zp_reset;           ///< 1 once "ZP" was reset.
+	long long stage_elapsed_ms; ///< Time spent in the stage.
+	long long total_elapsed_ms; ///< Time since the scenario start, restore ramps excluded.
+	int32_t current;            ///< Last current setpoint applied by the scenario.
+	int32_t voltage;            ///< Last voltage setpoint applied by the scenario, same units as ScenarioStage.
+	uint32_t reserved;          ///< Zero.
+	uint32_t checksum;          ///< FNV-1a of the bytes above, a record torn by a crash fails it.
+};
+
+static_assert(sizeof(ScenarioCheckpoint) == 48, "ScenarioCheckpoint is part of the checkpoint file layout");
+
+/**
+ * @class ScenarioExecutor
+ * @brief Runs a multi-stage recipe on the power supply from a dedicated thread.
+ *
+ * Stage boundaries are computed from the scenario start time on the steady clock,
+ * so the timing error does not accumulate from stage to stage. A stage transition
+ * is a single setpoint write performed by the executor thread.
+ *
+ * With a checkpoint file set, the progress is appended to it at every stage boundary and
+ * periodically within a stage, one small buffered write that reaches the system cache, so
+ * it survives a crash of the host. resume() continues an interrupted run from its last checkpoint.
+ */
+class SCENARIOEXECUTOR_API ScenarioExecutor
+{
+private:
+	/// @brief Point a run starts from: the beginning of the table or a checkpoint.
+	struct ResumePoint
+	{
+		std::size_t stage;          ///< Stage to start with.
+		long long stage_elapsed_ms; ///< Part of that stage already done.
+		long long total_elapsed_ms; ///< Part of the scenario already done.
+		uint16_t current;           ///< Current setpoint to ramp back to before continuing, 0 for none.
+		uint16_t voltage;           ///< Voltage setpoint held during that ramp.
+		bool zp_reset;              ///< Whether "ZP" was already reset.
+		std::string port;           ///< Port to attach to before turning on, empty to keep the current connection.
+		SerialSettings line;        ///< Line settings of `port`.
+		int slave;                  ///< Modbus slave ID on `port`.
+	};
+
+	PowerSupplyManager& m_power_supply;        ///< Device the scenario is run on.
+	std::vector<ScenarioStage> m_stages;       ///< Loaded stage table.
+	std::thread m_thread;                      ///< Executor thread.
+	std::mutex m_join_mutex;                   ///< Serializes the joins of the executor thread.
+	mutable std::mutex m_mutex;                ///< Guards the state below.
+	std::condition_variable m_cv;              ///< Wakes the executor thread on stop.
+	bool m_abort{ false };                     ///< Asks the executor thread to stop.
+	ScenarioStatus m_status{};                 ///< Last published progress.
+	std::chrono::steady_clock::time_point m_start;       ///< Scenario start time.
+	std::chrono::steady_clock::time_point m_stage_start; ///< Current stage start time.
+	std::chrono::steady_clock::time_point m_stage_end;   ///< Current stage deadline.
+	ResumePoint m_from{};                      ///< Where the run starts.
+
+	std::string m_checkpoint_path;                           ///< Checkpoint file, empty for none.
+	int m_checkpoint_period_ms{};                            ///< Period of the checkpoints within a stage, 0 for boundaries only.
+	std::FILE* m_checkpoint{ nullptr };                      ///< Checkpoint file of the run, used by the executor thread only.
+	uint32_t m_checkpoint_sequence{};                        ///< Sequence of the next record.
+	std::chrono::steady_clock::time_point m_next_checkpoint; ///< Moment of the next periodic checkpoint.
+	bool m_restoring{ false };                               ///< Whether the run ramps back to a checkpoint, whose record stays the last one.
+	bool m_zp_reset{ false };                                ///< Whether the run reset "ZP".
+	uint16_t m_applied_current{};                            ///< Last current setpoint applied by the run.
+	uint16_t m_applied_voltage{};                            ///< Last voltage setpoint applied by the run.
+
+	/// @brief Body of the executor thread.
+	void run();
+
+	/**
+	 * @brief Waits until the deadline or until the scenario is stopped.
+	 * @return bool True if the deadline was reached, false if stopped.
+	 */
+	bool wait_until(std::chrono::steady_clock::time_point deadline);
+
+	/// @brief Same as wait_until(), writing the periodic checkpoints that fall before the deadline.
+	bool wait_checkpointed(std::chrono::steady_clock::time_point deadline);
+
+	/**
+	 * @brief Applies setpoints and remembers them for the checkpoints.
+	 * @return int Status code of PowerSupplyManager::set_current_voltage().
+	 */
+	int apply(uint16_t current, uint16_t voltage);
+
+	/**
+	 * @brief Appends the progress to the checkpoint file, if there is one.
+	 * @param state ScenarioState to record.
+	 */
+	void write_checkpoint(int state);
+
+	/// @brief Whether a run is starting or running. Caller holds `m_mutex`.
+	bool busy_locked() const { return m_status.state == SCENARIO_RUNNING || m_status.state == SCENARIO_STARTING; }
+
+	/**
+	 * @brief Attaches to the port of `m_from` if it has one, turns the supply on and starts the executor thread from `m_from`.
+	 *
+	 * Publishes SCENARIO_STARTING and releases `lock` for the Modbus commands, so the
+	 * status stays readable meanwhile. A stop() during the start turns the supply off again.
+	 *
+	 * @param lock Lock held on `m_mutex`, held again on return.
+	 * @return int Status code indicating success (STATUS_OK) or specific error.
+	 */
+	int launch(std::unique_lock<std::mutex>& lock);
+
+	/**
+	 * @brief Turns the supply off and publishes the final state.
+	 * @param state Final ScenarioState.
+	 * @param error Error code to report.
+	 */
+	void finish(int state, int error);
+
+public:
+	/**
+	 * @brief Ctor.
+	 * @param power_supply Device the scenarios are run on.
+	 */
+	explicit ScenarioExecutor(PowerSupplyManager& power_supply);
+
+	/// @brief Dtor. Stops the running scenario.
+	~ScenarioExecutor();
+
+	ScenarioExecutor(const ScenarioExecutor&) = delete;
+	ScenarioExecutor& operator=(const ScenarioExecutor&) = delete;
+
+	/**
+	 * @brief Loads the stage table, replacing the previous one.
+	 * @param stages Array of stages.
+	 * @param count Number of stages, from 1 to kscenario_max_stages.
+	 * @return int Status code indicating success (STATUS_OK) or specific error.
+	 */
+	int load(const ScenarioStage* stages, int count);
+
+	/**
+	 * @brief Turns the supply on and starts the loaded scenario on the executor thread.
+	 * @return int Status code indicating success (STATUS_OK) or specific error.
+	 */
+	int start();
+
+	/// @brief Stops the running scenario and turns the supply off. Waits for a start in progress and for the executor thread.
+	void stop();
+
+	/**
+	 * @brief Sets the checkpoint file of the next runs. start() truncates it, resume() continues it.
+	 * @param path Checkpoint file, null to stop checkpointing.
+	 * @param period_ms Period of the checkpoints within a stage, from kscenario_min_checkpoint_period_ms, or 0 for stage boundaries only.
+	 * @return int Status code indicating success (STATUS_OK), SC_ERROR_INVALID_CHECKPOINT_PERIOD or SC_ERROR_ALREADY_RUNNING.
+	 */
+	int set_checkpoint_file(const char* path, int period_ms);
+
+	/**
+	 * @brief Continues an interrupted run from the last checkpoint of the checkpoint file.
+	 *
+	 * Loads the stage table of the file and attaches to the port, line settings and slave the
+	 * run was started with, so a restarted host does not need to connect first. Then turns the
+	 * supply on, reads back the current setpoint it holds and ramps it to the checkpoint over
+	 * kscenario_resume_ramp_ms, no ramp if it already matches, and continues the stage where
+	 * it was. The stage clock stands still during that ramp.
+	 *
+	 * @return int Status code indicating success (STATUS_OK), SC_ERROR_NO_CHECKPOINT if the file holds no valid checkpoint or the run completed, SC_ERROR_CHECKPOINT_OPEN_FAILED, SC_ERROR_ALREADY_RUNNING or a power supply error.
+	 */
+	int resume();
+
+	/**
+	 * @brief Gets the scenario progress.
+	 * @param status Pointer to store the progress.
+	 */
+	void get_status(ScenarioStatus* status) const;
+};
+
+///< Global instance of the scenario executor bound to the global power supply.
+extern SCENARIOEXECUTOR_API ScenarioExecutor g_Scenario;
+
+extern "C" {
+	SCENARIOEXECUTOR_API int Scenario_Load(const ScenarioStage* stages, int count);
+
+	SCENARIOEXECUTOR_API int Scenario_Start();
+
+	SCENARIOEXECUTOR_API void Scenario_Stop();
+
+	SCENARIOEXECUTOR_API void Scenario_GetStatus(ScenarioStatus* status);
+
+	SCENARIOEXECUTOR_API int Scenario_SetCheckpointFile(const char* path, int period_ms);
+
+	SCENARIOEXECUTOR_API int Scenario_Resume();
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
+
+/**
+ * @class ShadowRegisters
+ * @brief Write-through cache of the last acknowledged holding register values of one device.
+ *
+ * A write whose value matches the cached one can be skipped. The cache is bound to
+ * a bus connection epoch: once the port is reopened, every cached value is dropped,
+ * since the device may have been power cycled in the meantime.
+ */
+class ShadowRegisters
+{
+private:
+	mutable std::mutex m_mutex;                   ///< Guards the cached values.
+	std::map<int, uint16_t> m_values;             ///< Last acknowledged value per register address.
+	unsigned long long m_epoch{};                 ///< Connection epoch the values belong to.
+	std::atomic<unsigned long long> m_skipped{};  ///< Number of writes skipped so far.
+
+	/// @brief Drops the values if they belong to another epoch. Caller holds `m_mutex`.
+	void sync_epoch_locked(unsigned long long epoch);
+
+public:
+	/**
+	 * @brief Finds the part of a register block that differs from the cached values.
+	 * @param epoch Current connection epoch of the bus.
+	 * @param addr Address of the first register of the block.
+	 * @param nb Number of registers in the block.
+	 * @param values Values to be written.
+	 * @param first Receives the offset of the first register to write.
+	 * @param count Receives the number of registers to write from `first` on.
+	 * @return bool False if the whole block already holds the values, the write is counted as skipped.
+	 */
+	bool dirty_range(unsigned long long epoch, int addr, int nb, const uint16_t* values, int& first, int& count);
+
+	/**
+	 * @brief Records values acknowledged by the device.
+	 * @param epoch Connection epoch the write was made in.
+	 * @param addr Address of the first written register.
+	 * @param nb Number of written registers.
+	 * @param values Written values.
+	 */
+	void store(unsigned long long epoch, int addr, int nb, const uint16_t* values);
+
+	/**
+	 * @brief Copies the cached values of a register block.
+	 * @param epoch Current connection epoch of the bus.
+	 * @param addr Address of the first register of the block.
+	 * @param nb Number of registers in the block.
+	 * @param values Receives the cached values, left as they are when the result is false.
+	 * @return bool True if every register of the block was acknowledged in this epoch.
+	 */
+	bool lookup(unsigned long long epoch, int addr, int nb, uint16_t* values) const;
+
+	/// @brief Forgets a block of registers, e.g. after a failed write with unknown outcome.
+	void invalidate(int addr, int nb = 1);
+
+	/// @brief Forgets every register.
+	void clear();
+
+	/// @brief Gets the number of writes skipped so far.
+	unsigned long long skipped() const { return m_skipped; }
+};
@@ -0,0 +1,149 @@
+#pragma once
+
+#ifdef THERMORESISTIVEEVAPORATOR_EXPORTS
+#define SHAREDTELEMETRY_API __declspec(dllexport)
+#else
+#define SHAREDTELEMETRY_API __declspec(dllimport)
+#endif
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+
+#include "framework.h"
+#include "Constants.h"
+#include "ModbusBus.h"
+
+/**
+ * @struct SharedTelemetryData
+ * @brief Live state of the global devices, as published in the shared block.
+ *
+ * Every field is the last value acknowledged by the device, -1 where nothing was seen yet.
+ * Only the global power supply and step motor publish, the instances created by handle do not.
+ */
+struct SharedTelemetryData
+{
+	long long updates;            ///< Writes of the block since it was started.
+	long long reading_time_us;    ///< Steady clock time of the last current and voltage read, same base as the acquisition samples.
+	int32_t current;              ///< Value of the current register (20).
+	int32_t voltage;              ///< Value of the voltage register (21).
+	int32_t reading_status;       ///< STATUS_OK or the error code of the last read of the readings.
+	int32_t current_setpoint;     ///< Last current setpoint written to register 18.
+	int32_t voltage_setpoint;     ///< Last voltage setpoint written to register 19.
+	int32_t power_coil;           ///< Last state written to the power coil (272).
+	int32_t workmode_coil;        ///< Last state written to the work mode coil (273).
+	int32_t motor_direction;      ///< Last acknowledged 512/513 pair: bit 0 forward, bit 1 reverse.
+	long long limits_time_us;     ///< Steady clock time of the last read of the limit switches.
+	int32_t forward_limit;        ///< Forward limit switch (514), 1 when hit.
+	int32_t reverse_limit;        ///< Reverse limit switch (515), 1 when hit.
+	LinkStatus power_supply_link; ///< Link of the power supply port, as of the last read of the readings.
+	LinkStatus step_motor_link;   ///< Link of the step motor port, as of the last read of the limit switches.
+};
+
+static_assert(sizeof(LinkStatus) == 24, "LinkStatus is part of the shared layout");
+static_assert(sizeof(SharedTelemetryData) == 112, "SharedTelemetryData is part of the shared layout");
+
+/**
+ * @struct SharedTelemetryBlock
+ * @brief Content of the shared section.
+ *
+ * `sequence` is odd while the publisher writes `data`. A reader copies `data` between two
+ * reads of an even, unchanged sequence, otherwise it tries again.
+ */
+struct SharedTelemetryBlock
+{
+	uint32_t magic;                 ///< kshared_telemetry_magic.
+	uint32_t version;               ///< kshared_telemetry_version.
+	uint32_t size;                  ///< sizeof(SharedTelemetryBlock).
+	uint32_t publisher_pid;         ///< Id of the process publishing the block.
+	std::atomic<uint32_t> sequence; ///< Seqlock counter, odd during a write.
+	uint32_t reserved;              ///< Keeps `data` 8-byte aligned.
+	SharedTelemetryData data;       ///< Live state.
+};
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "The sequence is part of the shared layout");
+static_assert(sizeof(SharedTelemetryBlock) == 136, "SharedTelemetryBlock is part of the shared layout");
+
+/**
+ * @class SharedTelemetry
+ * @brief Publishes the live state of the devices in a named shared-memory section.
+ *
+ * The managers update the block from the reads and writes they do anyway, so a reader never
+ * adds a frame to the serial line: any number of local processes (a logger, a SCADA bridge,
+ * a second UI) poll the state at memory speed. The acquisition loop keeps the readings fresh.
+ * Updates are a few stores when the block is started and a flag test when it is not.
+ */
+class SHAREDTELEMETRY_API SharedTelemetry
+{
+private:
+	std::mutex m_mutex;                       ///< Serializes the writers of the process and guards the mapping.
+	std::atomic<bool> m_active{ false };      ///< Whether the block is published, tested before taking the mutex.
+	HANDLE m_mapping{ nullptr };              ///< Named section.
+	SharedTelemetryBlock* m_block{ nullptr }; ///< View of the section.
+
+public:
+	SharedTelemetry() = default;
+
+	/// @brief Dtor. Stops publishing.
+	~SharedTelemetry();
+
+	SharedTelemetry(const SharedTelemetry&) = delete;
+	SharedTelemetry& operator=(const SharedTelemetry&) = delete;
+
+	/**
+	 * @brief Creates the section and starts publishing, or restarts under another name.
+	 * @param name Name of the section, null for kshared_telemetry_default_name. A name with the Global\ prefix reaches readers of other sessions but needs the SeCreateGlobalPrivilege.
+	 * @return int Status code indicating success (STATUS_OK) or TM_ERROR_SHARED_OPEN_FAILED, e.g. if another process publishes under that name.
+	 */
+	int start(const char* name);
+
+	/// @brief Stops publishing and closes the section. The readers that still map it see the last state.
+	void stop();
+
+	/// @brief Whether the block is published.
+	bool active() const { return m_active; }
+
+	/**
+	 * @brief Writes to the block under the seqlock.
+	 * @param f Callable taking SharedTelemetryData& and setting the fields it knows. Not called when the block is not published.
+	 */
+	template <typename F>
+	void update(F f)
+	{
+		if (!m_active)
+			return;
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_block)
+			return;
+
+		// 1. Odd sequence first, so a reader never takes a half-written block for a whole one.
+		const uint32_t sequence{ m_block->sequence.load(std::memory_order_relaxed) };
+		m_block->sequence.store(sequence + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+
+		// 2. Writing in place, then publishing with the even sequence.
+		f(m_block->data);
+		++m_block->data.updates;
+		m_block->sequence.store(sequence + 2, std::memory_order_release);
+	}
+
+	/**
+	 * @brief Copies a consistent state out of a published block.
+	 * @param name Name of the section, null for kshared_telemetry_default_name.
+	 * @param out Pointer to store the state.
+	 * @return int Status code indicating success (STATUS_OK), TM_ERROR_SHARED_OPEN_FAILED if no block of this layout is published, or TM_ERROR_SHARED_BUSY if every try overlapped a write.
+	 */
+	static int read(const char* name, SharedTelemetryData* out);
+};
+
+///< Global instance of the shared block, written by the global power supply and step motor.
+extern SHAREDTELEMETRY_API SharedTelemetry g_SharedTelemetry;
+
+extern "C" {
+	SHAREDTELEMETRY_API int SharedTelemetry_Start(const char* name);
+
+	SHAREDTELEMETRY_API void SharedTelemetry_Stop();
+
+	SHAREDTELEMETRY_API int SharedTelemetry_Read(const char* name, SharedTelemetryData* out);
+}
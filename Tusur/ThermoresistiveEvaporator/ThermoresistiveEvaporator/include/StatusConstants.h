@@ -2,6 +2,15 @@
 
 #define STATUS_OK 0
 
+// BUS stands for the shared RS-485 line. Opening codes have the same values as the PS/SM ones.
+#define BUS_ERROR_INIT_CONNECTION_FAILED 1
+#define BUS_ERROR_CONNECT_FAILED 3
+#define BUS_ERROR_SETTINGS_MISMATCH 50
+#define BUS_ERROR_INVALID_TIMEOUT_POLICY 51
+#define BUS_ERROR_OFFLINE 52
+#define BUS_ERROR_INVALID_LINE_SETTINGS 53
+#define BUS_ERROR_PROBE_FAILED 54
+
 // PS stands for "Power Supply".
 #define PS_ERROR_INIT_CONNECTION_FAILED 1
 #define PS_ERROR_SET_SLAVE_FAILED 2
@@ -16,8 +25,12 @@
 #define PS_ERROR_POWER_SUPPLY_TURN_OFF_FAILED 11
 #define PS_ERROR_READ_CURRENT -1
 #define PS_ERROR_READ_VOLTAGE -2
+#define PS_ERROR_READ_TELEMETRY -3
 #define PS_ERROR_RESET_ZP_FAILED 12
 #define PS_ERROR_UNSUPPORTED_TIMER_VALUE 13
+#define PS_ERROR_UNSUPPORTED_ACQUISITION_INTERVAL 14
+#define PS_ERROR_INVALID_RAMP 15
+#define PS_ERROR_READ_SETPOINTS 16
 
 // SM stands for "Step motor"
 #define SM_ERROR_RW_HOLDING_REGISTER -1
@@ -29,3 +42,46 @@
 #define SM_ERROR_SET_512_REG_TO_0 6
 #define SM_ERROR_SET_513_REG_TO_0 7
 #define SM_ERROR_SHUTTER_ALREADY_CLOSED 8
+#define SM_ERROR_UNSUPPORTED_WATCH_INTERVAL 9
+
+// SC stands for "Scenario". Codes start at 100 to not clash with the PS codes passed through by the executor.
+#define SC_ERROR_INVALID_STAGES 100
+#define SC_ERROR_NOT_LOADED 101
+#define SC_ERROR_ALREADY_RUNNING 102
+#define SC_ERROR_INVALID_CHECKPOINT_PERIOD 103
+#define SC_ERROR_CHECKPOINT_OPEN_FAILED 104
+#define SC_ERROR_NO_CHECKPOINT 105
+
+// DG stands for "Diagnostics".
+#define DG_ERROR_TRACE_OPEN_FAILED 110
+
+// DEV stands for "Device batch", the device handles and the device groups.
+#define DEV_ERROR_INVALID_BATCH 120
+#define DEV_ERROR_BATCH_OP_FAILED 121
+#define DEV_ERROR_BATCH_SKIPPED 122
+#define DEV_ERROR_INVALID_HANDLE 123
+#define DEV_ERROR_TOO_MANY_DEVICES 124
+#define DEV_ERROR_INVALID_GROUP 125
+#define DEV_ERROR_GROUP_OP_FAILED 126
+#define DEV_ERROR_GROUP_START_FAILED 127
+
+// TM stands for "Telemetry".
+#define TM_ERROR_RECORDING_OPEN_FAILED 130
+#define TM_ERROR_SHARED_OPEN_FAILED 131
+#define TM_ERROR_SHARED_BUSY 132
+
+// RG stands for "Regulator".
+#define RG_ERROR_INVALID_CONFIG 140
+#define RG_ERROR_NOT_CONFIGURED 141
+#define RG_ERROR_ALREADY_RUNNING 142
+
+// SIM stands for "Simulator".
+#define SIM_ERROR_INVALID_CONFIG 150
+
+// WD stands for "Watchdog".
+#define WD_ERROR_INVALID_CONFIG 160
+#define WD_ERROR_NOT_ARMED 161
+
+// AS stands for "Asynchronous commands".
+#define AS_ERROR_QUEUE_FULL 170
+#define AS_ERROR_CANCELLED 171
@@ -1,13 +1,34 @@
+#pragma once
+
 #ifdef THERMORESISTIVEEVAPORATOR_EXPORTS
 #define STEPMOTORMANAGER_API __declspec(dllexport)
 #else
 #define STEPMOTORMANAGER_API __declspec(dllimport)
 #endif
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
 
 #include "modbus.h"
 #include "modbus_dev.h"
+#include "Constants.h"
+#include "DeviceRegistry.h"
+#include "ModbusBus.h"
+#include "RegisterMap.h"
+#include "ShadowRegisters.h"
+
+/**
+ * @brief Callback fired by the limit-switch watcher when the state of the switches changes.
+ * @param forward 1 if the forward limit switch (register 514) is hit, 0 otherwise.
+ * @param reverse 1 if the reverse limit switch (register 515) is hit, 0 otherwise.
+ * @note Called on the watcher thread.
+ */
+typedef void (*LimitSwitchCallback)(int forward, int reverse);
 
 /**
  * @class StepMotorManager
@@ -16,42 +37,90 @@
  * This class provides methods to connect to a step motor, read and write
  * registers, and control the step motor's operations such as opening, closing,
  * and stopping the motor.
+ *
+ * All methods are thread-safe. Frames are serialized by the bus, and each
+ * multi-frame command holds the device command lock.
  */
 class STEPMOTORMANAGER_API StepMotorManager : public modbus_dev
 {
 private:
-	std::unique_ptr<modbus_t, void(*)(modbus_t*)> m_ctx; ///< Unique pointer to Modbus context with custom deleter.
+	std::mutex m_bus_mutex;           ///< Guards the bus handle, the port name and the line settings.
+	std::string m_port;               ///< Serial port opened on first use.
+	SerialSettings m_line{ sm_constants::kbaud_rate, 'N', 8, 1 }; ///< Line settings of the port.
+	std::atomic<int> m_slave{ sm_constants::kslave_id }; ///< Modbus slave ID of the step motor.
+	std::shared_ptr<ModbusBus> m_bus; ///< Bus the step motor is a slave on, shared with other devices on the port.
+	TimeoutPolicy m_timeouts{ kdefault_timeout_policy }; ///< Timeouts of this device, applied to every bus it is attached to.
+	std::mutex m_command_mutex;       ///< Keeps the 512/513 write pairs of concurrent callers from interleaving.
+	ShadowRegisters m_shadow;         ///< Last acknowledged values of the 512/513 registers.
+
+	std::thread m_watch_thread;                         ///< Background limit-switch polling thread.
+	std::atomic<bool> m_watch_running{ false };         ///< Whether the watcher thread should keep polling.
+	std::atomic<int> m_watch_interval_ms{ kdefault_limit_watch_interval_ms }; ///< Polling period.
+	std::atomic<bool> m_watch_auto_stop{ false };       ///< Whether the watcher stops the motor when a limit is hit.
+	std::atomic<LimitSwitchCallback> m_limit_callback{ nullptr }; ///< Callback fired on limit-switch changes.
+	std::mutex m_watch_mutex;                           ///< Guards start/stop of the watcher thread.
+	std::mutex m_watch_wait_mutex;                      ///< Mutex for the watcher condition variable.
+	std::condition_variable m_watch_cv;                 ///< Wakes the watcher thread on stop.
+
+	std::mutex m_limit_mutex;                           ///< Guards the last limit-switch state and the hit counter.
+	std::condition_variable m_limit_cv;                 ///< Wakes wait_for_limit() callers when a limit is hit.
+	int m_limit_state{};                                ///< Last state seen by the watcher: bit 0 forward, bit 1 reverse.
+	std::atomic<int> m_direction{};                     ///< Last acknowledged 512/513 pair: bit 0 forward, bit 1 reverse.
+	unsigned long long m_limit_hits{};                  ///< Number of limit hits seen by the watcher.
 
 	/**
-	 * @brief Custom deleter for Modbus context.
-	 *		  Closes and frees the Modbus context if it is not null.
-	 * @param m Pointer to Modbus context.
+	 * @brief Reads both limit-switch registers (514 and 515) in one block.
+	 * @param forward Receives 1 if the forward limit is hit, 0 otherwise.
+	 * @param reverse Receives 1 if the reverse limit is hit, 0 otherwise.
+	 * @return int Status code indicating success (STATUS_OK) or specific error.
 	 */
-	static void ModbusDeleter(modbus_t* m) {
-		if (m) {
-			modbus_close(m);
-			modbus_free(m);
-		}
-	}
+	int read_limit_switches(int& forward, int& reverse);
 
 	/**
-	 * @brief Reads a holding register from the step motor.
-	 * @param addr The address of the holding register to read.
-	 * @return int The value of the register, or an error code.
+	 * @brief Publishes the result of a read of the limit switches in the shared block.
+	 * @param ok Whether the read succeeded, a failed one only updates the link.
+	 * @param registers Values of registers 514 and 515.
+	 */
+	void publish_limits(bool ok, const uint16_t* registers);
+
+	/// @brief Whether this instance writes the shared block, only the global one does.
+	bool publishes_shared_telemetry() const;
+
+	/// @brief Body of the watcher thread: polls registers 514-515 and reports their edges.
+	void watch_loop();
+
+	/**
+	 * @brief Writes the 512/513 pair of the step motor, in one frame when the register map allows it.
+	 * @param forward Value of the 512 register.
+	 * @param reverse Value of the 513 register.
+	 * @param priority Bus priority of the write, one of BusPriority.
+	 * @param force Write even if the shadow cache says the registers already hold the values.
+	 * @param written Receives the number of leading registers known to hold their values.
+	 * @return int Status code indicating success (STATUS_OK) or specific error.
 	 */
-	int read_holding_register(int addr);
+	int write_direction(uint16_t forward, uint16_t reverse, int priority, bool force, int& written);
 
 	/**
-	 * @brief Writes a value to a register of the step motor.
-	 * @param addr The address of the register to write to.
-	 * @param val The value to write to the register.
+	 * @brief Gets the bus of `m_port` and opens it if it is not open yet.
+	 * @param bus Receives the bus.
 	 * @return int Status code indicating success (STATUS_OK) or specific error.
 	 */
-	int write_register(int addr, uint16_t val);
+	int ensure_connected(std::shared_ptr<ModbusBus>& bus);
+
+	/**
+	 * @brief Stores the timeout policy and applies it to the current bus. Caller holds `m_bus_mutex`.
+	 * @param policy The policy.
+	 * @return int Status code indicating success (STATUS_OK) or BUS_ERROR_INVALID_TIMEOUT_POLICY.
+	 */
+	int store_timeout_policy_locked(const TimeoutPolicy& policy);
 
 public:
 	/**
 	 * @brief Constructor that initializes the step motor manager with a given port.
+	 *
+	 * Only records the port: it is opened on the first command or on an explicit connect(),
+	 * so constructing the global instance during DLL load does not touch the hardware.
+	 *
 	 * @param port The serial port to connect to.
 	 */
 	StepMotorManager(const char* port);
@@ -62,14 +131,90 @@ public:
 	/**
 	 * @brief Connects to the step motor via the specified port.
 	 *
-	 * Initializes the Modbus RTU connection, sets the Modbus slave ID,
-	 * and establishes the connection.
+	 * Attaches the step motor to the bus of the port and establishes the
+	 * connection. Returns immediately if the same port is already open and healthy.
 	 *
-	 * @param port The serial port to connect to.
+	 * @param port The serial port to connect to, null to use the recorded one.
 	 * @return int Status code indicating success (STATUS_OK) or specific error.
 	 */
 	int connect(const char* port);
 
+	/**
+	 * @brief Connects to the step motor with explicit line settings and slave ID.
+	 *
+	 * Detaches from the current bus and attaches to the bus of `port` with the new settings.
+	 * Another device already on that port must use the same settings. With a baud rate of 0,
+	 * the fastest rate the step motor answers reliably at is probed first, see ModbusBus::probe_baud().
+	 *
+	 * @param port The serial port to connect to.
+	 * @param line Line settings, baud rate 0 to probe it.
+	 * @param slave Modbus slave ID, from 1 to 247.
+	 * @return int Status code indicating success (STATUS_OK), BUS_ERROR_INVALID_LINE_SETTINGS, BUS_ERROR_PROBE_FAILED or specific error.
+	 */
+	int connect_ex(const char* port, const SerialSettings& line, int slave);
+
+	/// @brief Gets the baud rate of the port, the probed one after a probing connect_ex().
+	int baud_rate();
+
+	/**
+	 * @brief Closes and reopens the port unconditionally. Used to recover a broken link.
+	 * @return int Status code indicating success (STATUS_OK) or specific error.
+	 */
+	int reconnect();
+
+	/**
+	 * @brief Gets the duration of the last port opening.
+	 * @return long long Microseconds, or -1 if the port has never been opened.
+	 */
+	long long connect_latency_us();
+
+	/**
+	 * @brief Gets the state of the link supervisor of the bus.
+	 * @param status Pointer to store the state, LINK_DISCONNECTED if no bus is attached yet.
+	 */
+	void link_status(LinkStatus* status);
+
+	/**
+	 * @brief Sets the timeouts of the transactions with this device.
+	 *
+	 * In adaptive mode the response timeout follows the measured round trips
+	 * (mean plus four deviations), bounded by `response_timeout_ms` from above,
+	 * so the common case fails fast while a slow but healthy device still works.
+	 *
+	 * @param response_timeout_ms Response timeout, the upper bound in adaptive mode.
+	 * @param byte_timeout_ms Timeout between two bytes of a response, 0 disables it.
+	 * @param adaptive Whether to derive the response timeout from the measured round trips.
+	 * @return int Status code indicating success (STATUS_OK) or BUS_ERROR_INVALID_TIMEOUT_POLICY.
+	 */
+	int set_timeouts(int response_timeout_ms, int byte_timeout_ms, bool adaptive);
+
+	/**
+	 * @brief Sets the retries of the transactions that timed out or came back corrupted.
+	 * @param max_retries Number of retries, at most kmax_retries.
+	 * @param retry_backoff_ms Pause before the first retry, doubled for every next one, at most kmax_retry_backoff_ms.
+	 * @return int Status code indicating success (STATUS_OK) or BUS_ERROR_INVALID_TIMEOUT_POLICY.
+	 */
+	int set_retry_policy(int max_retries, int retry_backoff_ms);
+
+	/**
+	 * @brief Gets the response timeout the next transaction will use.
+	 * @return long long Microseconds.
+	 */
+	long long response_timeout_us();
+
+	/**
+	 * @brief Runs a batch of operations on this device as one bus request.
+	 *
+	 * Holds the device command lock, so the batch does not interleave with other
+	 * commands of this device. Registers written by the batch are dropped from the shadow cache.
+	 *
+	 * @param ops Operations, validated by the caller.
+	 * @param n Number of operations.
+	 * @param out Results, ops not reached are left untouched.
+	 * @return int Status code indicating success (STATUS_OK) or specific error.
+	 */
+	int execute_batch(const BatchOp* ops, int n, BatchResult* out);
+
 	/**
 	 * @brief Opens the step motor.
 	 *		  Writes to the necessary registers to open the step motor.
@@ -91,11 +236,16 @@ public:
 	 */
 	int stop();
 
+	/**
+	 * @brief Drops the cached 512/513 values, the next writes go to the device unconditionally.
+	 */
+	void invalidate_shadow() { m_shadow.clear(); }
+
 	/**
 	 * @brief Checks if the forward button is pressed.
 	 *
-	 * Reads the holding register associated with the forward button and
-	 * checks if it is pressed.
+	 * Returns the state last seen by the limit-switch watcher if it is running,
+	 * otherwise reads the limit-switch registers.
 	 *
 	 * @return int 1 if the forward button is pressed, 0 otherwise.
 	 */
@@ -104,27 +254,134 @@ public:
 	/**
 	 * @brief Checks if the reverse button is pressed.
 	 *
-	 * Reads the holding register associated with the reverse button and
-	 * checks if it is pressed.
+	 * Returns the state last seen by the limit-switch watcher if it is running,
+	 * otherwise reads the limit-switch registers.
 	 *
 	 * @return int 1 if the reverse button is pressed, 0 otherwise.
 	 */
 	int is_reverse_button_pressed();
+
+	/**
+	 * @brief Starts the limit-switch watcher thread.
+	 *
+	 * The watcher reads registers 514-515 as one block every `interval_ms`. On every
+	 * change it fires the registered callback, and when a limit becomes hit it wakes
+	 * wait_for_limit() callers. With `auto_stop` the motor is stopped by the watcher
+	 * right away, before the callback. Calling it while running only updates the settings.
+	 *
+	 * @param interval_ms Polling period in milliseconds.
+	 * @param auto_stop Whether to stop the motor when a limit is hit.
+	 * @return int Status code indicating success (STATUS_OK) or SM_ERROR_UNSUPPORTED_WATCH_INTERVAL.
+	 */
+	int start_limit_watch(int interval_ms, bool auto_stop);
+
+	/// @brief Stops the limit-switch watcher thread and waits for it to finish.
+	void stop_limit_watch();
+
+	/**
+	 * @brief Registers the callback fired on limit-switch changes.
+	 * @param callback The callback, null to unregister.
+	 */
+	void set_limit_callback(LimitSwitchCallback callback) { m_limit_callback = callback; }
+
+	/**
+	 * @brief Waits until the watcher sees a limit being hit.
+	 * @param timeout_ms Maximum time to wait in milliseconds.
+	 * @return int State of the switches at the hit (bit 0 forward, bit 1 reverse), or 0 on timeout.
+	 */
+	int wait_for_limit(int timeout_ms);
+
+	/**
+	 * @brief Gets the state of the motor known without a bus round trip, for the telemetry recording.
+	 * @return int Bit 0 forward and bit 1 reverse as last written to 512/513, bits 2 and 3 the forward
+	 *         and reverse limits as last seen by the watcher (0 while it is not running).
+	 */
+	int motor_state();
 };
 
 ///< Global instance of the extern variable with defaulted value of COM-port.
 extern STEPMOTORMANAGER_API StepMotorManager g_StepMotor;
 
+///< Global registry of the step motors created by handle, independent of `g_StepMotor`.
+extern STEPMOTORMANAGER_API DeviceRegistry<StepMotorManager> g_StepMotors;
+
 extern "C" {
-	STEPMOTORMANAGER_API int StepMotor_Connect(const char* port) { return g_StepMotor.connect(port); }
+	STEPMOTORMANAGER_API int StepMotor_Connect(const char* port);
+
+	STEPMOTORMANAGER_API int StepMotor_ConnectEx(const char* port, int baud, char parity, int data_bits, int stop_bits, int slave);
+
+	STEPMOTORMANAGER_API int StepMotor_GetBaudRate();
+
+	STEPMOTORMANAGER_API int StepMotor_Reconnect();
+
+	STEPMOTORMANAGER_API long long StepMotor_GetConnectLatency();
+
+	STEPMOTORMANAGER_API void StepMotor_GetLinkStatus(LinkStatus* status);
+
+	STEPMOTORMANAGER_API int StepMotor_SetTimeouts(int response_timeout_ms, int byte_timeout_ms, int adaptive);
+
+	STEPMOTORMANAGER_API int StepMotor_SetRetryPolicy(int max_retries, int retry_backoff_ms);
+
+	STEPMOTORMANAGER_API long long StepMotor_GetResponseTimeout();
+
+	STEPMOTORMANAGER_API int StepMotor_Forward();
+
+	STEPMOTORMANAGER_API int StepMotor_Reverse();
+
+	STEPMOTORMANAGER_API int StepMotor_Stop();
+
+	STEPMOTORMANAGER_API void StepMotor_InvalidateShadow();
+
+	STEPMOTORMANAGER_API int StepMotor_IsForwardButtonPressed();
+
+	STEPMOTORMANAGER_API int StepMotor_IsReverseButtonPressed();
+
+	STEPMOTORMANAGER_API int StepMotor_StartLimitWatch(int interval_ms, int auto_stop);
+
+	STEPMOTORMANAGER_API void StepMotor_StopLimitWatch();
+
+	STEPMOTORMANAGER_API void StepMotor_SetLimitCallback(LimitSwitchCallback callback);
+
+	STEPMOTORMANAGER_API int StepMotor_WaitForLimit(int timeout_ms);
+
+	/**
+	 * @brief Creates a step motor instance with its own connection and threads, see DeviceRegistry::create().
+	 *
+	 * The ...H exports below act on the instance like the exports without the suffix act on `g_StepMotor`,
+	 * and return DEV_ERROR_INVALID_HANDLE for an unknown handle.
+	 *
+	 * @param config Port, line settings and slave ID, baud rate 0 to probe it.
+	 * @param handle Receives the handle of the instance.
+	 * @return int Status code indicating success (STATUS_OK) or specific error.
+	 */
+	STEPMOTORMANAGER_API int StepMotor_Create(const DeviceConfig* config, int* handle);
+
+	/**
+	 * @brief Destroys a step motor instance, stopping its watcher. The motor is left in its current state.
+	 * @note Must not be called from a callback of the same instance.
+	 */
+	STEPMOTORMANAGER_API int StepMotor_Destroy(int handle);
+
+	STEPMOTORMANAGER_API int StepMotor_ReconnectH(int handle);
+
+	STEPMOTORMANAGER_API int StepMotor_GetLinkStatusH(int handle, LinkStatus* status);
+
+	STEPMOTORMANAGER_API int StepMotor_ForwardH(int handle);
+
+	STEPMOTORMANAGER_API int StepMotor_ReverseH(int handle);
+
+	STEPMOTORMANAGER_API int StepMotor_StopH(int handle);
 
-	STEPMOTORMANAGER_API int StepMotor_Forward() { return g_StepMotor.open(); }
+	/// @brief Returns 1 if the forward limit is hit, 0 otherwise or for an unknown handle.
+	STEPMOTORMANAGER_API int StepMotor_IsForwardButtonPressedH(int handle);
 
-	STEPMOTORMANAGER_API int StepMotor_Reverse() { return g_StepMotor.close(); }
+	/// @brief Returns 1 if the reverse limit is hit, 0 otherwise or for an unknown handle.
+	STEPMOTORMANAGER_API int StepMotor_IsReverseButtonPressedH(int handle);
 
-	STEPMOTORMANAGER_API int StepMotor_Stop() { return g_StepMotor.stop(); }
+	STEPMOTORMANAGER_API int StepMotor_StartLimitWatchH(int handle, int interval_ms, int auto_stop);
 
-	STEPMOTORMANAGER_API int StepMotor_IsForwardButtonPressed() { return g_StepMotor.is_forward_button_pressed(); }
+	STEPMOTORMANAGER_API int StepMotor_StopLimitWatchH(int handle);
 
-	STEPMOTORMANAGER_API int StepMotor_IsReverseButtonPressed() { return g_StepMotor.is_reverse_button_pressed(); }
+	/// @brief Returns the state of the switches at the hit, 0 on timeout or for an unknown handle.
+	STEPMOTORMANAGER_API int StepMotor_WaitForLimitH(int handle, int timeout_ms);
 }
@@ -0,0 +1,179 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "framework.h"
+#include "Constants.h"
+
+/**
+ * @struct TelemetryRecord
+ * @brief One sample of a recording, fixed size so record `i` sits at a computable offset.
+ */
+struct TelemetryRecord
+{
+	long long timestamp_us;   ///< Steady clock time of the read, same base as the acquisition samples.
+	int32_t current;          ///< Value of the current register (20).
+	int32_t voltage;          ///< Value of the voltage register (21).
+	int32_t current_setpoint; ///< Last current setpoint written to register 18.
+	int32_t voltage_setpoint; ///< Last voltage setpoint written to register 19.
+	int32_t motor_state;      ///< Step motor state, see StepMotorManager::motor_state(). -1 for supplies created by handle, they have no motor.
+	int32_t status;           ///< STATUS_OK or the error code of the failed read.
+};
+
+static_assert(sizeof(TelemetryRecord) == 32, "TelemetryRecord is part of the file layout");
+
+/**
+ * @struct TelemetryChunkIndex
+ * @brief Time range of one chunk, lets a reader seek by time without touching the records.
+ */
+struct TelemetryChunkIndex
+{
+	long long first_timestamp_us; ///< Timestamp of the first record of the chunk.
+	long long last_timestamp_us;  ///< Timestamp of the last record of the chunk.
+};
+
+/**
+ * @struct TelemetryFileHeader
+ * @brief Start of a recording file.
+ *
+ * The file is the header region of ktelemetry_header_size bytes followed by chunks
+ * of ktelemetry_chunk_records records. Record `i` is at
+ * `header_size + i * record_size`. A file left by a crash is valid up to `record_count`.
+ */
+struct TelemetryFileHeader
+{
+	uint32_t magic;         ///< ktelemetry_magic.
+	uint32_t version;       ///< ktelemetry_version.
+	uint32_t header_size;   ///< Offset of the first record.
+	uint32_t record_size;   ///< sizeof(TelemetryRecord).
+	uint32_t chunk_records; ///< Records per chunk.
+	uint32_t chunk_count;   ///< Chunks holding at least one record.
+	uint64_t record_count;  ///< Records written, updated after every record.
+	uint32_t closed;        ///< 1 once the recording was stopped and the file trimmed.
+	uint32_t reserved;      ///< Keeps the index 8-byte aligned.
+	TelemetryChunkIndex chunks[ktelemetry_max_chunks]; ///< Time range of every chunk.
+};
+
+static_assert(sizeof(TelemetryFileHeader) <= ktelemetry_header_size, "The chunk index must fit the header region");
+
+/**
+ * @struct TelemetryEnvelopePoint
+ * @brief Min/max envelope of consecutive records, one point of a plot.
+ */
+struct TelemetryEnvelopePoint
+{
+	long long first_timestamp_us; ///< Timestamp of the first record covered.
+	long long last_timestamp_us;  ///< Timestamp of the last record covered.
+	int32_t min_current;          ///< Lowest current reading.
+	int32_t max_current;          ///< Highest current reading.
+	int32_t min_voltage;          ///< Lowest voltage reading.
+	int32_t max_voltage;          ///< Highest voltage reading.
+	int32_t samples;              ///< Number of records covered, 1 for a raw record.
+	int32_t reserved;             ///< Keeps the point 8-byte aligned.
+};
+
+/**
+ * @class TelemetryRecorder
+ * @brief Appends telemetry records to a memory-mapped, chunked binary file.
+ *
+ * Records are filled in place in the mapped chunk, there is no intermediate buffer
+ * and no system call per record. The file grows one chunk at a time. When the
+ * last indexed chunk is full, new records are dropped and counted.
+ *
+ * Next to the file, a min/max pyramid is kept in memory: a bucket of level 0 covers
+ * ktelemetry_pyramid_fanout records, a bucket of level `l` covers fanout buckets of
+ * level `l - 1`. It costs about 1/12 of the file size and outlives the recording
+ * until the next one starts, so query() answers in time bounded by the points asked for.
+ */
+class TelemetryRecorder
+{
+private:
+	mutable std::mutex m_mutex;             ///< Guards the file and the views.
+	HANDLE m_file{ INVALID_HANDLE_VALUE };  ///< Recording file, invalid when not recording.
+	TelemetryFileHeader* m_header{};        ///< View of the header region.
+	TelemetryRecord* m_chunk{};             ///< View of the chunk being filled.
+	unsigned m_chunk_used{};                ///< Records in the chunk being filled.
+	unsigned long long m_dropped{};         ///< Records lost because the index was full.
+	std::string m_path;                     ///< File of the last recording, the raw level of the queries.
+	long long m_records{};                  ///< Records of the last recording.
+	std::vector<std::vector<TelemetryEnvelopePoint>> m_levels; ///< Envelope pyramid of the last recording, finest level first.
+
+	/// @brief Adds a committed record to every level of the pyramid.
+	void add_to_pyramid_locked(const TelemetryRecord& record);
+
+	/**
+	 * @brief Grows the file to hold chunk `index` and maps it, replacing the previous chunk view.
+	 * @param index Chunk index.
+	 * @return bool True if the chunk is mapped.
+	 */
+	bool map_chunk_locked(unsigned index);
+
+	/// @brief Gets the slot of the next record, mapping a new chunk if needed. Null if the record can not be stored.
+	TelemetryRecord* next_slot_locked();
+
+	/// @brief Publishes the record just filled in the slot returned by next_slot_locked().
+	void commit_locked(const TelemetryRecord& record);
+
+	/// @brief Unmaps the views, trims the unused tail of the last chunk and closes the file.
+	void close_locked();
+
+public:
+	/// @brief Dtor. Stops the recording.
+	~TelemetryRecorder();
+
+	/**
+	 * @brief Starts a new recording, replacing the current one.
+	 * @param path Path of the file, overwritten.
+	 * @return int Status code indicating success (STATUS_OK) or TM_ERROR_RECORDING_OPEN_FAILED.
+	 */
+	int start(const char* path);
+
+	/// @brief Stops the recording and closes the file.
+	void stop();
+
+	/**
+	 * @brief Appends one record, filled in place by `fill`.
+	 * @tparam Fill Callable taking `TelemetryRecord&`.
+	 * @param fill Fills the record. Called under the recorder lock, must not block.
+	 * @return bool True if the record was stored, false if not recording or the file is full.
+	 */
+	template <typename Fill>
+	bool append(Fill&& fill)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		TelemetryRecord* slot{ next_slot_locked() };
+		if (!slot)
+			return false;
+
+		fill(*slot);
+		commit_locked(*slot);
+		return true;
+	}
+
+	/// @brief Whether a recording is open.
+	bool is_recording() const;
+
+	/// @brief Number of records in the current recording, 0 when not recording.
+	long long record_count() const;
+
+	/// @brief Number of records dropped by the current recording because the file was full.
+	long long dropped_count() const;
+
+	/**
+	 * @brief Gets the envelope of the last recording between two instants, at the finest resolution that fits.
+	 *
+	 * Raw records are returned if there are at most `max_points` of them in the range,
+	 * otherwise the buckets of the finest pyramid level that fits. Works while recording
+	 * and after the recording was stopped.
+	 *
+	 * @param t0_us Start of the range, steady clock microseconds like the record timestamps.
+	 * @param t1_us End of the range, inclusive.
+	 * @param max_points Capacity of `out`.
+	 * @param out Receives the points, oldest first.
+	 * @return int Number of points written, 0 if the range holds no records.
+	 */
+	int query(long long t0_us, long long t1_us, int max_points, TelemetryEnvelopePoint* out) const;
+};
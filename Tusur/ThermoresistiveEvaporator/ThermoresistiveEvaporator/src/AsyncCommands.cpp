@@ -0,0 +1,207 @@
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "framework.h"
+#include "AsyncCommands.h"
+#include "PowerSupplyManager.h"
+#include "StepMotorManager.h"
+#include "StatusConstants.h"
+
+AsyncExecutor g_Async;
+
+namespace
+{
+	/// @brief Queues `f` on an instance created by handle, keeping the instance alive until it ran.
+	template <typename Device, typename F>
+	int submit_to(DeviceRegistry<Device>& registry, int handle, F f, AsyncCallback callback, void* ctx)
+	{
+		auto device{ registry.get(handle) };
+		if (!device)
+			return DEV_ERROR_INVALID_HANDLE;
+
+		const void* key{ device.get() };
+		return g_Async.submit(key, [device, f] { return f(*device); }, callback, ctx);
+	}
+}
+
+AsyncExecutor::~AsyncExecutor()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_shutdown = true;
+		m_ready.clear();
+		for (auto& lane : m_lanes)
+			lane.second.requests.clear();
+	}
+	m_cv.notify_all();
+
+	for (auto& worker : m_workers)
+		if (worker.joinable())
+			worker.join();
+}
+
+int AsyncExecutor::submit(const void* device, std::function<int()> command, AsyncCallback callback, void* ctx)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_shutdown || m_stats.pending + m_stats.running >= kasync_max_pending)
+			return AS_ERROR_QUEUE_FULL;
+
+		// 1. Queuing behind the commands of the same device, the lane becomes ready if it was idle.
+		auto& lane{ m_lanes[device] };
+		lane.requests.push_back(Request{ std::move(command), callback, ctx });
+		if (!lane.running && lane.requests.size() == 1)
+			m_ready.push_back(device);
+		++m_stats.pending;
+		++m_stats.submitted;
+
+		// 2. Starting the I/O threads with the first command.
+		while (m_workers.size() < static_cast<std::size_t>(kasync_workers))
+			m_workers.emplace_back(&AsyncExecutor::worker_loop, this);
+	}
+	m_cv.notify_one();
+
+	return STATUS_OK;
+}
+
+int AsyncExecutor::cancel_pending()
+{
+	std::vector<Request> cancelled;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (auto it{ m_lanes.begin() }; it != m_lanes.end();)
+		{
+			for (auto& request : it->second.requests)
+				cancelled.push_back(std::move(request));
+			it->second.requests.clear();
+
+			// A lane with a running command is removed by its I/O thread.
+			it = it->second.running ? std::next(it) : m_lanes.erase(it);
+		}
+		m_ready.clear();
+		m_stats.pending = 0;
+		m_stats.cancelled += static_cast<long long>(cancelled.size());
+	}
+
+	// Calling back outside the lock, a callback may queue the next command.
+	for (auto& request : cancelled)
+		if (request.callback)
+			request.callback(AS_ERROR_CANCELLED, request.ctx);
+
+	return static_cast<int>(cancelled.size());
+}
+
+void AsyncExecutor::stats(AsyncStats* stats)
+{
+	if (!stats)
+		return;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	*stats = m_stats;
+}
+
+void AsyncExecutor::worker_loop()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (true)
+	{
+		m_cv.wait(lock, [this] { return m_shutdown || !m_ready.empty(); });
+		if (m_shutdown)
+			break;
+
+		// 1. Taking the oldest command of the oldest ready lane, the lane stays busy until it is done.
+		const void* device{ m_ready.front() };
+		m_ready.pop_front();
+		auto lane{ m_lanes.find(device) };
+		Request request{ std::move(lane->second.requests.front()) };
+		lane->second.requests.pop_front();
+		lane->second.running = true;
+		--m_stats.pending;
+		++m_stats.running;
+		lock.unlock();
+
+		// 2. Running and reporting outside the lock. The command may hold the last reference to its device.
+		const int status{ request.command() };
+		if (request.callback)
+			request.callback(status, request.ctx);
+		request.command = nullptr;
+
+		// 3. Back to the end of the ready queue if more commands wait, so no device starves the others.
+		lock.lock();
+		--m_stats.running;
+		++m_stats.completed;
+		lane->second.running = false;
+		if (lane->second.requests.empty())
+			m_lanes.erase(lane);
+		else
+			m_ready.push_back(device);
+	}
+}
+
+extern "C" {
+	int PowerSupply_ConnectAsync(const char* port, AsyncCallback callback, void* ctx)
+	{
+		const bool has_port{ port != nullptr };
+		const std::string name{ has_port ? port : "" };
+		return g_Async.submit(&g_PowerSupply, [has_port, name] { return g_PowerSupply.connect(has_port ? name.c_str() : nullptr); }, callback, ctx);
+	}
+
+	int PowerSupply_TurnOnAsync(AsyncCallback callback, void* ctx) { return g_Async.submit(&g_PowerSupply, [] { return g_PowerSupply.turn_on(); }, callback, ctx); }
+
+	int PowerSupply_TurnOffAsync(AsyncCallback callback, void* ctx) { return g_Async.submit(&g_PowerSupply, [] { return g_PowerSupply.turn_off(); }, callback, ctx); }
+
+	int PowerSupply_SetCurrentVoltageAsync(uint16_t current, uint16_t voltage, AsyncCallback callback, void* ctx)
+	{
+		return g_Async.submit(&g_PowerSupply, [=] { return g_PowerSupply.set_current_voltage(current, voltage); }, callback, ctx);
+	}
+
+	int PowerSupply_ResetZPAsync(AsyncCallback callback, void* ctx) { return g_Async.submit(&g_PowerSupply, [] { return g_PowerSupply.reset_zp(); }, callback, ctx); }
+
+	int PowerSupply_TurnOnAsyncH(int handle, AsyncCallback callback, void* ctx)
+	{
+		return submit_to(g_PowerSupplies, handle, [](PowerSupplyManager& ps) { return ps.turn_on(); }, callback, ctx);
+	}
+
+	int PowerSupply_TurnOffAsyncH(int handle, AsyncCallback callback, void* ctx)
+	{
+		return submit_to(g_PowerSupplies, handle, [](PowerSupplyManager& ps) { return ps.turn_off(); }, callback, ctx);
+	}
+
+	int PowerSupply_SetCurrentVoltageAsyncH(int handle, uint16_t current, uint16_t voltage, AsyncCallback callback, void* ctx)
+	{
+		return submit_to(g_PowerSupplies, handle, [=](PowerSupplyManager& ps) { return ps.set_current_voltage(current, voltage); }, callback, ctx);
+	}
+
+	int StepMotor_ConnectAsync(const char* port, AsyncCallback callback, void* ctx)
+	{
+		const bool has_port{ port != nullptr };
+		const std::string name{ has_port ? port : "" };
+		return g_Async.submit(&g_StepMotor, [has_port, name] { return g_StepMotor.connect(has_port ? name.c_str() : nullptr); }, callback, ctx);
+	}
+
+	int StepMotor_ForwardAsync(AsyncCallback callback, void* ctx) { return g_Async.submit(&g_StepMotor, [] { return g_StepMotor.open(); }, callback, ctx); }
+
+	int StepMotor_ReverseAsync(AsyncCallback callback, void* ctx) { return g_Async.submit(&g_StepMotor, [] { return g_StepMotor.close(); }, callback, ctx); }
+
+	int StepMotor_StopAsync(AsyncCallback callback, void* ctx) { return g_Async.submit(&g_StepMotor, [] { return g_StepMotor.stop(); }, callback, ctx); }
+
+	int StepMotor_ForwardAsyncH(int handle, AsyncCallback callback, void* ctx)
+	{
+		return submit_to(g_StepMotors, handle, [](StepMotorManager& sm) { return sm.open(); }, callback, ctx);
+	}
+
+	int StepMotor_ReverseAsyncH(int handle, AsyncCallback callback, void* ctx)
+	{
+		return submit_to(g_StepMotors, handle, [](StepMotorManager& sm) { return sm.close(); }, callback, ctx);
+	}
+
+	int StepMotor_StopAsyncH(int handle, AsyncCallback callback, void* ctx)
+	{
+		return submit_to(g_StepMotors, handle, [](StepMotorManager& sm) { return sm.stop(); }, callback, ctx);
+	}
+
+	int Async_CancelPending() { return g_Async.cancel_pending(); }
+
+	void Async_GetStats(AsyncStats* stats) { g_Async.stats(stats); }
+}
@@ -0,0 +1,62 @@
+#include "framework.h"
+#include "DeviceBatch.h"
+#include "PowerSupplyManager.h"
+#include "StepMotorManager.h"
+#include "StatusConstants.h"
+
+namespace
+{
+	bool is_valid_op(const BatchOp& op)
+	{
+		if (op.device != BATCH_DEVICE_POWER_SUPPLY && op.device != BATCH_DEVICE_STEP_MOTOR)
+			return false;
+		if (op.addr < 0 || op.addr > 0xFFFF)
+			return false;
+
+		switch (op.kind)
+		{
+		case BATCH_READ_HOLDING:
+		case BATCH_READ_INPUT:
+			return true;
+		case BATCH_WRITE_REGISTER:
+			return op.value >= 0 && op.value <= 0xFFFF;
+		case BATCH_WRITE_COIL:
+			return op.value == 0 || op.value == 1;
+		default:
+			return false;
+		}
+	}
+}
+
+extern "C" {
+	int Device_ExecuteBatch(const BatchOp* ops, int n, BatchResult* out)
+	{
+		if (!ops || !out || n <= 0 || n > kmax_batch_ops)
+			return DEV_ERROR_INVALID_BATCH;
+
+		// 1. Validating the whole batch before anything is sent.
+		for (int i{}; i < n; ++i)
+			if (!is_valid_op(ops[i]))
+				return DEV_ERROR_INVALID_BATCH;
+
+		for (int i{}; i < n; ++i)
+			out[i] = BatchResult{ DEV_ERROR_BATCH_SKIPPED, 0 };
+
+		// 2. Handing every run of one device to its manager, in order.
+		for (int first{}; first < n;)
+		{
+			int count{ 1 };
+			while (first + count < n && ops[first + count].device == ops[first].device)
+				++count;
+
+			int status{ ops[first].device == BATCH_DEVICE_POWER_SUPPLY ? g_PowerSupply.execute_batch(ops + first, count, out + first)
+				: g_StepMotor.execute_batch(ops + first, count, out + first) };
+			if (status != STATUS_OK)
+				return status;
+
+			first += count;
+		}
+
+		return STATUS_OK;
+	}
+}
@@ -0,0 +1,120 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "framework.h"
+#include "DeviceGroup.h"
+#include "PowerSupplyManager.h"
+#include "StatusConstants.h"
+
+namespace
+{
+	using Command = std::function<int(PowerSupplyManager&)>;
+
+	int run_group(const int* handles, int n, const Command& command, GroupResult* out, GroupReport* report)
+	{
+		if (!handles || !out || n <= 0 || n > kmax_device_handles)
+			return DEV_ERROR_INVALID_GROUP;
+
+		// 1. Resolving the handles up front, the lookups stay out of the timed part.
+		std::vector<std::shared_ptr<PowerSupplyManager>> devices(n);
+		for (int i{}; i < n; ++i)
+		{
+			devices[i] = g_PowerSupplies.get(handles[i]);
+			out[i] = GroupResult{ handles[i], DEV_ERROR_INVALID_HANDLE, 0 };
+		}
+
+		// 2. Starting a worker per device, they spin at the gate so none lags behind a thread wake-up.
+		std::atomic<int> ready{};
+		std::atomic<bool> go{ false };
+		std::atomic<bool> cancelled{ false };
+		std::chrono::steady_clock::time_point start;
+		std::vector<std::thread> workers;
+		workers.reserve(n);
+		for (int i{}; i < n; ++i)
+		{
+			if (!devices[i])
+				continue;
+
+			try
+			{
+				workers.emplace_back([&, i] {
+					++ready;
+					while (!go.load(std::memory_order_acquire))
+						std::this_thread::yield();
+
+					if (cancelled)
+						return;
+
+					out[i].status = command(*devices[i]);
+					out[i].completed_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+				});
+			}
+			catch (const std::system_error&)
+			{
+				// A thread is missing, the group can not start together: the started workers leave the gate without the command.
+				cancelled = true;
+				go.store(true, std::memory_order_release);
+				for (auto& worker : workers)
+					worker.join();
+
+				for (int j{}; j < n; ++j)
+					if (devices[j])
+						out[j].status = DEV_ERROR_GROUP_START_FAILED;
+				return DEV_ERROR_GROUP_START_FAILED;
+			}
+		}
+
+		// 3. Releasing all workers at once and waiting for them.
+		while (ready.load() < static_cast<int>(workers.size()))
+			std::this_thread::yield();
+		start = std::chrono::steady_clock::now();
+		go.store(true, std::memory_order_release);
+		for (auto& worker : workers)
+			worker.join();
+
+		// 4. Summing up, the spread only counts devices that did what was asked.
+		GroupReport summary{};
+		long long first{}, last{};
+		for (int i{}; i < n; ++i)
+		{
+			summary.elapsed_us = std::max(summary.elapsed_us, out[i].completed_us);
+			if (out[i].status != STATUS_OK)
+			{
+				++summary.failed;
+				continue;
+			}
+
+			first = summary.succeeded == 0 ? out[i].completed_us : std::min(first, out[i].completed_us);
+			last = std::max(last, out[i].completed_us);
+			++summary.succeeded;
+		}
+		summary.spread_us = summary.succeeded > 1 ? last - first : 0;
+		if (report)
+			*report = summary;
+
+		return summary.failed == 0 ? STATUS_OK : DEV_ERROR_GROUP_OP_FAILED;
+	}
+}
+
+extern "C" {
+	int PowerSupply_GroupTurnOn(const int* handles, int n, GroupResult* out, GroupReport* report)
+	{
+		return run_group(handles, n, [](PowerSupplyManager& ps) { return ps.turn_on(); }, out, report);
+	}
+
+	int PowerSupply_GroupTurnOff(const int* handles, int n, GroupResult* out, GroupReport* report)
+	{
+		return run_group(handles, n, [](PowerSupplyManager& ps) { return ps.turn_off(); }, out, report);
+	}
+
+	int PowerSupply_GroupSetCurrentVoltage(const int* handles, int n, uint16_t current, uint16_t voltage, GroupResult* out, GroupReport* report)
+	{
+		return run_group(handles, n, [=](PowerSupplyManager& ps) { return ps.set_current_voltage(current, voltage); }, out, report);
+	}
+}
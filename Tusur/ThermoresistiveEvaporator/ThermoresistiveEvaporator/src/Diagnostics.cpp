@@ -0,0 +1,134 @@
+#include <cerrno>
+
+#include "framework.h"
+#include "Diagnostics.h"
+#include "StatusConstants.h"
+
+Diagnostics g_Diagnostics;
+
+namespace
+{
+	/// @brief Index of the histogram bucket of a latency.
+	int bucket_of(long long latency_us)
+	{
+		int bucket{};
+		while (latency_us > 0 && bucket < kdiag_histogram_buckets - 1)
+		{
+			latency_us >>= 1;
+			++bucket;
+		}
+		return bucket;
+	}
+}
+
+Diagnostics::~Diagnostics() { stop_trace(); }
+
+unsigned long long Diagnostics::key(int slave, int function, int addr)
+{
+	// Ordered by slave, then function, then register.
+	return static_cast<unsigned long long>(slave & 0xFF) << 40 |
+		static_cast<unsigned long long>(function & 0xFF) << 32 |
+		static_cast<unsigned long long>(static_cast<unsigned>(addr));
+}
+
+void Diagnostics::record(int slave, int function, int addr, long long timestamp_us, long long latency_us, int result, int error)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	// 1. Updating the statistics of the transaction kind.
+	auto it{ m_stats.find(key(slave, function, addr)) };
+	if (it == m_stats.end())
+	{
+		DiagnosticsStats stats{};
+		stats.slave = slave;
+		stats.function = function;
+		stats.addr = addr;
+		stats.min_us = latency_us;
+		it = m_stats.emplace(key(slave, function, addr), stats).first;
+	}
+
+	DiagnosticsStats& stats{ it->second };
+	++stats.count;
+	if (result == -1)
+	{
+		++stats.errors;
+		if (error == ETIMEDOUT)
+			++stats.timeouts;
+	}
+	if (latency_us < stats.min_us)
+		stats.min_us = latency_us;
+	if (latency_us > stats.max_us)
+		stats.max_us = latency_us;
+	stats.total_us += latency_us;
+	++stats.buckets[bucket_of(latency_us)];
+
+	// 2. Appending the transaction to the trace.
+	if (m_trace)
+	{
+		const DiagnosticsTraceRecord record{ timestamp_us, latency_us, slave, function, addr, result, result == -1 ? error : 0, 0 };
+		std::fwrite(&record, sizeof(record), 1, m_trace);
+	}
+}
+
+int Diagnostics::get_stats(DiagnosticsStats* out, int max) const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	int i{};
+	for (const auto& entry : m_stats)
+	{
+		if (!out || i >= max)
+			break;
+		out[i++] = entry.second;
+	}
+
+	return static_cast<int>(m_stats.size());
+}
+
+void Diagnostics::reset()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_stats.clear();
+}
+
+int Diagnostics::start_trace(const char* path)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_trace)
+	{
+		std::fclose(m_trace);
+		m_trace = nullptr;
+	}
+
+	if (!path)
+		return DG_ERROR_TRACE_OPEN_FAILED;
+
+	std::FILE* file{ std::fopen(path, "wb") };
+	if (!file)
+		return DG_ERROR_TRACE_OPEN_FAILED;
+
+	const unsigned header[2]{ kdiag_trace_magic, kdiag_trace_version };
+	std::fwrite(header, sizeof(header), 1, file);
+	m_trace = file;
+	return STATUS_OK;
+}
+
+void Diagnostics::stop_trace()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (!m_trace)
+		return;
+
+	std::fclose(m_trace);
+	m_trace = nullptr;
+}
+
+extern "C" {
+	int Diagnostics_GetStats(DiagnosticsStats* out, int max) { return g_Diagnostics.get_stats(out, max); }
+
+	void Diagnostics_Reset() { g_Diagnostics.reset(); }
+
+	int Diagnostics_StartTrace(const char* path) { return g_Diagnostics.start_trace(path); }
+
+	void Diagnostics_StopTrace() { g_Diagnostics.stop_trace(); }
+}
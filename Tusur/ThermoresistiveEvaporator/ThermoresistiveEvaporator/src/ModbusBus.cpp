@@ -0,0 +1,590 @@
+#include <cerrno>
+#include <chrono>
+#include <map>
+
+#include "framework.h"
+#include "ModbusBus.h"
+#include "Diagnostics.h"
+#include "StatusConstants.h"
+
+namespace
+{
+	bool same_settings(const SerialSettings& a, const SerialSettings& b)
+	{
+		return a.baud == b.baud && a.parity == b.parity && a.data_bits == b.data_bits && a.stop_bits == b.stop_bits;
+	}
+}
+
+int ModbusBus::acquire(const std::string& port, const SerialSettings& settings, std::shared_ptr<ModbusBus>& bus)
+{
+	// Buses are kept alive by their users only, the registry just lets them find each other.
+	static std::mutex registry_mutex;
+	static std::map<std::string, std::weak_ptr<ModbusBus>> registry;
+
+	std::lock_guard<std::mutex> lock(registry_mutex);
+	std::shared_ptr<ModbusBus> existing{ registry[port].lock() };
+	if (existing)
+	{
+		if (!same_settings(existing->settings(), settings))
+			return BUS_ERROR_SETTINGS_MISMATCH;
+
+		bus = existing;
+		return STATUS_OK;
+	}
+
+	bus.reset(new ModbusBus(port, settings));
+	registry[port] = bus;
+	return STATUS_OK;
+}
+
+ModbusBus::ModbusBus(const std::string& port, const SerialSettings& settings)
+	: m_port(port), m_settings(settings)
+{
+	m_thread = std::thread(&ModbusBus::run, this);
+}
+
+ModbusBus::~ModbusBus()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_shutdown = true;
+	}
+	m_cv.notify_all();
+	if (m_thread.joinable())
+		m_thread.join();
+}
+
+int ModbusBus::connect()
+{
+	// Fast path: the port is open, no need to go through the queue.
+	if (is_online())
+		return STATUS_OK;
+
+	// The supervisor is reopening the port, callers are turned away without waiting for it.
+	if (m_state == LINK_CONNECTING)
+		return BUS_ERROR_OFFLINE;
+
+	Request request{ REQUEST_CONNECT, BUS_PRIORITY_COMMAND, 0, -1, 0, -1, nullptr, 0, false };
+	return submit(request);
+}
+
+int ModbusBus::reconnect()
+{
+	Request request{ REQUEST_RECONNECT, BUS_PRIORITY_COMMAND, 0, -1, 0, -1, nullptr, 0, false };
+	return submit(request);
+}
+
+LinkStatus ModbusBus::link_status() const
+{
+	return LinkStatus{ m_state, m_consecutive_failures, m_reconnect_attempts, m_last_error, m_epoch };
+}
+
+int ModbusBus::execute(int slave, int priority, const Operation& op, int function, int addr)
+{
+	Request request{ REQUEST_OPERATION, priority, 0, slave, function, addr, &op, 0, false };
+	return submit(request);
+}
+
+int ModbusBus::execute_on_caller(int slave, const Operation& op)
+{
+	std::unique_lock<std::mutex> lock(m_mutex, std::try_to_lock);
+	if (!lock.owns_lock() || !m_transport || !is_online())
+		return -1;
+
+	// The killed bus thread may have left a frame half sent or half received.
+	m_transport->flush();
+	if (m_current_slave != slave)
+	{
+		if (m_transport->set_slave(slave) == -1)
+			return -1;
+		m_current_slave = slave;
+	}
+
+	return op(*m_transport);
+}
+
+int ModbusBus::read_registers(int slave, int priority, int addr, int nb, uint16_t* dest)
+{
+	return execute(slave, priority, [=](ModbusTransport& transport) { return transport.read_registers(addr, nb, dest); }, 0x03, addr);
+}
+
+int ModbusBus::read_input_registers(int slave, int priority, int addr, int nb, uint16_t* dest)
+{
+	return execute(slave, priority, [=](ModbusTransport& transport) { return transport.read_input_registers(addr, nb, dest); }, 0x04, addr);
+}
+
+int ModbusBus::write_register(int slave, int priority, int addr, uint16_t value)
+{
+	return execute(slave, priority, [=](ModbusTransport& transport) { return transport.write_register(addr, value); }, 0x06, addr);
+}
+
+int ModbusBus::write_registers(int slave, int priority, int addr, int nb, const uint16_t* src, int* written)
+{
+	int done{};
+	int rc{ execute(slave, priority, [this, addr, nb, src, &done](ModbusTransport& transport) { return write_block(transport, addr, nb, src, done); }, nb > 1 ? 0x10 : 0x06, addr) };
+	if (written)
+		*written = done;
+
+	return rc;
+}
+
+int ModbusBus::execute_batch(int slave, int priority, const BatchOp* ops, int n, BatchResult* out)
+{
+	return execute(slave, priority, [this, ops, n, out](ModbusTransport& transport) { return run_batch(transport, ops, n, out); }, 0, n > 0 ? ops[0].addr : -1);
+}
+
+int ModbusBus::write_bit(int slave, int priority, int addr, int status)
+{
+	return execute(slave, priority, [=](ModbusTransport& transport) { return transport.write_bit(addr, status); }, 0x05, addr);
+}
+
+bool ModbusBus::is_valid_policy(const TimeoutPolicy& policy)
+{
+	return policy.response_timeout_ms >= 1 && policy.byte_timeout_ms >= 0 &&
+		policy.max_retries >= 0 && policy.max_retries <= kmax_retries &&
+		policy.retry_backoff_ms >= 0 && policy.retry_backoff_ms <= kmax_retry_backoff_ms;
+}
+
+bool ModbusBus::is_valid_settings(const SerialSettings& settings)
+{
+	return settings.baud > 0 && (settings.parity == 'N' || settings.parity == 'E' || settings.parity == 'O') &&
+		settings.data_bits >= 5 && settings.data_bits <= 8 && (settings.stop_bits == 1 || settings.stop_bits == 2);
+}
+
+int ModbusBus::probe_baud(const std::string& port, const SerialSettings& settings, int slave, int function, int addr, int nb, int& baud)
+{
+	const TimeoutPolicy probe_policy{ kprobe_response_timeout_ms, kprobe_response_timeout_ms, false, 0, 0 };
+	uint16_t registers[MODBUS_MAX_READ_REGISTERS]{};
+
+	for (int candidate : kprobe_baud_rates)
+	{
+		// 1. Opening the port at the candidate rate, each candidate gets a bus of its own.
+		SerialSettings line{ settings };
+		line.baud = candidate;
+		std::shared_ptr<ModbusBus> bus;
+		int status{ acquire(port, line, bus) };
+		if (status != STATUS_OK)
+			return status;
+
+		bus->set_timeout_policy(slave, probe_policy);
+		status = bus->connect();
+		if (status != STATUS_OK)
+			return status;
+
+		// 2. Reading the known register, the first failure rules the rate out.
+		int reads{};
+		for (; reads < kprobe_reads; ++reads)
+		{
+			int rc{ function == 0x04 ? bus->read_input_registers(slave, BUS_PRIORITY_COMMAND, addr, nb, registers)
+				: bus->read_registers(slave, BUS_PRIORITY_COMMAND, addr, nb, registers) };
+			if (rc == -1)
+				break;
+		}
+
+		if (reads == kprobe_reads)
+		{
+			baud = candidate;
+			return STATUS_OK;
+		}
+	}
+
+	return BUS_ERROR_PROBE_FAILED;
+}
+
+int ModbusBus::set_timeout_policy(int slave, const TimeoutPolicy& policy)
+{
+	if (!is_valid_policy(policy))
+		return BUS_ERROR_INVALID_TIMEOUT_POLICY;
+
+	std::lock_guard<std::mutex> lock(m_links_mutex);
+	SlaveLink& link{ link_locked(slave) };
+
+	// Round trips measured so far stay valid, only the bounds change.
+	link.policy = policy;
+	return STATUS_OK;
+}
+
+long long ModbusBus::response_timeout_us(int slave) const
+{
+	std::lock_guard<std::mutex> lock(m_links_mutex);
+	auto it{ m_links.find(slave) };
+	return it != m_links.end() ? timeout_of(it->second) : kdefault_timeout_policy.response_timeout_ms * 1000LL;
+}
+
+ModbusBus::SlaveLink& ModbusBus::link_locked(int slave)
+{
+	auto it{ m_links.find(slave) };
+	if (it == m_links.end())
+		it = m_links.emplace(slave, SlaveLink{ kdefault_timeout_policy, false, 0.0, 0.0 }).first;
+
+	return it->second;
+}
+
+long long ModbusBus::timeout_of(const SlaveLink& link)
+{
+	const long long max_us{ link.policy.response_timeout_ms * 1000LL };
+	if (!link.policy.adaptive || !link.has_rtt)
+		return max_us;
+
+	// Same estimator as the TCP retransmission timeout (RFC 6298): mean plus four deviations.
+	long long timeout_us{ static_cast<long long>(link.srtt_us + 4.0 * link.rttvar_us) };
+	if (timeout_us < kmin_adaptive_timeout_ms * 1000LL)
+		timeout_us = kmin_adaptive_timeout_ms * 1000LL;
+
+	return timeout_us < max_us ? timeout_us : max_us;
+}
+
+void ModbusBus::apply_timeouts(long long response_us, long long byte_us)
+{
+	if (response_us != m_applied_response_us)
+	{
+		m_transport->set_response_timeout(response_us);
+		m_applied_response_us = response_us;
+	}
+
+	if (byte_us != m_applied_byte_us)
+	{
+		m_transport->set_byte_timeout(byte_us);
+		m_applied_byte_us = byte_us;
+	}
+}
+
+void ModbusBus::update_rtt(int slave, long long rtt_us)
+{
+	std::lock_guard<std::mutex> lock(m_links_mutex);
+	SlaveLink& link{ link_locked(slave) };
+	const double rtt{ static_cast<double>(rtt_us) };
+	if (!link.has_rtt)
+	{
+		link.srtt_us = rtt;
+		link.rttvar_us = rtt / 2.0;
+		link.has_rtt = true;
+		return;
+	}
+
+	const double deviation{ rtt > link.srtt_us ? rtt - link.srtt_us : link.srtt_us - rtt };
+	link.rttvar_us = 0.75 * link.rttvar_us + 0.25 * deviation;
+	link.srtt_us = 0.875 * link.srtt_us + 0.125 * rtt;
+}
+
+int ModbusBus::submit(Request& request)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	request.sequence = m_sequence++;
+	m_queue.push(&request);
+	m_cv.notify_one();
+
+	m_done_cv.wait(lock, [&request] { return request.done; });
+	return request.result;
+}
+
+void ModbusBus::run()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	auto wake{ [this] { return m_shutdown || !m_queue.empty(); } };
+	while (true)
+	{
+		if (m_state == LINK_CONNECTING)
+			m_cv.wait_until(lock, m_next_attempt, wake);
+		else
+			m_cv.wait(lock, wake);
+
+		if (m_shutdown && m_queue.empty())
+			break;
+
+		// Reopening the port in the background once the backoff has elapsed.
+		if (m_state == LINK_CONNECTING && std::chrono::steady_clock::now() >= m_next_attempt)
+		{
+			lock.unlock();
+			open();
+			lock.lock();
+			continue;
+		}
+
+		if (m_queue.empty())
+			continue;
+
+		Request* request{ m_queue.top() };
+		m_queue.pop();
+		lock.unlock();
+
+		int result{ process(*request) };
+
+		lock.lock();
+		request->result = result;
+		request->done = true;
+		m_done_cv.notify_all();
+	}
+}
+
+bool ModbusBus::safety_queued_locked() const { return !m_queue.empty() && m_queue.top()->priority == BUS_PRIORITY_SAFETY; }
+
+int ModbusBus::process(const Request& request)
+{
+	switch (request.kind)
+	{
+	case REQUEST_CONNECT:
+		if (is_online())
+			return STATUS_OK;
+		return m_state == LINK_CONNECTING ? BUS_ERROR_OFFLINE : open();
+
+	case REQUEST_RECONNECT:
+		// An explicit request does not wait for the backoff, and starts it over.
+		m_backoff_ms = kreconnect_backoff_min_ms;
+		return open();
+
+	case REQUEST_OPERATION:
+		break;
+	}
+
+	// Rejected without touching the port, the supervisor is reopening it.
+	if (m_state == LINK_CONNECTING)
+	{
+		errno = ENOTCONN;
+		return -1;
+	}
+
+	if (!m_transport && open() != STATUS_OK)
+		return -1;
+
+	// 1. Addressing the slave, RTU frames carry the slave ID of the transport.
+	if (m_current_slave != request.slave)
+	{
+		if (m_transport->set_slave(request.slave) == -1)
+			return -1;
+		m_current_slave = request.slave;
+	}
+
+	// 2. Taking the timing of the slave.
+	TimeoutPolicy policy;
+	long long response_us{};
+	{
+		std::lock_guard<std::mutex> lock(m_links_mutex);
+		SlaveLink& link{ link_locked(request.slave) };
+		policy = link.policy;
+		response_us = timeout_of(link);
+	}
+
+	// 3. Executing the operation, retrying timeouts and corrupted responses with a growing pause.
+	int rc{ -1 };
+	int error{};
+	for (int attempt{};; ++attempt)
+	{
+		// A retry waits longer, a too tight adaptive timeout must not fail a slow but healthy device.
+		long long attempt_us{ response_us << attempt };
+		if (attempt_us > policy.response_timeout_ms * 1000LL)
+			attempt_us = policy.response_timeout_ms * 1000LL;
+		apply_timeouts(attempt_us, policy.byte_timeout_ms * 1000LL);
+
+		const auto started{ std::chrono::steady_clock::now() };
+		rc = (*request.op)(*m_transport);
+		error = errno;
+		const auto finished{ std::chrono::steady_clock::now() };
+		const long long latency_us{ std::chrono::duration_cast<std::chrono::microseconds>(finished - started).count() };
+
+		g_Diagnostics.record(request.slave, request.function, request.addr,
+			std::chrono::duration_cast<std::chrono::microseconds>(started.time_since_epoch()).count(), latency_us, rc, error);
+
+		if (rc != -1)
+		{
+			update_rtt(request.slave, latency_us);
+			break;
+		}
+
+		if (attempt >= policy.max_retries || (error != ETIMEDOUT && error != EMBBADCRC))
+			break;
+
+		// Dropping the remains of a late or broken response before the retry.
+		m_transport->flush();
+		long long backoff_ms{ static_cast<long long>(policy.retry_backoff_ms) << attempt };
+		if (backoff_ms > kmax_retry_backoff_ms)
+			backoff_ms = kmax_retry_backoff_ms;
+
+		// A queued safety request does not wait out the retries of a lesser one, the transaction fails instead.
+		if (request.priority != BUS_PRIORITY_SAFETY)
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			if (m_cv.wait_for(lock, std::chrono::milliseconds(backoff_ms), [this] { return safety_queued_locked(); }))
+				break;
+		}
+		else
+			std::this_thread::sleep_for(std::chrono::milliseconds(backoff_ms));
+	}
+
+	// Modbus exception responses come from a live device, anything else means the link itself is broken.
+	if (rc != -1)
+	{
+		m_consecutive_failures = 0;
+		m_state = LINK_ONLINE;
+	}
+	else if (error < MODBUS_ENOBASE)
+		link_failed();
+
+	return rc;
+}
+
+int ModbusBus::write_block(ModbusTransport& transport, int addr, int nb, const uint16_t* src, int& written)
+{
+	written = 0;
+
+	// 1. Writing the whole block in one frame, unless the slave is known to reject it.
+	if (nb > 1 && m_single_write_slaves.count(m_current_slave) == 0)
+	{
+		int rc{ transport.write_registers(addr, nb, src) };
+		if (rc != -1)
+		{
+			written = nb;
+			return rc;
+		}
+
+		// Any other failure leaves the outcome unknown, repeating the block as single frames would not help.
+		if (errno != EMBXILFUN)
+			return -1;
+
+		m_single_write_slaves.insert(m_current_slave);
+	}
+
+	// 2. Falling back to one 0x06 frame per register.
+	for (; written < nb; ++written)
+		if (transport.write_register(addr + written, src[written]) == -1)
+			return -1;
+
+	return nb;
+}
+
+void ModbusBus::link_failed()
+{
+	if (++m_consecutive_failures < kdegraded_failure_limit)
+	{
+		m_state = LINK_DEGRADED;
+		return;
+	}
+
+	// The link is considered lost: closing the port, the first reopening attempt is made right away.
+	m_transport.reset();
+	m_backoff_ms = kreconnect_backoff_min_ms;
+	m_next_attempt = std::chrono::steady_clock::now();
+	m_state = LINK_CONNECTING;
+}
+
+int ModbusBus::write_bits_block(ModbusTransport& transport, int addr, int nb, const uint8_t* src)
+{
+	// 1. Writing the whole block in one frame, unless the slave is known to reject it.
+	if (nb > 1 && m_single_coil_slaves.count(m_current_slave) == 0)
+	{
+		int rc{ transport.write_bits(addr, nb, src) };
+		if (rc != -1 || errno != EMBXILFUN)
+			return rc;
+
+		m_single_coil_slaves.insert(m_current_slave);
+	}
+
+	// 2. Falling back to one 0x05 frame per coil.
+	for (int i{}; i < nb; ++i)
+		if (transport.write_bit(addr + i, src[i]) == -1)
+			return -1;
+
+	return nb;
+}
+
+int ModbusBus::run_batch(ModbusTransport& transport, const BatchOp* ops, int n, BatchResult* out)
+{
+	// A retry of the whole request starts over, the operations are plain reads and writes of values.
+	int done{};
+	while (done < n)
+	{
+		// 1. Collecting the run of the same kind on adjacent addresses.
+		const BatchOp& first{ ops[done] };
+		const int limit{ first.kind == BATCH_WRITE_COIL ? MODBUS_MAX_WRITE_BITS :
+			first.kind == BATCH_WRITE_REGISTER ? MODBUS_MAX_WRITE_REGISTERS : MODBUS_MAX_READ_REGISTERS };
+		int count{ 1 };
+		while (done + count < n && count < limit && ops[done + count].kind == first.kind && ops[done + count].addr == first.addr + count)
+			++count;
+
+		// 2. Sending the run as one frame.
+		int rc{ -1 };
+		switch (first.kind)
+		{
+		case BATCH_READ_HOLDING:
+		case BATCH_READ_INPUT:
+		{
+			uint16_t registers[MODBUS_MAX_READ_REGISTERS]{};
+			rc = first.kind == BATCH_READ_HOLDING ? transport.read_registers(first.addr, count, registers)
+				: transport.read_input_registers(first.addr, count, registers);
+			if (rc != -1)
+				for (int i{}; i < count; ++i)
+					out[done + i].value = registers[i];
+			break;
+		}
+		case BATCH_WRITE_REGISTER:
+		{
+			uint16_t registers[MODBUS_MAX_WRITE_REGISTERS]{};
+			for (int i{}; i < count; ++i)
+				out[done + i].value = registers[i] = static_cast<uint16_t>(ops[done + i].value);
+			int written{};
+			rc = write_block(transport, first.addr, count, registers, written);
+			break;
+		}
+		case BATCH_WRITE_COIL:
+		{
+			uint8_t coils[MODBUS_MAX_WRITE_BITS]{};
+			for (int i{}; i < count; ++i)
+				out[done + i].value = coils[i] = ops[done + i].value != 0;
+			rc = write_bits_block(transport, first.addr, count, coils);
+			break;
+		}
+		}
+
+		// 3. Stopping at the first failed frame.
+		const int status{ rc == -1 ? DEV_ERROR_BATCH_OP_FAILED : STATUS_OK };
+		for (int i{}; i < count; ++i)
+			out[done + i].status = status;
+		if (rc == -1)
+			return -1;
+
+		done += count;
+	}
+
+	return n;
+}
+
+int ModbusBus::open()
+{
+	const auto started{ std::chrono::steady_clock::now() };
+	m_current_slave = -1;
+	m_applied_response_us = -1;
+	m_applied_byte_us = -1;
+
+	// 1. Initializing connection.
+	int status{ STATUS_OK };
+	m_transport = make_transport(m_port, m_settings);
+	if (!m_transport)
+		status = BUS_ERROR_INIT_CONNECTION_FAILED;
+
+	// 2. Establishing the connection.
+	else if (m_transport->connect() == -1)
+	{
+		m_transport.reset();
+		status = BUS_ERROR_CONNECT_FAILED;
+	}
+
+	// 3. Scheduling the next attempt on failure, the pause doubles up to kreconnect_backoff_max_ms.
+	if (status != STATUS_OK)
+	{
+		m_last_error = status;
+		++m_reconnect_attempts;
+		m_next_attempt = std::chrono::steady_clock::now() + std::chrono::milliseconds(m_backoff_ms);
+		m_backoff_ms = m_backoff_ms * 2 < kreconnect_backoff_max_ms ? m_backoff_ms * 2 : kreconnect_backoff_max_ms;
+		m_state = LINK_CONNECTING;
+		return status;
+	}
+
+	++m_epoch;
+	m_consecutive_failures = 0;
+	m_reconnect_attempts = 0;
+	m_last_error = STATUS_OK;
+	m_backoff_ms = kreconnect_backoff_min_ms;
+	m_state = LINK_ONLINE;
+	m_connect_latency_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started).count();
+	return STATUS_OK;
+}
@@ -0,0 +1,392 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+#include "framework.h"
+#include <timeapi.h>
+#include "ModbusSimulator.h"
+#include "Constants.h"
+#include "RegisterMap.h"
+#include "StatusConstants.h"
+
+#pragma comment(lib, "winmm.lib")
+
+ModbusSimulator g_Simulator;
+
+namespace
+{
+	std::atomic<bool> g_simulator_enabled{ false }; ///< Whether the simulator factory is installed.
+
+	/// @brief Frame sizes in bytes, slave address and CRC included.
+	void frame_sizes(int function, int nb, int& request_bytes, int& response_bytes)
+	{
+		request_bytes = 8;
+		response_bytes = 8;
+		switch (function)
+		{
+		case 0x03:
+		case 0x04:
+			response_bytes = 5 + 2 * nb;
+			break;
+		case 0x0F:
+			request_bytes = 9 + (nb + 7) / 8;
+			break;
+		case 0x10:
+			request_bytes = 9 + 2 * nb;
+			break;
+		}
+	}
+
+	/// @brief Waits until a point in time, sleeping first and spinning through the last ksimulator_spin_us.
+	void wait_until(std::chrono::steady_clock::time_point deadline)
+	{
+		const auto spin{ std::chrono::microseconds(ksimulator_spin_us) };
+		const auto now{ std::chrono::steady_clock::now() };
+		if (deadline - now > spin)
+			std::this_thread::sleep_for(deadline - now - spin);
+
+		while (std::chrono::steady_clock::now() < deadline)
+			std::this_thread::yield();
+	}
+}
+
+int ModbusSimulator::configure(const SimulatorConfig& config)
+{
+	if (config.processing_us < 0 || config.jitter_us < 0 || config.response_tau_ms < 0 || config.motor_travel_ms < 0 || config.device_baud < 0 ||
+		!(config.timeout_rate >= 0.0 && config.timeout_rate <= 1.0) || !(config.crc_error_rate >= 0.0 && config.crc_error_rate <= 1.0))
+		return SIM_ERROR_INVALID_CONFIG;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	advance_locked();
+	m_config = config;
+	m_rng.seed(config.seed);
+	return STATUS_OK;
+}
+
+SimulatorConfig ModbusSimulator::config()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_config;
+}
+
+void ModbusSimulator::reset()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_rng.seed(m_config.seed);
+	m_stats = SimulatorStats{};
+	m_setpoint[0] = m_setpoint[1] = 0;
+	m_zero_point = 0;
+	m_coils[0] = m_coils[1] = false;
+	m_measured[0] = m_measured[1] = 0.0;
+	m_direction[0] = m_direction[1] = 0;
+	m_position = 0.0;
+	m_updated = std::chrono::steady_clock::now();
+}
+
+SimulatorStats ModbusSimulator::stats()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_stats;
+}
+
+bool ModbusSimulator::is_online()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_config.offline == 0;
+}
+
+double ModbusSimulator::draw_locked() { return std::uniform_real_distribution<double>(0.0, 1.0)(m_rng); }
+
+void ModbusSimulator::advance_locked()
+{
+	const auto now{ std::chrono::steady_clock::now() };
+	const double dt_ms{ std::chrono::duration<double, std::milli>(now - m_updated).count() };
+	m_updated = now;
+
+	// 1. Output of the power supply, a first order lag towards the setpoints while it is on.
+	const bool output_on{ m_coils[0] && m_coils[1] };
+	const double decay{ m_config.response_tau_ms > 0 ? std::exp(-dt_ms / m_config.response_tau_ms) : 0.0 };
+	for (int i{}; i < 2; ++i)
+	{
+		const double target{ output_on ? static_cast<double>(m_setpoint[i]) : 0.0 };
+		m_measured[i] = target + (m_measured[i] - target) * decay;
+	}
+
+	// 2. Shutter, moving while exactly one direction register is set.
+	const int velocity{ m_direction[0] == 1 && m_direction[1] != 1 ? 1 : m_direction[1] == 1 && m_direction[0] != 1 ? -1 : 0 };
+	if (velocity != 0)
+	{
+		const double step{ m_config.motor_travel_ms > 0 ? dt_ms / m_config.motor_travel_ms : 1.0 };
+		m_position = std::min(1.0, std::max(0.0, m_position + velocity * step));
+	}
+}
+
+int ModbusSimulator::apply_locked(int slave, int function, int addr, int nb, uint16_t* values)
+{
+	using Setpoints = PowerSupplyRegisters::Setpoints;
+	using Readings = PowerSupplyRegisters::Readings;
+	using Direction = StepMotorRegisters::Direction;
+	using Limits = StepMotorRegisters::Limits;
+	const bool power_supply{ slave == ps_constants::kslave_id };
+
+	// 1. Checking the whole request first, a rejected request changes nothing.
+	for (int i{}; i < nb; ++i)
+	{
+		const int a{ addr + i };
+		bool valid{};
+		switch (function)
+		{
+		case 0x03:
+			valid = power_supply ? (Setpoints::contains(a) || a == PowerSupplyRegisters::kzero_point) : (Direction::contains(a) || Limits::contains(a));
+			break;
+		case 0x04:
+			valid = power_supply && Readings::contains(a);
+			break;
+		case 0x06:
+		case 0x10:
+			valid = power_supply ? (Setpoints::contains(a) || a == PowerSupplyRegisters::kzero_point) : Direction::contains(a);
+			break;
+		case 0x05:
+		case 0x0F:
+			valid = power_supply && (a == PowerSupplyRegisters::kpower_coil || a == PowerSupplyRegisters::kworkmode_coil);
+			break;
+		default:
+			return MODBUS_EXCEPTION_ILLEGAL_FUNCTION;
+		}
+
+		if (!valid)
+			return MODBUS_EXCEPTION_ILLEGAL_DATA_ADDRESS;
+	}
+
+	// 2. Reading or writing the registers.
+	for (int i{}; i < nb; ++i)
+	{
+		const int a{ addr + i };
+		switch (function)
+		{
+		case 0x03:
+			if (a == PowerSupplyRegisters::kzero_point && power_supply)
+				values[i] = m_zero_point;
+			else if (power_supply)
+				values[i] = m_setpoint[Setpoints::index_of(a)];
+			else if (Direction::contains(a))
+				values[i] = m_direction[Direction::index_of(a)];
+			else
+				values[i] = static_cast<uint16_t>(Limits::index_of(a) == 0 ? m_position >= 1.0 : m_position <= 0.0);
+			break;
+		case 0x04:
+			values[i] = static_cast<uint16_t>(std::lround(m_measured[Readings::index_of(a)]));
+			break;
+		case 0x06:
+		case 0x10:
+			if (a == PowerSupplyRegisters::kzero_point && power_supply)
+				m_zero_point = values[i];
+			else if (power_supply)
+				m_setpoint[Setpoints::index_of(a)] = values[i];
+			else
+				m_direction[Direction::index_of(a)] = values[i];
+			break;
+		case 0x05:
+		case 0x0F:
+			m_coils[a == PowerSupplyRegisters::kworkmode_coil ? 1 : 0] = values[i] != 0;
+			break;
+		}
+	}
+
+	return 0;
+}
+
+int ModbusSimulator::transact(int slave, int function, int addr, int nb, uint16_t* values, int baud, double char_us, double gap_us,
+	long long response_timeout_us, long long& wait_us)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	advance_locked();
+	++m_stats.frames;
+
+	int request_bytes{}, response_bytes{};
+	frame_sizes(function, nb, request_bytes, response_bytes);
+	const double request_us{ request_bytes * char_us + gap_us };
+	const double turnaround_us{ m_config.processing_us + (m_config.jitter_us > 0 ? draw_locked() * m_config.jitter_us : 0.0) };
+
+	// 1. Silent slaves: offline bus, unknown slave, garbled request, lost request, or a response later than the master waits.
+	const bool known{ (slave == ps_constants::kslave_id || slave == sm_constants::kslave_id) && (m_config.device_baud == 0 || m_config.device_baud == baud) };
+	const bool lost{ m_config.timeout_rate > 0.0 && draw_locked() < m_config.timeout_rate };
+	if (m_config.offline != 0 || !known || lost || turnaround_us > response_timeout_us)
+	{
+		++m_stats.timeouts;
+		wait_us = static_cast<long long>(request_us) + response_timeout_us;
+		m_stats.wire_us += static_cast<unsigned long long>(request_us);
+		errno = ETIMEDOUT;
+		return -1;
+	}
+
+	// 2. Exception responses: block writes refused by configuration, unsupported addresses.
+	int exception{ m_config.reject_block_writes != 0 && (function == 0x10 || function == 0x0F) ? MODBUS_EXCEPTION_ILLEGAL_FUNCTION : 0 };
+	if (exception == 0)
+		exception = apply_locked(slave, function, addr, nb, values);
+	if (exception != 0)
+		response_bytes = 5;
+
+	const double response_us{ response_bytes * char_us };
+	wait_us = static_cast<long long>(request_us + turnaround_us + response_us);
+	m_stats.wire_us += static_cast<unsigned long long>(request_us + response_us);
+
+	// 3. Corruption on the way back, the request has been applied all the same.
+	if (m_config.crc_error_rate > 0.0 && draw_locked() < m_config.crc_error_rate)
+	{
+		++m_stats.crc_errors;
+		errno = EMBBADCRC;
+		return -1;
+	}
+
+	if (exception != 0)
+	{
+		++m_stats.exceptions;
+		errno = MODBUS_ENOBASE + exception;
+		return -1;
+	}
+
+	return nb;
+}
+
+std::unique_ptr<ModbusTransport> SimulatedTransport::create(const std::string& /* port */, const SerialSettings& settings)
+{
+	if (settings.baud <= 0 || settings.data_bits <= 0 || settings.stop_bits <= 0)
+		return nullptr;
+
+	return std::unique_ptr<ModbusTransport>(new SimulatedTransport(settings));
+}
+
+int SimulatedTransport::transfer(int function, int addr, int nb, uint16_t* values)
+{
+	// 1. Time of a character: start bit, data bits, parity bit and stop bits.
+	const int char_bits{ 1 + m_settings.data_bits + (m_settings.parity == 'N' ? 0 : 1) + m_settings.stop_bits };
+	const double char_us{ char_bits * 1000000.0 / m_settings.baud };
+	const double gap_us{ m_settings.baud > 19200 ? static_cast<double>(ksimulator_fast_gap_us) : 3.5 * char_us };
+
+	// 2. Running the transaction, then holding the caller for as long as the line would.
+	const auto started{ std::chrono::steady_clock::now() };
+	long long wait_us{};
+	int rc{ g_Simulator.transact(m_slave, function, addr, nb, values, m_settings.baud, char_us, gap_us, m_response_timeout_us, wait_us) };
+	const int error{ errno };
+	wait_until(started + std::chrono::microseconds(wait_us));
+	errno = error;
+	return rc;
+}
+
+int SimulatedTransport::connect()
+{
+	if (!g_Simulator.is_online())
+	{
+		errno = ENOENT;
+		return -1;
+	}
+
+	return 0;
+}
+
+int SimulatedTransport::flush() { return 0; }
+
+int SimulatedTransport::set_slave(int slave)
+{
+	m_slave = slave;
+	return 0;
+}
+
+void SimulatedTransport::set_response_timeout(long long timeout_us) { m_response_timeout_us = timeout_us; }
+
+void SimulatedTransport::set_byte_timeout(long long /* timeout_us */) {}
+
+int SimulatedTransport::read_registers(int addr, int nb, uint16_t* dest)
+{
+	if (nb < 1 || nb > MODBUS_MAX_READ_REGISTERS)
+	{
+		errno = EMBMDATA;
+		return -1;
+	}
+
+	return transfer(0x03, addr, nb, dest);
+}
+
+int SimulatedTransport::read_input_registers(int addr, int nb, uint16_t* dest)
+{
+	if (nb < 1 || nb > MODBUS_MAX_READ_REGISTERS)
+	{
+		errno = EMBMDATA;
+		return -1;
+	}
+
+	return transfer(0x04, addr, nb, dest);
+}
+
+int SimulatedTransport::write_register(int addr, uint16_t value) { return transfer(0x06, addr, 1, &value) == -1 ? -1 : 1; }
+
+int SimulatedTransport::write_registers(int addr, int nb, const uint16_t* src)
+{
+	if (nb < 1 || nb > MODBUS_MAX_WRITE_REGISTERS)
+	{
+		errno = EMBMDATA;
+		return -1;
+	}
+
+	std::vector<uint16_t> values(src, src + nb);
+	return transfer(0x10, addr, nb, values.data());
+}
+
+int SimulatedTransport::write_bit(int addr, int status)
+{
+	uint16_t value{ static_cast<uint16_t>(status != 0) };
+	return transfer(0x05, addr, 1, &value) == -1 ? -1 : 1;
+}
+
+int SimulatedTransport::write_bits(int addr, int nb, const uint8_t* src)
+{
+	if (nb < 1 || nb > MODBUS_MAX_WRITE_BITS)
+	{
+		errno = EMBMDATA;
+		return -1;
+	}
+
+	std::vector<uint16_t> values(src, src + nb);
+	return transfer(0x0F, addr, nb, values.data());
+}
+
+extern "C" {
+	int Simulator_Enable(const SimulatorConfig* config)
+	{
+		if (!config)
+			return SIM_ERROR_INVALID_CONFIG;
+
+		int status{ g_Simulator.configure(*config) };
+		if (status != STATUS_OK)
+			return status;
+
+		// The first enabling starts from powered-on devices and a finer system timer for the waits.
+		if (!g_simulator_enabled.exchange(true))
+		{
+			g_Simulator.reset();
+			timeBeginPeriod(1);
+		}
+
+		set_transport_factory(&SimulatedTransport::create);
+		return STATUS_OK;
+	}
+
+	void Simulator_Disable()
+	{
+		set_transport_factory(nullptr);
+		if (g_simulator_enabled.exchange(false))
+			timeEndPeriod(1);
+	}
+
+	void Simulator_Reset() { g_Simulator.reset(); }
+
+	void Simulator_GetStats(SimulatorStats* stats)
+	{
+		if (stats)
+			*stats = g_Simulator.stats();
+	}
+}
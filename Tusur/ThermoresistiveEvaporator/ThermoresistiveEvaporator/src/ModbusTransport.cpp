@@ -0,0 +1,54 @@
+#include <atomic>
+
+#include "framework.h"
+#include "ModbusTransport.h"
+
+namespace
+{
+	std::atomic<TransportFactory> g_transport_factory{ nullptr }; ///< Factory selected by set_transport_factory().
+}
+
+std::unique_ptr<ModbusTransport> RtuTransport::create(const std::string& port, const SerialSettings& settings)
+{
+	modbus_t* ctx{ modbus_new_rtu(port.c_str(), settings.baud, settings.parity, settings.data_bits, settings.stop_bits) };
+	if (!ctx)
+		return nullptr;
+
+	return std::unique_ptr<ModbusTransport>(new RtuTransport(ctx));
+}
+
+int RtuTransport::connect() { return modbus_connect(m_ctx.get()); }
+
+int RtuTransport::flush() { return modbus_flush(m_ctx.get()); }
+
+int RtuTransport::set_slave(int slave) { return modbus_set_slave(m_ctx.get(), slave); }
+
+void RtuTransport::set_response_timeout(long long timeout_us)
+{
+	modbus_set_response_timeout(m_ctx.get(), static_cast<uint32_t>(timeout_us / 1000000), static_cast<uint32_t>(timeout_us % 1000000));
+}
+
+void RtuTransport::set_byte_timeout(long long timeout_us)
+{
+	modbus_set_byte_timeout(m_ctx.get(), static_cast<uint32_t>(timeout_us / 1000000), static_cast<uint32_t>(timeout_us % 1000000));
+}
+
+int RtuTransport::read_registers(int addr, int nb, uint16_t* dest) { return modbus_read_registers(m_ctx.get(), addr, nb, dest); }
+
+int RtuTransport::read_input_registers(int addr, int nb, uint16_t* dest) { return modbus_read_input_registers(m_ctx.get(), addr, nb, dest); }
+
+int RtuTransport::write_register(int addr, uint16_t value) { return modbus_write_register(m_ctx.get(), addr, value); }
+
+int RtuTransport::write_registers(int addr, int nb, const uint16_t* src) { return modbus_write_registers(m_ctx.get(), addr, nb, src); }
+
+int RtuTransport::write_bit(int addr, int status) { return modbus_write_bit(m_ctx.get(), addr, status); }
+
+int RtuTransport::write_bits(int addr, int nb, const uint8_t* src) { return modbus_write_bits(m_ctx.get(), addr, nb, src); }
+
+void set_transport_factory(TransportFactory factory) { g_transport_factory = factory; }
+
+std::unique_ptr<ModbusTransport> make_transport(const std::string& port, const SerialSettings& settings)
+{
+	TransportFactory factory{ g_transport_factory };
+	return factory ? factory(port, settings) : RtuTransport::create(port, settings);
+}
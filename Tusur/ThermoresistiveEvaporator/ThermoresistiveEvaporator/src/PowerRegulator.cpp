@@ -0,0 +1,240 @@
+#include <algorithm>
+#include <cmath>
+
+#include "framework.h"
+#include <timeapi.h>
+#include "PowerRegulator.h"
+#include "StatusConstants.h"
+
+#pragma comment(lib, "winmm.lib")
+
+PowerRegulator g_Regulator(g_PowerSupply);
+
+PowerRegulator::PowerRegulator(PowerSupplyManager& power_supply) : m_power_supply(power_supply) {}
+
+PowerRegulator::~PowerRegulator() { stop(); }
+
+int PowerRegulator::configure(const RegulatorConfig& config)
+{
+	if (config.mode < REGULATE_CURRENT || config.mode > REGULATE_RESISTANCE)
+		return RG_ERROR_INVALID_CONFIG;
+	if (config.period_ms < kregulator_min_period_ms)
+		return RG_ERROR_INVALID_CONFIG;
+	if (config.output_min < 0 || config.output_max > 0xFFFF || config.output_min > config.output_max)
+		return RG_ERROR_INVALID_CONFIG;
+	if (config.slew_per_s < 0 || config.voltage_limit < 0 || !PowerSupplyRegisters::voltage_fits(config.voltage_limit))
+		return RG_ERROR_INVALID_CONFIG;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_config = config;
+	m_configured = true;
+	return STATUS_OK;
+}
+
+void PowerRegulator::set_target(double target)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_status.target = target;
+}
+
+int PowerRegulator::start()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	if (!m_configured)
+		return RG_ERROR_NOT_CONFIGURED;
+	if (m_status.running)
+		return RG_ERROR_ALREADY_RUNNING;
+
+	// The previous loop has stopped on its own, only the thread object is left.
+	if (m_thread.joinable())
+	{
+		lock.unlock();
+		m_thread.join();
+		lock.lock();
+	}
+
+	const double target{ m_status.target };
+	m_status = RegulatorStatus{};
+	m_status.running = 1;
+	m_status.target = target;
+	m_stop = false;
+	m_thread = std::thread(&PowerRegulator::run, this);
+	return STATUS_OK;
+}
+
+void PowerRegulator::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_cv.notify_all();
+
+	if (m_thread.joinable())
+		m_thread.join();
+}
+
+void PowerRegulator::get_status(RegulatorStatus* status) const
+{
+	if (!status)
+		return;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	*status = m_status;
+}
+
+bool PowerRegulator::process_variable(int mode, int current, int voltage, double& value)
+{
+	const double volts{ PowerSupplyRegisters::register_to_volts(voltage) };
+	switch (mode)
+	{
+	case REGULATE_CURRENT:
+		value = current;
+		return true;
+	case REGULATE_POWER:
+		value = current * volts;
+		return true;
+	case REGULATE_RESISTANCE:
+		if (current <= 0)
+			return false;
+		value = volts / current;
+		return true;
+	default:
+		return false;
+	}
+}
+
+void PowerRegulator::run()
+{
+	// The default 15.6 ms timer tick would dominate the jitter of short periods.
+	timeBeginPeriod(1);
+	SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
+
+	// Bumpless start: the integral takes over whatever setpoint is applied now, read back if this process
+	// has not written one yet. Without it the first output would be a guess, so the loop does not start.
+	int applied{};
+	int error{ m_power_supply.read_setpoints(&applied, nullptr) };
+	double output{ static_cast<double>(applied) };
+	double integral{};
+	double previous_pv{};
+	bool has_previous{ false };
+	bool integral_seeded{ false };
+	int failures{};
+
+	auto deadline{ std::chrono::steady_clock::now() };
+	auto previous_cycle{ deadline };
+	while (error == STATUS_OK)
+	{
+		// 1. Taking the tuning and the target of this cycle.
+		RegulatorConfig config;
+		double target;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			config = m_config;
+			target = m_status.target;
+		}
+
+		const auto cycle_start{ std::chrono::steady_clock::now() };
+		const double dt{ has_previous ? std::chrono::duration<double>(cycle_start - previous_cycle).count() : config.period_ms / 1000.0 };
+		previous_cycle = cycle_start;
+
+		// 2. Measuring, both registers in one block read.
+		int current{}, voltage{};
+		int status{ m_power_supply.read_telemetry(&current, &voltage) };
+		double pv{};
+		if (status == STATUS_OK && process_variable(config.mode, current, voltage, pv))
+		{
+			const double feed_forward{ config.kff * target };
+			if (!integral_seeded)
+			{
+				integral = output - feed_forward;
+				integral_seeded = true;
+			}
+
+			// 3. Feed-forward plus PID, the derivative on the measurement.
+			const double error_value{ target - pv };
+			const double derivative{ has_previous && dt > 0 ? (pv - previous_pv) / dt : 0.0 };
+			const double next_integral{ integral + config.ki * error_value * dt };
+			const double wanted{ feed_forward + config.kp * error_value + next_integral - config.kd * derivative };
+
+			// 4. Range and slew limits.
+			double limited{ std::min(std::max(wanted, static_cast<double>(config.output_min)), static_cast<double>(config.output_max)) };
+			if (config.slew_per_s > 0)
+			{
+				const double step{ config.slew_per_s * dt };
+				limited = std::min(std::max(limited, output - step), output + step);
+			}
+
+			// 5. Anti-windup: no integration while a limit holds the output back from where the error pushes it.
+			const bool held{ (wanted > limited && error_value > 0) || (wanted < limited && error_value < 0) };
+			if (!held)
+				integral = next_integral;
+
+			output = limited;
+			previous_pv = pv;
+			has_previous = true;
+
+			// 6. Writing the setpoint, skipped by the shadow cache when the rounded value did not change.
+			status = m_power_supply.set_current_voltage(static_cast<uint16_t>(std::lround(output)), static_cast<uint16_t>(config.voltage_limit));
+		}
+		else if (status == STATUS_OK)
+		{
+			// Undefined process variable, e.g. the resistance before any current flows: bringing the output to its range.
+			output = std::min(std::max(output, static_cast<double>(config.output_min)), static_cast<double>(config.output_max));
+			integral_seeded = false;
+			status = m_power_supply.set_current_voltage(static_cast<uint16_t>(std::lround(output)), static_cast<uint16_t>(config.voltage_limit));
+		}
+
+		failures = status == STATUS_OK ? 0 : failures + 1;
+
+		// 7. Publishing the cycle.
+		const auto now{ std::chrono::steady_clock::now() };
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_status.measured = pv;
+			m_status.output = output;
+			m_status.integral = integral;
+			++m_status.cycles;
+			if (now - cycle_start > std::chrono::milliseconds(config.period_ms))
+				++m_status.overruns;
+			m_status.last_error = status;
+		}
+
+		if (failures >= kregulator_failure_limit)
+		{
+			error = status;
+			break;
+		}
+
+		// 8. Waiting for the next deadline of the fixed grid, skipping the ones already missed.
+		deadline += std::chrono::milliseconds(config.period_ms);
+		if (deadline < now)
+			deadline = now;
+
+		std::unique_lock<std::mutex> lock(m_mutex);
+		if (m_cv.wait_until(lock, deadline, [this] { return m_stop; }))
+			break;
+
+		const long long jitter_us{ std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - deadline).count() };
+		if (jitter_us > m_status.max_jitter_us)
+			m_status.max_jitter_us = jitter_us;
+	}
+
+	timeEndPeriod(1);
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_status.running = 0;
+	m_status.last_error = error;
+}
+
+extern "C" {
+	int Regulator_Configure(const RegulatorConfig* config) { return config ? g_Regulator.configure(*config) : RG_ERROR_INVALID_CONFIG; }
+
+	void Regulator_SetTarget(double target) { g_Regulator.set_target(target); }
+
+	int Regulator_Start() { return g_Regulator.start(); }
+
+	void Regulator_Stop() { g_Regulator.stop(); }
+
+	void Regulator_GetStatus(RegulatorStatus* status) { g_Regulator.get_status(status); }
+}
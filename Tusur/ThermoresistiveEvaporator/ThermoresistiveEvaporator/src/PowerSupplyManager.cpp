@@ -1,79 +1,451 @@
-#include <cstring>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
 
 #include "framework.h"
 #include "PowerSupplyManager.h"
+#include "SharedTelemetry.h"
 #include "StatusConstants.h"
+#include "StepMotorManager.h"
 
 PowerSupplyManager g_PowerSupply(ps_constants::kdefault_com_port);
+DeviceRegistry<PowerSupplyManager> g_PowerSupplies;
 
-PowerSupplyManager::PowerSupplyManager(const char* port) : m_ctx(nullptr, ModbusDeleter)
+PowerSupplyManager::PowerSupplyManager(const char* port) : m_port(port) {}
+
+PowerSupplyManager::~PowerSupplyManager()
 {
-	std::memset(buffer, 0, 20ul);
-	connect(port);
-}
+	stop_acquisition();
 
-PowerSupplyManager::~PowerSupplyManager() {}
+	{
+		std::lock_guard<std::mutex> lock(m_timed_run_mutex);
+		m_timed_run_shutdown = true;
+	}
+	m_timed_run_cv.notify_all();
+	if (m_timed_run_thread.joinable())
+		m_timed_run_thread.join();
+
+	{
+		std::lock_guard<std::mutex> lock(m_ramp_mutex);
+		m_ramp_shutdown = true;
+	}
+	m_ramp_cv.notify_all();
+	if (m_ramp_thread.joinable())
+		m_ramp_thread.join();
+
+	{
+		std::lock_guard<std::mutex> lock(m_mailbox_mutex);
+		m_mailbox_shutdown = true;
+	}
+	m_mailbox_cv.notify_all();
+	if (m_mailbox_thread.joinable())
+		m_mailbox_thread.join();
+}
 
 int PowerSupplyManager::connect(const char* port)
 {
-	// 1. Initializing connection.
-	m_ctx.reset(modbus_new_rtu(port, 19200, 'N', 8, 1));
-	if (!m_ctx)
-		return PS_ERROR_INIT_CONNECTION_FAILED;
+	std::shared_ptr<ModbusBus> bus;
+	bool switched{ false };
+	{
+		std::lock_guard<std::mutex> lock(m_bus_mutex);
 
-	// 2. Setting to slave.
-	if (modbus_set_slave(m_ctx.get(), 1) == -1)
-		return PS_ERROR_SET_SLAVE_FAILED;
+		// Switching to another port detaches the power supply from the current bus.
+		if (port && m_port != port)
+		{
+			m_port = port;
+			m_bus.reset();
+			switched = true;
+		}
+	}
 
-	// 3. Establishing the connection.
-	if (modbus_connect(m_ctx.get()) == -1)
+	// The epochs of the new bus start over, nothing cached for the previous device applies.
+	if (switched)
+		m_shadow.clear();
+
+	// Idempotent: returns immediately if the port is already open and healthy.
+	return ensure_connected(bus);
+}
+
+int PowerSupplyManager::connect_ex(const char* port, const SerialSettings& line, int slave)
+{
+	SerialSettings checked{ line };
+	if (checked.baud == 0)
+		checked.baud = kprobe_baud_rates[0];
+	if (!port || slave < 1 || slave > 247 || !ModbusBus::is_valid_settings(checked))
+		return BUS_ERROR_INVALID_LINE_SETTINGS;
+
+	// 1. Detaching from the current bus, so the probe can open the port at other rates.
 	{
-		m_ctx.reset();
-		return PS_ERROR_CONNECT_FAILED;
+		std::lock_guard<std::mutex> lock(m_bus_mutex);
+		m_port = port;
+		m_bus.reset();
 	}
 
-	return STATUS_OK;
+	// 2. Probing the baud rate on a known register.
+	SerialSettings selected{ line };
+	if (line.baud == 0)
+	{
+		int status{ ModbusBus::probe_baud(port, line, slave, 0x04, Readings::frame_addr(0), Readings::kframe_registers, selected.baud) };
+		if (status != STATUS_OK)
+			return status;
+	}
+
+	// 3. Attaching with the new settings, nothing cached for the previous slave applies.
+	{
+		std::lock_guard<std::mutex> lock(m_bus_mutex);
+		m_line = selected;
+		m_slave = slave;
+	}
+	m_shadow.clear();
+
+	std::shared_ptr<ModbusBus> bus;
+	return ensure_connected(bus);
+}
+
+int PowerSupplyManager::baud_rate()
+{
+	std::lock_guard<std::mutex> lock(m_bus_mutex);
+	return m_line.baud;
+}
+
+void PowerSupplyManager::connection_settings(std::string& port, SerialSettings& line, int& slave)
+{
+	std::lock_guard<std::mutex> lock(m_bus_mutex);
+	port = m_port;
+	line = m_line;
+	slave = m_slave;
+}
+
+int PowerSupplyManager::reconnect()
+{
+	std::shared_ptr<ModbusBus> bus;
+	int status{ ensure_connected(bus) };
+	if (status != STATUS_OK)
+		return status;
+
+	// The reopened device may have been power cycled, nothing cached before is trusted.
+	m_shadow.clear();
+	return bus->reconnect();
+}
+
+long long PowerSupplyManager::connect_latency_us()
+{
+	std::lock_guard<std::mutex> lock(m_bus_mutex);
+	return m_bus ? m_bus->connect_latency_us() : -1;
+}
+
+void PowerSupplyManager::link_status(LinkStatus* status)
+{
+	if (!status)
+		return;
+
+	std::lock_guard<std::mutex> lock(m_bus_mutex);
+	*status = m_bus ? m_bus->link_status() : LinkStatus{ LINK_DISCONNECTED, 0, 0, STATUS_OK, 0 };
+}
+
+int PowerSupplyManager::store_timeout_policy_locked(const TimeoutPolicy& policy)
+{
+	if (!ModbusBus::is_valid_policy(policy))
+		return BUS_ERROR_INVALID_TIMEOUT_POLICY;
+
+	m_timeouts = policy;
+	return m_bus ? m_bus->set_timeout_policy(m_slave, policy) : STATUS_OK;
+}
+
+int PowerSupplyManager::set_timeouts(int response_timeout_ms, int byte_timeout_ms, bool adaptive)
+{
+	std::lock_guard<std::mutex> lock(m_bus_mutex);
+	TimeoutPolicy policy{ m_timeouts };
+	policy.response_timeout_ms = response_timeout_ms;
+	policy.byte_timeout_ms = byte_timeout_ms;
+	policy.adaptive = adaptive;
+	return store_timeout_policy_locked(policy);
 }
 
-int PowerSupplyManager::set_current_voltage(uint16_t current, uint16_t voltage)
+int PowerSupplyManager::set_retry_policy(int max_retries, int retry_backoff_ms)
 {
-	// 1. Setting up the current register.
-	if (modbus_write_register(m_ctx.get(), 18, current) == -1)
-		return PS_ERROR_SET_CURRENT_FAILED;
+	std::lock_guard<std::mutex> lock(m_bus_mutex);
+	TimeoutPolicy policy{ m_timeouts };
+	policy.max_retries = max_retries;
+	policy.retry_backoff_ms = retry_backoff_ms;
+	return store_timeout_policy_locked(policy);
+}
+
+long long PowerSupplyManager::response_timeout_us()
+{
+	std::lock_guard<std::mutex> lock(m_bus_mutex);
+	return m_bus ? m_bus->response_timeout_us(m_slave) : m_timeouts.response_timeout_ms * 1000LL;
+}
+
+int PowerSupplyManager::ensure_connected(std::shared_ptr<ModbusBus>& bus)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_bus_mutex);
+		if (!m_bus)
+		{
+			int status{ ModbusBus::acquire(m_port, m_line, m_bus) };
+			if (status != STATUS_OK)
+				return status;
+
+			// A freshly created bus only knows the default policy.
+			m_bus->set_timeout_policy(m_slave, m_timeouts);
+		}
+		bus = m_bus;
+	}
+
+	return bus->connect();
+}
+
+int PowerSupplyManager::write_registers_cached(ModbusBus& bus, int priority, int addr, int nb, const uint16_t* values, bool force, int& written)
+{
+	const auto epoch{ bus.connection_epoch() };
+	int first{}, count{ nb };
+	if (!force && !m_shadow.dirty_range(epoch, addr, nb, values, first, count))
+	{
+		written = nb;
+		return nb;
+	}
+
+	int done{};
+	int rc{ bus.write_registers(m_slave, priority, addr + first, count, values + first, &done) };
+	m_shadow.store(epoch, addr + first, done, values + first);
+
+	// The outcome of a failed write is unknown, so the rest of the block can not stay cached.
+	if (rc == -1)
+		m_shadow.invalidate(addr + first + done, count - done);
+
+	written = rc == -1 ? first + done : nb;
+	for (int i{}; i < written; ++i)
+		note_setpoint(addr + i, values[i]);
+
+	return rc;
+}
+
+int PowerSupplyManager::write_setpoints_cached(ModbusBus& bus, int priority, const uint16_t* values, bool force, int& written)
+{
+	written = 0;
+	for (int frame{}; frame < Setpoints::kframes; ++frame)
+	{
+		const int offset{ frame * Setpoints::kframe_registers };
+		int done{};
+		int rc{ write_registers_cached(bus, priority, Setpoints::frame_addr(frame), Setpoints::kframe_registers, values + offset, force, done) };
+		written = offset + done;
+		if (rc == -1)
+			return -1;
+	}
+
+	return 2;
+}
+
+int PowerSupplyManager::read_setpoints_cached(ModbusBus& bus, int priority, uint16_t* values)
+{
+	const auto epoch{ bus.connection_epoch() };
+	if (m_shadow.lookup(epoch, Setpoints::kfirst, 1, values) && m_shadow.lookup(epoch, Setpoints::ksecond, 1, values + 1))
+		return 2;
+
+	// Nothing acknowledged on this connection, the device itself knows what it holds.
+	for (int frame{}; frame < Setpoints::kframes; ++frame)
+		if (bus.read_registers(m_slave, priority, Setpoints::frame_addr(frame), Setpoints::kframe_registers, values + frame * Setpoints::kframe_registers) == -1)
+			return -1;
+
+	m_shadow.store(epoch, Setpoints::kfirst, 1, values);
+	m_shadow.store(epoch, Setpoints::ksecond, 1, values + 1);
+	note_setpoint(Setpoints::kfirst, values[0]);
+	note_setpoint(Setpoints::ksecond, values[1]);
+	return 2;
+}
+
+void PowerSupplyManager::note_setpoint(int addr, int value)
+{
+	if (addr == Setpoints::kfirst)
+		m_current_setpoint = value;
+	else if (addr == Setpoints::ksecond)
+		m_voltage_setpoint = value;
+	else
+		return;
+
+	if (publishes_shared_telemetry())
+		g_SharedTelemetry.update([this](SharedTelemetryData& data) {
+			data.current_setpoint = m_current_setpoint;
+			data.voltage_setpoint = m_voltage_setpoint;
+		});
+}
+
+void PowerSupplyManager::note_coil(int addr, int state)
+{
+	if (!publishes_shared_telemetry() || (addr != PowerSupplyRegisters::kpower_coil && addr != PowerSupplyRegisters::kworkmode_coil))
+		return;
+
+	g_SharedTelemetry.update([addr, state](SharedTelemetryData& data) {
+		(addr == PowerSupplyRegisters::kpower_coil ? data.power_coil : data.workmode_coil) = state;
+	});
+}
+
+void PowerSupplyManager::publish_readings(int status, const uint16_t* registers)
+{
+	if (!publishes_shared_telemetry() || !g_SharedTelemetry.active())
+		return;
+
+	// Taken before the block is locked, the bus may be busy reconnecting.
+	LinkStatus link{};
+	link_status(&link);
+	const long long now_us{ std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count() };
+
+	g_SharedTelemetry.update([&](SharedTelemetryData& data) {
+		data.reading_time_us = now_us;
+		data.reading_status = status;
+		if (status == STATUS_OK)
+		{
+			data.current = registers[0];
+			data.voltage = registers[1];
+		}
+		data.power_supply_link = link;
+	});
+}
+
+bool PowerSupplyManager::publishes_shared_telemetry() const { return this == &g_PowerSupply; }
+
+int PowerSupplyManager::execute_batch(const BatchOp* ops, int n, BatchResult* out)
+{
+	std::lock_guard<std::mutex> command_lock(m_command_mutex);
+
+	std::shared_ptr<ModbusBus> bus;
+	int status{ ensure_connected(bus) };
+	if (status != STATUS_OK)
+		return status;
 
-	// 2. Setting up the voltage register.
-	if (modbus_write_register(m_ctx.get(), 19, voltage * kvoltage_multiplier) == -1)
-		return PS_ERROR_SET_VOLTAGE_FAILED;
+	int rc{ bus->execute_batch(m_slave, BUS_PRIORITY_COMMAND, ops, n, out) };
+
+	// The batch bypasses the cache, whatever it wrote can not stay cached.
+	for (int i{}; i < n; ++i)
+	{
+		// A skipped coil write left the coil as it was.
+		if (ops[i].kind == BATCH_WRITE_COIL && out[i].status != DEV_ERROR_BATCH_SKIPPED)
+			note_coil(ops[i].addr, out[i].status == STATUS_OK ? (ops[i].value ? 1 : 0) : -1);
+
+		if (ops[i].kind != BATCH_WRITE_REGISTER)
+			continue;
+
+		m_shadow.invalidate(ops[i].addr);
+		if (out[i].status == STATUS_OK)
+			note_setpoint(ops[i].addr, ops[i].value);
+	}
+
+	return rc == -1 ? DEV_ERROR_BATCH_OP_FAILED : STATUS_OK;
+}
+
+int PowerSupplyManager::set_current_voltage(uint16_t current, uint16_t voltage, bool force)
+{
+	// The latest command wins over a running ramp and a posted setpoint.
+	cancel_ramp_silently();
+	discard_posted_setpoint();
+	std::lock_guard<std::mutex> command_lock(m_command_mutex);
+
+	std::shared_ptr<ModbusBus> bus;
+	int status{ ensure_connected(bus) };
+	if (status != STATUS_OK)
+		return status;
+
+	// Setting up the current (18) and voltage (19) registers in one frame.
+	const uint16_t setpoint[2]{ current, PowerSupplyRegisters::voltage_to_register(voltage) };
+	int written{};
+	if (write_setpoints_cached(*bus, BUS_PRIORITY_COMMAND, setpoint, force, written) == -1)
+		return written == 0 ? PS_ERROR_SET_CURRENT_FAILED : PS_ERROR_SET_VOLTAGE_FAILED;
 
 	return STATUS_OK;
 }
 
 int PowerSupplyManager::read_current()
 {
+	std::shared_ptr<ModbusBus> bus;
+	if (ensure_connected(bus) != STATUS_OK)
+		return PS_ERROR_READ_CURRENT;
+
+	uint16_t value{};
+
 	// Reading input registers from 0x20 addr.
-	if (modbus_read_input_registers(m_ctx.get(), 20, 1, buffer) == -1)
+	if (bus->read_input_registers(m_slave, BUS_PRIORITY_TELEMETRY, Readings::kfirst, 1, &value) == -1)
 		return PS_ERROR_READ_CURRENT;
 
-	return static_cast<int>(buffer[0]);
+	return static_cast<int>(value);
 }
 
 int PowerSupplyManager::read_voltage()
 {
+	std::shared_ptr<ModbusBus> bus;
+	if (ensure_connected(bus) != STATUS_OK)
+		return PS_ERROR_READ_VOLTAGE;
+
+	uint16_t value{};
+
 	// Reading input registers from 0x21 addr.
-	if (modbus_read_input_registers(m_ctx.get(), 21, 1, buffer) == -1)
+	if (bus->read_input_registers(m_slave, BUS_PRIORITY_TELEMETRY, Readings::ksecond, 1, &value) == -1)
 		return PS_ERROR_READ_VOLTAGE;
 
-	return static_cast<int>(buffer[0]);
+	return static_cast<int>(value);
+}
+
+int PowerSupplyManager::read_telemetry(int* current, int* voltage)
+{
+	std::shared_ptr<ModbusBus> bus;
+	int status{ ensure_connected(bus) };
+	uint16_t registers[2]{};
+
+	// Reading input registers 0x20 (current) and 0x21 (voltage) as one block.
+	for (int frame{}; status == STATUS_OK && frame < Readings::kframes; ++frame)
+		if (bus->read_input_registers(m_slave, BUS_PRIORITY_TELEMETRY, Readings::frame_addr(frame), Readings::kframe_registers, registers + frame * Readings::kframe_registers) == -1)
+			status = PS_ERROR_READ_TELEMETRY;
+
+	// Failures are published too, a reader sees the link go down.
+	publish_readings(status, registers);
+	if (status != STATUS_OK)
+		return status;
+
+	if (current)
+		*current = static_cast<int>(registers[0]);
+	if (voltage)
+		*voltage = static_cast<int>(registers[1]);
+
+	return STATUS_OK;
+}
+
+int PowerSupplyManager::read_setpoints(int* current, int* voltage)
+{
+	std::lock_guard<std::mutex> command_lock(m_command_mutex);
+
+	std::shared_ptr<ModbusBus> bus;
+	uint16_t values[2]{};
+	if (ensure_connected(bus) != STATUS_OK || read_setpoints_cached(*bus, BUS_PRIORITY_COMMAND, values) == -1)
+		return PS_ERROR_READ_SETPOINTS;
+
+	if (current)
+		*current = static_cast<int>(values[0]);
+	if (voltage)
+		*voltage = static_cast<int>(values[1]);
+
+	return STATUS_OK;
 }
 
 int PowerSupplyManager::turn_on()
 {
+	std::lock_guard<std::mutex> command_lock(m_command_mutex);
+
+	std::shared_ptr<ModbusBus> bus;
+	int status{ ensure_connected(bus) };
+	if (status != STATUS_OK)
+		return status;
+
 	// 1. Turning on power supply.
-	if (modbus_write_bit(m_ctx.get(), 272, 1) == -1)
+	const bool powered{ bus->write_bit(m_slave, BUS_PRIORITY_COMMAND, PowerSupplyRegisters::kpower_coil, 1) != -1 };
+	note_coil(PowerSupplyRegisters::kpower_coil, powered ? 1 : -1);
+	if (!powered)
 		return PS_ERROR_POWER_SUPPLY_TURN_ON_FAILED;
 
 	// 2. Turning on workmode of the power supply.
-	if (modbus_write_bit(m_ctx.get(), 273, 1) == -1)
+	const bool working{ bus->write_bit(m_slave, BUS_PRIORITY_COMMAND, PowerSupplyRegisters::kworkmode_coil, 1) != -1 };
+	note_coil(PowerSupplyRegisters::kworkmode_coil, working ? 1 : -1);
+	if (!working)
 		return PS_ERROR_POWER_SUPPLY_TURN_ON_WORKMODE_FAILED;
 
 	return STATUS_OK;
@@ -81,20 +453,77 @@ int PowerSupplyManager::turn_on()
 
 int PowerSupplyManager::turn_off()
 {
-	// 1. Resetting current.
-	if (modbus_write_register(m_ctx.get(), 18, 0) == -1)
-		return PS_ERROR_RESET_CURRENT;
+	// Cancelled before the command lock is taken, so no ramp step or posted setpoint lands after the reset.
+	cancel_ramp_silently();
+	discard_posted_setpoint();
+	std::lock_guard<std::mutex> command_lock(m_command_mutex);
+	return turn_off_sequence();
+}
+
+int PowerSupplyManager::safety_turn_off()
+{
+	cancel_ramp_silently();
+	discard_posted_setpoint();
+	return turn_off_sequence();
+}
+
+int PowerSupplyManager::turn_off_sequence()
+{
+	std::shared_ptr<ModbusBus> bus;
+	int status{ ensure_connected(bus) };
+	if (status != STATUS_OK)
+		return status;
+
+	// 1. Resetting current and voltage in one frame. Safety path: always written, whatever the cache says.
+	const uint16_t zero[2]{};
+	int written{};
+	if (write_setpoints_cached(*bus, BUS_PRIORITY_SAFETY, zero, true, written) == -1)
+		return written == 0 ? PS_ERROR_RESET_CURRENT : PS_ERROR_RESET_VOLTAGE;
+
+	// 2. Resetting workmode.
+	const bool idle{ bus->write_bit(m_slave, BUS_PRIORITY_SAFETY, PowerSupplyRegisters::kworkmode_coil, 0) != -1 };
+	note_coil(PowerSupplyRegisters::kworkmode_coil, idle ? 0 : -1);
+	if (!idle)
+		return PS_ERROR_RESET_WORKMODE;
+
+	// 3. Turning of the power supply.
+	const bool off{ bus->write_bit(m_slave, BUS_PRIORITY_SAFETY, PowerSupplyRegisters::kpower_coil, 0) != -1 };
+	note_coil(PowerSupplyRegisters::kpower_coil, off ? 0 : -1);
+	if (!off)
+		return PS_ERROR_POWER_SUPPLY_TURN_OFF_FAILED;
+
+	return STATUS_OK;
+}
+
+int PowerSupplyManager::emergency_turn_off()
+{
+	std::shared_ptr<ModbusBus> bus;
+	{
+		std::unique_lock<std::mutex> lock(m_bus_mutex, std::try_to_lock);
+		if (!lock.owns_lock())
+			return PS_ERROR_RESET_CURRENT;
+
+		// Never connected, nothing to turn off.
+		if (!m_bus)
+			return STATUS_OK;
+		bus = m_bus;
+	}
 
-	// 2. Resetting voltage.
-	if (modbus_write_register(m_ctx.get(), 19, 0) == -1)
-		return PS_ERROR_RESET_VOLTAGE;
+	// 1. Resetting current and voltage, one register at a time if the slave rejects the block write.
+	const uint16_t zero[2]{};
+	if (bus->execute_on_caller(m_slave, [&zero](ModbusTransport& transport) {
+			if (Setpoints::kframes == 1 && transport.write_registers(Setpoints::kfirst, 2, zero) != -1)
+				return 2;
+			return transport.write_register(Setpoints::kfirst, 0) != -1 && transport.write_register(Setpoints::ksecond, 0) != -1 ? 2 : -1;
+		}) == -1)
+		return PS_ERROR_RESET_CURRENT;
 
-	// 3. Resetting workmode.
-	if (modbus_write_bit(m_ctx.get(), 273, 0) == -1)
+	// 2. Resetting workmode.
+	if (bus->execute_on_caller(m_slave, [](ModbusTransport& transport) { return transport.write_bit(PowerSupplyRegisters::kworkmode_coil, 0); }) == -1)
 		return PS_ERROR_RESET_WORKMODE;
 
-	// 4. Turning of the power supply.
-	if (modbus_write_bit(m_ctx.get(), 272, 0) == -1)
+	// 3. Turning of the power supply.
+	if (bus->execute_on_caller(m_slave, [](ModbusTransport& transport) { return transport.write_bit(PowerSupplyRegisters::kpower_coil, 0); }) == -1)
 		return PS_ERROR_POWER_SUPPLY_TURN_OFF_FAILED;
 
 	return STATUS_OK;
@@ -102,32 +531,652 @@ int PowerSupplyManager::turn_off()
 
 int PowerSupplyManager::reset_zp()
 {
-	if (modbus_write_register(m_ctx.get(), 36, 0) == -1)
+	std::lock_guard<std::mutex> command_lock(m_command_mutex);
+
+	std::shared_ptr<ModbusBus> bus;
+	int status{ ensure_connected(bus) };
+	if (status != STATUS_OK)
+		return status;
+
+	if (bus->write_register(m_slave, BUS_PRIORITY_COMMAND, PowerSupplyRegisters::kzero_point, 0) == -1)
 		return PS_ERROR_RESET_ZP_FAILED;
 
 	return STATUS_OK;
 }
 
+int PowerSupplyManager::start_acquisition(int interval_ms)
+{
+	if (interval_ms < kmin_acquisition_interval_ms)
+		return PS_ERROR_UNSUPPORTED_ACQUISITION_INTERVAL;
+
+	std::lock_guard<std::mutex> lock(m_acquisition_mutex);
+	m_acquisition_interval_ms = interval_ms;
+	if (m_acquisition_running)
+		return STATUS_OK;
+
+	m_acquisition_running = true;
+	m_acquisition_thread = std::thread(&PowerSupplyManager::acquisition_loop, this);
+	return STATUS_OK;
+}
+
+void PowerSupplyManager::stop_acquisition()
+{
+	std::lock_guard<std::mutex> lock(m_acquisition_mutex);
+	{
+		std::lock_guard<std::mutex> wait_lock(m_acquisition_wait_mutex);
+		m_acquisition_running = false;
+	}
+	m_acquisition_cv.notify_all();
+
+	if (m_acquisition_thread.joinable())
+		m_acquisition_thread.join();
+}
+
+int PowerSupplyManager::drain_samples(Sample* out, int max)
+{
+	if (!out || max <= 0)
+		return 0;
+
+	return static_cast<int>(m_samples.pop(out, static_cast<std::size_t>(max)));
+}
+
+void PowerSupplyManager::acquisition_loop()
+{
+	auto deadline{ std::chrono::steady_clock::now() };
+	while (m_acquisition_running)
+	{
+		Sample sample{};
+		sample.status = read_telemetry(&sample.current, &sample.voltage);
+		sample.timestamp_us = std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+
+		// If the consumer is not draining, newest samples are dropped.
+		m_samples.push(sample);
+
+		// The record is filled directly in the mapped file. Only the global supply works with the global motor.
+		const int motor_state{ this == &g_PowerSupply ? g_StepMotor.motor_state() : -1 };
+		m_recorder.append([this, &sample, motor_state](TelemetryRecord& record) {
+			record.timestamp_us = sample.timestamp_us;
+			record.current = sample.current;
+			record.voltage = sample.voltage;
+			record.current_setpoint = m_current_setpoint;
+			record.voltage_setpoint = m_voltage_setpoint;
+			record.motor_state = motor_state;
+			record.status = sample.status;
+		});
+
+		// Deadline-based schedule: a slow read shortens the next wait instead of shifting the grid.
+		deadline += std::chrono::milliseconds(m_acquisition_interval_ms.load());
+		const auto now{ std::chrono::steady_clock::now() };
+		if (deadline < now)
+			deadline = now;
+
+		std::unique_lock<std::mutex> lock(m_acquisition_wait_mutex);
+		m_acquisition_cv.wait_until(lock, deadline, [this] { return !m_acquisition_running; });
+	}
+}
+
 int PowerSupplyManager::turn_on_with_timer()
 {
+	const int minutes{ timer_val };
+
 	// 1. If "timer_val" is negative
-	if (timer_val < 0) {
+	if (minutes < 0)
 		return PS_ERROR_UNSUPPORTED_TIMER_VALUE;
-	}
+
 	// 2. If timer value is 0, then it the usual "turn_on" will be executed
-	else if (timer_val == 0)
-		return PowerSupplyManager::turn_on();
-	// 3. The timer value is positive, so timer operation will start
-	else {
-		// 4. The power supply will turn on
+	if (minutes == 0)
+		return turn_on();
+
+	// 3. The timer value is positive, the supply is turned on and turned off by the scheduler after "timer_val" minutes
+	return start_timed_run(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::minutes(minutes)).count());
+}
+
+int PowerSupplyManager::start_timed_run(long long duration_ms)
+{
+	if (duration_ms <= 0)
+		return PS_ERROR_UNSUPPORTED_TIMER_VALUE;
 
-		if (not(PowerSupplyManager::turn_on()))
-			return PS_ERROR_POWER_SUPPLY_TURN_ON_FAILED;
+	// 1. Turning on the power supply.
+	int status{ turn_on() };
+	if (status != STATUS_OK)
+		return status;
 
-		// 5. Now the operation will be paused for user specified amount of time (minutes)
+	// 2. Scheduling the turn-off, the deadline is counted from the moment the supply is on.
+	{
+		std::lock_guard<std::mutex> lock(m_timed_run_mutex);
+		m_timed_run_deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(duration_ms);
+		m_timed_run_active = true;
+		if (!m_timed_run_thread.joinable())
+			m_timed_run_thread = std::thread(&PowerSupplyManager::timed_run_loop, this);
+	}
+	m_timed_run_cv.notify_all();
+
+	return STATUS_OK;
+}
 
-		std::this_thread::sleep_for(std::chrono::minutes(timer_val));
+void PowerSupplyManager::cancel_timed_run()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_timed_run_mutex);
+		m_timed_run_active = false;
+	}
+	m_timed_run_cv.notify_all();
+}
+
+long long PowerSupplyManager::timed_run_remaining_ms()
+{
+	std::lock_guard<std::mutex> lock(m_timed_run_mutex);
+	if (!m_timed_run_active)
+		return -1;
+
+	auto remaining{ std::chrono::duration_cast<std::chrono::milliseconds>(m_timed_run_deadline - std::chrono::steady_clock::now()).count() };
+	return remaining > 0 ? remaining : 0;
+}
+
+void PowerSupplyManager::set_timed_run_callback(TimedRunCallback callback)
+{
+	std::lock_guard<std::mutex> lock(m_timed_run_mutex);
+	m_timed_run_callback = callback;
+}
+
+void PowerSupplyManager::timed_run_loop()
+{
+	std::unique_lock<std::mutex> lock(m_timed_run_mutex);
+	while (!m_timed_run_shutdown)
+	{
+		if (!m_timed_run_active)
+		{
+			m_timed_run_cv.wait(lock);
+			continue;
+		}
+
+		// Woken up early by start, cancel or shutdown - re-evaluate the state.
+		m_timed_run_cv.wait_until(lock, m_timed_run_deadline);
+		if (m_timed_run_shutdown || !m_timed_run_active || std::chrono::steady_clock::now() < m_timed_run_deadline)
+			continue;
+
+		m_timed_run_active = false;
+		TimedRunCallback callback{ m_timed_run_callback };
+		lock.unlock();
+
+		int status{ turn_off() };
+		if (callback)
+			callback(status);
+
+		lock.lock();
+	}
+}
+
+int PowerSupplyManager::set_ramp_config(const RampConfig& config)
+{
+	if ((config.profile != RAMP_LINEAR && config.profile != RAMP_S_CURVE) || config.current_rate_per_s < 0 || config.voltage_rate_per_s < 0)
+		return PS_ERROR_INVALID_RAMP;
+
+	std::lock_guard<std::mutex> lock(m_ramp_mutex);
+	m_ramp_config = config;
+	return STATUS_OK;
+}
+
+int PowerSupplyManager::ramp_to(uint16_t current, uint16_t voltage)
+{
+	if (!PowerSupplyRegisters::voltage_fits(voltage))
+		return PS_ERROR_INVALID_RAMP;
+
+	return start_ramp(current, PowerSupplyRegisters::voltage_to_register(voltage), false);
+}
+
+int PowerSupplyManager::ramp_off() { return start_ramp(0, 0, true); }
+
+int PowerSupplyManager::start_ramp(int current, int voltage, bool turn_off)
+{
+	// Checking the link up front, so the caller learns about a missing device right away.
+	std::shared_ptr<ModbusBus> bus;
+	int status{ ensure_connected(bus) };
+	if (status != STATUS_OK)
+		return status;
+
+	discard_posted_setpoint();
+	{
+		// 1. Starting where the setpoints are now, a running ramp included. The command lock keeps
+		//    the ramp thread from moving them between the read and the takeover.
+		std::lock_guard<std::mutex> command_lock(m_command_mutex);
+		uint16_t origin[2]{};
+		if (read_setpoints_cached(*bus, BUS_PRIORITY_COMMAND, origin) == -1)
+			return PS_ERROR_READ_SETPOINTS;
+
+		std::lock_guard<std::mutex> lock(m_ramp_mutex);
+		m_ramp_from[0] = origin[0];
+		m_ramp_from[1] = origin[1];
+		m_ramp_to[0] = current;
+		m_ramp_to[1] = voltage;
+		m_ramp_stepped[0] = m_ramp_config.current_rate_per_s <= 0;
+		m_ramp_stepped[1] = m_ramp_config.voltage_rate_per_s <= 0;
+
+		// 2. The slower channel sets the duration. The S-curve peaks at 1.5 times its mean rate.
+		const double scale{ m_ramp_config.profile == RAMP_S_CURVE ? 1.5 : 1.0 };
+		double seconds{};
+		if (m_ramp_config.current_rate_per_s > 0)
+			seconds = std::max(seconds, std::abs(current - m_ramp_from[0]) * scale / m_ramp_config.current_rate_per_s);
+		if (m_ramp_config.voltage_rate_per_s > 0)
+			seconds = std::max(seconds, std::abs(voltage - m_ramp_from[1]) * scale / (m_ramp_config.voltage_rate_per_s * PowerSupplyRegisters::kvoltage_scale));
+
+		m_ramp_profile = m_ramp_config.profile;
+		m_ramp_start = std::chrono::steady_clock::now();
+		m_ramp_duration = std::chrono::microseconds(static_cast<long long>(seconds * 1e6));
+		m_ramp_turn_off = turn_off;
+		m_ramp_active = true;
+		m_ramp_status.active = 1;
+		m_ramp_status.last_error = STATUS_OK;
+		if (!m_ramp_thread.joinable())
+			m_ramp_thread = std::thread(&PowerSupplyManager::ramp_loop, this);
+	}
+	m_ramp_cv.notify_all();
+
+	return STATUS_OK;
+}
+
+void PowerSupplyManager::cancel_ramp_silently()
+{
+	std::lock_guard<std::mutex> lock(m_ramp_mutex);
+	m_ramp_active = false;
+	m_ramp_status.active = 0;
+}
+
+void PowerSupplyManager::cancel_ramp()
+{
+	cancel_ramp_silently();
+	m_ramp_cv.notify_all();
+}
+
+void PowerSupplyManager::ramp_status(RampStatus* status)
+{
+	if (!status)
+		return;
+
+	std::lock_guard<std::mutex> lock(m_ramp_mutex);
+	*status = m_ramp_status;
+	status->remaining_ms = 0;
+	if (m_ramp_active)
+	{
+		auto remaining{ std::chrono::duration_cast<std::chrono::milliseconds>(m_ramp_start + m_ramp_duration - std::chrono::steady_clock::now()).count() };
+		status->remaining_ms = remaining > 0 ? remaining : 0;
+	}
+}
+
+void PowerSupplyManager::ramp_loop()
+{
+	auto deadline{ std::chrono::steady_clock::now() };
+	std::unique_lock<std::mutex> lock(m_ramp_mutex);
+	while (!m_ramp_shutdown)
+	{
+		if (!m_ramp_active)
+		{
+			m_ramp_cv.wait(lock);
+			deadline = std::chrono::steady_clock::now();
+			continue;
+		}
+
+		const auto ramp_start{ m_ramp_start };
+		lock.unlock();
+
+		int status{ STATUS_OK };
+		bool finished{ false }, turn_off_at_end{ false };
+		{
+			std::lock_guard<std::mutex> command_lock(m_command_mutex);
+			lock.lock();
+
+			// 1. The ramp may have been cancelled or replaced while waiting for the command lock.
+			if (!m_ramp_active || m_ramp_start != ramp_start)
+				continue;
+
+			// 2. Profile value at the moment the bus is ours.
+			const auto elapsed{ std::chrono::steady_clock::now() - m_ramp_start };
+			double s{ 1.0 };
+			if (m_ramp_duration.count() > 0 && elapsed < m_ramp_duration)
+			{
+				s = std::chrono::duration<double>(elapsed).count() / std::chrono::duration<double>(m_ramp_duration).count();
+				if (m_ramp_profile == RAMP_S_CURVE)
+					s = s * s * (3.0 - 2.0 * s);
+			}
+
+			uint16_t values[2]{};
+			for (int i{}; i < 2; ++i)
+				values[i] = static_cast<uint16_t>(std::lround(m_ramp_from[i] + (m_ramp_to[i] - m_ramp_from[i]) * (m_ramp_stepped[i] ? 1.0 : s)));
+			finished = s >= 1.0;
+			turn_off_at_end = m_ramp_turn_off;
+			lock.unlock();
+
+			// 3. Writing both setpoints in one frame, skipped when the rounded values did not move.
+			std::shared_ptr<ModbusBus> bus;
+			status = ensure_connected(bus);
+			int written{};
+			if (status == STATUS_OK && write_setpoints_cached(*bus, BUS_PRIORITY_COMMAND, values, false, written) == -1)
+				status = written == 0 ? PS_ERROR_SET_CURRENT_FAILED : PS_ERROR_SET_VOLTAGE_FAILED;
+
+			lock.lock();
+			m_ramp_status.current = values[0];
+			m_ramp_status.voltage = values[1];
+			++m_ramp_status.writes;
+		}
+
+		// 4. Ending the ramp at the target or at the first failure.
+		if (status != STATUS_OK || finished)
+		{
+			m_ramp_active = false;
+			m_ramp_status.last_error = status;
+			lock.unlock();
+			if (status == STATUS_OK && turn_off_at_end)
+			{
+				// A ramp started meanwhile owns the setpoints, this one does not turn the supply off under it.
+				// The check and the reset share the command lock, which the start of a ramp takes too.
+				std::lock_guard<std::mutex> command_lock(m_command_mutex);
+				lock.lock();
+				const bool owned{ m_ramp_start == ramp_start && !m_ramp_active };
+				lock.unlock();
+				if (owned)
+				{
+					discard_posted_setpoint();
+					status = turn_off_sequence();
+				}
+			}
+			lock.lock();
+			if (m_ramp_start == ramp_start)
+				m_ramp_status.last_error = status;
+			m_ramp_status.active = m_ramp_active ? 1 : 0;
+			continue;
+		}
+
+		// 5. Next write on the step grid. A write slower than the step moves the grid instead of queueing up.
+		deadline += std::chrono::milliseconds(kramp_step_ms);
+		const auto now{ std::chrono::steady_clock::now() };
+		if (deadline < now)
+			deadline = now;
+		m_ramp_cv.wait_until(lock, deadline, [this, ramp_start] { return m_ramp_shutdown || !m_ramp_active || m_ramp_start != ramp_start; });
+	}
+}
+
+int PowerSupplyManager::post_current_voltage(uint16_t current, uint16_t voltage)
+{
+	// The latest command wins over a running ramp.
+	cancel_ramp_silently();
+
+	int unreported{ STATUS_OK };
+	{
+		std::lock_guard<std::mutex> lock(m_mailbox_mutex);
+		if (m_mailbox_pending)
+			++m_mailbox_status.coalesced;
+		else
+			m_mailbox_posted_at = std::chrono::steady_clock::now();
+
+		m_mailbox_values[0] = current;
+		m_mailbox_values[1] = PowerSupplyRegisters::voltage_to_register(voltage);
+		m_mailbox_pending = true;
+		m_mailbox_status.pending = 1;
+		++m_mailbox_status.posted;
+
+		unreported = m_mailbox_unreported_error;
+		m_mailbox_unreported_error = STATUS_OK;
+		if (!m_mailbox_thread.joinable())
+			m_mailbox_thread = std::thread(&PowerSupplyManager::mailbox_loop, this);
+	}
+	m_mailbox_cv.notify_all();
+
+	return unreported;
+}
+
+void PowerSupplyManager::discard_posted_setpoint()
+{
+	std::lock_guard<std::mutex> lock(m_mailbox_mutex);
+	m_mailbox_pending = false;
+	m_mailbox_status.pending = 0;
+}
+
+void PowerSupplyManager::setpoint_mailbox_status(SetpointMailboxStatus* status)
+{
+	if (!status)
+		return;
+
+	std::lock_guard<std::mutex> lock(m_mailbox_mutex);
+	*status = m_mailbox_status;
+}
+
+void PowerSupplyManager::mailbox_loop()
+{
+	std::unique_lock<std::mutex> lock(m_mailbox_mutex);
+	while (!m_mailbox_shutdown)
+	{
+		if (!m_mailbox_pending)
+		{
+			m_mailbox_cv.wait(lock);
+			continue;
+		}
+		lock.unlock();
+
+		int status{ STATUS_OK };
+		{
+			std::lock_guard<std::mutex> command_lock(m_command_mutex);
+			lock.lock();
+
+			// 1. Taking the newest value once the command lock is ours, a command may have dropped it meanwhile.
+			if (!m_mailbox_pending)
+				continue;
+
+			const uint16_t values[2]{ m_mailbox_values[0], m_mailbox_values[1] };
+			const auto posted_at{ m_mailbox_posted_at };
+			m_mailbox_pending = false;
+			m_mailbox_status.pending = 0;
+			lock.unlock();
+
+			// 2. Writing both setpoints in one frame. Posts arriving meanwhile only replace the mailbox value.
+			std::shared_ptr<ModbusBus> bus;
+			status = ensure_connected(bus);
+			int written{};
+			if (status == STATUS_OK && write_setpoints_cached(*bus, BUS_PRIORITY_COMMAND, values, false, written) == -1)
+				status = written == 0 ? PS_ERROR_SET_CURRENT_FAILED : PS_ERROR_SET_VOLTAGE_FAILED;
+
+			const long long lag_us{ std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - posted_at).count() };
+			lock.lock();
+			m_mailbox_status.last_error = status;
+			if (status == STATUS_OK)
+			{
+				m_mailbox_status.current = values[0];
+				m_mailbox_status.voltage = values[1];
+				m_mailbox_status.last_lag_us = lag_us;
+				if (lag_us > m_mailbox_status.max_lag_us)
+					m_mailbox_status.max_lag_us = lag_us;
+				++m_mailbox_status.applied;
+			}
+			else if (m_mailbox_unreported_error == STATUS_OK)
+				m_mailbox_unreported_error = status;
+		}
+	}
+}
+
+extern "C" {
+	int PowerSupply_Connect(const char* port) { return g_PowerSupply.connect(port); }
+
+	int PowerSupply_ConnectEx(const char* port, int baud, char parity, int data_bits, int stop_bits, int slave)
+	{
+		return g_PowerSupply.connect_ex(port, SerialSettings{ baud, parity, data_bits, stop_bits }, slave);
+	}
+
+	int PowerSupply_GetBaudRate() { return g_PowerSupply.baud_rate(); }
+
+	int PowerSupply_Reconnect() { return g_PowerSupply.reconnect(); }
+
+	long long PowerSupply_GetConnectLatency() { return g_PowerSupply.connect_latency_us(); }
+
+	void PowerSupply_GetLinkStatus(LinkStatus* status) { g_PowerSupply.link_status(status); }
+
+	int PowerSupply_SetTimeouts(int response_timeout_ms, int byte_timeout_ms, int adaptive) { return g_PowerSupply.set_timeouts(response_timeout_ms, byte_timeout_ms, adaptive != 0); }
+
+	int PowerSupply_SetRetryPolicy(int max_retries, int retry_backoff_ms) { return g_PowerSupply.set_retry_policy(max_retries, retry_backoff_ms); }
+
+	long long PowerSupply_GetResponseTimeout() { return g_PowerSupply.response_timeout_us(); }
+
+	int PowerSupply_SetCurrentVoltage(uint16_t current, uint16_t voltage) { return g_PowerSupply.set_current_voltage(current, voltage); }
+
+	int PowerSupply_SetCurrentVoltageEx(uint16_t current, uint16_t voltage, int force) { return g_PowerSupply.set_current_voltage(current, voltage, force != 0); }
+
+	void PowerSupply_InvalidateShadow() { g_PowerSupply.invalidate_shadow(); }
+
+	int PowerSupply_TurnOn() { return g_PowerSupply.turn_on(); }
+
+	int PowerSupply_TurnOff() { return g_PowerSupply.turn_off(); }
+
+	int PowerSupply_ReadCurrent() { return g_PowerSupply.read_current(); }
+
+	int PowerSupply_ReadVoltage() { return g_PowerSupply.read_voltage(); }
+
+	int PowerSupply_ReadCurrentVoltage(int* current, int* voltage) { return g_PowerSupply.read_telemetry(current, voltage); }
+
+	int PowerSupply_StartAcquisition(int interval_ms) { return g_PowerSupply.start_acquisition(interval_ms); }
+
+	void PowerSupply_StopAcquisition() { g_PowerSupply.stop_acquisition(); }
+
+	int PowerSupply_DrainSamples(Sample* out, int max) { return g_PowerSupply.drain_samples(out, max); }
+
+	int PowerSupply_StartRecording(const char* path) { return g_PowerSupply.start_recording(path); }
+
+	void PowerSupply_StopRecording() { g_PowerSupply.stop_recording(); }
+
+	long long PowerSupply_GetRecordedCount() { return g_PowerSupply.recorded_count(); }
+
+	int Telemetry_Query(long long t0_us, long long t1_us, int max_points, TelemetryEnvelopePoint* out) { return g_PowerSupply.query_telemetry(t0_us, t1_us, max_points, out); }
+
+	int PowerSupply_ResetZP() { return g_PowerSupply.reset_zp(); }
+
+	void PowerSupply_SetTimer(int t) { g_PowerSupply.set_timer(t); }
+
+	int PowerSupply_TurnOnWithTimer() { return g_PowerSupply.turn_on_with_timer(); }
+
+	int PowerSupply_StartTimedRun(long long duration_ms) { return g_PowerSupply.start_timed_run(duration_ms); }
+
+	void PowerSupply_CancelTimedRun() { g_PowerSupply.cancel_timed_run(); }
+
+	long long PowerSupply_GetTimedRunRemaining() { return g_PowerSupply.timed_run_remaining_ms(); }
+
+	void PowerSupply_SetTimedRunCallback(TimedRunCallback callback) { g_PowerSupply.set_timed_run_callback(callback); }
+
+	int PowerSupply_SetRampConfig(const RampConfig* config) { return config ? g_PowerSupply.set_ramp_config(*config) : PS_ERROR_INVALID_RAMP; }
+
+	int PowerSupply_RampTo(uint16_t current, uint16_t voltage) { return g_PowerSupply.ramp_to(current, voltage); }
+
+	int PowerSupply_RampOff() { return g_PowerSupply.ramp_off(); }
+
+	void PowerSupply_CancelRamp() { g_PowerSupply.cancel_ramp(); }
+
+	void PowerSupply_GetRampStatus(RampStatus* status) { g_PowerSupply.ramp_status(status); }
+
+	int PowerSupply_PostCurrentVoltage(uint16_t current, uint16_t voltage) { return g_PowerSupply.post_current_voltage(current, voltage); }
+
+	void PowerSupply_GetSetpointMailboxStatus(SetpointMailboxStatus* status) { g_PowerSupply.setpoint_mailbox_status(status); }
+
+	int PowerSupply_Create(const DeviceConfig* config, int* handle)
+	{
+		if (!config || !handle)
+			return BUS_ERROR_INVALID_LINE_SETTINGS;
+
+		return g_PowerSupplies.create(*config, *handle);
+	}
+
+	int PowerSupply_Destroy(int handle) { return g_PowerSupplies.destroy(handle); }
+
+	int PowerSupply_GetBaudRateH(int handle)
+	{
+		auto ps{ g_PowerSupplies.get(handle) };
+		return ps ? ps->baud_rate() : 0;
+	}
+
+	int PowerSupply_ReconnectH(int handle) { return g_PowerSupplies.invoke(handle, [](PowerSupplyManager& ps) { return ps.reconnect(); }); }
+
+	int PowerSupply_GetLinkStatusH(int handle, LinkStatus* status)
+	{
+		return g_PowerSupplies.invoke(handle, [status](PowerSupplyManager& ps) { ps.link_status(status); return STATUS_OK; });
+	}
+
+	int PowerSupply_SetTimeoutsH(int handle, int response_timeout_ms, int byte_timeout_ms, int adaptive)
+	{
+		return g_PowerSupplies.invoke(handle, [=](PowerSupplyManager& ps) { return ps.set_timeouts(response_timeout_ms, byte_timeout_ms, adaptive != 0); });
+	}
+
+	int PowerSupply_SetRetryPolicyH(int handle, int max_retries, int retry_backoff_ms)
+	{
+		return g_PowerSupplies.invoke(handle, [=](PowerSupplyManager& ps) { return ps.set_retry_policy(max_retries, retry_backoff_ms); });
+	}
+
+	int PowerSupply_SetCurrentVoltageH(int handle, uint16_t current, uint16_t voltage)
+	{
+		return g_PowerSupplies.invoke(handle, [=](PowerSupplyManager& ps) { return ps.set_current_voltage(current, voltage); });
+	}
+
+	int PowerSupply_TurnOnH(int handle) { return g_PowerSupplies.invoke(handle, [](PowerSupplyManager& ps) { return ps.turn_on(); }); }
+
+	int PowerSupply_TurnOffH(int handle) { return g_PowerSupplies.invoke(handle, [](PowerSupplyManager& ps) { return ps.turn_off(); }); }
+
+	int PowerSupply_ResetZPH(int handle) { return g_PowerSupplies.invoke(handle, [](PowerSupplyManager& ps) { return ps.reset_zp(); }); }
+
+	int PowerSupply_ReadCurrentVoltageH(int handle, int* current, int* voltage)
+	{
+		return g_PowerSupplies.invoke(handle, [=](PowerSupplyManager& ps) { return ps.read_telemetry(current, voltage); });
+	}
+
+	int PowerSupply_StartAcquisitionH(int handle, int interval_ms)
+	{
+		return g_PowerSupplies.invoke(handle, [=](PowerSupplyManager& ps) { return ps.start_acquisition(interval_ms); });
+	}
+
+	int PowerSupply_StopAcquisitionH(int handle)
+	{
+		return g_PowerSupplies.invoke(handle, [](PowerSupplyManager& ps) { ps.stop_acquisition(); return STATUS_OK; });
+	}
+
+	int PowerSupply_DrainSamplesH(int handle, Sample* out, int max)
+	{
+		auto ps{ g_PowerSupplies.get(handle) };
+		return ps ? ps->drain_samples(out, max) : 0;
+	}
+
+	int PowerSupply_StartTimedRunH(int handle, long long duration_ms)
+	{
+		return g_PowerSupplies.invoke(handle, [=](PowerSupplyManager& ps) { return ps.start_timed_run(duration_ms); });
+	}
+
+	int PowerSupply_CancelTimedRunH(int handle)
+	{
+		return g_PowerSupplies.invoke(handle, [](PowerSupplyManager& ps) { ps.cancel_timed_run(); return STATUS_OK; });
+	}
+
+	int PowerSupply_SetRampConfigH(int handle, const RampConfig* config)
+	{
+		return g_PowerSupplies.invoke(handle, [config](PowerSupplyManager& ps) { return config ? ps.set_ramp_config(*config) : PS_ERROR_INVALID_RAMP; });
+	}
+
+	int PowerSupply_RampToH(int handle, uint16_t current, uint16_t voltage)
+	{
+		return g_PowerSupplies.invoke(handle, [=](PowerSupplyManager& ps) { return ps.ramp_to(current, voltage); });
+	}
+
+	int PowerSupply_RampOffH(int handle) { return g_PowerSupplies.invoke(handle, [](PowerSupplyManager& ps) { return ps.ramp_off(); }); }
+
+	int PowerSupply_CancelRampH(int handle)
+	{
+		return g_PowerSupplies.invoke(handle, [](PowerSupplyManager& ps) { ps.cancel_ramp(); return STATUS_OK; });
+	}
+
+	int PowerSupply_GetRampStatusH(int handle, RampStatus* status)
+	{
+		return g_PowerSupplies.invoke(handle, [status](PowerSupplyManager& ps) { ps.ramp_status(status); return STATUS_OK; });
+	}
+
+	int PowerSupply_PostCurrentVoltageH(int handle, uint16_t current, uint16_t voltage)
+	{
+		return g_PowerSupplies.invoke(handle, [=](PowerSupplyManager& ps) { return ps.post_current_voltage(current, voltage); });
+	}
+
+	int PowerSupply_GetSetpointMailboxStatusH(int handle, SetpointMailboxStatus* status)
+	{
+		return g_PowerSupplies.invoke(handle, [status](PowerSupplyManager& ps) { ps.setpoint_mailbox_status(status); return STATUS_OK; });
 	}
-	// 6. Power supply has to be turned off after user specified amount of minutes
-	return PowerSupplyManager::turn_off();
 }
@@ -0,0 +1,305 @@
+#include <memory>
+#include <vector>
+
+#include "framework.h"
+#include <timeapi.h>
+#include "SafetyWatchdog.h"
+#include "PowerRegulator.h"
+#include "ScenarioExecutor.h"
+#include "StatusConstants.h"
+
+#pragma comment(lib, "winmm.lib")
+
+SafetyWatchdog g_Watchdog;
+
+namespace
+{
+	/// @brief Whether the supply has ever been asked to connect, a supply that was never used is left alone.
+	bool is_attached(PowerSupplyManager& power_supply)
+	{
+		LinkStatus link{};
+		power_supply.link_status(&link);
+		return link.state != LINK_DISCONNECTED;
+	}
+
+	/// @brief Keeps the first error of a sequence.
+	void keep_first_error(int& status, int rc)
+	{
+		if (status == STATUS_OK)
+			status = rc;
+	}
+}
+
+SafetyWatchdog::~SafetyWatchdog() { disarm(); }
+
+int SafetyWatchdog::arm(const WatchdogConfig& config)
+{
+	if (config.kick_timeout_ms < kwatchdog_min_kick_timeout_ms || config.current_limit < 0 || config.voltage_limit < 0)
+		return WD_ERROR_INVALID_CONFIG;
+	if ((config.current_limit > 0 || config.voltage_limit > 0) && config.poll_period_ms < kwatchdog_min_poll_ms)
+		return WD_ERROR_INVALID_CONFIG;
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_config = config;
+	m_kick_deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(config.kick_timeout_ms);
+
+	// Already armed: the thread picks up the new deadline and limits when woken.
+	if (m_status.armed)
+	{
+		lock.unlock();
+		m_cv.notify_all();
+		return STATUS_OK;
+	}
+
+	// The previous arming has tripped, only the thread object is left.
+	if (m_thread.joinable())
+	{
+		lock.unlock();
+		m_thread.join();
+		lock.lock();
+	}
+
+	m_status.armed = 1;
+	m_status.trip_reason = WATCHDOG_TRIP_NONE;
+	m_status.shutdown_status = STATUS_OK;
+	m_status.checks = 0;
+	m_status.read_failures = 0;
+	m_status.last_latency_us = 0;
+	m_stop = false;
+
+	// While the thread exists it keeps the DLL loaded, a FreeLibrary of the host can not unmap its code.
+	HMODULE module{};
+	if (!m_module && GetModuleHandleExA(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS, reinterpret_cast<LPCSTR>(&g_Watchdog), &module))
+		m_module = module;
+
+	m_thread = std::thread(&SafetyWatchdog::run, this);
+	return STATUS_OK;
+}
+
+void SafetyWatchdog::disarm()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_cv.notify_all();
+
+	if (m_thread.joinable())
+		m_thread.join();
+
+	// The thread is gone, the DLL may be unloaded now.
+	HMODULE module{ m_module.exchange(nullptr) };
+	if (module)
+		FreeLibrary(module);
+}
+
+int SafetyWatchdog::shutdown()
+{
+	bool armed{};
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		armed = m_status.armed && !m_stop;
+	}
+
+	// 1. Stopping the thread first, so it can not trip into the same shutdown.
+	disarm();
+	if (!armed)
+		return STATUS_OK;
+
+	// 2. Turning off like a trip, the regulator and the scenario included.
+	const auto trigger{ std::chrono::steady_clock::now() };
+	std::chrono::steady_clock::time_point off_at;
+	int status{ shutdown_all(off_at) };
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	record_trip_locked(WATCHDOG_TRIP_SHUTDOWN, trigger, off_at, status);
+	return status;
+}
+
+int SafetyWatchdog::kick()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (!m_status.armed || m_stop)
+		return WD_ERROR_NOT_ARMED;
+
+	// Only ever later, so the thread does not need to be woken.
+	m_kick_deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(m_config.kick_timeout_ms);
+	return STATUS_OK;
+}
+
+void SafetyWatchdog::get_status(WatchdogStatus* status) const
+{
+	if (!status)
+		return;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	*status = m_status;
+}
+
+int SafetyWatchdog::shutdown_all(std::chrono::steady_clock::time_point& off_at)
+{
+	std::vector<std::shared_ptr<PowerSupplyManager>> instances;
+	g_PowerSupplies.snapshot(instances);
+
+	// 1. Turning every supply off first, without waiting for the commands in progress. The safety frames jump the queues of the buses.
+	int status{ STATUS_OK };
+	if (is_attached(g_PowerSupply))
+		keep_first_error(status, g_PowerSupply.safety_turn_off());
+	for (auto& instance : instances)
+		keep_first_error(status, instance->safety_turn_off());
+	off_at = std::chrono::steady_clock::now();
+
+	// 2. Stopping whatever could write a setpoint again, then turning off once more in case one of them did.
+	//    This pass takes the command locks, so it also comes after the commands that were in progress.
+	g_Regulator.stop();
+	g_Scenario.stop();
+	g_PowerSupply.cancel_timed_run();
+	for (auto& instance : instances)
+		instance->cancel_timed_run();
+
+	if (is_attached(g_PowerSupply))
+		keep_first_error(status, g_PowerSupply.turn_off());
+	for (auto& instance : instances)
+		keep_first_error(status, instance->turn_off());
+
+	return status;
+}
+
+void SafetyWatchdog::record_trip_locked(int reason, std::chrono::steady_clock::time_point trigger, std::chrono::steady_clock::time_point off_at, int status)
+{
+	const long long latency_us{ std::chrono::duration_cast<std::chrono::microseconds>(off_at - trigger).count() };
+	m_status.trip_reason = reason;
+	m_status.shutdown_status = status;
+	m_status.last_latency_us = latency_us;
+	if (latency_us > m_status.max_latency_us)
+		m_status.max_latency_us = latency_us;
+	++m_status.trips;
+}
+
+void SafetyWatchdog::run()
+{
+	// The default 15.6 ms timer tick would add up to a tick to every trip.
+	timeBeginPeriod(1);
+	SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
+
+	auto next_check{ std::chrono::steady_clock::now() };
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (!m_stop)
+	{
+		// 1. Sleeping until the kick deadline or the next limit check, whichever comes first.
+		const WatchdogConfig config{ m_config };
+		const bool check_limits{ config.current_limit > 0 || config.voltage_limit > 0 };
+		const auto wake{ check_limits && next_check < m_kick_deadline ? next_check : m_kick_deadline };
+		if (m_cv.wait_until(lock, wake, [this] { return m_stop; }))
+			break;
+
+		// 2. A missed kick trips right away, the deadline itself is the trigger.
+		const auto now{ std::chrono::steady_clock::now() };
+		if (now >= m_kick_deadline)
+		{
+			const auto trigger{ m_kick_deadline };
+			lock.unlock();
+			std::chrono::steady_clock::time_point off_at;
+			int status{ shutdown_all(off_at) };
+			lock.lock();
+			record_trip_locked(WATCHDOG_TRIP_KICK_TIMEOUT, trigger, off_at, status);
+			break;
+		}
+
+		// Woken early by a new arming, or the deadline was moved by a kick.
+		if (!check_limits || now < next_check)
+			continue;
+
+		// 3. Checking the limits on the readback of registers 20-21.
+		lock.unlock();
+		int current{}, voltage{};
+		int status{ g_PowerSupply.read_telemetry(&current, &voltage) };
+		const auto read_at{ std::chrono::steady_clock::now() };
+
+		int reason{ WATCHDOG_TRIP_NONE };
+		if (status == STATUS_OK && config.current_limit > 0 && current > config.current_limit)
+			reason = WATCHDOG_TRIP_CURRENT_LIMIT;
+		else if (status == STATUS_OK && config.voltage_limit > 0 && voltage > config.voltage_limit)
+			reason = WATCHDOG_TRIP_VOLTAGE_LIMIT;
+
+		std::chrono::steady_clock::time_point off_at;
+		int shutdown_status{ STATUS_OK };
+		if (reason != WATCHDOG_TRIP_NONE)
+			shutdown_status = shutdown_all(off_at);
+
+		lock.lock();
+		++m_status.checks;
+		if (status == STATUS_OK)
+		{
+			m_status.current = current;
+			m_status.voltage = voltage;
+		}
+		else
+			++m_status.read_failures;
+
+		if (reason != WATCHDOG_TRIP_NONE)
+		{
+			record_trip_locked(reason, read_at, off_at, shutdown_status);
+			break;
+		}
+
+		// 4. Next check on the fixed grid, skipping the ones already missed.
+		next_check += std::chrono::milliseconds(config.poll_period_ms);
+		if (next_check < read_at)
+			next_check = read_at;
+	}
+
+	m_status.armed = 0;
+	lock.unlock();
+	timeEndPeriod(1);
+}
+
+void SafetyWatchdog::process_detach(bool process_exit)
+{
+	// On FreeLibrary the watchdog thread does not exist, while it does its reference keeps the DLL loaded.
+	if (!process_exit)
+		return;
+
+	// The reference of the killed thread goes away with the process, FreeLibrary is not called under the loader lock.
+	m_module = nullptr;
+	{
+		// The watchdog thread may have been killed holding the lock, trying is all there is.
+		std::unique_lock<std::mutex> lock(m_mutex, std::try_to_lock);
+		if (!lock.owns_lock() || !m_status.armed || m_stop)
+			return;
+		m_stop = true;
+	}
+
+	// The thread was killed with the others, only its object is left.
+	if (m_thread.joinable())
+		m_thread.detach();
+
+	// Every other thread is gone, bus threads included: the frames go out from this thread.
+	const auto trigger{ std::chrono::steady_clock::now() };
+	int status{ STATUS_OK };
+	std::vector<std::shared_ptr<PowerSupplyManager>> instances;
+	keep_first_error(status, g_PowerSupply.emergency_turn_off());
+	if (g_PowerSupplies.snapshot(instances, false))
+		for (auto& instance : instances)
+			keep_first_error(status, instance->emergency_turn_off());
+	const auto off_at{ std::chrono::steady_clock::now() };
+
+	std::unique_lock<std::mutex> lock(m_mutex, std::try_to_lock);
+	if (lock.owns_lock())
+	{
+		record_trip_locked(WATCHDOG_TRIP_PROCESS_DETACH, trigger, off_at, status);
+		m_status.armed = 0;
+	}
+}
+
+extern "C" {
+	int Watchdog_Arm(const WatchdogConfig* config) { return config ? g_Watchdog.arm(*config) : WD_ERROR_INVALID_CONFIG; }
+
+	void Watchdog_Disarm() { g_Watchdog.disarm(); }
+
+	int Watchdog_Shutdown() { return g_Watchdog.shutdown(); }
+
+	int Watchdog_Kick() { return g_Watchdog.kick(); }
+
+	void Watchdog_GetStatus(WatchdogStatus* status) { g_Watchdog.get_status(status); }
+}
@@ -0,0 +1,470 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+#include "framework.h"
+#include "ScenarioExecutor.h"
+#include "StatusConstants.h"
+
+ScenarioExecutor g_Scenario(g_PowerSupply);
+
+namespace
+{
+	/// @brief FNV-1a of a checkpoint record, its checksum excluded.
+	uint32_t checksum_of(const ScenarioCheckpoint& checkpoint)
+	{
+		const auto* bytes{ reinterpret_cast<const unsigned char*>(&checkpoint) };
+		uint32_t hash{ 2166136261u };
+		for (std::size_t i{}; i < offsetof(ScenarioCheckpoint, checksum); ++i)
+			hash = (hash ^ bytes[i]) * 16777619u;
+		return hash;
+	}
+
+	/**
+	 * @brief Reads the stage table and the last valid checkpoint of a file.
+	 * @param end Receives the offset right after that checkpoint, where the next record goes.
+	 * @return int Status code indicating success (STATUS_OK), SC_ERROR_CHECKPOINT_OPEN_FAILED or SC_ERROR_NO_CHECKPOINT.
+	 */
+	int read_checkpoint(const std::string& path, ScenarioCheckpointHeader& header, ScenarioCheckpoint& checkpoint, long& end)
+	{
+		std::FILE* file{ std::fopen(path.c_str(), "rb") };
+		if (!file)
+			return SC_ERROR_CHECKPOINT_OPEN_FAILED;
+
+		// 1. Checking the header and its stage table.
+		int status{ SC_ERROR_NO_CHECKPOINT };
+		if (std::fread(&header, sizeof(header), 1, file) != 1 || header.magic != kscenario_checkpoint_magic ||
+			header.version != kscenario_checkpoint_version || header.record_size != sizeof(ScenarioCheckpoint) ||
+			header.stage_count <= 0 || header.stage_count > kscenario_max_stages || !std::memchr(header.port, '\0', sizeof(header.port)))
+		{
+			std::fclose(file);
+			return status;
+		}
+
+		// 2. Scanning the records, the last one may be torn by a crash in the middle of its write.
+		ScenarioCheckpoint record{};
+		long offset{ static_cast<long>(sizeof(header)) };
+		while (std::fread(&record, sizeof(record), 1, file) == 1)
+		{
+			offset += static_cast<long>(sizeof(record));
+			if (record.checksum != checksum_of(record) || record.stage_index < 0 || record.stage_index >= header.stage_count)
+				continue;
+
+			checkpoint = record;
+			end = offset;
+			status = STATUS_OK;
+		}
+
+		std::fclose(file);
+		return status;
+	}
+}
+
+ScenarioExecutor::ScenarioExecutor(PowerSupplyManager& power_supply) : m_power_supply(power_supply) {}
+
+ScenarioExecutor::~ScenarioExecutor()
+{
+	stop();
+	if (m_checkpoint)
+		std::fclose(m_checkpoint);
+}
+
+int ScenarioExecutor::load(const ScenarioStage* stages, int count)
+{
+	if (!stages || count <= 0 || count > kscenario_max_stages)
+		return SC_ERROR_INVALID_STAGES;
+
+	for (int i{}; i < count; ++i)
+		if (stages[i].duration_ms <= 0 || stages[i].ramp_ms < 0)
+			return SC_ERROR_INVALID_STAGES;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (busy_locked())
+		return SC_ERROR_ALREADY_RUNNING;
+
+	m_stages.assign(stages, stages + count);
+	m_status = ScenarioStatus{};
+	m_status.stage_count = count;
+	return STATUS_OK;
+}
+
+int ScenarioExecutor::start()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	if (busy_locked())
+		return SC_ERROR_ALREADY_RUNNING;
+	if (m_stages.empty())
+		return SC_ERROR_NOT_LOADED;
+
+	// A new run starts a new checkpoint file with its connection and its stage table.
+	if (!m_checkpoint_path.empty())
+	{
+		std::string port;
+		SerialSettings line{};
+		int slave{};
+		m_power_supply.connection_settings(port, line, slave);
+
+		// A port name that does not fit could not be attached to on resume.
+		if (port.size() >= kscenario_checkpoint_port_size)
+			return SC_ERROR_CHECKPOINT_OPEN_FAILED;
+
+		std::FILE* file{ std::fopen(m_checkpoint_path.c_str(), "wb") };
+		if (!file)
+			return SC_ERROR_CHECKPOINT_OPEN_FAILED;
+
+		ScenarioCheckpointHeader header{};
+		header.magic = kscenario_checkpoint_magic;
+		header.version = kscenario_checkpoint_version;
+		header.record_size = sizeof(ScenarioCheckpoint);
+		header.stage_count = static_cast<int32_t>(m_stages.size());
+		std::memcpy(header.port, port.c_str(), port.size() + 1);
+		header.baud = line.baud;
+		header.parity = line.parity;
+		header.data_bits = line.data_bits;
+		header.stop_bits = line.stop_bits;
+		header.slave = slave;
+		std::copy(m_stages.begin(), m_stages.end(), header.stages);
+		std::fwrite(&header, sizeof(header), 1, file);
+		if (m_checkpoint)
+			std::fclose(m_checkpoint);
+		m_checkpoint = file;
+		m_checkpoint_sequence = 0;
+	}
+
+	m_from = ResumePoint{};
+	return launch(lock);
+}
+
+int ScenarioExecutor::resume()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	if (busy_locked())
+		return SC_ERROR_ALREADY_RUNNING;
+	if (m_checkpoint_path.empty())
+		return SC_ERROR_NO_CHECKPOINT;
+
+	// 1. Reading the last checkpoint, a completed run has nothing left to resume.
+	ScenarioCheckpointHeader header{};
+	ScenarioCheckpoint checkpoint{};
+	long end{};
+	int status{ read_checkpoint(m_checkpoint_path, header, checkpoint, end) };
+	if (status != STATUS_OK)
+		return status;
+	if (checkpoint.state == SCENARIO_COMPLETED)
+		return SC_ERROR_NO_CHECKPOINT;
+
+	// 2. Continuing the file right after that checkpoint, over a torn record if there is one.
+	std::FILE* file{ std::fopen(m_checkpoint_path.c_str(), "r+b") };
+	if (!file || std::fseek(file, end, SEEK_SET) != 0)
+	{
+		if (file)
+			std::fclose(file);
+		return SC_ERROR_CHECKPOINT_OPEN_FAILED;
+	}
+	if (m_checkpoint)
+		std::fclose(m_checkpoint);
+	m_checkpoint = file;
+	m_checkpoint_sequence = checkpoint.sequence + 1;
+
+	// 3. Attaching to the port, line settings and slave of the run, a restarted host has not connected yet.
+	m_stages.assign(header.stages, header.stages + header.stage_count);
+	m_from = ResumePoint{ static_cast<std::size_t>(checkpoint.stage_index), checkpoint.stage_elapsed_ms, checkpoint.total_elapsed_ms,
+		static_cast<uint16_t>(checkpoint.current), static_cast<uint16_t>(checkpoint.voltage), checkpoint.zp_reset != 0,
+		header.port,
+		SerialSettings{ header.baud, static_cast<char>(header.parity), header.data_bits, header.stop_bits }, header.slave };
+	return launch(lock);
+}
+
+int ScenarioExecutor::launch(std::unique_lock<std::mutex>& lock)
+{
+	// 1. Claiming the executor, then leaving the lock for the I/O: the status stays readable.
+	m_abort = false;
+	m_status = ScenarioStatus{};
+	m_status.state = SCENARIO_STARTING;
+	m_status.stage_index = static_cast<int>(m_from.stage);
+	m_status.stage_count = static_cast<int>(m_stages.size());
+	lock.unlock();
+
+	// The previous run has finished on its own, only the thread object is left.
+	{
+		std::lock_guard<std::mutex> join_lock(m_join_mutex);
+		if (m_thread.joinable())
+			m_thread.join();
+	}
+
+	// 2. Turning on the power supply, failures are reported to the caller right away.
+	int status{ m_from.port.empty() ? STATUS_OK : m_power_supply.connect_ex(m_from.port.c_str(), m_from.line, m_from.slave) };
+	if (status == STATUS_OK)
+		status = m_power_supply.turn_on();
+
+	// A stop() during the start waits for it, the supply is turned off again before it returns.
+	lock.lock();
+	if (status == STATUS_OK && m_abort)
+	{
+		lock.unlock();
+		status = m_power_supply.turn_off();
+		lock.lock();
+		m_status.state = SCENARIO_ABORTED;
+		m_status.last_error = status;
+		m_cv.notify_all();
+		return STATUS_OK;
+	}
+	if (status != STATUS_OK)
+	{
+		m_status.state = SCENARIO_FAILED;
+		m_status.last_error = status;
+		m_cv.notify_all();
+		return status;
+	}
+
+	// 3. Executing the stages on the dedicated thread.
+	const auto now{ std::chrono::steady_clock::now() };
+	m_start = now - std::chrono::milliseconds(m_from.total_elapsed_ms);
+	m_stage_start = now - std::chrono::milliseconds(m_from.stage_elapsed_ms);
+	m_stage_end = m_stage_start + std::chrono::milliseconds(m_stages[m_from.stage].duration_ms);
+	m_applied_current = m_from.current;
+	m_applied_voltage = m_from.voltage;
+	m_zp_reset = m_from.zp_reset;
+	m_restoring = false;
+	m_status.state = SCENARIO_RUNNING;
+	m_thread = std::thread(&ScenarioExecutor::run, this);
+	m_cv.notify_all();
+
+	return STATUS_OK;
+}
+
+int ScenarioExecutor::set_checkpoint_file(const char* path, int period_ms)
+{
+	if (period_ms != 0 && period_ms < kscenario_min_checkpoint_period_ms)
+		return SC_ERROR_INVALID_CHECKPOINT_PERIOD;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (busy_locked())
+		return SC_ERROR_ALREADY_RUNNING;
+
+	m_checkpoint_path = path ? path : "";
+	m_checkpoint_period_ms = period_ms;
+	if (m_checkpoint)
+	{
+		std::fclose(m_checkpoint);
+		m_checkpoint = nullptr;
+	}
+	return STATUS_OK;
+}
+
+void ScenarioExecutor::stop()
+{
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_abort = true;
+		m_cv.notify_all();
+		m_cv.wait(lock, [this] { return m_status.state != SCENARIO_STARTING; });
+	}
+
+	// Concurrent stops must not join the same thread.
+	std::lock_guard<std::mutex> join_lock(m_join_mutex);
+	if (m_thread.joinable())
+		m_thread.join();
+}
+
+void ScenarioExecutor::get_status(ScenarioStatus* status) const
+{
+	if (!status)
+		return;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	*status = m_status;
+	if (m_status.state != SCENARIO_RUNNING)
+		return;
+
+	auto now{ std::chrono::steady_clock::now() };
+	status->total_elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(now - m_start).count();
+	status->stage_elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(now - m_stage_start).count();
+	auto remaining{ std::chrono::duration_cast<std::chrono::milliseconds>(m_stage_end - now).count() };
+	status->stage_remaining_ms = remaining > 0 ? remaining : 0;
+}
+
+bool ScenarioExecutor::wait_until(std::chrono::steady_clock::time_point deadline)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	return !m_cv.wait_until(lock, deadline, [this] { return m_abort; });
+}
+
+bool ScenarioExecutor::wait_checkpointed(std::chrono::steady_clock::time_point deadline)
+{
+	while (m_checkpoint && m_checkpoint_period_ms > 0 && m_next_checkpoint < deadline)
+	{
+		if (!wait_until(m_next_checkpoint))
+			return false;
+		write_checkpoint(SCENARIO_RUNNING);
+	}
+
+	return wait_until(deadline);
+}
+
+int ScenarioExecutor::apply(uint16_t current, uint16_t voltage)
+{
+	int status{ m_power_supply.set_current_voltage(current, voltage) };
+	if (status == STATUS_OK)
+	{
+		m_applied_current = current;
+		m_applied_voltage = voltage;
+	}
+
+	return status;
+}
+
+void ScenarioExecutor::write_checkpoint(int state)
+{
+	// While ramping back, the checkpoint resumed from stays the point to resume from.
+	if (!m_checkpoint || m_restoring)
+		return;
+
+	const auto now{ std::chrono::steady_clock::now() };
+	ScenarioCheckpoint checkpoint{};
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		checkpoint.stage_index = m_status.stage_index;
+		checkpoint.stage_elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(now - m_stage_start).count();
+		checkpoint.total_elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(now - m_start).count();
+	}
+	checkpoint.sequence = m_checkpoint_sequence++;
+	checkpoint.state = state;
+	checkpoint.zp_reset = m_zp_reset ? 1 : 0;
+	checkpoint.current = m_applied_current;
+	checkpoint.voltage = m_applied_voltage;
+	checkpoint.checksum = checksum_of(checkpoint);
+
+	// Flushed to the system cache only: that survives a crash of the host, and costs no disk wait.
+	std::fwrite(&checkpoint, sizeof(checkpoint), 1, m_checkpoint);
+	std::fflush(m_checkpoint);
+	m_next_checkpoint = now + std::chrono::milliseconds(m_checkpoint_period_ms);
+}
+
+void ScenarioExecutor::finish(int state, int error)
+{
+	int status{ m_power_supply.turn_off() };
+	write_checkpoint(state);
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_status.state = state;
+	m_status.last_error = error != STATUS_OK ? error : status;
+}
+
+void ScenarioExecutor::run()
+{
+	const ResumePoint from{ m_from };
+
+	// Puts the clocks where the run starts from, as of now.
+	const auto rebase_clocks{ [this, &from] {
+		const auto now{ std::chrono::steady_clock::now() };
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_start = now - std::chrono::milliseconds(from.total_elapsed_ms);
+		m_stage_start = now - std::chrono::milliseconds(from.stage_elapsed_ms);
+		m_stage_end = m_stage_start + std::chrono::milliseconds(m_stages[from.stage].duration_ms);
+		return m_stage_start;
+	} };
+
+	// 1. Resuming: ramping the current back from where the supply is to the checkpoint, the clocks stand still meanwhile.
+	if (from.current != 0)
+	{
+		int origin{};
+		int status{ m_power_supply.read_setpoints(&origin, nullptr) };
+		if (status != STATUS_OK)
+			return finish(SCENARIO_FAILED, status);
+
+		// A supply still at the checkpoint, e.g. after a crash of the host alone, needs no ramp.
+		m_restoring = true;
+		const auto ramp_start{ std::chrono::steady_clock::now() };
+		const long long steps{ origin == from.current ? 0 : kscenario_resume_ramp_ms / kscenario_ramp_step_ms };
+		for (long long step{ 1 }; step <= steps; ++step)
+		{
+			if (!wait_until(ramp_start + std::chrono::milliseconds(step * kscenario_ramp_step_ms)))
+				return finish(SCENARIO_ABORTED, STATUS_OK);
+
+			auto current{ static_cast<uint16_t>(origin + (from.current - origin) * step / steps) };
+			status = m_power_supply.set_current_voltage(current, from.voltage);
+			if (status != STATUS_OK)
+				return finish(SCENARIO_FAILED, status);
+			rebase_clocks();
+		}
+
+		// The voltage may differ even without a ramp, the shadow cache skips what already holds.
+		status = m_power_supply.set_current_voltage(from.current, from.voltage);
+		if (status != STATUS_OK)
+			return finish(SCENARIO_FAILED, status);
+		m_restoring = false;
+	}
+
+	auto stage_start{ rebase_clocks() };
+
+	for (std::size_t i{ from.stage }; i < m_stages.size(); ++i)
+	{
+		const ScenarioStage& stage{ m_stages[i] };
+		const uint16_t previous_current{ i > 0 ? m_stages[i - 1].current : uint16_t{} };
+		const long long done_ms{ i == from.stage ? from.stage_elapsed_ms : 0 };
+		const auto stage_end{ stage_start + std::chrono::milliseconds(stage.duration_ms) };
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_status.stage_index = static_cast<int>(i);
+			m_stage_start = stage_start;
+			m_stage_end = stage_end;
+		}
+
+		// 2. Checkpointing the stage boundary, or the resume point.
+		write_checkpoint(SCENARIO_RUNNING);
+
+		// 3. Ramping the current from the previous stage value, each step on its own deadline.
+		const long long ramp_ms{ stage.ramp_ms < stage.duration_ms ? stage.ramp_ms : stage.duration_ms };
+		const long long steps{ ramp_ms / kscenario_ramp_step_ms };
+		for (long long step{ done_ms / kscenario_ramp_step_ms + 1 }; step < steps; ++step)
+		{
+			if (!wait_checkpointed(stage_start + std::chrono::milliseconds(step * kscenario_ramp_step_ms)))
+				return finish(SCENARIO_ABORTED, STATUS_OK);
+
+			auto current{ static_cast<uint16_t>(previous_current + (stage.current - previous_current) * step / steps) };
+			int status{ apply(current, stage.voltage) };
+			if (status != STATUS_OK)
+				return finish(SCENARIO_FAILED, status);
+		}
+
+		// 4. Applying the stage setpoint.
+		if (ramp_ms > 0 && !wait_checkpointed(stage_start + std::chrono::milliseconds(ramp_ms)))
+			return finish(SCENARIO_ABORTED, STATUS_OK);
+
+		int status{ apply(stage.current, stage.voltage) };
+		if (status != STATUS_OK)
+			return finish(SCENARIO_FAILED, status);
+
+		// 5. Resetting "ZP" register once the first setpoint is applied, like the manual start does.
+		if (!m_zp_reset)
+		{
+			status = m_power_supply.reset_zp();
+			if (status != STATUS_OK)
+				return finish(SCENARIO_FAILED, status);
+			m_zp_reset = true;
+		}
+
+		// 6. Holding the stage until its deadline, counted from the scenario start.
+		if (!wait_checkpointed(stage_end))
+			return finish(SCENARIO_ABORTED, STATUS_OK);
+
+		stage_start = stage_end;
+	}
+
+	finish(SCENARIO_COMPLETED, STATUS_OK);
+}
+
+extern "C" {
+	int Scenario_Load(const ScenarioStage* stages, int count) { return g_Scenario.load(stages, count); }
+
+	int Scenario_Start() { return g_Scenario.start(); }
+
+	void Scenario_Stop() { g_Scenario.stop(); }
+
+	void Scenario_GetStatus(ScenarioStatus* status) { g_Scenario.get_status(status); }
+
+	int Scenario_SetCheckpointFile(const char* path, int period_ms) { return g_Scenario.set_checkpoint_file(path, period_ms); }
+
+	int Scenario_Resume() { return g_Scenario.resume(); }
+}
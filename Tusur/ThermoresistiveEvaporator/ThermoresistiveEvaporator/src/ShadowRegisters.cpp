@@ -0,0 +1,78 @@
+#include "framework.h"
+#include "ShadowRegisters.h"
+
+void ShadowRegisters::sync_epoch_locked(unsigned long long epoch)
+{
+	if (m_epoch == epoch)
+		return;
+
+	m_values.clear();
+	m_epoch = epoch;
+}
+
+bool ShadowRegisters::dirty_range(unsigned long long epoch, int addr, int nb, const uint16_t* values, int& first, int& count)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	sync_epoch_locked(epoch);
+
+	// The block is written as one frame, so only its clean ends can be trimmed.
+	int last{ -1 };
+	first = nb;
+	for (int i{}; i < nb; ++i)
+	{
+		auto it{ m_values.find(addr + i) };
+		if (it != m_values.end() && it->second == values[i])
+			continue;
+
+		if (first == nb)
+			first = i;
+		last = i;
+	}
+
+	if (last < 0)
+	{
+		first = 0;
+		count = 0;
+		++m_skipped;
+		return false;
+	}
+
+	count = last - first + 1;
+	return true;
+}
+
+void ShadowRegisters::store(unsigned long long epoch, int addr, int nb, const uint16_t* values)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	sync_epoch_locked(epoch);
+	for (int i{}; i < nb; ++i)
+		m_values[addr + i] = values[i];
+}
+
+bool ShadowRegisters::lookup(unsigned long long epoch, int addr, int nb, uint16_t* values) const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_epoch != epoch)
+		return false;
+
+	for (int i{}; i < nb; ++i)
+		if (m_values.count(addr + i) == 0)
+			return false;
+
+	for (int i{}; i < nb; ++i)
+		values[i] = m_values.at(addr + i);
+	return true;
+}
+
+void ShadowRegisters::invalidate(int addr, int nb)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	for (int i{}; i < nb; ++i)
+		m_values.erase(addr + i);
+}
+
+void ShadowRegisters::clear()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_values.clear();
+}
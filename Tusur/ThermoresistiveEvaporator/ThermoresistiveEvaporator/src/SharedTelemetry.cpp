@@ -0,0 +1,133 @@
+#include <cstring>
+
+#include "SharedTelemetry.h"
+#include "StatusConstants.h"
+
+SharedTelemetry g_SharedTelemetry;
+
+namespace
+{
+	/// @brief Whether a block found in an existing section is published by another live process.
+	bool owned_by_other_process(const SharedTelemetryBlock& block)
+	{
+		if (block.magic != kshared_telemetry_magic || block.publisher_pid == 0 || block.publisher_pid == GetCurrentProcessId())
+			return false;
+
+		HANDLE process{ OpenProcess(SYNCHRONIZE, FALSE, block.publisher_pid) };
+		if (!process)
+			return false;
+
+		const bool alive{ WaitForSingleObject(process, 0) == WAIT_TIMEOUT };
+		CloseHandle(process);
+		return alive;
+	}
+}
+
+SharedTelemetry::~SharedTelemetry() { stop(); }
+
+int SharedTelemetry::start(const char* name)
+{
+	stop();
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	// 1. Creating the section in the paging file, or opening it if readers or a dead publisher left it.
+	HANDLE mapping{ CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, sizeof(SharedTelemetryBlock), name ? name : kshared_telemetry_default_name) };
+	if (!mapping)
+		return TM_ERROR_SHARED_OPEN_FAILED;
+	const bool existed{ GetLastError() == ERROR_ALREADY_EXISTS };
+
+	auto* block{ static_cast<SharedTelemetryBlock*>(MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, sizeof(SharedTelemetryBlock))) };
+	if (!block || (existed && owned_by_other_process(*block)))
+	{
+		if (block)
+			UnmapViewOfFile(block);
+		CloseHandle(mapping);
+		return TM_ERROR_SHARED_OPEN_FAILED;
+	}
+
+	// 2. Taking the block over with an odd sequence, readers wait for the "nothing seen yet" state.
+	const uint32_t sequence{ existed ? block->sequence.load(std::memory_order_relaxed) | 1u : 1u };
+	block->sequence.store(sequence, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	block->magic = kshared_telemetry_magic;
+	block->version = kshared_telemetry_version;
+	block->size = sizeof(SharedTelemetryBlock);
+	block->publisher_pid = GetCurrentProcessId();
+	block->reserved = 0;
+
+	SharedTelemetryData& data{ block->data };
+	std::memset(&data, 0, sizeof(data));
+	data.current = data.voltage = -1;
+	data.reading_status = STATUS_OK;
+	data.current_setpoint = data.voltage_setpoint = -1;
+	data.power_coil = data.workmode_coil = -1;
+	data.motor_direction = -1;
+	data.forward_limit = data.reverse_limit = -1;
+	block->sequence.store(sequence + 1, std::memory_order_release);
+
+	m_mapping = mapping;
+	m_block = block;
+	m_active = true;
+	return STATUS_OK;
+}
+
+void SharedTelemetry::stop()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_active = false;
+	if (m_block)
+		UnmapViewOfFile(m_block);
+	if (m_mapping)
+		CloseHandle(m_mapping);
+	m_block = nullptr;
+	m_mapping = nullptr;
+}
+
+int SharedTelemetry::read(const char* name, SharedTelemetryData* out)
+{
+	if (!out)
+		return TM_ERROR_SHARED_OPEN_FAILED;
+
+	HANDLE mapping{ OpenFileMappingA(FILE_MAP_READ, FALSE, name ? name : kshared_telemetry_default_name) };
+	if (!mapping)
+		return TM_ERROR_SHARED_OPEN_FAILED;
+
+	const auto* block{ static_cast<const SharedTelemetryBlock*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, sizeof(SharedTelemetryBlock))) };
+	CloseHandle(mapping);
+	if (!block)
+		return TM_ERROR_SHARED_OPEN_FAILED;
+
+	int status{ TM_ERROR_SHARED_OPEN_FAILED };
+	if (block->magic == kshared_telemetry_magic && block->version == kshared_telemetry_version && block->size == sizeof(SharedTelemetryBlock))
+	{
+		// Copying until no write overlapped the copy: the sequence was even and did not move.
+		status = TM_ERROR_SHARED_BUSY;
+		for (int i{}; i < kshared_telemetry_read_tries; ++i)
+		{
+			const uint32_t before{ block->sequence.load(std::memory_order_acquire) };
+			if (before & 1u)
+				continue;
+
+			std::memcpy(out, &block->data, sizeof(SharedTelemetryData));
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (block->sequence.load(std::memory_order_relaxed) == before)
+			{
+				status = STATUS_OK;
+				break;
+			}
+		}
+	}
+
+	UnmapViewOfFile(block);
+	return status;
+}
+
+extern "C" {
+	int SharedTelemetry_Start(const char* name) { return g_SharedTelemetry.start(name); }
+
+	void SharedTelemetry_Stop() { g_SharedTelemetry.stop(); }
+
+	int SharedTelemetry_Read(const char* name, SharedTelemetryData* out) { return SharedTelemetry::read(name, out); }
+}
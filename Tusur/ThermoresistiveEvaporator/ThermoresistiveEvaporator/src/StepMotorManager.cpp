@@ -1,85 +1,520 @@
 #include "framework.h"
 #include "StepMotorManager.h"
+#include "SharedTelemetry.h"
 #include "StatusConstants.h"
 #include "Constants.h"
 
 StepMotorManager g_StepMotor(sm_constants::kdefault_com_port);
+DeviceRegistry<StepMotorManager> g_StepMotors;
 
-int StepMotorManager::read_holding_register(int addr)
+int StepMotorManager::read_limit_switches(int& forward, int& reverse)
 {
-	uint16_t readbacks[kreadbacks_size]{};
-	if (modbus_read_registers(m_ctx.get(), addr, 1, readbacks) == -1)
+	std::shared_ptr<ModbusBus> bus;
+	bool ok{ ensure_connected(bus) == STATUS_OK };
+
+	using Limits = StepMotorRegisters::Limits;
+	uint16_t registers[2]{};
+
+	// Reading holding registers 514 (forward) and 515 (reverse) as one block.
+	for (int frame{}; ok && frame < Limits::kframes; ++frame)
+		if (bus->read_registers(m_slave, BUS_PRIORITY_TELEMETRY, Limits::frame_addr(frame), Limits::kframe_registers, registers + frame * Limits::kframe_registers) == -1)
+			ok = false;
+
+	// Failures are published too, a reader sees the link go down.
+	publish_limits(ok, registers);
+	if (!ok)
 		return SM_ERROR_RW_HOLDING_REGISTER;
 
-	return static_cast<int>(readbacks[0]);
+	forward = registers[0] == 1;
+	reverse = registers[1] == 1;
+	return STATUS_OK;
 }
 
-int StepMotorManager::write_register(int addr, uint16_t val)
+void StepMotorManager::publish_limits(bool ok, const uint16_t* registers)
 {
-	if (modbus_write_register(m_ctx.get(), addr, val) == -1)
+	if (!publishes_shared_telemetry() || !g_SharedTelemetry.active())
+		return;
+
+	// Taken before the block is locked, the bus may be busy reconnecting.
+	LinkStatus link{};
+	link_status(&link);
+	const long long now_us{ std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count() };
+
+	g_SharedTelemetry.update([&](SharedTelemetryData& data) {
+		if (ok)
+		{
+			data.limits_time_us = now_us;
+			data.forward_limit = registers[0] == 1;
+			data.reverse_limit = registers[1] == 1;
+		}
+		data.step_motor_link = link;
+	});
+}
+
+bool StepMotorManager::publishes_shared_telemetry() const { return this == &g_StepMotor; }
+
+int StepMotorManager::write_direction(uint16_t forward, uint16_t reverse, int priority, bool force, int& written)
+{
+	written = 0;
+	std::shared_ptr<ModbusBus> bus;
+	if (ensure_connected(bus) != STATUS_OK)
 		return SM_ERROR_RW_HOLDING_REGISTER;
 
+	using Direction = StepMotorRegisters::Direction;
+	const auto epoch{ bus->connection_epoch() };
+	const uint16_t values[2]{ forward, reverse };
+	for (int frame{}; frame < Direction::kframes; ++frame)
+	{
+		const int addr{ Direction::frame_addr(frame) };
+		const uint16_t* frame_values{ values + frame * Direction::kframe_registers };
+		int first{}, count{ Direction::kframe_registers };
+		if (!force && !m_shadow.dirty_range(epoch, addr, Direction::kframe_registers, frame_values, first, count))
+		{
+			written += Direction::kframe_registers;
+			continue;
+		}
+
+		// Adjacent registers go in one frame, so the motor never sees a half-applied direction.
+		int done{};
+		int rc{ bus->write_registers(m_slave, priority, addr + first, count, frame_values + first, &done) };
+		m_shadow.store(epoch, addr + first, done, frame_values + first);
+		if (rc == -1)
+		{
+			// The outcome of a failed write is unknown, so the rest of the pair can not stay cached.
+			m_shadow.invalidate(addr + first + done, count - done);
+			written += first + done;
+			return SM_ERROR_RW_HOLDING_REGISTER;
+		}
+		written += Direction::kframe_registers;
+	}
+
+	m_direction = (forward == 1 ? 1 : 0) | (reverse == 1 ? 2 : 0);
+	written = 2;
+
+	if (publishes_shared_telemetry())
+		g_SharedTelemetry.update([this](SharedTelemetryData& data) { data.motor_direction = m_direction; });
+	return STATUS_OK;
+}
+
+int StepMotorManager::is_forward_button_pressed()
+{
+	if (m_watch_running)
+	{
+		std::lock_guard<std::mutex> lock(m_limit_mutex);
+		return (m_limit_state & 1) != 0;
+	}
+
+	int forward{}, reverse{};
+	return read_limit_switches(forward, reverse) == STATUS_OK && forward;
+}
+
+int StepMotorManager::is_reverse_button_pressed()
+{
+	if (m_watch_running)
+	{
+		std::lock_guard<std::mutex> lock(m_limit_mutex);
+		return (m_limit_state & 2) != 0;
+	}
+
+	int forward{}, reverse{};
+	return read_limit_switches(forward, reverse) == STATUS_OK && reverse;
+}
+
+int StepMotorManager::start_limit_watch(int interval_ms, bool auto_stop)
+{
+	if (interval_ms < kmin_limit_watch_interval_ms)
+		return SM_ERROR_UNSUPPORTED_WATCH_INTERVAL;
+
+	std::lock_guard<std::mutex> lock(m_watch_mutex);
+	m_watch_interval_ms = interval_ms;
+	m_watch_auto_stop = auto_stop;
+	if (m_watch_running)
+		return STATUS_OK;
+
+	m_watch_running = true;
+	m_watch_thread = std::thread(&StepMotorManager::watch_loop, this);
 	return STATUS_OK;
 }
 
-int StepMotorManager::is_forward_button_pressed() { return read_holding_register(514) == 1; }
+void StepMotorManager::stop_limit_watch()
+{
+	std::lock_guard<std::mutex> lock(m_watch_mutex);
+	{
+		std::lock_guard<std::mutex> wait_lock(m_watch_wait_mutex);
+		m_watch_running = false;
+	}
+	m_watch_cv.notify_all();
 
-int StepMotorManager::is_reverse_button_pressed() { return read_holding_register(515) == 1; }
+	if (m_watch_thread.joinable())
+		m_watch_thread.join();
+}
 
-StepMotorManager::StepMotorManager(const char* port) : m_ctx(nullptr, ModbusDeleter) { connect(port); }
+int StepMotorManager::wait_for_limit(int timeout_ms)
+{
+	std::unique_lock<std::mutex> lock(m_limit_mutex);
+	const unsigned long long hits{ m_limit_hits };
+	if (!m_limit_cv.wait_for(lock, std::chrono::milliseconds(timeout_ms), [this, hits] { return m_limit_hits != hits; }))
+		return 0;
 
-StepMotorManager::~StepMotorManager() {}
+	return m_limit_state;
+}
+
+int StepMotorManager::motor_state()
+{
+	int limits{};
+	if (m_watch_running)
+	{
+		std::lock_guard<std::mutex> lock(m_limit_mutex);
+		limits = m_limit_state;
+	}
+
+	return m_direction | limits << 2;
+}
+
+void StepMotorManager::watch_loop()
+{
+	// The first successful read reports the initial state as a change.
+	int previous{ -1 };
+	auto deadline{ std::chrono::steady_clock::now() };
+	while (m_watch_running)
+	{
+		int forward{}, reverse{};
+		if (read_limit_switches(forward, reverse) == STATUS_OK)
+		{
+			const int state{ forward | reverse << 1 };
+			const int hit{ previous < 0 ? state : state & ~previous };
+
+			// 1. Stopping the motor first, the callback and the waiters may take their time.
+			if (hit && m_watch_auto_stop)
+				stop();
+
+			// 2. Publishing the state, waking the waiters on a rising edge only.
+			if (state != previous)
+			{
+				{
+					std::lock_guard<std::mutex> lock(m_limit_mutex);
+					m_limit_state = state;
+					if (hit)
+						++m_limit_hits;
+				}
+				if (hit)
+					m_limit_cv.notify_all();
+
+				LimitSwitchCallback callback{ m_limit_callback };
+				if (callback)
+					callback(forward, reverse);
+
+				previous = state;
+			}
+		}
+
+		// Deadline-based schedule, like the telemetry acquisition.
+		deadline += std::chrono::milliseconds(m_watch_interval_ms.load());
+		const auto now{ std::chrono::steady_clock::now() };
+		if (deadline < now)
+			deadline = now;
+
+		std::unique_lock<std::mutex> lock(m_watch_wait_mutex);
+		m_watch_cv.wait_until(lock, deadline, [this] { return !m_watch_running; });
+	}
+}
+
+StepMotorManager::StepMotorManager(const char* port) : m_port(port) {}
+
+StepMotorManager::~StepMotorManager() { stop_limit_watch(); }
 
 int StepMotorManager::connect(const char* port)
 {
-	// 1. Initializing connection.
-	m_ctx.reset(modbus_new_rtu(port, 115200, 'N', 8, 1));
-	if (!m_ctx)
-		return SM_ERROR_INIT_CONNECTION_FAILED;
+	std::shared_ptr<ModbusBus> bus;
+	bool switched{ false };
+	{
+		std::lock_guard<std::mutex> lock(m_bus_mutex);
+
+		// Switching to another port detaches the step motor from the current bus.
+		if (port && m_port != port)
+		{
+			m_port = port;
+			m_bus.reset();
+			switched = true;
+		}
+	}
 
-	// 2. Setting to slave.
-	if (modbus_set_slave(m_ctx.get(), 3) == -1)
-		return SM_ERROR_SET_SLAVE_FAILED;
+	// The epochs of the new bus start over, nothing cached for the previous device applies.
+	if (switched)
+		m_shadow.clear();
+
+	// Idempotent: returns immediately if the port is already open and healthy.
+	return ensure_connected(bus);
+}
 
-	// 3. Establishing the connection.
-	if (modbus_connect(m_ctx.get()) == -1)
+int StepMotorManager::connect_ex(const char* port, const SerialSettings& line, int slave)
+{
+	SerialSettings checked{ line };
+	if (checked.baud == 0)
+		checked.baud = kprobe_baud_rates[0];
+	if (!port || slave < 1 || slave > 247 || !ModbusBus::is_valid_settings(checked))
+		return BUS_ERROR_INVALID_LINE_SETTINGS;
+
+	// 1. Detaching from the current bus, so the probe can open the port at other rates.
 	{
-		m_ctx.reset();
-		return SM_ERROR_CONNECT_FAILED;
+		std::lock_guard<std::mutex> lock(m_bus_mutex);
+		m_port = port;
+		m_bus.reset();
 	}
 
-	return STATUS_OK;
+	// 2. Probing the baud rate on a known register.
+	SerialSettings selected{ line };
+	if (line.baud == 0)
+	{
+		int status{ ModbusBus::probe_baud(port, line, slave, 0x03, StepMotorRegisters::Limits::frame_addr(0), StepMotorRegisters::Limits::kframe_registers, selected.baud) };
+		if (status != STATUS_OK)
+			return status;
+	}
+
+	// 3. Attaching with the new settings, nothing cached for the previous slave applies.
+	{
+		std::lock_guard<std::mutex> lock(m_bus_mutex);
+		m_line = selected;
+		m_slave = slave;
+	}
+	m_shadow.clear();
+
+	std::shared_ptr<ModbusBus> bus;
+	return ensure_connected(bus);
+}
+
+int StepMotorManager::baud_rate()
+{
+	std::lock_guard<std::mutex> lock(m_bus_mutex);
+	return m_line.baud;
+}
+
+int StepMotorManager::reconnect()
+{
+	std::shared_ptr<ModbusBus> bus;
+	int status{ ensure_connected(bus) };
+	if (status != STATUS_OK)
+		return status;
+
+	// The reopened device may have been power cycled, nothing cached before is trusted.
+	m_shadow.clear();
+	return bus->reconnect();
+}
+
+long long StepMotorManager::connect_latency_us()
+{
+	std::lock_guard<std::mutex> lock(m_bus_mutex);
+	return m_bus ? m_bus->connect_latency_us() : -1;
+}
+
+void StepMotorManager::link_status(LinkStatus* status)
+{
+	if (!status)
+		return;
+
+	std::lock_guard<std::mutex> lock(m_bus_mutex);
+	*status = m_bus ? m_bus->link_status() : LinkStatus{ LINK_DISCONNECTED, 0, 0, STATUS_OK, 0 };
+}
+
+int StepMotorManager::store_timeout_policy_locked(const TimeoutPolicy& policy)
+{
+	if (!ModbusBus::is_valid_policy(policy))
+		return BUS_ERROR_INVALID_TIMEOUT_POLICY;
+
+	m_timeouts = policy;
+	return m_bus ? m_bus->set_timeout_policy(m_slave, policy) : STATUS_OK;
+}
+
+int StepMotorManager::set_timeouts(int response_timeout_ms, int byte_timeout_ms, bool adaptive)
+{
+	std::lock_guard<std::mutex> lock(m_bus_mutex);
+	TimeoutPolicy policy{ m_timeouts };
+	policy.response_timeout_ms = response_timeout_ms;
+	policy.byte_timeout_ms = byte_timeout_ms;
+	policy.adaptive = adaptive;
+	return store_timeout_policy_locked(policy);
+}
+
+int StepMotorManager::set_retry_policy(int max_retries, int retry_backoff_ms)
+{
+	std::lock_guard<std::mutex> lock(m_bus_mutex);
+	TimeoutPolicy policy{ m_timeouts };
+	policy.max_retries = max_retries;
+	policy.retry_backoff_ms = retry_backoff_ms;
+	return store_timeout_policy_locked(policy);
+}
+
+long long StepMotorManager::response_timeout_us()
+{
+	std::lock_guard<std::mutex> lock(m_bus_mutex);
+	return m_bus ? m_bus->response_timeout_us(m_slave) : m_timeouts.response_timeout_ms * 1000LL;
+}
+
+int StepMotorManager::ensure_connected(std::shared_ptr<ModbusBus>& bus)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_bus_mutex);
+		if (!m_bus)
+		{
+			int status{ ModbusBus::acquire(m_port, m_line, m_bus) };
+			if (status != STATUS_OK)
+				return status;
+
+			// A freshly created bus only knows the default policy.
+			m_bus->set_timeout_policy(m_slave, m_timeouts);
+		}
+		bus = m_bus;
+	}
+
+	return bus->connect();
+}
+
+int StepMotorManager::execute_batch(const BatchOp* ops, int n, BatchResult* out)
+{
+	std::lock_guard<std::mutex> command_lock(m_command_mutex);
+
+	std::shared_ptr<ModbusBus> bus;
+	int status{ ensure_connected(bus) };
+	if (status != STATUS_OK)
+		return status;
+
+	int rc{ bus->execute_batch(m_slave, BUS_PRIORITY_COMMAND, ops, n, out) };
+
+	// The batch bypasses the cache, whatever it wrote can not stay cached.
+	for (int i{}; i < n; ++i)
+		if (ops[i].kind == BATCH_WRITE_REGISTER)
+			m_shadow.invalidate(ops[i].addr);
+
+	return rc == -1 ? DEV_ERROR_BATCH_OP_FAILED : STATUS_OK;
 }
 
 int StepMotorManager::open()
 {
-	// Writing 1 to 512 and 513 registers.
-	if (write_register(512, 1) == SM_ERROR_RW_HOLDING_REGISTER)
-		return SM_ERROR_SET_512_REG_TO_1;
-	if (write_register(513, 0) == SM_ERROR_RW_HOLDING_REGISTER)
-		return SM_ERROR_SET_513_REG_TO_0;
+	std::lock_guard<std::mutex> command_lock(m_command_mutex);
+
+	// Writing 1 to 512 and 0 to 513 register.
+	int written{};
+	if (write_direction(1, 0, BUS_PRIORITY_COMMAND, false, written) == SM_ERROR_RW_HOLDING_REGISTER)
+		return written == 0 ? SM_ERROR_SET_512_REG_TO_1 : SM_ERROR_SET_513_REG_TO_0;
 
 	return STATUS_OK;
 }
 
 int StepMotorManager::close()
 {
-	// Writing 1 to 512 and 513 registers.
-	if (write_register(512, 0) == SM_ERROR_RW_HOLDING_REGISTER)
-		return SM_ERROR_SET_512_REG_TO_0;
-	if (write_register(513, 1) == SM_ERROR_RW_HOLDING_REGISTER)
-		return SM_ERROR_SET_513_REG_TO_1;
+	std::lock_guard<std::mutex> command_lock(m_command_mutex);
+
+	// Writing 0 to 512 and 1 to 513 register.
+	int written{};
+	if (write_direction(0, 1, BUS_PRIORITY_COMMAND, false, written) == SM_ERROR_RW_HOLDING_REGISTER)
+		return written == 0 ? SM_ERROR_SET_512_REG_TO_0 : SM_ERROR_SET_513_REG_TO_1;
 
 	return STATUS_OK;
 }
 
 int StepMotorManager::stop()
 {
-	// Writing 1 to 512 and 513 registers.
-	if (write_register(512, 0) == SM_ERROR_RW_HOLDING_REGISTER)
-		return SM_ERROR_SET_512_REG_TO_0;
-	if (write_register(513, 0) == SM_ERROR_RW_HOLDING_REGISTER)
-		return SM_ERROR_SET_513_REG_TO_0;
+	std::lock_guard<std::mutex> command_lock(m_command_mutex);
+
+	// Writing 0 to 512 and 513 registers. Safety path: always written, whatever the cache says.
+	int written{};
+	if (write_direction(0, 0, BUS_PRIORITY_SAFETY, true, written) == SM_ERROR_RW_HOLDING_REGISTER)
+		return written == 0 ? SM_ERROR_SET_512_REG_TO_0 : SM_ERROR_SET_513_REG_TO_0;
 
 	return STATUS_OK;
 }
+
+extern "C" {
+	int StepMotor_Connect(const char* port) { return g_StepMotor.connect(port); }
+
+	int StepMotor_ConnectEx(const char* port, int baud, char parity, int data_bits, int stop_bits, int slave)
+	{
+		return g_StepMotor.connect_ex(port, SerialSettings{ baud, parity, data_bits, stop_bits }, slave);
+	}
+
+	int StepMotor_GetBaudRate() { return g_StepMotor.baud_rate(); }
+
+	int StepMotor_Reconnect() { return g_StepMotor.reconnect(); }
+
+	long long StepMotor_GetConnectLatency() { return g_StepMotor.connect_latency_us(); }
+
+	void StepMotor_GetLinkStatus(LinkStatus* status) { g_StepMotor.link_status(status); }
+
+	int StepMotor_SetTimeouts(int response_timeout_ms, int byte_timeout_ms, int adaptive) { return g_StepMotor.set_timeouts(response_timeout_ms, byte_timeout_ms, adaptive != 0); }
+
+	int StepMotor_SetRetryPolicy(int max_retries, int retry_backoff_ms) { return g_StepMotor.set_retry_policy(max_retries, retry_backoff_ms); }
+
+	long long StepMotor_GetResponseTimeout() { return g_StepMotor.response_timeout_us(); }
+
+	int StepMotor_Forward() { return g_StepMotor.open(); }
+
+	int StepMotor_Reverse() { return g_StepMotor.close(); }
+
+	int StepMotor_Stop() { return g_StepMotor.stop(); }
+
+	void StepMotor_InvalidateShadow() { g_StepMotor.invalidate_shadow(); }
+
+	int StepMotor_IsForwardButtonPressed() { return g_StepMotor.is_forward_button_pressed(); }
+
+	int StepMotor_IsReverseButtonPressed() { return g_StepMotor.is_reverse_button_pressed(); }
+
+	int StepMotor_StartLimitWatch(int interval_ms, int auto_stop) { return g_StepMotor.start_limit_watch(interval_ms, auto_stop != 0); }
+
+	void StepMotor_StopLimitWatch() { g_StepMotor.stop_limit_watch(); }
+
+	void StepMotor_SetLimitCallback(LimitSwitchCallback callback) { g_StepMotor.set_limit_callback(callback); }
+
+	int StepMotor_WaitForLimit(int timeout_ms) { return g_StepMotor.wait_for_limit(timeout_ms); }
+
+	int StepMotor_Create(const DeviceConfig* config, int* handle)
+	{
+		if (!config || !handle)
+			return BUS_ERROR_INVALID_LINE_SETTINGS;
+
+		return g_StepMotors.create(*config, *handle);
+	}
+
+	int StepMotor_Destroy(int handle) { return g_StepMotors.destroy(handle); }
+
+	int StepMotor_ReconnectH(int handle) { return g_StepMotors.invoke(handle, [](StepMotorManager& sm) { return sm.reconnect(); }); }
+
+	int StepMotor_GetLinkStatusH(int handle, LinkStatus* status)
+	{
+		return g_StepMotors.invoke(handle, [status](StepMotorManager& sm) { sm.link_status(status); return STATUS_OK; });
+	}
+
+	int StepMotor_ForwardH(int handle) { return g_StepMotors.invoke(handle, [](StepMotorManager& sm) { return sm.open(); }); }
+
+	int StepMotor_ReverseH(int handle) { return g_StepMotors.invoke(handle, [](StepMotorManager& sm) { return sm.close(); }); }
+
+	int StepMotor_StopH(int handle) { return g_StepMotors.invoke(handle, [](StepMotorManager& sm) { return sm.stop(); }); }
+
+	int StepMotor_IsForwardButtonPressedH(int handle)
+	{
+		auto sm{ g_StepMotors.get(handle) };
+		return sm ? sm->is_forward_button_pressed() : 0;
+	}
+
+	int StepMotor_IsReverseButtonPressedH(int handle)
+	{
+		auto sm{ g_StepMotors.get(handle) };
+		return sm ? sm->is_reverse_button_pressed() : 0;
+	}
+
+	int StepMotor_StartLimitWatchH(int handle, int interval_ms, int auto_stop)
+	{
+		return g_StepMotors.invoke(handle, [=](StepMotorManager& sm) { return sm.start_limit_watch(interval_ms, auto_stop != 0); });
+	}
+
+	int StepMotor_StopLimitWatchH(int handle)
+	{
+		return g_StepMotors.invoke(handle, [](StepMotorManager& sm) { sm.stop_limit_watch(); return STATUS_OK; });
+	}
+
+	int StepMotor_WaitForLimitH(int handle, int timeout_ms)
+	{
+		auto sm{ g_StepMotors.get(handle) };
+		return sm ? sm->wait_for_limit(timeout_ms) : 0;
+	}
+}
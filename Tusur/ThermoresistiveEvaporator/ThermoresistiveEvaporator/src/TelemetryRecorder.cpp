@@ -0,0 +1,289 @@
+#include <algorithm>
+#include <atomic>
+
+#include "TelemetryRecorder.h"
+#include "StatusConstants.h"
+
+namespace
+{
+	constexpr unsigned long long kchunk_bytes{ static_cast<unsigned long long>(ktelemetry_chunk_records) * sizeof(TelemetryRecord) };
+
+	/// @brief Maps `size` bytes of `file` at `offset`, growing the file if it is shorter.
+	void* map_view(HANDLE file, unsigned long long offset, unsigned long long size)
+	{
+		const unsigned long long end{ offset + size };
+		HANDLE mapping{ CreateFileMappingA(file, nullptr, PAGE_READWRITE, static_cast<DWORD>(end >> 32), static_cast<DWORD>(end), nullptr) };
+		if (!mapping)
+			return nullptr;
+
+		void* view{ MapViewOfFile(mapping, FILE_MAP_WRITE, static_cast<DWORD>(offset >> 32), static_cast<DWORD>(offset), static_cast<SIZE_T>(size)) };
+
+		// The view keeps the section alive.
+		CloseHandle(mapping);
+		return view;
+	}
+
+	/// @brief Widens an envelope by another one that follows it in time.
+	void merge(TelemetryEnvelopePoint& into, const TelemetryEnvelopePoint& point)
+	{
+		into.last_timestamp_us = point.last_timestamp_us;
+		into.min_current = std::min(into.min_current, point.min_current);
+		into.max_current = std::max(into.max_current, point.max_current);
+		into.min_voltage = std::min(into.min_voltage, point.min_voltage);
+		into.max_voltage = std::max(into.max_voltage, point.max_voltage);
+		into.samples += point.samples;
+	}
+
+	/**
+	 * @brief Copies the records of a range that fall between two instants, read through a temporary read-only view.
+	 * @return int Number of points written.
+	 */
+	int read_raw(const std::string& path, long long first, long long count, long long t0_us, long long t1_us, TelemetryEnvelopePoint* out)
+	{
+		// 1. Opening the file next to the recorder, which may still be writing it.
+		HANDLE file{ CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr) };
+		if (file == INVALID_HANDLE_VALUE)
+			return 0;
+
+		HANDLE mapping{ CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr) };
+		CloseHandle(file);
+		if (!mapping)
+			return 0;
+
+		// 2. Mapping the records, the view has to start at a multiple of the header size.
+		const unsigned long long offset{ ktelemetry_header_size + static_cast<unsigned long long>(first) * sizeof(TelemetryRecord) };
+		const unsigned long long aligned{ offset / ktelemetry_header_size * ktelemetry_header_size };
+		const unsigned long long size{ offset - aligned + static_cast<unsigned long long>(count) * sizeof(TelemetryRecord) };
+		const void* view{ MapViewOfFile(mapping, FILE_MAP_READ, static_cast<DWORD>(aligned >> 32), static_cast<DWORD>(aligned), static_cast<SIZE_T>(size)) };
+		CloseHandle(mapping);
+		if (!view)
+			return 0;
+
+		// 3. Converting the records in the range.
+		const TelemetryRecord* records{ reinterpret_cast<const TelemetryRecord*>(static_cast<const char*>(view) + (offset - aligned)) };
+		int written{};
+		for (long long i{}; i < count; ++i)
+		{
+			const TelemetryRecord& record{ records[i] };
+			if (record.timestamp_us < t0_us || record.timestamp_us > t1_us)
+				continue;
+
+			out[written++] = TelemetryEnvelopePoint{ record.timestamp_us, record.timestamp_us, record.current, record.current, record.voltage, record.voltage, 1, 0 };
+		}
+
+		UnmapViewOfFile(view);
+		return written;
+	}
+}
+
+TelemetryRecorder::~TelemetryRecorder() { stop(); }
+
+int TelemetryRecorder::start(const char* path)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	close_locked();
+
+	if (!path)
+		return TM_ERROR_RECORDING_OPEN_FAILED;
+
+	// 1. Creating the file, readers may open it while it is being recorded.
+	m_file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (m_file == INVALID_HANDLE_VALUE)
+		return TM_ERROR_RECORDING_OPEN_FAILED;
+
+	// 2. Mapping the header region and the first chunk.
+	m_header = static_cast<TelemetryFileHeader*>(map_view(m_file, 0, ktelemetry_header_size));
+	if (!m_header || !map_chunk_locked(0))
+	{
+		close_locked();
+		return TM_ERROR_RECORDING_OPEN_FAILED;
+	}
+
+	// 3. Filling the header, the mapping is zero-initialized.
+	m_header->magic = ktelemetry_magic;
+	m_header->version = ktelemetry_version;
+	m_header->header_size = ktelemetry_header_size;
+	m_header->record_size = sizeof(TelemetryRecord);
+	m_header->chunk_records = ktelemetry_chunk_records;
+	m_dropped = 0;
+	m_path = path;
+	m_records = 0;
+	m_levels.assign(1, {});
+	return STATUS_OK;
+}
+
+void TelemetryRecorder::stop()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	close_locked();
+}
+
+bool TelemetryRecorder::map_chunk_locked(unsigned index)
+{
+	if (m_chunk)
+	{
+		UnmapViewOfFile(m_chunk);
+		m_chunk = nullptr;
+	}
+
+	m_chunk = static_cast<TelemetryRecord*>(map_view(m_file, ktelemetry_header_size + index * kchunk_bytes, kchunk_bytes));
+	m_chunk_used = 0;
+	return m_chunk != nullptr;
+}
+
+TelemetryRecord* TelemetryRecorder::next_slot_locked()
+{
+	if (!m_header)
+		return nullptr;
+
+	// 1. Moving to the next chunk when the current one is full.
+	if (m_chunk_used == ktelemetry_chunk_records)
+	{
+		if (m_header->chunk_count == ktelemetry_max_chunks || !map_chunk_locked(m_header->chunk_count))
+		{
+			++m_dropped;
+			return nullptr;
+		}
+	}
+
+	return m_chunk ? m_chunk + m_chunk_used : nullptr;
+}
+
+void TelemetryRecorder::commit_locked(const TelemetryRecord& record)
+{
+	// 1. Updating the index of the chunk.
+	if (m_chunk_used == 0)
+	{
+		m_header->chunks[m_header->chunk_count].first_timestamp_us = record.timestamp_us;
+		++m_header->chunk_count;
+	}
+	m_header->chunks[m_header->chunk_count - 1].last_timestamp_us = record.timestamp_us;
+	++m_chunk_used;
+
+	// 2. Publishing the record, a reader of the live file never sees a count ahead of the data.
+	std::atomic_thread_fence(std::memory_order_release);
+	++m_header->record_count;
+	++m_records;
+
+	add_to_pyramid_locked(record);
+}
+
+void TelemetryRecorder::add_to_pyramid_locked(const TelemetryRecord& record)
+{
+	const TelemetryEnvelopePoint point{ record.timestamp_us, record.timestamp_us, record.current, record.current, record.voltage, record.voltage, 1, 0 };
+
+	long long span{ ktelemetry_pyramid_fanout };
+	for (std::size_t level{};; ++level, span *= ktelemetry_pyramid_fanout)
+	{
+		// 1. A level that outgrew one bucket gets a coarser one, starting with the bucket it already has.
+		if (level == m_levels.size())
+			m_levels.emplace_back(1, m_levels[level - 1].front());
+
+		// 2. Adding the record to the last bucket of the level, or opening a new one.
+		std::vector<TelemetryEnvelopePoint>& buckets{ m_levels[level] };
+		if (buckets.empty() || buckets.back().samples == span)
+			buckets.push_back(point);
+		else
+			merge(buckets.back(), point);
+
+		// 3. The coarsest level always has a single bucket.
+		if (level + 1 == m_levels.size() && buckets.size() < 2)
+			break;
+	}
+}
+
+void TelemetryRecorder::close_locked()
+{
+	if (m_file == INVALID_HANDLE_VALUE)
+		return;
+
+	// 1. Unmapping the views, the header last, after it was marked as closed.
+	unsigned long long records{};
+	if (m_chunk)
+		UnmapViewOfFile(m_chunk);
+	if (m_header)
+	{
+		records = m_header->record_count;
+		m_header->closed = 1;
+		FlushViewOfFile(m_header, 0);
+		UnmapViewOfFile(m_header);
+	}
+	m_chunk = nullptr;
+	m_header = nullptr;
+	m_chunk_used = 0;
+
+	// 2. Trimming the preallocated tail of the last chunk.
+	LARGE_INTEGER size{};
+	size.QuadPart = static_cast<LONGLONG>(ktelemetry_header_size + records * sizeof(TelemetryRecord));
+	if (SetFilePointerEx(m_file, size, nullptr, FILE_BEGIN))
+		SetEndOfFile(m_file);
+
+	CloseHandle(m_file);
+	m_file = INVALID_HANDLE_VALUE;
+}
+
+bool TelemetryRecorder::is_recording() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_header != nullptr;
+}
+
+long long TelemetryRecorder::record_count() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_header ? static_cast<long long>(m_header->record_count) : 0;
+}
+
+long long TelemetryRecorder::dropped_count() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return static_cast<long long>(m_dropped);
+}
+
+int TelemetryRecorder::query(long long t0_us, long long t1_us, int max_points, TelemetryEnvelopePoint* out) const
+{
+	if (!out || max_points <= 0 || t1_us < t0_us)
+		return 0;
+
+	std::string path;
+	long long first{}, count{};
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_levels.empty() || m_levels.front().empty())
+			return 0;
+
+		// 1. Finding the buckets of every level that overlap the range, finest level first.
+		for (std::size_t level{}; level < m_levels.size(); ++level)
+		{
+			const std::vector<TelemetryEnvelopePoint>& buckets{ m_levels[level] };
+			const auto begin{ std::partition_point(buckets.begin(), buckets.end(),
+				[t0_us](const TelemetryEnvelopePoint& bucket) { return bucket.last_timestamp_us < t0_us; }) };
+			const auto end{ std::partition_point(begin, buckets.end(),
+				[t1_us](const TelemetryEnvelopePoint& bucket) { return bucket.first_timestamp_us <= t1_us; }) };
+			if (begin == end)
+				return 0;
+
+			// 2. Raw records when the finest buckets hold few enough of them.
+			if (level == 0)
+			{
+				first = static_cast<long long>(begin - buckets.begin()) * ktelemetry_pyramid_fanout;
+				count = std::min<long long>(static_cast<long long>(end - begin) * ktelemetry_pyramid_fanout, m_records - first);
+				if (count <= max_points)
+				{
+					path = m_path;
+					break;
+				}
+			}
+
+			// 3. Otherwise the first level that fits.
+			if (end - begin <= max_points)
+			{
+				std::copy(begin, end, out);
+				return static_cast<int>(end - begin);
+			}
+		}
+	}
+
+	// Committed records do not change, so the file is read without holding the recorder.
+	return read_raw(path, first, count, t0_us, t1_us, out);
+}
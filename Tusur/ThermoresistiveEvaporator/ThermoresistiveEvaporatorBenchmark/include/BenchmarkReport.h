@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+/// @brief Output format of a report.
+enum ReportFormat
+{
+	REPORT_JSON = 0, ///< One JSON object: "info" and "metrics".
+	REPORT_CSV = 1   ///< "name,value,unit" rows, the info as leading "# key=value" lines.
+};
+
+/**
+ * @struct LatencySummary
+ * @brief Distribution of a series of durations.
+ */
+struct LatencySummary
+{
+	std::size_t count; ///< Number of samples.
+	double mean_us;    ///< Mean.
+	long long p50_us;  ///< Median, nearest rank.
+	long long p99_us;  ///< 99th percentile, nearest rank.
+	long long min_us;  ///< Smallest sample.
+	long long max_us;  ///< Largest sample.
+};
+
+/**
+ * @brief Summarizes a series of durations.
+ * @param samples_us The samples, sorted in place.
+ * @return LatencySummary All zero for an empty series.
+ */
+LatencySummary summarize(std::vector<long long>& samples_us);
+
+/**
+ * @class BenchmarkReport
+ * @brief Collects the results of a benchmark run and writes them in a machine-readable form.
+ */
+class BenchmarkReport
+{
+private:
+	/// @brief One measured value.
+	struct Metric
+	{
+		std::string name; ///< Dotted name, e.g. "command.set_current_voltage.p99".
+		double value;     ///< Value.
+		std::string unit; ///< Unit, e.g. "us" or "samples/s".
+	};
+
+	std::vector<std::pair<std::string, std::string>> m_info; ///< Description of the run: mode, ports, settings.
+	std::vector<Metric> m_metrics;                           ///< Results in the order they were measured.
+
+public:
+	/// @brief Adds a description entry of the run.
+	void set_info(const std::string& key, const std::string& value);
+
+	/// @brief Adds a measured value.
+	void add(const std::string& name, double value, const std::string& unit);
+
+	/// @brief Adds the count, mean, p50, p99, min and max of a series under `name`.
+	void add_latency(const std::string& name, std::vector<long long> samples_us);
+
+	/**
+	 * @brief Writes the report.
+	 * @param out Destination stream.
+	 * @param format One of ReportFormat.
+	 * @return bool False if writing failed.
+	 */
+	bool write(std::FILE* out, int format) const;
+};
@@ -0,0 +1,82 @@
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+#include "BenchmarkReport.h"
+
+namespace
+{
+	/// @brief Sample of a sorted series at a percentile, nearest rank.
+	long long percentile(const std::vector<long long>& sorted, double p)
+	{
+		std::size_t rank{ static_cast<std::size_t>(std::ceil(p / 100.0 * sorted.size())) };
+		return sorted[rank > 0 ? rank - 1 : 0];
+	}
+
+	/// @brief Quotes a string for JSON.
+	std::string quoted(const std::string& text)
+	{
+		std::string result{ "\"" };
+		for (char c : text)
+		{
+			if (c == '"' || c == '\\')
+				result += '\\';
+			result += c;
+		}
+		return result + "\"";
+	}
+}
+
+LatencySummary summarize(std::vector<long long>& samples_us)
+{
+	if (samples_us.empty())
+		return LatencySummary{};
+
+	std::sort(samples_us.begin(), samples_us.end());
+	const double total{ std::accumulate(samples_us.begin(), samples_us.end(), 0.0) };
+	return LatencySummary{ samples_us.size(), total / samples_us.size(), percentile(samples_us, 50.0), percentile(samples_us, 99.0),
+		samples_us.front(), samples_us.back() };
+}
+
+void BenchmarkReport::set_info(const std::string& key, const std::string& value) { m_info.emplace_back(key, value); }
+
+void BenchmarkReport::add(const std::string& name, double value, const std::string& unit) { m_metrics.push_back(Metric{ name, value, unit }); }
+
+void BenchmarkReport::add_latency(const std::string& name, std::vector<long long> samples_us)
+{
+	const LatencySummary summary{ summarize(samples_us) };
+	add(name + ".count", static_cast<double>(summary.count), "samples");
+	add(name + ".mean", summary.mean_us, "us");
+	add(name + ".p50", static_cast<double>(summary.p50_us), "us");
+	add(name + ".p99", static_cast<double>(summary.p99_us), "us");
+	add(name + ".min", static_cast<double>(summary.min_us), "us");
+	add(name + ".max", static_cast<double>(summary.max_us), "us");
+}
+
+bool BenchmarkReport::write(std::FILE* out, int format) const
+{
+	if (format == REPORT_CSV)
+	{
+		for (const auto& entry : m_info)
+			std::fprintf(out, "# %s=%s\n", entry.first.c_str(), entry.second.c_str());
+
+		std::fprintf(out, "name,value,unit\n");
+		for (const Metric& metric : m_metrics)
+			std::fprintf(out, "%s,%.3f,%s\n", metric.name.c_str(), metric.value, metric.unit.c_str());
+	}
+	else
+	{
+		std::fprintf(out, "{\n  \"info\": {");
+		for (std::size_t i{}; i < m_info.size(); ++i)
+			std::fprintf(out, "%s\n    %s: %s", i > 0 ? "," : "", quoted(m_info[i].first).c_str(), quoted(m_info[i].second).c_str());
+
+		std::fprintf(out, "\n  },\n  \"metrics\": [");
+		for (std::size_t i{}; i < m_metrics.size(); ++i)
+			std::fprintf(out, "%s\n    { \"name\": %s, \"value\": %.3f, \"unit\": %s }", i > 0 ? "," : "", quoted(m_metrics[i].name).c_str(),
+				m_metrics[i].value, quoted(m_metrics[i].unit).c_str());
+
+		std::fprintf(out, "\n  ]\n}\n");
+	}
+
+	return std::fflush(out) == 0 && !std::ferror(out);
+}
@@ -0,0 +1,484 @@
+// Benchmarks of the ThermoresistiveEvaporator device managers, against the simulated bus or the real devices.
+//
+// Usage: ThermoresistiveEvaporatorBenchmark [--hardware] [--ps-port COM1] [--sm-port COM2] [--no-motor]
+//        [--format json|csv] [--output file] [--duration-ms 2000] [--iterations 200] [--interval-ms 1]
+//        [--timed-runs 5] [--timed-run-ms 200] [--stages 10] [--stage-ms 100] [--reconnect-cycles 5]
+//        [--ps-baud N] [--sm-baud N] (0 probes the rate, omitted keeps the default line settings)
+//        [--processing-us 500] [--jitter-us 200] [--timeout-rate 0] [--crc-error-rate 0] [--seed 1] [--device-baud 0]
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "BenchmarkReport.h"
+#include "Diagnostics.h"
+#include "ModbusSimulator.h"
+#include "PowerSupplyManager.h"
+#include "ScenarioExecutor.h"
+#include "StatusConstants.h"
+#include "StepMotorManager.h"
+
+namespace
+{
+	/// @brief Settings of a benchmark run, from the command line.
+	struct Options
+	{
+		bool hardware{ false };                   ///< Real devices instead of the simulator.
+		std::string ps_port{ "COM1" };            ///< Port of the power supply.
+		std::string sm_port{ "COM2" };            ///< Port of the step motor.
+		int ps_baud{ -1 };                        ///< Baud rate of the power supply, 0 to probe, -1 for the default.
+		int sm_baud{ -1 };                        ///< Baud rate of the step motor, 0 to probe, -1 for the default.
+		bool motor{ true };                       ///< Whether the step motor is exercised.
+		int format{ REPORT_JSON };                ///< One of ReportFormat.
+		std::string output;                       ///< Report file, standard output if empty.
+		int duration_ms{ 2000 };                  ///< Length of the telemetry measurement.
+		int iterations{ 200 };                    ///< Transactions per round-trip measurement.
+		int interval_ms{ 1 };                     ///< Acquisition period asked for in the telemetry measurement.
+		int timed_runs{ 5 };                      ///< Timed runs measured.
+		int timed_run_ms{ 200 };                  ///< Duration of one timed run.
+		int stages{ 10 };                         ///< Stages of the measured scenario.
+		int stage_ms{ 100 };                      ///< Duration of one stage.
+		int reconnect_cycles{ 5 };                ///< Link losses measured.
+		SimulatorConfig simulator{ 500, 200, 0.0, 0.0, 0, 0, 20, 200, 1, 0 }; ///< Simulated bus.
+	};
+
+	const char* const ktrace_path{ "benchmark_trace.bin" }; ///< Diagnostics trace written during the deadline measurements.
+
+	std::atomic<long long> g_timed_run_done_us{ -1 }; ///< Time the last timed-run callback fired.
+
+	/// @brief Steady clock time in microseconds, the base of the diagnostics trace.
+	long long now_us()
+	{
+		return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	/// @brief Reads the records of a diagnostics trace, empty if the file is missing or not a trace.
+	std::vector<DiagnosticsTraceRecord> read_trace(const char* path)
+	{
+		std::vector<DiagnosticsTraceRecord> records;
+		std::FILE* file{ std::fopen(path, "rb") };
+		if (!file)
+			return records;
+
+		unsigned header[2]{};
+		if (std::fread(header, sizeof(header), 1, file) == 1 && header[0] == kdiag_trace_magic && header[1] == kdiag_trace_version)
+		{
+			DiagnosticsTraceRecord record{};
+			while (std::fread(&record, sizeof(record), 1, file) == 1)
+				records.push_back(record);
+		}
+
+		std::fclose(file);
+		return records;
+	}
+
+	/// @brief Start times of the setpoint writes (register 18) to the power supply from `since_us` on.
+	std::vector<long long> setpoint_writes(const std::vector<DiagnosticsTraceRecord>& records, long long since_us)
+	{
+		std::vector<long long> writes;
+		for (const DiagnosticsTraceRecord& record : records)
+			if (record.slave == ps_constants::kslave_id && record.addr == 18 && (record.function == 0x10 || record.function == 0x06) &&
+				record.timestamp_us >= since_us)
+				writes.push_back(record.timestamp_us);
+
+		return writes;
+	}
+
+	/// @brief Setpoint current of the measurements: negligible on real devices.
+	uint16_t base_current(const Options& options) { return options.hardware ? 0 : 100; }
+
+	/// @brief Setpoint voltage of the measurements: none on real devices.
+	uint16_t base_voltage(const Options& options) { return options.hardware ? 0 : 5; }
+
+	/// @brief Telemetry samples per second the acquisition thread achieves, and the spacing of the samples.
+	int bench_telemetry(const Options& options, BenchmarkReport& report)
+	{
+		int status{ PowerSupply_StartAcquisition(options.interval_ms) };
+		if (status != STATUS_OK)
+			return status;
+
+		// 1. Draining the ring while the acquisition runs, so no sample is overwritten.
+		std::vector<Sample> buffer(ksample_ring_capacity);
+		std::vector<long long> gaps_us;
+		long long ok{}, failed{}, last_us{ -1 };
+		const auto started{ std::chrono::steady_clock::now() };
+		const auto finish{ started + std::chrono::milliseconds(options.duration_ms) };
+		while (std::chrono::steady_clock::now() < finish)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(20));
+			int n{ PowerSupply_DrainSamples(buffer.data(), static_cast<int>(buffer.size())) };
+			for (int i{}; i < n; ++i)
+			{
+				if (buffer[i].status != STATUS_OK)
+				{
+					++failed;
+					continue;
+				}
+
+				if (last_us >= 0)
+					gaps_us.push_back(buffer[i].timestamp_us - last_us);
+				last_us = buffer[i].timestamp_us;
+				++ok;
+			}
+		}
+
+		PowerSupply_StopAcquisition();
+		const double elapsed_s{ std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count() };
+
+		// 2. Reporting the rate and the spacing.
+		report.add("telemetry.interval_requested", options.interval_ms, "ms");
+		report.add("telemetry.samples_per_second", ok / elapsed_s, "samples/s");
+		report.add("telemetry.failed_samples", static_cast<double>(failed), "samples");
+		report.add_latency("telemetry.sample_gap", gaps_us);
+		return STATUS_OK;
+	}
+
+	/// @brief Round trips of the commands issued by the UI.
+	int bench_commands(const Options& options, BenchmarkReport& report)
+	{
+		std::vector<long long> set_us, read_us, motor_us;
+		int status{ STATUS_OK };
+
+		// 1. Setpoint writes, forced so every call reaches the device.
+		for (int i{}; i < options.iterations && status == STATUS_OK; ++i)
+		{
+			const long long started{ now_us() };
+			status = PowerSupply_SetCurrentVoltageEx(static_cast<uint16_t>(base_current(options) + i % 2), base_voltage(options), 1);
+			set_us.push_back(now_us() - started);
+		}
+
+		// 2. Telemetry reads of current and voltage in one frame.
+		for (int i{}; i < options.iterations && status == STATUS_OK; ++i)
+		{
+			int current{}, voltage{};
+			const long long started{ now_us() };
+			status = PowerSupply_ReadCurrentVoltage(&current, &voltage);
+			read_us.push_back(now_us() - started);
+		}
+
+		// 3. Direction changes of the step motor, alternating so every call writes.
+		if (options.motor)
+		{
+			for (int i{}; i < options.iterations && status == STATUS_OK; ++i)
+			{
+				const long long started{ now_us() };
+				status = i % 2 == 0 ? StepMotor_Forward() : StepMotor_Reverse();
+				motor_us.push_back(now_us() - started);
+			}
+			StepMotor_Stop();
+		}
+
+		report.add_latency("command.set_current_voltage", set_us);
+		report.add_latency("command.read_current_voltage", read_us);
+		if (options.motor)
+			report.add_latency("command.step_motor_direction", motor_us);
+
+		return status;
+	}
+
+	/// @brief Lateness of the turn-off of timed runs, from the trace of the reset write.
+	int bench_timed_run(const Options& options, BenchmarkReport& report)
+	{
+		int status{ Diagnostics_StartTrace(ktrace_path) };
+		if (status != STATUS_OK)
+			return status;
+
+		PowerSupply_SetTimedRunCallback([](int) { g_timed_run_done_us = now_us(); });
+
+		std::vector<long long> starts_us;
+		std::vector<long long> callback_us;
+		for (int i{}; i < options.timed_runs && status == STATUS_OK; ++i)
+		{
+			// 1. The deadline is set when StartTimedRun() returns, less the time taken by the return itself.
+			g_timed_run_done_us = -1;
+			status = PowerSupply_StartTimedRun(options.timed_run_ms);
+			const long long started_us{ now_us() };
+			if (status != STATUS_OK)
+				break;
+
+			starts_us.push_back(started_us);
+
+			// 2. Waiting for the turn-off, with a generous margin for a slow line.
+			const long long deadline_us{ started_us + options.timed_run_ms * 1000LL };
+			while (g_timed_run_done_us < 0 && now_us() < deadline_us + 5000000LL)
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+			if (g_timed_run_done_us < 0)
+			{
+				PowerSupply_CancelTimedRun();
+				status = PS_ERROR_POWER_SUPPLY_TURN_OFF_FAILED;
+				break;
+			}
+
+			callback_us.push_back(g_timed_run_done_us - deadline_us);
+		}
+
+		PowerSupply_SetTimedRunCallback(nullptr);
+		Diagnostics_StopTrace();
+		const std::vector<DiagnosticsTraceRecord> records{ read_trace(ktrace_path) };
+		std::remove(ktrace_path);
+		if (status != STATUS_OK)
+			return status;
+
+		// 3. Matching each run with the first setpoint write after its deadline, the reset of the turn-off.
+		std::vector<long long> error_us;
+		for (long long started_us : starts_us)
+		{
+			const long long deadline_us{ started_us + options.timed_run_ms * 1000LL };
+			std::vector<long long> writes{ setpoint_writes(records, started_us) };
+			if (!writes.empty())
+				error_us.push_back(writes.front() - deadline_us);
+		}
+
+		report.add_latency("timed_run.deadline_error", error_us);
+		report.add_latency("timed_run.callback_delay", callback_us);
+		return STATUS_OK;
+	}
+
+	/// @brief Time error of the stage transitions of a scenario, from the trace of the setpoint writes.
+	int bench_scenario(const Options& options, BenchmarkReport& report)
+	{
+		// 1. Step stages with distinct setpoints, so every transition is one write.
+		std::vector<ScenarioStage> stages;
+		for (int i{}; i < options.stages; ++i)
+			stages.push_back(ScenarioStage{ static_cast<uint16_t>(base_current(options) + i + 1), base_voltage(options), options.stage_ms, 0 });
+
+		int status{ Scenario_Load(stages.data(), static_cast<int>(stages.size())) };
+		if (status == STATUS_OK)
+			status = Diagnostics_StartTrace(ktrace_path);
+		if (status != STATUS_OK)
+			return status;
+
+		// 2. Running the scenario, the first stage must be written even if the cache holds its setpoint.
+		PowerSupply_InvalidateShadow();
+		const long long started_us{ now_us() };
+		status = Scenario_Start();
+		if (status != STATUS_OK)
+		{
+			Diagnostics_StopTrace();
+			std::remove(ktrace_path);
+			return status;
+		}
+
+		ScenarioStatus progress{};
+		do
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+			Scenario_GetStatus(&progress);
+		} while (progress.state == SCENARIO_RUNNING);
+
+		Scenario_Stop();
+		Diagnostics_StopTrace();
+		const std::vector<long long> writes{ setpoint_writes(read_trace(ktrace_path), started_us) };
+		std::remove(ktrace_path);
+		if (progress.state != SCENARIO_COMPLETED)
+			return progress.last_error != STATUS_OK ? progress.last_error : SC_ERROR_NOT_LOADED;
+
+		// 3. Writes after the first one are the transitions, the last one the turn-off at the end of the final stage.
+		std::vector<long long> jitter_us;
+		for (std::size_t i{ 1 }; i < writes.size() && i <= stages.size(); ++i)
+			jitter_us.push_back(writes[i] - writes[0] - static_cast<long long>(i) * options.stage_ms * 1000LL);
+
+		report.add_latency("scenario.transition_error", jitter_us);
+		return STATUS_OK;
+	}
+
+	/// @brief Time to get the link back: after the simulated bus returns, or of a forced reopening on real devices.
+	int bench_reconnect(const Options& options, BenchmarkReport& report)
+	{
+		std::vector<long long> reconnect_us;
+		std::vector<long long> open_us;
+		int current{}, voltage{};
+		for (int i{}; i < options.reconnect_cycles; ++i)
+		{
+			if (options.hardware)
+			{
+				const long long started{ now_us() };
+				int status{ PowerSupply_Reconnect() };
+				if (status != STATUS_OK)
+					return status;
+
+				reconnect_us.push_back(now_us() - started);
+			}
+			else
+			{
+				// 1. Losing the bus, until the manager gives the link up.
+				SimulatorConfig config{ options.simulator };
+				config.offline = 1;
+				Simulator_Enable(&config);
+
+				LinkStatus link{};
+				do
+				{
+					PowerSupply_ReadCurrentVoltage(&current, &voltage);
+					PowerSupply_GetLinkStatus(&link);
+				} while (link.state == LINK_ONLINE || link.state == LINK_DEGRADED);
+
+				// 2. Bringing it back, timing the first successful read.
+				config.offline = 0;
+				Simulator_Enable(&config);
+				const long long started{ now_us() };
+				while (PowerSupply_ReadCurrentVoltage(&current, &voltage) != STATUS_OK)
+				{
+					if (now_us() - started > 30000000LL)
+						return BUS_ERROR_OFFLINE;
+					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				}
+
+				reconnect_us.push_back(now_us() - started);
+			}
+
+			open_us.push_back(PowerSupply_GetConnectLatency());
+		}
+
+		report.add_latency("reconnect.time_to_first_read", reconnect_us);
+		report.add_latency("reconnect.port_open", open_us);
+		return STATUS_OK;
+	}
+
+	/// @brief Parses the command line, false on an unknown or incomplete option.
+	bool parse(int argc, char* argv[], Options& options)
+	{
+		for (int i{ 1 }; i < argc; ++i)
+		{
+			const std::string arg{ argv[i] };
+			if (arg == "--hardware")
+				options.hardware = true;
+			else if (arg == "--no-motor")
+				options.motor = false;
+			else if (i + 1 >= argc)
+				return false;
+			else if (arg == "--ps-port")
+				options.ps_port = argv[++i];
+			else if (arg == "--sm-port")
+				options.sm_port = argv[++i];
+			else if (arg == "--ps-baud")
+				options.ps_baud = std::atoi(argv[++i]);
+			else if (arg == "--sm-baud")
+				options.sm_baud = std::atoi(argv[++i]);
+			else if (arg == "--format")
+				options.format = std::strcmp(argv[++i], "csv") == 0 ? REPORT_CSV : REPORT_JSON;
+			else if (arg == "--output")
+				options.output = argv[++i];
+			else if (arg == "--duration-ms")
+				options.duration_ms = std::atoi(argv[++i]);
+			else if (arg == "--iterations")
+				options.iterations = std::atoi(argv[++i]);
+			else if (arg == "--interval-ms")
+				options.interval_ms = std::atoi(argv[++i]);
+			else if (arg == "--timed-runs")
+				options.timed_runs = std::atoi(argv[++i]);
+			else if (arg == "--timed-run-ms")
+				options.timed_run_ms = std::atoi(argv[++i]);
+			else if (arg == "--stages")
+				options.stages = std::atoi(argv[++i]);
+			else if (arg == "--stage-ms")
+				options.stage_ms = std::atoi(argv[++i]);
+			else if (arg == "--reconnect-cycles")
+				options.reconnect_cycles = std::atoi(argv[++i]);
+			else if (arg == "--processing-us")
+				options.simulator.processing_us = std::atoi(argv[++i]);
+			else if (arg == "--jitter-us")
+				options.simulator.jitter_us = std::atoi(argv[++i]);
+			else if (arg == "--timeout-rate")
+				options.simulator.timeout_rate = std::atof(argv[++i]);
+			else if (arg == "--crc-error-rate")
+				options.simulator.crc_error_rate = std::atof(argv[++i]);
+			else if (arg == "--device-baud")
+				options.simulator.device_baud = std::atoi(argv[++i]);
+			else if (arg == "--seed")
+				options.simulator.seed = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+			else
+				return false;
+		}
+
+		return true;
+	}
+
+	/// @brief Runs one benchmark, recording its outcome as `<name>.status`.
+	template <typename Bench>
+	bool run(const char* name, Bench bench, const Options& options, BenchmarkReport& report)
+	{
+		int status{ bench(options, report) };
+		report.add(std::string(name) + ".status", status, "code");
+		if (status != STATUS_OK)
+			std::fprintf(stderr, "%s failed: %d\n", name, status);
+
+		return status == STATUS_OK;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	Options options;
+	if (!parse(argc, argv, options))
+	{
+		std::fprintf(stderr, "usage: see the head of main.cpp\n");
+		return 2;
+	}
+
+	BenchmarkReport report;
+	report.set_info("mode", options.hardware ? "hardware" : "simulator");
+	report.set_info("build", __DATE__ " " __TIME__);
+	report.set_info("ps_port", options.ps_port);
+	report.set_info("sm_port", options.motor ? options.sm_port : "unused");
+	if (!options.hardware)
+	{
+		report.set_info("processing_us", std::to_string(options.simulator.processing_us));
+		report.set_info("jitter_us", std::to_string(options.simulator.jitter_us));
+		report.set_info("timeout_rate", std::to_string(options.simulator.timeout_rate));
+		report.set_info("crc_error_rate", std::to_string(options.simulator.crc_error_rate));
+		report.set_info("seed", std::to_string(options.simulator.seed));
+	}
+
+	// 1. Routing the ports to the simulator before they are opened, and opening them.
+	if (!options.hardware && Simulator_Enable(&options.simulator) != STATUS_OK)
+	{
+		std::fprintf(stderr, "invalid simulator settings\n");
+		return 2;
+	}
+
+	int status{ options.ps_baud < 0 ? PowerSupply_Connect(options.ps_port.c_str())
+		: PowerSupply_ConnectEx(options.ps_port.c_str(), options.ps_baud, 'N', 8, 1, ps_constants::kslave_id) };
+	if (status == STATUS_OK && options.motor)
+		status = options.sm_baud < 0 ? StepMotor_Connect(options.sm_port.c_str())
+			: StepMotor_ConnectEx(options.sm_port.c_str(), options.sm_baud, 'N', 8, 1, sm_constants::kslave_id);
+	if (status != STATUS_OK)
+	{
+		std::fprintf(stderr, "connect failed: %d\n", status);
+		return 1;
+	}
+
+	report.set_info("ps_baud", std::to_string(PowerSupply_GetBaudRate()));
+	if (options.motor)
+		report.set_info("sm_baud", std::to_string(StepMotor_GetBaudRate()));
+
+	// 2. Measuring.
+	bool ok{ run("telemetry", bench_telemetry, options, report) };
+	ok = run("command", bench_commands, options, report) && ok;
+	ok = run("timed_run", bench_timed_run, options, report) && ok;
+	ok = run("scenario", bench_scenario, options, report) && ok;
+	ok = run("reconnect", bench_reconnect, options, report) && ok;
+
+	// 3. Leaving the supply off, then writing the report.
+	PowerSupply_TurnOff();
+	if (!options.hardware)
+		Simulator_Disable();
+
+	std::FILE* out{ options.output.empty() ? stdout : std::fopen(options.output.c_str(), "w") };
+	if (!out || !report.write(out, options.format))
+	{
+		std::fprintf(stderr, "can not write the report\n");
+		return 1;
+	}
+
+	if (out != stdout)
+		std::fclose(out);
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,181 @@
+﻿using System.Runtime.InteropServices;
+using TusurUI.Source;
+
+namespace TusurUI.ExternalSources
+{
+    [StructLayout(LayoutKind.Sequential)]
+    public struct AsyncStats
+    {
+        public int Pending;
+        public int Running;
+        public long Submitted;
+        public long Completed;
+        public long Cancelled;
+    }
+
+    /// Commands run by the I/O threads of the DLL. The tasks complete with the status code of the blocking command, no thread waits meanwhile.
+    public class AsyncCommands
+    {
+        [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+        private delegate void AsyncCallback(int status, IntPtr ctx);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi)]
+        private static extern int PowerSupply_ConnectAsync(string port, AsyncCallback callback, IntPtr ctx);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int PowerSupply_TurnOnAsync(AsyncCallback callback, IntPtr ctx);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int PowerSupply_TurnOffAsync(AsyncCallback callback, IntPtr ctx);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int PowerSupply_SetCurrentVoltageAsync(ushort current, ushort voltage, AsyncCallback callback, IntPtr ctx);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int PowerSupply_ResetZPAsync(AsyncCallback callback, IntPtr ctx);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int PowerSupply_TurnOnAsyncH(int handle, AsyncCallback callback, IntPtr ctx);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int PowerSupply_TurnOffAsyncH(int handle, AsyncCallback callback, IntPtr ctx);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int PowerSupply_SetCurrentVoltageAsyncH(int handle, ushort current, ushort voltage, AsyncCallback callback, IntPtr ctx);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi)]
+        private static extern int StepMotor_ConnectAsync(string port, AsyncCallback callback, IntPtr ctx);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int StepMotor_ForwardAsync(AsyncCallback callback, IntPtr ctx);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int StepMotor_ReverseAsync(AsyncCallback callback, IntPtr ctx);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int StepMotor_StopAsync(AsyncCallback callback, IntPtr ctx);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int StepMotor_ForwardAsyncH(int handle, AsyncCallback callback, IntPtr ctx);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int StepMotor_ReverseAsyncH(int handle, AsyncCallback callback, IntPtr ctx);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int StepMotor_StopAsyncH(int handle, AsyncCallback callback, IntPtr ctx);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int Async_CancelPending();
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern void Async_GetStats(out AsyncStats stats);
+
+        public const int k_ErrorQueueFull = 170;
+        public const int k_ErrorCancelled = 171;
+
+        // One delegate for every command, kept alive for the lifetime of the DLL.
+        private static readonly AsyncCallback _callback = OnCompleted;
+
+        AsyncCommands() { }
+
+        public static Task<int> PowerSupplyConnectAsync(string port) { return Submit((callback, ctx) => PowerSupply_ConnectAsync(port, callback, ctx)); }
+
+        public static Task<int> PowerSupplyTurnOnAsync() { return Submit(PowerSupply_TurnOnAsync); }
+
+        public static Task<int> PowerSupplyTurnOffAsync() { return Submit(PowerSupply_TurnOffAsync); }
+
+        public static Task<int> PowerSupplySetCurrentVoltageAsync(ushort current, ushort voltage)
+        {
+            return Submit((callback, ctx) => PowerSupply_SetCurrentVoltageAsync(current, voltage, callback, ctx));
+        }
+
+        public static Task<int> PowerSupplyResetAsync() { return Submit(PowerSupply_ResetZPAsync); }
+
+        public static Task<int> PowerSupplyTurnOnAsyncH(int handle) { return Submit((callback, ctx) => PowerSupply_TurnOnAsyncH(handle, callback, ctx)); }
+
+        public static Task<int> PowerSupplyTurnOffAsyncH(int handle) { return Submit((callback, ctx) => PowerSupply_TurnOffAsyncH(handle, callback, ctx)); }
+
+        public static Task<int> PowerSupplySetCurrentVoltageAsyncH(int handle, ushort current, ushort voltage)
+        {
+            return Submit((callback, ctx) => PowerSupply_SetCurrentVoltageAsyncH(handle, current, voltage, callback, ctx));
+        }
+
+        public static Task<int> StepMotorConnectAsync(string port) { return Submit((callback, ctx) => StepMotor_ConnectAsync(port, callback, ctx)); }
+
+        public static Task<int> StepMotorForwardAsync() { return Submit(StepMotor_ForwardAsync); }
+
+        public static Task<int> StepMotorReverseAsync() { return Submit(StepMotor_ReverseAsync); }
+
+        /// Runs after the queued motor commands, StepMotor.Stop() stops the motor at once.
+        public static Task<int> StepMotorStopAsync() { return Submit(StepMotor_StopAsync); }
+
+        public static Task<int> StepMotorForwardAsyncH(int handle) { return Submit((callback, ctx) => StepMotor_ForwardAsyncH(handle, callback, ctx)); }
+
+        public static Task<int> StepMotorReverseAsyncH(int handle) { return Submit((callback, ctx) => StepMotor_ReverseAsyncH(handle, callback, ctx)); }
+
+        public static Task<int> StepMotorStopAsyncH(int handle) { return Submit((callback, ctx) => StepMotor_StopAsyncH(handle, callback, ctx)); }
+
+        /// The tasks of the queued commands complete with k_ErrorCancelled.
+        public static int CancelPending() { return Async_CancelPending(); }
+
+        public static AsyncStats GetStats()
+        {
+            Async_GetStats(out AsyncStats stats);
+            return stats;
+        }
+
+        private static Task<int> Submit(Func<AsyncCallback, IntPtr, int> submit)
+        {
+            // Continuations must not run on the I/O thread of the DLL, it serves the next command.
+            var completion = new TaskCompletionSource<int>(TaskCreationOptions.RunContinuationsAsynchronously);
+            GCHandle handle = GCHandle.Alloc(completion);
+            int status = submit(_callback, GCHandle.ToIntPtr(handle));
+
+            // A rejected command never calls back.
+            if (status != 0)
+            {
+                handle.Free();
+                completion.SetResult(status);
+            }
+            return completion.Task;
+        }
+
+        private static void OnCompleted(int status, IntPtr ctx)
+        {
+            GCHandle handle = GCHandle.FromIntPtr(ctx);
+            var completion = (TaskCompletionSource<int>)handle.Target!;
+            handle.Free();
+            completion.SetResult(status);
+        }
+
+        private static string GetErrorMessageEN(int errorCode)
+        {
+            return errorCode switch
+            {
+                170 => "Too many commands are queued.",
+                171 => "The command was cancelled.",
+                _ => PowerSupply.GetErrorMessage(errorCode, "EN")
+            };
+        }
+
+        private static string GetErrorMessageRU(int errorCode)
+        {
+            return errorCode switch
+            {
+                170 => "Слишком много команд в очереди.",
+                171 => "Команда отменена.",
+                _ => PowerSupply.GetErrorMessage(errorCode, "RU")
+            };
+        }
+
+        public static string GetErrorMessage(int errorCode, string language = "RU")
+        {
+            return language switch
+            {
+                "RU" => GetErrorMessageRU(errorCode),
+                "EN" => GetErrorMessageEN(errorCode),
+                _ => "Language not supported."
+            };
+        }
+    }
+}
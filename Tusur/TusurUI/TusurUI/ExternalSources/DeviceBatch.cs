@@ -0,0 +1,89 @@
+﻿using System.Runtime.InteropServices;
+
+namespace TusurUI.ExternalSources
+{
+    [StructLayout(LayoutKind.Sequential)]
+    public struct BatchOp
+    {
+        public int Device;
+        public int Kind;
+        public int Address;
+        public int Value;
+
+        public BatchOp(int device, int kind, int address, int value = 0)
+        {
+            Device = device;
+            Kind = kind;
+            Address = address;
+            Value = value;
+        }
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct BatchResult
+    {
+        public int Status;
+        public int Value;
+    }
+
+    public class DeviceBatch
+    {
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int Device_ExecuteBatch([In] BatchOp[] ops, int n, [Out] BatchResult[] results);
+
+        public const int k_DevicePowerSupply = 0;
+        public const int k_DeviceStepMotor = 1;
+
+        public const int k_ReadHolding = 0;
+        public const int k_ReadInput = 1;
+        public const int k_WriteRegister = 2;
+        public const int k_WriteCoil = 3;
+
+        public const int k_MaxOps = 256;
+
+        DeviceBatch() { }
+
+        /// Adjacent addresses of the same kind go out as one frame, execution stops at the first failure.
+        public static int Execute(BatchOp[] ops, BatchResult[] results)
+        {
+            if (results.Length < ops.Length)
+                throw new ArgumentException("The results array is shorter than the batch.", nameof(results));
+
+            return Device_ExecuteBatch(ops, ops.Length, results);
+        }
+
+        private static string GetErrorMessageEN(int errorCode)
+        {
+            return errorCode switch
+            {
+                0 => "Operation successful.",
+                120 => "Invalid batch of operations.",
+                121 => "A batch operation failed.",
+                122 => "The operation was skipped after an earlier failure.",
+                _ => "Unknown error."
+            };
+        }
+
+        private static string GetErrorMessageRU(int errorCode)
+        {
+            return errorCode switch
+            {
+                0 => "Операция прошла успешно.",
+                120 => "Некорректный пакет операций.",
+                121 => "Не удалось выполнить операцию пакета.",
+                122 => "Операция пропущена из-за предыдущей ошибки.",
+                _ => "Неизвестная ошибка."
+            };
+        }
+
+        public static string GetErrorMessage(int errorCode, string language = "RU")
+        {
+            return language switch
+            {
+                "RU" => GetErrorMessageRU(errorCode),
+                "EN" => GetErrorMessageEN(errorCode),
+                _ => "Language not supported."
+            };
+        }
+    }
+}
@@ -0,0 +1,28 @@
+﻿using System.Runtime.InteropServices;
+
+namespace TusurUI.ExternalSources
+{
+    /// Port, line settings and slave ID of a device instance, see PowerSupply.Create() and StepMotor.Create().
+    [StructLayout(LayoutKind.Sequential, CharSet = CharSet.Ansi)]
+    public struct DeviceConfig
+    {
+        [MarshalAs(UnmanagedType.LPStr)]
+        public string Port;
+        /// 0 probes the fastest rate the device answers reliably at.
+        public int Baud;
+        public byte Parity;
+        public int DataBits;
+        public int StopBits;
+        public int Slave;
+
+        public DeviceConfig(string port, int baud, int slave, char parity = 'N', int dataBits = 8, int stopBits = 1)
+        {
+            Port = port;
+            Baud = baud;
+            Parity = (byte)parity;
+            DataBits = dataBits;
+            StopBits = stopBits;
+            Slave = slave;
+        }
+    }
+}
@@ -0,0 +1,100 @@
+﻿using System.Runtime.InteropServices;
+using TusurUI.Source;
+
+namespace TusurUI.ExternalSources
+{
+    [StructLayout(LayoutKind.Sequential)]
+    public struct GroupResult
+    {
+        public int Handle;
+        public int Status;
+        /// From the common start of the group.
+        public long CompletedMicroseconds;
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct GroupReport
+    {
+        public int Succeeded;
+        public int Failed;
+        public long ElapsedMicroseconds;
+        /// Between the first and the last successful device.
+        public long SpreadMicroseconds;
+    }
+
+    /// Commands to several power supplies created with PowerSupply.Create(), sent to all of them at the same time.
+    public class DeviceGroup
+    {
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int PowerSupply_GroupTurnOn([In] int[] handles, int n, [Out] GroupResult[] results, out GroupReport report);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int PowerSupply_GroupTurnOff([In] int[] handles, int n, [Out] GroupResult[] results, out GroupReport report);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int PowerSupply_GroupSetCurrentVoltage([In] int[] handles, int n, ushort current, ushort voltage, [Out] GroupResult[] results, out GroupReport report);
+
+        public const int k_MaxDevices = 32;
+
+        DeviceGroup() { }
+
+        /// Returns 126 if the command failed on some of the devices, see the per-device statuses in results.
+        public static int TurnOn(int[] handles, GroupResult[] results, out GroupReport report)
+        {
+            CheckResults(handles, results);
+            return PowerSupply_GroupTurnOn(handles, handles.Length, results, out report);
+        }
+
+        public static int TurnOff(int[] handles, GroupResult[] results, out GroupReport report)
+        {
+            CheckResults(handles, results);
+            return PowerSupply_GroupTurnOff(handles, handles.Length, results, out report);
+        }
+
+        public static int SetCurrentVoltage(int[] handles, ushort current, ushort voltage, GroupResult[] results, out GroupReport report)
+        {
+            CheckResults(handles, results);
+            return PowerSupply_GroupSetCurrentVoltage(handles, handles.Length, current, voltage, results, out report);
+        }
+
+        private static void CheckResults(int[] handles, GroupResult[] results)
+        {
+            if (results.Length < handles.Length)
+                throw new ArgumentException("The results array is shorter than the group.", nameof(results));
+        }
+
+        private static string GetErrorMessageEN(int errorCode)
+        {
+            return errorCode switch
+            {
+                123 => "Unknown device handle.",
+                125 => "Invalid group of devices.",
+                126 => "The command failed on some of the devices.",
+                127 => "Failed to start the workers of the group, no device got the command.",
+                _ => PowerSupply.GetErrorMessage(errorCode, "EN")
+            };
+        }
+
+        private static string GetErrorMessageRU(int errorCode)
+        {
+            return errorCode switch
+            {
+                123 => "Неизвестный дескриптор устройства.",
+                125 => "Некорректная группа устройств.",
+                126 => "Команда не выполнена на части устройств.",
+                127 => "Не удалось запустить потоки группы, команда не отправлена ни одному устройству.",
+                _ => PowerSupply.GetErrorMessage(errorCode, "RU")
+            };
+        }
+
+        public static string GetErrorMessage(int errorCode, string language = "RU")
+        {
+            return language switch
+            {
+                "RU" => GetErrorMessageRU(errorCode),
+                "EN" => GetErrorMessageEN(errorCode),
+                _ => "Language not supported."
+            };
+        }
+    }
+}
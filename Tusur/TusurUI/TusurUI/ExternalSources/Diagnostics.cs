@@ -0,0 +1,89 @@
+﻿using System.Runtime.InteropServices;
+
+namespace TusurUI.ExternalSources
+{
+    [StructLayout(LayoutKind.Sequential)]
+    public struct DiagnosticsStats
+    {
+        public int Slave;
+        public int Function;
+        public int Address;
+        public ulong Count;
+        public ulong Errors;
+        public ulong Timeouts;
+        public long MinMicroseconds;
+        public long MaxMicroseconds;
+        public long TotalMicroseconds;
+
+        /// Bucket 0 counts transactions under 1 us, bucket i the ones in [2^(i-1), 2^i) us.
+        [MarshalAs(UnmanagedType.ByValArray, SizeConst = Diagnostics.k_HistogramBuckets)]
+        public ulong[] Buckets;
+    }
+
+    public class Diagnostics
+    {
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int Diagnostics_GetStats([Out] DiagnosticsStats[]? stats, int max);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern void Diagnostics_Reset();
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi)]
+        private static extern int Diagnostics_StartTrace(string path);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern void Diagnostics_StopTrace();
+
+        public const int k_HistogramBuckets = 32;
+
+        Diagnostics() { }
+
+        /// Latency statistics of every Modbus transaction kind (slave, function, register) seen so far.
+        public static DiagnosticsStats[] GetStats()
+        {
+            int count = Diagnostics_GetStats(null, 0);
+            var stats = new DiagnosticsStats[count];
+            int available = Diagnostics_GetStats(stats, count);
+
+            // New transaction kinds may have shown up between the two calls, they are picked up next time.
+            return available >= count ? stats : stats[..available];
+        }
+
+        public static void Reset() { Diagnostics_Reset(); }
+
+        /// Writes every transaction to a binary trace file until StopTrace() is called.
+        public static int StartTrace(string path) { return Diagnostics_StartTrace(path); }
+
+        public static void StopTrace() { Diagnostics_StopTrace(); }
+
+        private static string GetErrorMessageEN(int errorCode)
+        {
+            return errorCode switch
+            {
+                0 => "Operation successful.",
+                110 => "Failed to open the trace file.",
+                _ => "Unknown error."
+            };
+        }
+
+        private static string GetErrorMessageRU(int errorCode)
+        {
+            return errorCode switch
+            {
+                0 => "Операция прошла успешно.",
+                110 => "Не удалось открыть файл трассировки.",
+                _ => "Неизвестная ошибка."
+            };
+        }
+
+        public static string GetErrorMessage(int errorCode, string language = "RU")
+        {
+            return language switch
+            {
+                "RU" => GetErrorMessageRU(errorCode),
+                "EN" => GetErrorMessageEN(errorCode),
+                _ => "Language not supported."
+            };
+        }
+    }
+}
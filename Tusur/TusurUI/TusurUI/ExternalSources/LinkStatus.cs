@@ -0,0 +1,22 @@
+﻿using System.Runtime.InteropServices;
+
+namespace TusurUI.ExternalSources
+{
+    /// Snapshot of the link supervisor of a device's COM port, see PowerSupply.GetLinkStatus() and StepMotor.GetLinkStatus().
+    [StructLayout(LayoutKind.Sequential)]
+    public struct LinkStatus
+    {
+        public const int k_Disconnected = 0;
+        public const int k_Connecting = 1;
+        public const int k_Online = 2;
+        public const int k_Degraded = 3;
+
+        public int State;
+        public int ConsecutiveFailures;
+        public int ReconnectAttempts;
+        public int LastError;
+        public ulong Connections;
+
+        public bool IsOnline => State == k_Online || State == k_Degraded;
+    }
+}
@@ -1,21 +1,159 @@
 ﻿using System.Runtime.InteropServices;
+using TusurUI.ExternalSources;
 
 namespace TusurUI.Source
 {
+    [StructLayout(LayoutKind.Sequential)]
+    public struct PowerSupplySample
+    {
+        public long TimestampMicroseconds;
+        public int Current;
+        public int Voltage;
+        public int Status;
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct RampConfig
+    {
+        /// 0 linear, 1 S-curve.
+        public int Profile;
+        /// Current setpoint units per second, 0 to step the current.
+        public double CurrentRatePerSecond;
+        /// Volts per second, 0 to step the voltage.
+        public double VoltageRatePerSecond;
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct RampStatus
+    {
+        public int Active;
+        public int LastError;
+        public int Current;
+        public int Voltage;
+        public long RemainingMilliseconds;
+        public long Writes;
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct SetpointMailboxStatus
+    {
+        public int Pending;
+        public int LastError;
+        public int Current;
+        public int Voltage;
+        public long Posted;
+        public long Applied;
+        /// Posts replaced by a newer one before they were written.
+        public long Coalesced;
+        /// From the oldest post the last write covered until the device acknowledged it.
+        public long LastLagMicroseconds;
+        public long MaxLagMicroseconds;
+    }
+
+    [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+    public delegate void TimedRunCallback(int status);
+
     public class PowerSupply
     {
         [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi)]
         private static extern int PowerSupply_Connect(string port);
 
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi)]
+        private static extern int PowerSupply_ConnectEx(string port, int baud, byte parity, int dataBits, int stopBits, int slave);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int PowerSupply_GetBaudRate();
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int PowerSupply_Reconnect();
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern long PowerSupply_GetConnectLatency();
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern void PowerSupply_GetLinkStatus(out LinkStatus status);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int PowerSupply_SetTimeouts(int responseTimeoutMs, int byteTimeoutMs, int adaptive);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int PowerSupply_SetRetryPolicy(int maxRetries, int retryBackoffMs);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern long PowerSupply_GetResponseTimeout();
+
         [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
         private static extern int PowerSupply_SetCurrentVoltage(ushort current, ushort voltage);
 
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int PowerSupply_SetCurrentVoltageEx(ushort current, ushort voltage, int force);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern void PowerSupply_InvalidateShadow();
+
         [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
         private static extern int PowerSupply_ReadCurrent();
 
         [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
         private static extern int PowerSupply_ReadVoltage();
 
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int PowerSupply_ReadCurrentVoltage(out int current, out int voltage);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int PowerSupply_StartAcquisition(int intervalMilliseconds);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern void PowerSupply_StopAcquisition();
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int PowerSupply_DrainSamples([Out] PowerSupplySample[] samples, int max);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi)]
+        private static extern int PowerSupply_StartRecording(string path);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern void PowerSupply_StopRecording();
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern long PowerSupply_GetRecordedCount();
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int PowerSupply_StartTimedRun(long durationMilliseconds);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern void PowerSupply_CancelTimedRun();
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern long PowerSupply_GetTimedRunRemaining();
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern void PowerSupply_SetTimedRunCallback(TimedRunCallback? callback);
+
+        // Keeps the delegate alive while the DLL holds the function pointer.
+        private static TimedRunCallback? _timedRunCallback;
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int PowerSupply_SetRampConfig(ref RampConfig config);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int PowerSupply_RampTo(ushort current, ushort voltage);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int PowerSupply_RampOff();
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern void PowerSupply_CancelRamp();
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern void PowerSupply_GetRampStatus(out RampStatus status);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int PowerSupply_PostCurrentVoltage(ushort current, ushort voltage);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern void PowerSupply_GetSetpointMailboxStatus(out SetpointMailboxStatus status);
+
         [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
         private static extern int PowerSupply_TurnOn();
 
@@ -25,20 +163,143 @@ namespace TusurUI.Source
         [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
         private static extern int PowerSupply_ResetZP();
 
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int PowerSupply_Create(ref DeviceConfig config, out int handle);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int PowerSupply_Destroy(int handle);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int PowerSupply_ReconnectH(int handle);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int PowerSupply_GetLinkStatusH(int handle, out LinkStatus status);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int PowerSupply_SetCurrentVoltageH(int handle, ushort current, ushort voltage);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int PowerSupply_TurnOnH(int handle);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int PowerSupply_TurnOffH(int handle);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int PowerSupply_ReadCurrentVoltageH(int handle, out int current, out int voltage);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int PowerSupply_StartAcquisitionH(int handle, int intervalMilliseconds);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int PowerSupply_StopAcquisitionH(int handle);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int PowerSupply_DrainSamplesH(int handle, [Out] PowerSupplySample[] samples, int max);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int PowerSupply_RampToH(int handle, ushort current, ushort voltage);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int PowerSupply_RampOffH(int handle);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int PowerSupply_PostCurrentVoltageH(int handle, ushort current, ushort voltage);
+
         PowerSupply() { }
 
         public const ushort kdefault_Voltage = 6;
         public static int Connect(string port) { return PowerSupply_Connect(port); }
+        /// Baud rate 0 probes the fastest rate the device answers reliably at, see GetBaudRate().
+        public static int ConnectEx(string port, int baud, char parity = 'N', int dataBits = 8, int stopBits = 1, int slave = 1)
+        {
+            return PowerSupply_ConnectEx(port, baud, (byte)parity, dataBits, stopBits, slave);
+        }
+        public static int GetBaudRate() { return PowerSupply_GetBaudRate(); }
+        public static int Reconnect() { return PowerSupply_Reconnect(); }
+        /// Duration of the last port opening in microseconds, -1 if the port has not been opened yet.
+        public static long GetConnectLatency() { return PowerSupply_GetConnectLatency(); }
+
+        /// Reads a few atomics in the DLL, cheap enough for the UI timer.
+        public static LinkStatus GetLinkStatus()
+        {
+            PowerSupply_GetLinkStatus(out LinkStatus status);
+            return status;
+        }
+
+        /// In adaptive mode the response timeout follows the measured round trips, bounded by responseTimeoutMs.
+        public static int SetTimeouts(int responseTimeoutMs, int byteTimeoutMs, bool adaptive) { return PowerSupply_SetTimeouts(responseTimeoutMs, byteTimeoutMs, adaptive ? 1 : 0); }
+
+        /// Retries timed out or corrupted transactions, the pause doubles with every retry.
+        public static int SetRetryPolicy(int maxRetries, int retryBackoffMs) { return PowerSupply_SetRetryPolicy(maxRetries, retryBackoffMs); }
+
+        public static TimeSpan GetResponseTimeout() { return TimeSpan.FromTicks(PowerSupply_GetResponseTimeout() * 10); }
         public static int TurnOn() { return PowerSupply_TurnOn(); }
         public static int TurnOff() { return PowerSupply_TurnOff(); }
         public static int SetCurrentVoltage(ushort current, ushort voltage) { return PowerSupply_SetCurrentVoltage(current, voltage); }
+        public static int SetCurrentVoltage(ushort current, ushort voltage, bool force) { return PowerSupply_SetCurrentVoltageEx(current, voltage, force ? 1 : 0); }
+        public static void InvalidateShadow() { PowerSupply_InvalidateShadow(); }
         public static int ReadCurrent() { return PowerSupply_ReadCurrent(); }
         public static int ReadVoltage() { return PowerSupply_ReadVoltage(); }
+        public static int ReadCurrentVoltage(out int current, out int voltage) { return PowerSupply_ReadCurrentVoltage(out current, out voltage); }
+        public static int StartAcquisition(int intervalMilliseconds) { return PowerSupply_StartAcquisition(intervalMilliseconds); }
+        public static void StopAcquisition() { PowerSupply_StopAcquisition(); }
+        public static int DrainSamples(PowerSupplySample[] samples) { return PowerSupply_DrainSamples(samples, samples.Length); }
+        /// Every acquired sample is appended to the file, open it afterwards with TelemetryFile.
+        public static int StartRecording(string path) { return PowerSupply_StartRecording(path); }
+        public static void StopRecording() { PowerSupply_StopRecording(); }
+        public static long GetRecordedCount() { return PowerSupply_GetRecordedCount(); }
+        public static int StartTimedRun(TimeSpan duration) { return PowerSupply_StartTimedRun((long)duration.TotalMilliseconds); }
+        public static void CancelTimedRun() { PowerSupply_CancelTimedRun(); }
+        public static TimeSpan? GetTimedRunRemaining()
+        {
+            long remaining = PowerSupply_GetTimedRunRemaining();
+            return remaining < 0 ? null : TimeSpan.FromMilliseconds(remaining);
+        }
+        /// The callback is invoked on the DLL's scheduler thread, not on the UI thread.
+        public static void SetTimedRunCallback(TimedRunCallback? callback)
+        {
+            _timedRunCallback = callback;
+            PowerSupply_SetTimedRunCallback(callback);
+        }
+        public static int SetRampConfig(RampConfig config) { return PowerSupply_SetRampConfig(ref config); }
+        /// Returns at once, the setpoints are ramped by a native thread. SetCurrentVoltage and TurnOff cancel the ramp.
+        public static int RampTo(ushort current, ushort voltage) { return PowerSupply_RampTo(current, voltage); }
+        /// Ramps both setpoints down to 0, then turns the supply off.
+        public static int RampOff() { return PowerSupply_RampOff(); }
+        public static void CancelRamp() { PowerSupply_CancelRamp(); }
+        public static RampStatus GetRampStatus()
+        {
+            PowerSupply_GetRampStatus(out RampStatus status);
+            return status;
+        }
+        /// Returns at once, only the newest of quickly repeated posts is written. The result is the first write error since the previous post.
+        public static int PostCurrentVoltage(ushort current, ushort voltage) { return PowerSupply_PostCurrentVoltage(current, voltage); }
+        public static SetpointMailboxStatus GetSetpointMailboxStatus()
+        {
+            PowerSupply_GetSetpointMailboxStatus(out SetpointMailboxStatus status);
+            return status;
+        }
         public static int Reset() { return PowerSupply_ResetZP(); }
+        /// Creates an instance with its own connection and threads, the ...H methods act on it. The handle is 0 on failure.
+        public static int Create(DeviceConfig config, out int handle) { return PowerSupply_Create(ref config, out handle); }
+        public static int Destroy(int handle) { return PowerSupply_Destroy(handle); }
+        public static int ReconnectH(int handle) { return PowerSupply_ReconnectH(handle); }
+        public static int GetLinkStatusH(int handle, out LinkStatus status) { return PowerSupply_GetLinkStatusH(handle, out status); }
+        public static int SetCurrentVoltageH(int handle, ushort current, ushort voltage) { return PowerSupply_SetCurrentVoltageH(handle, current, voltage); }
+        public static int TurnOnH(int handle) { return PowerSupply_TurnOnH(handle); }
+        public static int TurnOffH(int handle) { return PowerSupply_TurnOffH(handle); }
+        public static int ReadCurrentVoltageH(int handle, out int current, out int voltage) { return PowerSupply_ReadCurrentVoltageH(handle, out current, out voltage); }
+        public static int StartAcquisitionH(int handle, int intervalMilliseconds) { return PowerSupply_StartAcquisitionH(handle, intervalMilliseconds); }
+        public static int StopAcquisitionH(int handle) { return PowerSupply_StopAcquisitionH(handle); }
+        public static int DrainSamplesH(int handle, PowerSupplySample[] samples) { return PowerSupply_DrainSamplesH(handle, samples, samples.Length); }
+        public static int RampToH(int handle, ushort current, ushort voltage) { return PowerSupply_RampToH(handle, current, voltage); }
+        public static int RampOffH(int handle) { return PowerSupply_RampOffH(handle); }
+        public static int PostCurrentVoltageH(int handle, ushort current, ushort voltage) { return PowerSupply_PostCurrentVoltageH(handle, current, voltage); }
         private static string GetErrorMessageEN(int errorCode)
         {
             return errorCode switch
             {
+                -3 => "Error reading current and voltage registers 20-21 (0x14-0x15)",
                 -2 => "Error reading voltage register 21 (0x15)",
                 -1 => "Error reading current register 20 (0x14)",
                 0 => "Operation successful.",
@@ -54,6 +315,18 @@ namespace TusurUI.Source
                 10 => "Failed to reset work mode.",
                 11 => "Failed to turn off the power supply.",
                 12 => "Failed to reset ZP register (36).",
+                13 => "Unsupported timer value.",
+                14 => "Unsupported telemetry acquisition interval.",
+                15 => "Invalid ramp settings.",
+                16 => "Failed to read back the setpoint registers 18-19 (0x12-0x13).",
+                50 => "The COM port is already used by another device with different line settings.",
+                51 => "Invalid timeout or retry settings.",
+                52 => "The connection is lost, reconnecting in the background.",
+                53 => "Invalid line settings or slave ID.",
+                54 => "The device does not answer at any of the probed baud rates.",
+                123 => "Unknown device handle.",
+                124 => "Too many device instances.",
+                130 => "Failed to create the telemetry recording file.",
                 _ => "Unknown error."
             };
         }
@@ -61,6 +334,7 @@ namespace TusurUI.Source
         {
             return errorCode switch
             {
+                -3 => "Не удалось прочитать значения тока и напряжения с регистров 20-21 (0x14-0x15)",
                 -2 => "Не удалось прочитать значение напряжения с регистра 21 (0x15)",
                 -1 => "Не удалось прочитать значение тока с регистра 20 (0x14)",
                 0 => "Операция прошла успешно.",
@@ -76,6 +350,18 @@ namespace TusurUI.Source
                 10 => "Не удалось сбросить рабочий режим.",
                 11 => "Не удалось выключить блок питания.",
                 12 => "Не удалось сбросить регистр ЗП(36).",
+                13 => "Неподдерживаемое значение таймера.",
+                14 => "Неподдерживаемый интервал опроса телеметрии.",
+                15 => "Некорректные параметры рампы.",
+                16 => "Не удалось прочитать уставки с регистров 18-19 (0x12-0x13).",
+                50 => "COM-порт уже используется другим устройством с другими параметрами линии.",
+                51 => "Некорректные параметры таймаутов или повторов.",
+                52 => "Соединение потеряно, выполняется переподключение в фоне.",
+                53 => "Некорректные параметры линии или адрес устройства.",
+                54 => "Устройство не отвечает ни на одной из проверенных скоростей.",
+                123 => "Неизвестный дескриптор устройства.",
+                124 => "Превышено число экземпляров устройств.",
+                130 => "Не удалось создать файл записи телеметрии.",
                 _ => "Неизвестная ошибка."
             };
         }
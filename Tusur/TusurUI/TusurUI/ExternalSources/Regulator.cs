@@ -0,0 +1,107 @@
+﻿using System.Runtime.InteropServices;
+using TusurUI.Source;
+
+namespace TusurUI.ExternalSources
+{
+    [StructLayout(LayoutKind.Sequential)]
+    public struct RegulatorConfig
+    {
+        public int Mode;
+        public int PeriodMilliseconds;
+        public double Kp;
+        public double Ki;
+        public double Kd;
+        public double Kff;
+        public int OutputMin;
+        public int OutputMax;
+        /// Largest change of the current setpoint per second, 0 for no limit.
+        public double SlewPerSecond;
+        public int VoltageLimit;
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct RegulatorStatus
+    {
+        public int Running;
+        public int LastError;
+        public double Target;
+        public double Measured;
+        public double Output;
+        public double Integral;
+        public long Cycles;
+        public long Overruns;
+        public long MaxJitterMicroseconds;
+    }
+
+    public class Regulator
+    {
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int Regulator_Configure(ref RegulatorConfig config);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern void Regulator_SetTarget(double target);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int Regulator_Start();
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern void Regulator_Stop();
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern void Regulator_GetStatus(out RegulatorStatus status);
+
+        public const int k_ModeCurrent = 0;
+        public const int k_ModePower = 1;
+        public const int k_ModeResistance = 2;
+
+        Regulator() { }
+
+        public static int Configure(RegulatorConfig config) { return Regulator_Configure(ref config); }
+
+        /// Units follow the mode: current register units, current units times volts, or volts per current unit.
+        public static void SetTarget(double target) { Regulator_SetTarget(target); }
+
+        /// The loop runs on a native thread at the configured period, the UI only polls GetStatus().
+        public static int Start() { return Regulator_Start(); }
+
+        public static void Stop() { Regulator_Stop(); }
+
+        public static RegulatorStatus GetStatus()
+        {
+            Regulator_GetStatus(out RegulatorStatus status);
+            return status;
+        }
+
+        private static string GetErrorMessageEN(int errorCode)
+        {
+            return errorCode switch
+            {
+                140 => "Invalid regulator settings.",
+                141 => "The regulator is not configured.",
+                142 => "The regulator is already running.",
+                _ => PowerSupply.GetErrorMessage(errorCode, "EN")
+            };
+        }
+
+        private static string GetErrorMessageRU(int errorCode)
+        {
+            return errorCode switch
+            {
+                140 => "Некорректные параметры регулятора.",
+                141 => "Регулятор не настроен.",
+                142 => "Регулятор уже запущен.",
+                _ => PowerSupply.GetErrorMessage(errorCode, "RU")
+            };
+        }
+
+        public static string GetErrorMessage(int errorCode, string language = "RU")
+        {
+            return language switch
+            {
+                "RU" => GetErrorMessageRU(errorCode),
+                "EN" => GetErrorMessageEN(errorCode),
+                _ => "Language not supported."
+            };
+        }
+    }
+}
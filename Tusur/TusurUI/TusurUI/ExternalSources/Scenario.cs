@@ -0,0 +1,112 @@
+﻿using System.Runtime.InteropServices;
+using TusurUI.Source;
+
+namespace TusurUI.ExternalSources
+{
+    [StructLayout(LayoutKind.Sequential)]
+    public struct ScenarioStage
+    {
+        public ushort Current;
+        public ushort Voltage;
+        public long DurationMilliseconds;
+        public long RampMilliseconds;
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct ScenarioStatus
+    {
+        public int State;
+        public int StageIndex;
+        public int StageCount;
+        public int LastError;
+        public long StageElapsedMilliseconds;
+        public long StageRemainingMilliseconds;
+        public long TotalElapsedMilliseconds;
+    }
+
+    public class Scenario
+    {
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int Scenario_Load([In] ScenarioStage[] stages, int count);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int Scenario_Start();
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern void Scenario_Stop();
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern void Scenario_GetStatus(out ScenarioStatus status);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int Scenario_SetCheckpointFile(string? path, int periodMs);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int Scenario_Resume();
+
+        public const int k_StateIdle = 0;
+        public const int k_StateRunning = 1;
+        public const int k_StateCompleted = 2;
+        public const int k_StateAborted = 3;
+        public const int k_StateFailed = 4;
+        public const int k_StateStarting = 5;
+
+        Scenario() { }
+
+        public static int Load(ScenarioStage[] stages) { return Scenario_Load(stages, stages.Length); }
+
+        public static int Start() { return Scenario_Start(); }
+
+        public static void Stop() { Scenario_Stop(); }
+
+        public static ScenarioStatus GetStatus()
+        {
+            Scenario_GetStatus(out ScenarioStatus status);
+            return status;
+        }
+
+        /// Start() truncates the file, Resume() continues it. Null stops checkpointing, a period of 0 checkpoints at stage boundaries only.
+        public static int SetCheckpointFile(string? path, int periodMs = 1000) { return Scenario_SetCheckpointFile(path, periodMs); }
+
+        /// Continues an interrupted run from the last checkpoint, with the stage table stored in the file.
+        public static int Resume() { return Scenario_Resume(); }
+
+        private static string GetErrorMessageEN(int errorCode)
+        {
+            return errorCode switch
+            {
+                100 => "Invalid scenario stages.",
+                101 => "Scenario is not loaded.",
+                102 => "Scenario is already running.",
+                103 => "Invalid scenario checkpoint period.",
+                104 => "Failed to open the scenario checkpoint file.",
+                105 => "No scenario checkpoint to resume from.",
+                _ => PowerSupply.GetErrorMessage(errorCode, "EN")
+            };
+        }
+
+        private static string GetErrorMessageRU(int errorCode)
+        {
+            return errorCode switch
+            {
+                100 => "Некорректные этапы сценария.",
+                101 => "Сценарий не загружен.",
+                102 => "Сценарий уже выполняется.",
+                103 => "Некорректный период контрольных точек сценария.",
+                104 => "Не удалось открыть файл контрольных точек сценария.",
+                105 => "Нет контрольной точки сценария для продолжения.",
+                _ => PowerSupply.GetErrorMessage(errorCode, "RU")
+            };
+        }
+
+        public static string GetErrorMessage(int errorCode, string language = "RU")
+        {
+            return language switch
+            {
+                "RU" => GetErrorMessageRU(errorCode),
+                "EN" => GetErrorMessageEN(errorCode),
+                _ => "Language not supported."
+            };
+        }
+    }
+}
@@ -0,0 +1,139 @@
+﻿using System.IO.MemoryMappedFiles;
+using System.Runtime.InteropServices;
+using TusurUI.Source;
+
+namespace TusurUI.ExternalSources
+{
+    /// Live state of the global devices, -1 where nothing was acknowledged yet.
+    [StructLayout(LayoutKind.Sequential)]
+    public struct SharedTelemetryData
+    {
+        public long Updates;
+        public long ReadingTimeMicroseconds;
+        public int Current;
+        public int Voltage;
+        public int ReadingStatus;
+        public int CurrentSetpoint;
+        public int VoltageSetpoint;
+        public int PowerCoil;
+        public int WorkmodeCoil;
+        /// Bit 0 forward, bit 1 reverse.
+        public int MotorDirection;
+        public long LimitsTimeMicroseconds;
+        public int ForwardLimit;
+        public int ReverseLimit;
+        public LinkStatus PowerSupplyLink;
+        public LinkStatus StepMotorLink;
+    }
+
+    /// Publishes the live state of the devices in a named shared-memory section, read by SharedTelemetryReader in any local process.
+    public class SharedTelemetry
+    {
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int SharedTelemetry_Start(string? name);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern void SharedTelemetry_Stop();
+
+        public const string k_DefaultName = "Local\\ThermoresistiveEvaporatorTelemetry";
+
+        SharedTelemetry() { }
+
+        /// A name with the Global\ prefix reaches readers of other sessions, e.g. a service.
+        public static int Start(string? name = null) { return SharedTelemetry_Start(name); }
+
+        public static void Stop() { SharedTelemetry_Stop(); }
+
+        private static string GetErrorMessageEN(int errorCode)
+        {
+            return errorCode switch
+            {
+                131 => "Failed to open the shared telemetry block.",
+                132 => "The shared telemetry block is being written, try again.",
+                _ => PowerSupply.GetErrorMessage(errorCode, "EN")
+            };
+        }
+
+        private static string GetErrorMessageRU(int errorCode)
+        {
+            return errorCode switch
+            {
+                131 => "Не удалось открыть общий блок телеметрии.",
+                132 => "Общий блок телеметрии записывается, повторите попытку.",
+                _ => PowerSupply.GetErrorMessage(errorCode, "RU")
+            };
+        }
+
+        public static string GetErrorMessage(int errorCode, string language = "RU")
+        {
+            return language switch
+            {
+                "RU" => GetErrorMessageRU(errorCode),
+                "EN" => GetErrorMessageEN(errorCode),
+                _ => "Language not supported."
+            };
+        }
+    }
+
+    /// Read-only view of the block published by SharedTelemetry.Start, needs no DLL and never touches the serial line.
+    public sealed class SharedTelemetryReader : IDisposable
+    {
+        public const uint k_Magic = 0x4D485354;
+        public const uint k_Version = 1;
+
+        private const int k_BlockSize = 136;
+        private const int k_SizeOffset = 8;
+        private const int k_SequenceOffset = 16;
+        private const int k_DataOffset = 24;
+        private const int k_ReadTries = 1000;
+
+        private readonly MemoryMappedFile _section;
+        private readonly MemoryMappedViewAccessor _view;
+
+        private SharedTelemetryReader(MemoryMappedFile section, MemoryMappedViewAccessor view)
+        {
+            _section = section;
+            _view = view;
+        }
+
+        /// Throws FileNotFoundException if nothing is published under the name.
+        public static SharedTelemetryReader Open(string name = SharedTelemetry.k_DefaultName)
+        {
+            var section = MemoryMappedFile.OpenExisting(name, MemoryMappedFileRights.Read);
+            var view = section.CreateViewAccessor(0, k_BlockSize, MemoryMappedFileAccess.Read);
+            if (view.ReadUInt32(0) != k_Magic || view.ReadUInt32(4) != k_Version || view.ReadUInt32(k_SizeOffset) != k_BlockSize)
+            {
+                view.Dispose();
+                section.Dispose();
+                throw new InvalidDataException($"{name} is not a shared telemetry block.");
+            }
+            return new SharedTelemetryReader(section, view);
+        }
+
+        /// Copies a consistent state, false if every try overlapped a write of the publisher.
+        public bool TryRead(out SharedTelemetryData data)
+        {
+            for (int i = 0; i < k_ReadTries; ++i)
+            {
+                // The sequence is odd while the publisher writes, and moves if a write overlapped the copy.
+                uint before = _view.ReadUInt32(k_SequenceOffset);
+                Interlocked.MemoryBarrier();
+                if ((before & 1) != 0)
+                    continue;
+
+                _view.Read(k_DataOffset, out data);
+                Interlocked.MemoryBarrier();
+                if (_view.ReadUInt32(k_SequenceOffset) == before)
+                    return true;
+            }
+            data = default;
+            return false;
+        }
+
+        public void Dispose()
+        {
+            _view.Dispose();
+            _section.Dispose();
+        }
+    }
+}
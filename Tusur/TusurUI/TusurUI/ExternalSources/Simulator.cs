@@ -0,0 +1,90 @@
+﻿using System.Runtime.InteropServices;
+using TusurUI.Source;
+
+namespace TusurUI.ExternalSources
+{
+    [StructLayout(LayoutKind.Sequential)]
+    public struct SimulatorConfig
+    {
+        public int ProcessingMicroseconds;
+        public int JitterMicroseconds;
+        /// Probabilities from 0 to 1.
+        public double TimeoutRate;
+        public double CrcErrorRate;
+        public int RejectBlockWrites;
+        public int Offline;
+        public int ResponseTauMilliseconds;
+        public int MotorTravelMilliseconds;
+        public uint Seed;
+        /// 0 to answer at any baud rate.
+        public int DeviceBaud;
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct SimulatorStats
+    {
+        public ulong Frames;
+        public ulong Timeouts;
+        public ulong CrcErrors;
+        public ulong Exceptions;
+        public ulong WireMicroseconds;
+    }
+
+    public class Simulator
+    {
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int Simulator_Enable(ref SimulatorConfig config);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern void Simulator_Disable();
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern void Simulator_Reset();
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern void Simulator_GetStats(out SimulatorStats stats);
+
+        Simulator() { }
+
+        /// Ports opened after this call talk to the simulated devices, call it before PowerSupply.Connect() and StepMotor.Connect().
+        public static int Enable(SimulatorConfig config) { return Simulator_Enable(ref config); }
+
+        public static void Disable() { Simulator_Disable(); }
+
+        public static void Reset() { Simulator_Reset(); }
+
+        public static SimulatorStats GetStats()
+        {
+            Simulator_GetStats(out SimulatorStats stats);
+            return stats;
+        }
+
+        private static string GetErrorMessageEN(int errorCode)
+        {
+            return errorCode switch
+            {
+                150 => "Invalid simulator settings.",
+                _ => PowerSupply.GetErrorMessage(errorCode, "EN")
+            };
+        }
+
+        private static string GetErrorMessageRU(int errorCode)
+        {
+            return errorCode switch
+            {
+                150 => "Некорректные параметры симулятора.",
+                _ => PowerSupply.GetErrorMessage(errorCode, "RU")
+            };
+        }
+
+        public static string GetErrorMessage(int errorCode, string language = "RU")
+        {
+            return language switch
+            {
+                "RU" => GetErrorMessageRU(errorCode),
+                "EN" => GetErrorMessageEN(errorCode),
+                _ => "Language not supported."
+            };
+        }
+    }
+}
@@ -2,11 +2,38 @@
 
 namespace TusurUI.ExternalSources
 {
+    [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+    public delegate void LimitSwitchCallback(int forward, int reverse);
+
     public class StepMotor
     {
         [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi)]
         private static extern int StepMotor_Connect(string port);
 
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi)]
+        private static extern int StepMotor_ConnectEx(string port, int baud, byte parity, int dataBits, int stopBits, int slave);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int StepMotor_GetBaudRate();
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int StepMotor_Reconnect();
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern long StepMotor_GetConnectLatency();
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern void StepMotor_GetLinkStatus(out LinkStatus status);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int StepMotor_SetTimeouts(int responseTimeoutMs, int byteTimeoutMs, int adaptive);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int StepMotor_SetRetryPolicy(int maxRetries, int retryBackoffMs);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern long StepMotor_GetResponseTimeout();
+
         [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
         private static extern int StepMotor_Forward();
 
@@ -16,6 +43,9 @@ namespace TusurUI.ExternalSources
         [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
         private static extern int StepMotor_Stop();
 
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern void StepMotor_InvalidateShadow();
+
         [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
         private static extern int StepMotor_GetLastState();
 
@@ -25,22 +55,143 @@ namespace TusurUI.ExternalSources
         [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
         private static extern int StepMotor_IsReverseButtonPressed();
 
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int StepMotor_StartLimitWatch(int intervalMs, int autoStop);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern void StepMotor_StopLimitWatch();
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern void StepMotor_SetLimitCallback(LimitSwitchCallback? callback);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int StepMotor_WaitForLimit(int timeoutMs);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int StepMotor_Create(ref DeviceConfig config, out int handle);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int StepMotor_Destroy(int handle);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int StepMotor_ReconnectH(int handle);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int StepMotor_GetLinkStatusH(int handle, out LinkStatus status);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int StepMotor_ForwardH(int handle);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int StepMotor_ReverseH(int handle);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int StepMotor_StopH(int handle);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int StepMotor_IsForwardButtonPressedH(int handle);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int StepMotor_IsReverseButtonPressedH(int handle);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int StepMotor_StartLimitWatchH(int handle, int intervalMs, int autoStop);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int StepMotor_StopLimitWatchH(int handle);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int StepMotor_WaitForLimitH(int handle, int timeoutMs);
+
+        // Keeps the delegate alive while the DLL holds the function pointer.
+        private static LimitSwitchCallback? _limitCallback;
+
         public StepMotor() { }
 
         public static int Connect(string port) { return StepMotor_Connect(port); }
 
+        /// Baud rate 0 probes the fastest rate the device answers reliably at, see GetBaudRate().
+        public static int ConnectEx(string port, int baud, char parity = 'N', int dataBits = 8, int stopBits = 1, int slave = 3)
+        {
+            return StepMotor_ConnectEx(port, baud, (byte)parity, dataBits, stopBits, slave);
+        }
+
+        public static int GetBaudRate() { return StepMotor_GetBaudRate(); }
+
+        public static int Reconnect() { return StepMotor_Reconnect(); }
+
+        /// Duration of the last port opening in microseconds, -1 if the port has not been opened yet.
+        public static long GetConnectLatency() { return StepMotor_GetConnectLatency(); }
+
+        /// Reads a few atomics in the DLL, cheap enough for the UI timer.
+        public static LinkStatus GetLinkStatus()
+        {
+            StepMotor_GetLinkStatus(out LinkStatus status);
+            return status;
+        }
+
+        /// In adaptive mode the response timeout follows the measured round trips, bounded by responseTimeoutMs.
+        public static int SetTimeouts(int responseTimeoutMs, int byteTimeoutMs, bool adaptive) { return StepMotor_SetTimeouts(responseTimeoutMs, byteTimeoutMs, adaptive ? 1 : 0); }
+
+        /// Retries timed out or corrupted transactions, the pause doubles with every retry.
+        public static int SetRetryPolicy(int maxRetries, int retryBackoffMs) { return StepMotor_SetRetryPolicy(maxRetries, retryBackoffMs); }
+
+        public static TimeSpan GetResponseTimeout() { return TimeSpan.FromTicks(StepMotor_GetResponseTimeout() * 10); }
+
         public static int Forward() { return StepMotor_Forward(); }
 
         public static int Reverse() { return StepMotor_Reverse(); }
 
         public static int Stop() { return StepMotor_Stop(); }
 
+        public static void InvalidateShadow() { StepMotor_InvalidateShadow(); }
+
         public static int GetLastMotorState() { return StepMotor_GetLastState(); }
 
         public static bool IsForwardButtonPressed() { return StepMotor_IsForwardButtonPressed() == 1; }
 
         public static bool IsReverseButtonPressed() { return StepMotor_IsReverseButtonPressed() == 1; }
 
+        /// Polls the limit switches natively every intervalMs, optionally stopping the motor when one is hit.
+        public static int StartLimitWatch(int intervalMs, bool autoStop) { return StepMotor_StartLimitWatch(intervalMs, autoStop ? 1 : 0); }
+
+        public static void StopLimitWatch() { StepMotor_StopLimitWatch(); }
+
+        /// The callback is invoked on the DLL's watcher thread, not on the UI thread.
+        public static void SetLimitCallback(LimitSwitchCallback? callback)
+        {
+            _limitCallback = callback;
+            StepMotor_SetLimitCallback(callback);
+        }
+
+        /// Returns the switch state at the hit (bit 0 forward, bit 1 reverse), or 0 on timeout.
+        public static int WaitForLimit(int timeoutMs) { return StepMotor_WaitForLimit(timeoutMs); }
+
+        /// Creates an instance with its own connection and watcher, the ...H methods act on it. The handle is 0 on failure.
+        public static int Create(DeviceConfig config, out int handle) { return StepMotor_Create(ref config, out handle); }
+
+        public static int Destroy(int handle) { return StepMotor_Destroy(handle); }
+
+        public static int ReconnectH(int handle) { return StepMotor_ReconnectH(handle); }
+
+        public static int GetLinkStatusH(int handle, out LinkStatus status) { return StepMotor_GetLinkStatusH(handle, out status); }
+
+        public static int ForwardH(int handle) { return StepMotor_ForwardH(handle); }
+
+        public static int ReverseH(int handle) { return StepMotor_ReverseH(handle); }
+
+        public static int StopH(int handle) { return StepMotor_StopH(handle); }
+
+        public static bool IsForwardButtonPressedH(int handle) { return StepMotor_IsForwardButtonPressedH(handle) == 1; }
+
+        public static bool IsReverseButtonPressedH(int handle) { return StepMotor_IsReverseButtonPressedH(handle) == 1; }
+
+        public static int StartLimitWatchH(int handle, int intervalMs, bool autoStop) { return StepMotor_StartLimitWatchH(handle, intervalMs, autoStop ? 1 : 0); }
+
+        public static int StopLimitWatchH(int handle) { return StepMotor_StopLimitWatchH(handle); }
+
+        public static int WaitForLimitH(int handle, int timeoutMs) { return StepMotor_WaitForLimitH(handle, timeoutMs); }
+
         private void UpdateMotorStateDisplay()
         {
             int state = StepMotor_GetLastState();
@@ -71,6 +222,14 @@ namespace TusurUI.ExternalSources
                 6 => "It was not possible to reset the FORWARD mode of the stepper motor (set the value of 512 register to 0).",
                 7 => "It was not possible to reset the REVERSE mode of the stepper motor (set the value of register 513 to 0).",
                 8 => "Shutter already closed.",
+                9 => "Unsupported limit switch polling interval.",
+                50 => "The COM port is already used by another device with different line settings.",
+                51 => "Invalid timeout or retry settings.",
+                52 => "The connection is lost, reconnecting in the background.",
+                53 => "Invalid line settings or slave ID.",
+                54 => "The device does not answer at any of the probed baud rates.",
+                123 => "Unknown device handle.",
+                124 => "Too many device instances.",
                 _ => "Unknown error."
             };
         }
@@ -88,6 +247,14 @@ namespace TusurUI.ExternalSources
                 6 => "Не удалось произвести сброс режима FORWARD у шагового двигателя (установить значение 512 регистра в 0).",
                 7 => "Не удалось произвести сброс режима REVERSE у шагового двигателя (установить значение 513 регистра в 0).",
                 8 => "Заслонка уже закрыта.",
+                9 => "Неподдерживаемый интервал опроса концевых выключателей.",
+                50 => "COM-порт уже используется другим устройством с другими параметрами линии.",
+                51 => "Некорректные параметры таймаутов или повторов.",
+                52 => "Соединение потеряно, выполняется переподключение в фоне.",
+                53 => "Некорректные параметры линии или адрес устройства.",
+                54 => "Устройство не отвечает ни на одной из проверенных скоростей.",
+                123 => "Неизвестный дескриптор устройства.",
+                124 => "Превышено число экземпляров устройств.",
                 _ => "Неизвестная ошибка."
             };
         }
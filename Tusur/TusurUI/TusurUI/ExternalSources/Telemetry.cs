@@ -0,0 +1,35 @@
+﻿using System.Runtime.InteropServices;
+
+namespace TusurUI.ExternalSources
+{
+    [StructLayout(LayoutKind.Sequential)]
+    public struct TelemetryEnvelopePoint
+    {
+        public long FirstTimestampMicroseconds;
+        public long LastTimestampMicroseconds;
+        public int MinCurrent;
+        public int MaxCurrent;
+        public int MinVoltage;
+        public int MaxVoltage;
+        /// Number of records covered, 1 for a raw record.
+        public int Samples;
+        private int _reserved;
+    }
+
+    public class Telemetry
+    {
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int Telemetry_Query(long t0Microseconds, long t1Microseconds, int maxPoints, [Out] TelemetryEnvelopePoint[] points);
+
+        Telemetry() { }
+
+        /// Min/max envelope of the last recording between two record timestamps, at most `maxPoints` points.
+        /// The cost depends on `maxPoints` only, so a chart can requery on every zoom or pan.
+        public static TelemetryEnvelopePoint[] Query(long t0Microseconds, long t1Microseconds, int maxPoints)
+        {
+            var points = new TelemetryEnvelopePoint[maxPoints];
+            int count = Telemetry_Query(t0Microseconds, t1Microseconds, maxPoints, points);
+            return count == maxPoints ? points : points[..count];
+        }
+    }
+}
@@ -0,0 +1,77 @@
+﻿using System.IO.MemoryMappedFiles;
+using System.Runtime.InteropServices;
+
+namespace TusurUI.ExternalSources
+{
+    [StructLayout(LayoutKind.Sequential)]
+    public struct TelemetryRecord
+    {
+        public long TimestampMicroseconds;
+        public int Current;
+        public int Voltage;
+        public int CurrentSetpoint;
+        public int VoltageSetpoint;
+        /// Bit 0 forward, bit 1 reverse, bits 2 and 3 the forward and reverse limits. -1 for supplies created by handle.
+        public int MotorState;
+        public int Status;
+    }
+
+    /// Read-only view of a recording written by PowerSupply.StartRecording, nothing is parsed up front.
+    public sealed class TelemetryFile : IDisposable
+    {
+        public const uint k_Magic = 0x4D4C4554;
+        public const uint k_Version = 1;
+
+        private const int k_HeaderSizeOffset = 8;
+        private const int k_RecordSizeOffset = 12;
+        private const int k_RecordCountOffset = 24;
+        private const int k_ClosedOffset = 32;
+
+        private readonly MemoryMappedFile _file;
+        private readonly MemoryMappedViewAccessor _view;
+        private readonly long _headerSize;
+        private readonly int _recordSize;
+
+        private TelemetryFile(MemoryMappedFile file, MemoryMappedViewAccessor view)
+        {
+            _file = file;
+            _view = view;
+            _headerSize = view.ReadUInt32(k_HeaderSizeOffset);
+            _recordSize = (int)view.ReadUInt32(k_RecordSizeOffset);
+        }
+
+        public static TelemetryFile Open(string path)
+        {
+            // The recorder shares the file for reading, so a live recording can be opened too.
+            var stream = new FileStream(path, FileMode.Open, FileAccess.Read, FileShare.ReadWrite);
+            var file = MemoryMappedFile.CreateFromFile(stream, null, 0, MemoryMappedFileAccess.Read, HandleInheritability.None, false);
+            var view = file.CreateViewAccessor(0, 0, MemoryMappedFileAccess.Read);
+            if (view.ReadUInt32(0) != k_Magic || view.ReadUInt32(4) != k_Version || view.ReadUInt32(k_RecordSizeOffset) != Marshal.SizeOf<TelemetryRecord>())
+            {
+                view.Dispose();
+                file.Dispose();
+                throw new InvalidDataException($"{path} is not a telemetry recording.");
+            }
+            return new TelemetryFile(file, view);
+        }
+
+        /// Records available in the mapped part of the file.
+        public long Count => Math.Min((long)_view.ReadUInt64(k_RecordCountOffset), (_view.Capacity - _headerSize) / _recordSize);
+
+        /// False for a recording still being written or interrupted by a crash.
+        public bool IsClosed => _view.ReadUInt32(k_ClosedOffset) != 0;
+
+        /// Copies records starting at `first`, returns the number copied.
+        public int Read(long first, TelemetryRecord[] records)
+        {
+            long count = Math.Clamp(Count - first, 0, records.Length);
+            return _view.ReadArray(_headerSize + first * _recordSize, records, 0, (int)count);
+        }
+
+        public void Dispose()
+        {
+            _view.Dispose();
+            _file.Dispose();
+        }
+    }
+}
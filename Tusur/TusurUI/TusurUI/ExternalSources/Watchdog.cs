@@ -0,0 +1,119 @@
+﻿using System.Runtime.InteropServices;
+using TusurUI.Source;
+
+namespace TusurUI.ExternalSources
+{
+    [StructLayout(LayoutKind.Sequential)]
+    public struct WatchdogConfig
+    {
+        /// Longest time between two kicks, at least 10 ms.
+        public int KickTimeoutMs;
+        /// Period of the limit checks, at least 5 ms. Ignored when both limits are 0.
+        public int PollPeriodMs;
+        /// Raw register 20 units, 0 for no limit.
+        public int CurrentLimit;
+        /// Raw register 21 units, 0 for no limit.
+        public int VoltageLimit;
+
+        public WatchdogConfig(int kickTimeoutMs, int pollPeriodMs = 0, int currentLimit = 0, int voltageLimit = 0)
+        {
+            KickTimeoutMs = kickTimeoutMs;
+            PollPeriodMs = pollPeriodMs;
+            CurrentLimit = currentLimit;
+            VoltageLimit = voltageLimit;
+        }
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct WatchdogStatus
+    {
+        public int Armed;
+        /// One of the Watchdog.k_Trip* values.
+        public int TripReason;
+        public int ShutdownStatus;
+        public int Current;
+        public int Voltage;
+        public long Checks;
+        public long ReadFailures;
+        public long Trips;
+        /// From the trigger of the last trip until every supply acknowledged the turn-off.
+        public long LastLatencyMicroseconds;
+        public long MaxLatencyMicroseconds;
+    }
+
+    /// Turns every power supply off when the UI stops calling Kick(), a limit is exceeded or the process exits.
+    /// While armed it keeps the DLL loaded, call Shutdown() before unloading it.
+    public class Watchdog
+    {
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int Watchdog_Arm(ref WatchdogConfig config);
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern void Watchdog_Disarm();
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int Watchdog_Shutdown();
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern int Watchdog_Kick();
+
+        [DllImport("Libs/ThermoresistiveEvaporator.dll", CallingConvention = CallingConvention.Cdecl)]
+        private static extern void Watchdog_GetStatus(out WatchdogStatus status);
+
+        public const int k_TripNone = 0;
+        public const int k_TripKickTimeout = 1;
+        public const int k_TripCurrentLimit = 2;
+        public const int k_TripVoltageLimit = 3;
+        public const int k_TripProcessDetach = 4;
+        public const int k_TripShutdown = 5;
+
+        Watchdog() { }
+
+        /// Counts as a kick. Calling it while armed replaces the deadline and the limits.
+        public static int Arm(WatchdogConfig config) { return Watchdog_Arm(ref config); }
+
+        public static void Disarm() { Watchdog_Disarm(); }
+
+        /// Disarms and, if armed, turns every supply off like a trip. Returns once no watchdog thread is left.
+        public static int Shutdown() { return Watchdog_Shutdown(); }
+
+        /// Returns 161 once the watchdog has tripped, it has to be armed again.
+        public static int Kick() { return Watchdog_Kick(); }
+
+        public static WatchdogStatus GetStatus()
+        {
+            Watchdog_GetStatus(out WatchdogStatus status);
+            return status;
+        }
+
+        private static string GetErrorMessageEN(int errorCode)
+        {
+            return errorCode switch
+            {
+                160 => "Invalid watchdog configuration.",
+                161 => "The watchdog is not armed.",
+                _ => PowerSupply.GetErrorMessage(errorCode, "EN")
+            };
+        }
+
+        private static string GetErrorMessageRU(int errorCode)
+        {
+            return errorCode switch
+            {
+                160 => "Некорректная конфигурация сторожевого таймера.",
+                161 => "Сторожевой таймер не активирован.",
+                _ => PowerSupply.GetErrorMessage(errorCode, "RU")
+            };
+        }
+
+        public static string GetErrorMessage(int errorCode, string language = "RU")
+        {
+            return language switch
+            {
+                "RU" => GetErrorMessageRU(errorCode),
+                "EN" => GetErrorMessageEN(errorCode),
+                _ => "Language not supported."
+            };
+        }
+    }
+}
@@ -17,6 +17,14 @@
          */
         void Connect(string comPort);
 
+        /**
+         * @brief Connects to the power supply without blocking the calling thread.
+         * @param comPort The COM port to which the power supply is connected.
+         *
+         * The connection is opened by an I/O thread of the DLL, the task completes once it is done.
+         */
+        Task ConnectAsync(string comPort);
+
         /**
          * @brief Turns on the power supply.
          * @param comPort The COM port to which the power supply is connected.
@@ -25,6 +33,14 @@
          */
         void TurnOn(string comPort);
 
+        /**
+         * @brief Turns on the power supply without blocking the calling thread.
+         * @param comPort The COM port to which the power supply is connected.
+         *
+         * The task completes once the power supply acknowledged the command, and throws on error.
+         */
+        Task TurnOnAsync(string comPort);
+
         /**
          * @brief Resets the power supply.
          * @param comPort The COM port to which the power supply is connected.
@@ -33,6 +49,14 @@
          */
         void Reset(string comPort);
 
+        /**
+         * @brief Resets the power supply without blocking the calling thread.
+         * @param comPort The COM port to which the power supply is connected.
+         *
+         * The task completes once the power supply acknowledged the command, and throws on error.
+         */
+        Task ResetAsync(string comPort);
+
         /**
          * @brief Applies the specified voltage to the power supply.
          * @param currentValue The current value to be set.
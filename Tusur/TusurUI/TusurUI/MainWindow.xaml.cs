@@ -374,6 +374,16 @@ namespace TusurUI
             }, UncheckVaporizerButton);
         }
 
+        public async Task PowerSupplyTurnOnAsync()
+        {
+            await ExecuteWithErrorHandlingAsync(async () =>
+            {
+                string comPort = _powerSupplyComPortManager.GetComPortName();
+                await _powerSupplyManager.TurnOnAsync(comPort);
+                _currentVoltageUpdateTimerManager.Start();
+            }, UncheckVaporizerButton);
+        }
+
         public void PowerSupplyReset()
         {
             ExecuteWithErrorHandling(() =>
@@ -383,6 +393,15 @@ namespace TusurUI
             }, UncheckVaporizerButton);
         }
 
+        public async Task PowerSupplyResetAsync()
+        {
+            await ExecuteWithErrorHandlingAsync(async () =>
+            {
+                string comPort = _powerSupplyComPortManager.GetComPortName();
+                await _powerSupplyManager.ResetAsync(comPort);
+            }, UncheckVaporizerButton);
+        }
+
         public void PowerSupplyApplyCurrent(ushort current)
         {
             ExecuteWithErrorHandling(() =>
@@ -436,6 +455,20 @@ namespace TusurUI
             }
         }
 
+        private async Task ExecuteWithErrorHandlingAsync(Func<Task> action, Action? onError = null)
+        {
+            try
+            {
+                await action();
+            }
+            catch (Exception ex)
+            {
+                _scenariosWindow?.StopProgram(ex);
+                ShowError(ex.Message);
+                onError?.Invoke();
+            }
+        }
+
         /// Main functions
         private void AddScenarioButton_Click(object sender, RoutedEventArgs e)
         {
@@ -460,10 +493,11 @@ namespace TusurUI
 
             try
             {
-                PowerSupplyTurnOn();
+                // The serial I/O runs on the DLL's own threads, the Dispatcher stays free while the commands complete.
+                await PowerSupplyTurnOnAsync();
                 PowerSupplyApplyCurrent(current);
                 PowerSupplyUpdateCurrentVoltage(); // Reads specific register for the current and voltage and updating labels in UI
-                PowerSupplyReset(); // Resets specific register that needed to correctly manage power supply after rebooting
+                await PowerSupplyResetAsync(); // Resets specific register that needed to correctly manage power supply after rebooting
 
                 // Wait for the duration of the stage 
                 await Task.Delay(duration);
@@ -1,4 +1,5 @@
 ﻿using System.Windows.Controls;
+using TusurUI.ExternalSources;
 using TusurUI.Interfaces;
 
 namespace TusurUI.Source
@@ -12,8 +13,13 @@ namespace TusurUI.Source
      */
     public class PowerSupplyManager : IPowerSupplyManager
     {
+        private const int k_AcquisitionIntervalMilliseconds = 50;
+        private const int k_SampleBatchSize = 256;
+        private const int k_ErrorOffline = 52;
+
         private readonly Label _currentValueLabel;
         private readonly Label _voltageValueLabel;
+        private readonly PowerSupplySample[] _samples = new PowerSupplySample[k_SampleBatchSize];
 
         private bool _IsConnected = false;
 
@@ -26,6 +32,14 @@ namespace TusurUI.Source
         public void Connect(string comPort)
         {
             PowerSupply.Connect(comPort);
+            PowerSupply.StartAcquisition(k_AcquisitionIntervalMilliseconds);
+            _IsConnected = true;
+        }
+
+        public async Task ConnectAsync(string comPort)
+        {
+            await AsyncCommands.PowerSupplyConnectAsync(comPort);
+            PowerSupply.StartAcquisition(k_AcquisitionIntervalMilliseconds);
             _IsConnected = true;
         }
 
@@ -37,28 +51,46 @@ namespace TusurUI.Source
             ExecuteCommand(PowerSupply.TurnOn);
         }
 
+        public async Task TurnOnAsync(string comPort)
+        {
+            await ConnectAsync(comPort);
+            await ExecuteCommandAsync(AsyncCommands.PowerSupplyTurnOnAsync);
+        }
+
         public void Reset(string comPort)
         {
             Connect(comPort);
             ExecuteCommand(PowerSupply.Reset);
         }
 
+        public async Task ResetAsync(string comPort)
+        {
+            await ConnectAsync(comPort);
+            await ExecuteCommandAsync(AsyncCommands.PowerSupplyResetAsync);
+        }
+
         public void ApplyVoltage(double currentValue, ushort voltageValue)
         {
-            ExecuteCommand(() => PowerSupply.SetCurrentVoltage((ushort)currentValue, voltageValue));
+            // Posted without waiting for the device, a slider drag writes only the newest value.
+            ExecuteCommand(() => PowerSupply.PostCurrentVoltage((ushort)currentValue, voltageValue));
         }
 
         public void ReadCurrentVoltageAndChangeTextBox()
         {
-            int current = PowerSupply.ReadCurrent();
-            if (current == -1)
-                throw new Exception(PowerSupply.GetErrorMessage(current));
+            // Samples are polled by the DLL's acquisition thread, here we only take the newest one.
+            int count = 0, drained;
+            while ((drained = PowerSupply.DrainSamples(_samples)) > 0)
+                count = drained;
+            if (count == 0)
+                return;
 
-            _currentValueLabel.Content = current.ToString();
+            PowerSupplySample latest = _samples[count - 1];
+            if (latest.Status != 0)
+                throw new Exception(PowerSupply.GetErrorMessage(latest.Status));
 
-            int voltage = PowerSupply.ReadVoltage();
-            if (voltage == -2)
-                throw new Exception(PowerSupply.GetErrorMessage(voltage));
+            int current = latest.Current;
+            int voltage = latest.Voltage;
+            _currentValueLabel.Content = current.ToString();
 
             // Convert the voltage to float by dividing by 100
             float voltageFloat = voltage / 100.0f;
@@ -73,10 +105,22 @@ namespace TusurUI.Source
 
         private void ExecuteCommand(Func<int> command)
         {
-            string? err = GetErrorMessage(command());
+            CheckErrorCode(command());
+        }
+
+        private async Task ExecuteCommandAsync(Func<Task<int>> command)
+        {
+            CheckErrorCode(await command());
+        }
+
+        private void CheckErrorCode(int errorCode)
+        {
+            string? err = GetErrorMessage(errorCode);
             if (err != null)
             {
-                _IsConnected = false;
+                // While offline the DLL reconnects on its own, no need to connect again from the UI.
+                if (errorCode != k_ErrorOffline)
+                    _IsConnected = false;
                 throw new Exception(err);
             }
         }
@@ -84,7 +128,7 @@ namespace TusurUI.Source
         private string? GetErrorMessage(int errorCode)
         {
             if (errorCode > 0)
-                return PowerSupply.GetErrorMessage(errorCode);
+                return AsyncCommands.GetErrorMessage(errorCode);
             return null;
         }
     }